@@ -0,0 +1,515 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ansi_parser.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define ANSI_SSE2 1
+#else
+#	define ANSI_SSE2 0
+#endif // SSE2
+
+#define ANSI_ESC 0x1b
+#define ANSI_BEL 0x07
+#define MAX_SGR_PARAMS 32
+
+namespace
+{
+	// xterm colors of SGR 30-37 and 90-97, rgba.
+	const uint32_t s_ansiColors[16] =
+	{
+		0x000000ff, 0xcd0000ff, 0x00cd00ff, 0xcdcd00ff,
+		0x0000eeff, 0xcd00cdff, 0x00cdcdff, 0xe5e5e5ff,
+		0x7f7f7fff, 0xff0000ff, 0x00ff00ff, 0xffff00ff,
+		0x5c5cffff, 0xff00ffff, 0x00ffffff, 0xffffffff,
+	};
+
+	// Return the first escape, line feed or carriage return, or _end.
+	const char* findControl(const char* _str, const char* _end)
+	{
+#if ANSI_SSE2
+		const __m128i esc = _mm_set1_epi8(ANSI_ESC);
+		const __m128i lf = _mm_set1_epi8('\n');
+		const __m128i cr = _mm_set1_epi8('\r');
+		for (; _end - _str >= 16; _str += 16)
+		{
+			const __m128i bytes = _mm_loadu_si128( (const __m128i*)_str);
+			const __m128i match = _mm_or_si128(_mm_or_si128(
+				  _mm_cmpeq_epi8(bytes, esc)
+				, _mm_cmpeq_epi8(bytes, lf) )
+				, _mm_cmpeq_epi8(bytes, cr)
+				);
+
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+			if (0 != mask)
+			{
+				while (0 == (mask & 1) )
+				{
+					mask >>= 1;
+					++_str;
+				}
+				return _str;
+			}
+		}
+#endif // ANSI_SSE2
+
+		for (; _str < _end; ++_str)
+		{
+			if (*_str == ANSI_ESC || *_str == '\n' || *_str == '\r')
+			{
+				return _str;
+			}
+		}
+
+		return _end;
+	}
+
+	uint32_t paletteColor(uint32_t _index)
+	{
+		if (_index < 16)
+		{
+			return s_ansiColors[_index];
+		}
+
+		// 6x6x6 color cube, then 24 grays.
+		if (_index < 232)
+		{
+			const uint32_t cube = _index - 16;
+			const uint32_t rr = cube / 36;
+			const uint32_t gg = (cube / 6) % 6;
+			const uint32_t bb = cube % 6;
+			return ( (0 != rr ? 55 + rr * 40 : 0) << 24)
+				 | ( (0 != gg ? 55 + gg * 40 : 0) << 16)
+				 | ( (0 != bb ? 55 + bb * 40 : 0) <<  8)
+				 | 0xff
+				 ;
+		}
+
+		const uint32_t gray = 8 + (_index - 232) * 10;
+		return (gray << 24) | (gray << 16) | (gray << 8) | 0xff;
+	}
+
+	// Parse the color following SGR 38 or 48 at _params[*_param], as
+	// "5;index" or "2;r;g;b". Return false if malformed.
+	bool parseExtendedColor(const int32_t* _params, uint32_t _numParams, uint32_t* _param, int32_t* _color)
+	{
+		uint32_t ii = *_param;
+		if (ii + 1 < _numParams
+		&&  5 == _params[ii]
+		&&  _params[ii + 1] >= 0
+		&&  _params[ii + 1] < 256)
+		{
+			*_color = _params[ii + 1];
+			*_param = ii + 2;
+			return true;
+		}
+
+		if (ii + 3 < _numParams
+		&&  2 == _params[ii])
+		{
+			int32_t rgb = 0;
+			for (uint32_t jj = 1; jj <= 3; ++jj)
+			{
+				int32_t channel = _params[ii + jj];
+				channel = channel < 0 ? 0 : (channel > 255 ? 255 : channel);
+				rgb = (rgb << 8) | channel;
+			}
+			*_color = 256 + rgb;
+			*_param = ii + 4;
+			return true;
+		}
+
+		return false;
+	}
+
+} // namespace
+
+AnsiParser::AnsiParser()
+	: m_defaultTextColor(0xe5e5e5ff)
+	, m_defaultBackgroundColor(0x000000ff)
+{
+	clear();
+}
+
+void AnsiParser::setDefaultColors(uint32_t _textRgba, uint32_t _backgroundRgba)
+{
+	m_defaultTextColor = _textRgba;
+	m_defaultBackgroundColor = _backgroundRgba;
+	updateRun();
+}
+
+void AnsiParser::clear()
+{
+	m_text.clear();
+	m_runs.clear();
+	m_lineRuns.assign(1, 0);
+	m_pending.clear();
+	m_lineIndex.reset(NULL, 0);
+
+	m_attributes.foreground = -1;
+	m_attributes.background = -1;
+	m_attributes.styleFlags = STYLE_NORMAL;
+	m_attributes.bold = false;
+	m_attributes.inverse = false;
+	updateRun();
+}
+
+uint32_t AnsiParser::append(const char* _data, uint32_t _size)
+{
+	const char* str = _data;
+	const char* end = _data + _size;
+
+	// Complete the escape sequence split by the previous call, a byte at a
+	// time. A malformed sequence ends before the byte breaking it, the bytes
+	// left over may come from previous calls and are parsed again from a
+	// copy of them.
+	while (!m_pending.empty() && str < end)
+	{
+		m_pending.push_back(*str++);
+		uint32_t length = parseEscape(m_pending.data(), m_pending.data() + m_pending.size() );
+		if (0 == length
+		&&  m_pending.size() >= MAX_ANSI_ESCAPE_LENGTH)
+		{
+			// Unterminated, drop the escape byte alone.
+			length = 1;
+		}
+
+		if (0 != length)
+		{
+			std::string rest(m_pending, length);
+			m_pending.clear();
+			parseText(rest.data(), rest.data() + rest.size() );
+		}
+	}
+
+	parseText(str, end);
+
+	const char* text = m_text.empty() ? NULL : &m_text[0];
+	return m_lineIndex.append(text, (uint32_t)m_text.size() );
+}
+
+const StyleRun* AnsiParser::getLineRuns(uint32_t _line, uint32_t* _numRuns) const
+{
+	BX_CHECK(_line < m_lineRuns.size(), "Invalid line");
+	uint32_t first = m_lineRuns[_line];
+	uint32_t last = _line + 1 < m_lineRuns.size() ? m_lineRuns[_line + 1] : (uint32_t)m_runs.size();
+	*_numRuns = last - first;
+	return first < m_runs.size() ? &m_runs[first] : NULL;
+}
+
+void AnsiParser::getRuns(uint32_t _firstLine, uint32_t _numLines, std::vector<StyleRun>* _runs) const
+{
+	_runs->clear();
+
+	const uint32_t lineCount = (uint32_t)m_lineRuns.size();
+	if (_firstLine >= lineCount)
+	{
+		return;
+	}
+
+	_numLines = _numLines < lineCount - _firstLine ? _numLines : lineCount - _firstLine;
+	for (uint32_t ii = 0; ii < _numLines; ++ii)
+	{
+		uint32_t numRuns;
+		const StyleRun* runs = getLineRuns(_firstLine + ii, &numRuns);
+		_runs->insert(_runs->end(), runs, runs + numRuns);
+
+		// The line feed takes the attributes of the end of the line.
+		if (ii + 1 < _numLines)
+		{
+			if (_runs->empty() )
+			{
+				StyleRun run = m_run;
+				run.length = 0;
+				_runs->push_back(run);
+			}
+			_runs->back().length += 1;
+		}
+	}
+}
+
+void AnsiParser::parseText(const char* _str, const char* _end)
+{
+	const char* str = _str;
+	while (str < _end)
+	{
+		const char* control = findControl(str, _end);
+		appendVisible(str, control);
+		if (control == _end)
+		{
+			break;
+		}
+
+		str = control + 1;
+		if (*control == '\n')
+		{
+			appendLineFeed();
+		}
+		else if (*control == ANSI_ESC)
+		{
+			uint32_t length = parseEscape(control, _end);
+			if (0 == length)
+			{
+				if (_end - control < MAX_ANSI_ESCAPE_LENGTH)
+				{
+					m_pending.assign(control, _end);
+					break;
+				}
+
+				// Unterminated, drop the escape byte alone.
+				length = 1;
+			}
+
+			str = control + length;
+		}
+	}
+}
+
+uint32_t AnsiParser::parseEscape(const char* _str, const char* _end)
+{
+	BX_CHECK(*_str == ANSI_ESC, "Not an escape sequence");
+	if (_end - _str < 2)
+	{
+		return 0;
+	}
+
+	const char* str = _str + 2;
+	switch (_str[1])
+	{
+	case '[':
+		// CSI: parameter bytes, intermediate bytes, final byte.
+		for (; str < _end; ++str)
+		{
+			const uint8_t ch = (uint8_t)*str;
+			if (ch >= 0x40 && ch <= 0x7e)
+			{
+				if (ch == 'm')
+				{
+					applySgr(_str + 2, str);
+				}
+				return (uint32_t)(str + 1 - _str);
+			}
+
+			if (ch < 0x20 || ch > 0x3f)
+			{
+				// Malformed, drop what was parsed.
+				return (uint32_t)(str - _str);
+			}
+		}
+		return 0;
+
+	case ']':
+	case 'P':
+	case 'X':
+	case '^':
+	case '_':
+		// OSC and other strings, ended by BEL or ST. A line feed ends them
+		// too, instead of swallowing the following lines.
+		for (; str < _end; ++str)
+		{
+			if (*str == ANSI_BEL)
+			{
+				return (uint32_t)(str + 1 - _str);
+			}
+
+			if (*str == '\n')
+			{
+				return (uint32_t)(str - _str);
+			}
+
+			if (*str == ANSI_ESC)
+			{
+				if (str + 1 == _end)
+				{
+					return 0;
+				}
+				return (uint32_t)(str + ('\\' == str[1] ? 2 : 0) - _str);
+			}
+		}
+		return 0;
+
+	default:
+		// Intermediate bytes, then a final byte, as in charset designations.
+		for (str = _str + 1; str < _end; ++str)
+		{
+			const uint8_t ch = (uint8_t)*str;
+			if (ch < 0x20 || ch > 0x2f)
+			{
+				return (uint32_t)(str + (ch >= 0x30 && ch <= 0x7e ? 1 : 0) - _str);
+			}
+		}
+		return 0;
+	}
+}
+
+void AnsiParser::applySgr(const char* _str, const char* _end)
+{
+	int32_t params[MAX_SGR_PARAMS];
+	uint32_t numParams = 0;
+
+	// Missing parameters are 0, sub-parameters are read as parameters.
+	int32_t value = -1;
+	for (const char* str = _str; str <= _end; ++str)
+	{
+		if (str == _end || *str == ';' || *str == ':')
+		{
+			if (numParams < MAX_SGR_PARAMS)
+			{
+				params[numParams++] = value < 0 ? 0 : value;
+			}
+			value = -1;
+		}
+		else if (*str >= '0' && *str <= '9')
+		{
+			value = (value < 0 ? 0 : value) * 10 + (*str - '0');
+			value = value < 0xffff ? value : 0xffff;
+		}
+		else
+		{
+			// Private sequence, not SGR.
+			return;
+		}
+	}
+
+	Attributes& attr = m_attributes;
+	for (uint32_t ii = 0; ii < numParams;)
+	{
+		const int32_t param = params[ii++];
+		switch (param)
+		{
+		case 0:
+			attr.foreground = -1;
+			attr.background = -1;
+			attr.styleFlags = STYLE_NORMAL;
+			attr.bold = false;
+			attr.inverse = false;
+			break;
+
+		case 1:  attr.bold = true;                               break;
+		case 22: attr.bold = false;                              break;
+		case 4:
+		case 21: attr.styleFlags |= STYLE_UNDERLINE;             break;
+		case 24: attr.styleFlags &= ~STYLE_UNDERLINE;            break;
+		case 7:  attr.inverse = true;                            break;
+		case 27: attr.inverse = false;                           break;
+		case 9:  attr.styleFlags |= STYLE_STRIKE_THROUGH;        break;
+		case 29: attr.styleFlags &= ~STYLE_STRIKE_THROUGH;       break;
+		case 53: attr.styleFlags |= STYLE_OVERLINE;              break;
+		case 55: attr.styleFlags &= ~STYLE_OVERLINE;             break;
+		case 39: attr.foreground = -1;                           break;
+		case 49: attr.background = -1;                           break;
+
+		case 38:
+			if (!parseExtendedColor(params, numParams, &ii, &attr.foreground) )
+			{
+				ii = numParams;
+			}
+			break;
+
+		case 48:
+			if (!parseExtendedColor(params, numParams, &ii, &attr.background) )
+			{
+				ii = numParams;
+			}
+			break;
+
+		default:
+			if (param >= 30 && param <= 37)
+			{
+				attr.foreground = param - 30;
+			}
+			else if (param >= 90 && param <= 97)
+			{
+				attr.foreground = param - 90 + 8;
+			}
+			else if (param >= 40 && param <= 47)
+			{
+				attr.background = param - 40;
+			}
+			else if (param >= 100 && param <= 107)
+			{
+				attr.background = param - 100 + 8;
+			}
+			break;
+		}
+	}
+
+	updateRun();
+}
+
+void AnsiParser::updateRun()
+{
+	const Attributes& attr = m_attributes;
+	const int32_t foreground = attr.inverse ? attr.background : attr.foreground;
+	const int32_t background = attr.inverse ? attr.foreground : attr.background;
+
+	m_run.length = 0;
+	m_run.textColor = attr.inverse
+		? resolveColor(foreground, false)
+		: resolveColor(foreground, true)
+		;
+	m_run.backgroundColor = attr.inverse
+		? resolveColor(background, true)
+		: resolveColor(background, false)
+		;
+	m_run.styleFlags = attr.styleFlags;
+	if (attr.inverse || background >= 0)
+	{
+		m_run.styleFlags |= STYLE_BACKGROUND;
+	}
+}
+
+uint32_t AnsiParser::resolveColor(int32_t _color, bool _foreground) const
+{
+	if (_color < 0)
+	{
+		return _foreground ? m_defaultTextColor : m_defaultBackgroundColor;
+	}
+
+	if (_color < 256)
+	{
+		// Bold brightens the first 8 colors of the text, as in terminals.
+		uint32_t index = _foreground && m_attributes.bold && _color < 8 ? _color + 8 : _color;
+		return paletteColor(index);
+	}
+
+	return ( (uint32_t)(_color - 256) << 8) | 0xff;
+}
+
+void AnsiParser::appendVisible(const char* _begin, const char* _end)
+{
+	if (_begin == _end)
+	{
+		return;
+	}
+
+	const uint32_t length = (uint32_t)(_end - _begin);
+	m_text.insert(m_text.end(), _begin, _end);
+
+	// Runs don't span lines.
+	if (m_runs.size() > m_lineRuns.back() )
+	{
+		StyleRun& last = m_runs.back();
+		if (last.textColor == m_run.textColor
+		&&  last.backgroundColor == m_run.backgroundColor
+		&&  last.styleFlags == m_run.styleFlags)
+		{
+			last.length += length;
+			return;
+		}
+	}
+
+	StyleRun run = m_run;
+	run.length = length;
+	m_runs.push_back(run);
+}
+
+void AnsiParser::appendLineFeed()
+{
+	m_text.push_back('\n');
+	m_lineRuns.push_back( (uint32_t)m_runs.size() );
+}
@@ -0,0 +1,86 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef ANSI_PARSER_H_HEADER_GUARD
+#define ANSI_PARSER_H_HEADER_GUARD
+
+#include <string>
+#include <vector>
+
+#include "line_index.h"
+#include "text_buffer_manager.h"
+
+/// Escape sequences split by append() are kept until they complete, up to
+/// this length.
+#define MAX_ANSI_ESCAPE_LENGTH 256
+
+/// Text with ANSI escape sequences, as written to a terminal by compilers
+/// and debuggers. Escape sequences are stripped from the text while it is
+/// appended, SGR sequences becoming the style runs of each line, so that
+/// laying the lines out again never parses them again. Carriage returns
+/// are dropped, other sequences are ignored.
+class AnsiParser
+{
+public:
+	AnsiParser();
+
+	/// Colors of SGR 39 and 49, rgba.
+	void setDefaultColors(uint32_t _textRgba, uint32_t _backgroundRgba);
+
+	/// Append raw bytes, which may end in the middle of a line or of an
+	/// escape sequence. The style set by SGR sequences carries on to the
+	/// following lines.
+	/// @return first line modified, the previous last line may continue
+	uint32_t append(const char* _data, uint32_t _size);
+
+	/// Drop the text and reset the style.
+	void clear();
+
+	/// Lines of the text without its escape sequences.
+	const LineIndex& getLineIndex() const
+	{
+		return m_lineIndex;
+	}
+
+	/// Runs of a line, without its line feed.
+	const StyleRun* getLineRuns(uint32_t _line, uint32_t* _numRuns) const;
+
+	/// Runs of lines [_firstLine, _firstLine + _numLines), line feeds
+	/// included, for TextBufferManager::appendRuns() with the text starting
+	/// at the beginning of _firstLine.
+	void getRuns(uint32_t _firstLine, uint32_t _numLines, std::vector<StyleRun>* _runs) const;
+
+private:
+	/// SGR state, colors are -1 for the default, a palette index up to 255
+	/// or 256 + 0xRRGGBB.
+	struct Attributes
+	{
+		int32_t foreground;
+		int32_t background;
+		uint32_t styleFlags;
+		bool bold;
+		bool inverse;
+	};
+
+	void parseText(const char* _str, const char* _end);
+	uint32_t parseEscape(const char* _str, const char* _end);
+	void applySgr(const char* _str, const char* _end);
+	void updateRun();
+	void appendVisible(const char* _begin, const char* _end);
+	void appendLineFeed();
+	uint32_t resolveColor(int32_t _color, bool _foreground) const;
+
+	LineIndex m_lineIndex;
+	std::vector<char> m_text;       //< text without escape sequences
+	std::vector<StyleRun> m_runs;   //< runs of every line
+	std::vector<uint32_t> m_lineRuns; //< first run of each line
+	std::string m_pending;          //< escape sequence split by append()
+
+	Attributes m_attributes;
+	StyleRun m_run; //< attributes of the next visible bytes, resolved
+	uint32_t m_defaultTextColor;
+	uint32_t m_defaultBackgroundColor;
+};
+
+#endif // ANSI_PARSER_H_HEADER_GUARD
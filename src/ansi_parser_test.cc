@@ -0,0 +1,138 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Checks the text and runs AnsiParser gives for a few inputs, and that they
+// are the same whether the input comes in one call or split in two at any
+// byte.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "ansi_parser.h"
+
+namespace {
+
+const uint32_t kText = 0xffffffff;
+const uint32_t kBackground = 0x000000ff;
+
+struct Case {
+  const char* input;
+  // Expected output, from the parse of the whole input.
+  const char* text;
+  StyleRun runs[8];
+  size_t num_runs;
+};
+
+const Case kCases[] = {
+    // SGR colors and styles.
+    {"plain \x1b[1;31mbold red\x1b[0m \x1b[38;5;208mpalette\x1b[39m\n"
+     "\x1b[48;2;1;2;3mtrue color\x1b[7m inverse\x1b[27;49m end\n",
+     "plain bold red palette\ntrue color inverse end\n",
+     {{6, kText, kBackground, STYLE_NORMAL},
+      {8, 0xff0000ff, kBackground, STYLE_NORMAL},
+      {1, kText, kBackground, STYLE_NORMAL},
+      {8, 0xff8700ff, kBackground, STYLE_NORMAL},
+      {10, kText, 0x010203ff, STYLE_BACKGROUND},
+      {8, 0x010203ff, kText, STYLE_BACKGROUND},
+      {5, kText, kBackground, STYLE_NORMAL}},
+     7},
+    // OSC terminated by ST, the ESC of ST splits it.
+    {"a\x1b]0;title\x1b\\b\x1b[4mc\x1b[24m\n",
+     "abc\n",
+     {{2, kText, kBackground, STYLE_NORMAL},
+      {2, kText, kBackground, STYLE_UNDERLINE}},
+     2},
+    // OSC terminated by BEL.
+    {"\x1b]2;title\adone\n",
+     "done\n",
+     {{5, kText, kBackground, STYLE_NORMAL}},
+     1},
+    // OSC broken by an ESC starting another sequence.
+    {"x\x1b]0;t\x1b[32mgreen\x1b[m\n",
+     "xgreen\n",
+     {{1, kText, kBackground, STYLE_NORMAL},
+      {6, 0x00cd00ff, kBackground, STYLE_NORMAL}},
+     2},
+    // Malformed CSI, the byte breaking it is parsed as text.
+    {"\x1b[12\nnext\x1b[1mline\n",
+     "\nnextline\n",
+     {{1, kText, kBackground, STYLE_NORMAL},
+      {9, kText, kBackground, STYLE_NORMAL}},
+     2},
+    // Charset selection, carriage returns and a sequence at the very end.
+    {"\x1b(Bcr\r\nlf\x1b[",
+     "cr\nlf",
+     {{3, kText, kBackground, STYLE_NORMAL},
+      {2, kText, kBackground, STYLE_NORMAL}},
+     2},
+};
+
+struct Result {
+  std::string text;
+  std::vector<StyleRun> runs;
+};
+
+Result Parse(const std::string& input, size_t split) {
+  AnsiParser parser;
+  parser.setDefaultColors(kText, kBackground);
+  // Separate allocations, so that reading past either one is caught by
+  // address sanitizers.
+  std::vector<char> first(input.begin(), input.begin() + split);
+  std::vector<char> second(input.begin() + split, input.end());
+  if (!first.empty())
+    parser.append(&first[0], (uint32_t)first.size());
+  if (!second.empty())
+    parser.append(&second[0], (uint32_t)second.size());
+
+  Result result;
+  const LineIndex& line_index = parser.getLineIndex();
+  result.text.assign(line_index.getText(),
+                     line_index.getText() + line_index.getSize());
+  parser.getRuns(0, line_index.getLineCount(), &result.runs);
+  return result;
+}
+
+bool SameRuns(const std::vector<StyleRun>& a, const std::vector<StyleRun>& b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].length != b[i].length || a[i].textColor != b[i].textColor ||
+        a[i].backgroundColor != b[i].backgroundColor ||
+        a[i].styleFlags != b[i].styleFlags) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main() {
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(kCases) / sizeof(kCases[0]); ++i) {
+    const Case& c = kCases[i];
+    const std::string input = c.input;
+    const Result whole = Parse(input, input.size());
+    if (whole.text != c.text ||
+        !SameRuns(whole.runs,
+                  std::vector<StyleRun>(c.runs, c.runs + c.num_runs))) {
+      fprintf(stderr, "input %d: unexpected output\n", (int)i);
+      ++failures;
+    }
+    for (size_t split = 0; split < input.size(); ++split) {
+      const Result result = Parse(input, split);
+      if (result.text != whole.text || !SameRuns(result.runs, whole.runs)) {
+        fprintf(stderr, "input %d split at %d: output differs\n", (int)i,
+                (int)split);
+        ++failures;
+      }
+    }
+  }
+
+  printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
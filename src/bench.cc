@@ -0,0 +1,180 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Offline benchmarks of the text rendering building blocks, run from the
+// repository root: bench [font.ttf]
+
+#include <bx/bx.h>
+#include <bx/timer.h>
+#include <freetype/freetype.h>
+
+#include <stdio.h>
+#include <vector>
+
+#include "rect_packer.h"
+
+namespace {
+
+const uint32_t kLayerSize = 512;
+const uint32_t kIterations = 20;
+
+// Padding added around glyph bitmaps by the distance field baking, and the
+// one pixel the atlas keeps between regions.
+const uint32_t kDistanceFieldPadding = 6;
+const uint32_t kAtlasPadding = 1;
+
+struct GlyphSize {
+  uint16_t width;
+  uint16_t height;
+};
+
+typedef std::vector<GlyphSize> GlyphSizes;
+
+// Appends the atlas footprint of the glyphs of |code_points| rendered at
+// |pixel_height|, in order.
+void AppendGlyphSizes(FT_Face face,
+                      uint32_t pixel_height,
+                      const std::vector<FT_ULong>& code_points,
+                      GlyphSizes* sizes) {
+  FT_Set_Pixel_Sizes(face, 0, pixel_height);
+  for (size_t i = 0; i < code_points.size(); ++i) {
+    if (FT_Load_Char(face, code_points[i], FT_LOAD_RENDER) != 0)
+      continue;
+    const FT_Bitmap& bitmap = face->glyph->bitmap;
+    if (bitmap.width == 0 || bitmap.rows == 0)
+      continue;
+    GlyphSize size;
+    size.width = static_cast<uint16_t>(
+        bitmap.width + kDistanceFieldPadding * 2 + kAtlasPadding);
+    size.height = static_cast<uint16_t>(
+        bitmap.rows + kDistanceFieldPadding * 2 + kAtlasPadding);
+    sizes->push_back(size);
+  }
+}
+
+// Deterministic shuffle, so runs stay comparable.
+void Shuffle(GlyphSizes* sizes) {
+  uint32_t seed = 0x9e3779b9;
+  for (size_t i = sizes->size(); i > 1; --i) {
+    seed = seed * 1664525 + 1013904223;
+    size_t j = seed % i;
+    GlyphSize tmp = (*sizes)[i - 1];
+    (*sizes)[i - 1] = (*sizes)[j];
+    (*sizes)[j] = tmp;
+  }
+}
+
+struct PackResult {
+  double inserts_per_second;
+  uint32_t layers;
+  // Of the full layers.
+  float occupancy;
+};
+
+// Inserts |sizes| in layers of kLayerSize, opening a new layer when the
+// current one is full, like the atlas does once its older layers are full.
+PackResult Pack(PackerType::Enum type, const GlyphSizes& sizes) {
+  PackResult result = {0.0, 0, 0.0f};
+  int64_t elapsed = 0;
+  for (uint32_t iteration = 0; iteration < kIterations; ++iteration) {
+    std::vector<RectanglePacker*> layers;
+    layers.push_back(createRectanglePacker(type));
+    layers.back()->init(kLayerSize, kLayerSize);
+
+    int64_t start = bx::getHPCounter();
+    for (size_t i = 0; i < sizes.size(); ++i) {
+      uint16_t x, y;
+      if (layers.back()->addRectangle(sizes[i].width, sizes[i].height, x, y))
+        continue;
+      layers.push_back(createRectanglePacker(type));
+      layers.back()->init(kLayerSize, kLayerSize);
+      layers.back()->addRectangle(sizes[i].width, sizes[i].height, x, y);
+    }
+    elapsed += bx::getHPCounter() - start;
+
+    // The last layer is still being filled, only count it when it is the
+    // only one.
+    uint64_t used = 0;
+    uint64_t total = 0;
+    size_t full_layers = layers.size() > 1 ? layers.size() - 1 : 1;
+    for (size_t i = 0; i < layers.size(); ++i) {
+      if (i < full_layers) {
+        used += layers[i]->getUsedSurface();
+        total += layers[i]->getTotalSurface();
+      }
+      delete layers[i];
+    }
+    result.layers = static_cast<uint32_t>(layers.size());
+    result.occupancy = static_cast<float>(used) / static_cast<float>(total);
+  }
+
+  double seconds = static_cast<double>(elapsed) /
+                   static_cast<double>(bx::getHPFrequency());
+  result.inserts_per_second =
+      seconds > 0.0 ? (sizes.size() * kIterations) / seconds : 0.0;
+  return result;
+}
+
+void BenchPackers(const char* name, const GlyphSizes& sizes) {
+  printf("%s: %d glyphs\n", name, static_cast<int>(sizes.size()));
+  for (int type = 0; type < PackerType::Count; ++type) {
+    RectanglePacker* packer =
+        createRectanglePacker(static_cast<PackerType::Enum>(type));
+    const char* packer_name = packer->getName();
+    delete packer;
+
+    PackResult result =
+        Pack(static_cast<PackerType::Enum>(type), sizes);
+    printf("  %-16s %12.0f inserts/s %3d layers %6.2f%% occupancy\n",
+           packer_name,
+           result.inserts_per_second,
+           result.layers,
+           result.occupancy * 100.0f);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* font_path = argc > 1 ? argv[1] : "art/VeraMono.ttf";
+
+  FT_Library library;
+  FT_Face face;
+  if (FT_Init_FreeType(&library) != 0 ||
+      FT_New_Face(library, font_path, 0, &face) != 0) {
+    fprintf(stderr, "Unable to load %s\n", font_path);
+    return 1;
+  }
+
+  std::vector<FT_ULong> ascii;
+  for (FT_ULong c = 32; c < 127; ++c)
+    ascii.push_back(c);
+
+  std::vector<FT_ULong> all;
+  FT_UInt glyph_index;
+  for (FT_ULong c = FT_Get_First_Char(face, &glyph_index); glyph_index != 0;
+       c = FT_Get_Next_Char(face, c, &glyph_index)) {
+    all.push_back(c);
+  }
+
+  // Code reading at a few zoom levels, the font is baked again per size.
+  const uint32_t kPixelHeights[] = {12, 16, 22, 32, 48};
+  GlyphSizes ascii_sizes;
+  GlyphSizes all_sizes;
+  for (size_t i = 0; i < BX_COUNTOF(kPixelHeights); ++i) {
+    AppendGlyphSizes(face, kPixelHeights[i], ascii, &ascii_sizes);
+    AppendGlyphSizes(face, kPixelHeights[i], all, &all_sizes);
+  }
+
+  GlyphSizes shuffled_sizes = all_sizes;
+  Shuffle(&shuffled_sizes);
+
+  BenchPackers("ascii, by size", ascii_sizes);
+  BenchPackers("whole font, by size", all_sizes);
+  BenchPackers("whole font, shuffled", shuffled_sizes);
+
+  FT_Done_Face(face);
+  FT_Done_FreeType(library);
+  return 0;
+}
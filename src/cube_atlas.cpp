@@ -6,260 +6,111 @@
 #include "common.h"
 #include <bgfx.h>
 
-#include <limits.h> // INT_MAX
 #include <memory.h> // memset
+#include <algorithm> // std::sort
 #include <vector>
 
 #include "cube_atlas.h"
+#include "rect_packer.h"
 
-class RectanglePacker
+struct Atlas::PackedLayer
 {
-public:
-	RectanglePacker();
-	RectanglePacker(uint32_t _width, uint32_t _height);
-
-	/// non constructor initialization
-	void init(uint32_t _width, uint32_t _height);
-
-	/// find a suitable position for the given rectangle
-	/// @return true if the rectangle can be added, false otherwise
-	bool addRectangle(uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY);
-
-	/// return the used surface in squared unit
-	uint32_t getUsedSurface()
-	{
-		return m_usedSpace;
-	}
-
-	/// return the total available surface in squared unit
-	uint32_t getTotalSurface()
+	PackedLayer()
+		: packer(NULL)
+		, failedWidth(UINT16_MAX)
+		, failedHeight(UINT16_MAX)
+		, compacting(false)
 	{
-		return m_width * m_height;
-	}
-
-	/// return the usage ratio of the available surface [0:1]
-	float getUsageRatio();
-
-	/// reset to initial state
-	void clear();
-
-private:
-	int32_t fit(uint32_t _skylineNodeIndex, uint16_t _width, uint16_t _height);
-
-	/// Merges all skyline nodes that are at the same level.
-	void merge();
-
-	struct Node
-	{
-		Node(int16_t _x, int16_t _y, int16_t _width) : x(_x), y(_y), width(_width)
-		{
-		}
-
-		int16_t x;     //< The starting x-coordinate (leftmost).
-		int16_t y;     //< The y-coordinate of the skyline level line.
-		int32_t width; //< The line _width. The ending coordinate (inclusive) will be x+width-1.
-	};
-
-	
-	uint32_t m_width;            //< width (in pixels) of the underlying texture	
-	uint32_t m_height;           //< height (in pixels) of the underlying texture
-	uint32_t m_usedSpace;        //< Surface used in squared pixel
-	std::vector<Node> m_skyline; //< node of the skyline algorithm
-};
-
-RectanglePacker::RectanglePacker()
-	: m_width(0)
-	, m_height(0)
-	, m_usedSpace(0)
-{
-}
-
-RectanglePacker::RectanglePacker(uint32_t _width, uint32_t _height)
-	: m_width(_width)
-	, m_height(_height)
-	, m_usedSpace(0)
-{
-	// We want a one pixel border around the whole atlas to avoid any artefact when
-	// sampling texture
-	m_skyline.push_back(Node(1, 1, _width - 2) );
-}
-
-void RectanglePacker::init(uint32_t _width, uint32_t _height)
-{
-	BX_CHECK(_width > 2, "_width must be > 2");
-	BX_CHECK(_height > 2, "_height must be > 2");
-	m_width = _width;
-	m_height = _height;
-	m_usedSpace = 0;
-
-	m_skyline.clear();
-	// We want a one pixel border around the whole atlas to avoid any artifact when
-	// sampling texture
-	m_skyline.push_back(Node(1, 1, _width - 2) );
-}
-
-bool RectanglePacker::addRectangle(uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY)
-{
-	int yy, best_height, best_index;
-	int32_t best_width;
-	Node* node;
-	Node* prev;
-	_outX = 0;
-	_outY = 0;
-
-	uint32_t ii;
-
-	best_height = INT_MAX;
-	best_index = -1;
-	best_width = INT_MAX;
-	for (ii = 0; ii < m_skyline.size(); ++ii)
-	{
-		yy = fit(ii, _width, _height);
-		if (yy >= 0)
-		{
-			node = &m_skyline[ii];
-			if ( ( (yy + _height) < best_height)
-				|| ( ( (yy + _height) == best_height)
-				&& (node->width < best_width) ) )
-			{
-				best_height = yy + _height;
-				best_index = ii;
-				best_width = node->width;
-				_outX = node->x;
-				_outY = yy;
-			}
-		}
 	}
 
-	if (best_index == -1)
+	~PackedLayer()
 	{
-		return false;
+		delete packer;
 	}
 
-	Node newNode(_outX, _outY + _height, _width);
-	m_skyline.insert(m_skyline.begin() + best_index, newNode);
-
-	for (ii = best_index + 1; ii < m_skyline.size(); ++ii)
+	/// forget the smallest failed size, after space was given back
+	void resetFailed()
 	{
-		node = &m_skyline[ii];
-		prev = &m_skyline[ii - 1];
-		if (node->x < (prev->x + prev->width) )
-		{
-			int shrink = prev->x + prev->width - node->x;
-			node->x += shrink;
-			node->width -= shrink;
-			if (node->width <= 0)
-			{
-				m_skyline.erase(m_skyline.begin() + ii);
-				--ii;
-			}
-			else
-			{
-				break;
-			}
-		}
-		else
-		{
-			break;
-		}
+		failedWidth = UINT16_MAX;
+		failedHeight = UINT16_MAX;
 	}
 
-	merge();
-	m_usedSpace += _width * _height;
-	return true;
-}
-
-float RectanglePacker::getUsageRatio()
-{
-	uint32_t total = m_width * m_height;
-	if (total > 0)
-	{
-		return (float)m_usedSpace / (float)total;
-	}
-
-	return 0.0f;
-}
+	RectanglePacker* packer;
+	/// smallest rectangle that didn't fit, larger ones are not tried
+	uint16_t failedWidth;
+	uint16_t failedHeight;
+	AtlasRegion faceRegion;
+	bool compacting; //< regions are being moved out, don't add any
+};
 
-void RectanglePacker::clear()
+struct Atlas::Compaction
 {
-	m_skyline.clear();
-	m_usedSpace = 0;
-
-	// We want a one pixel border around the whole atlas to avoid any artefact when
-	// sampling texture
-	m_skyline.push_back(Node(1, 1, m_width - 2) );
-}
+	/// live regions to move, grouped by source layer
+	std::vector<uint16_t> regions;
+	/// source layer of each region
+	std::vector<uint32_t> regionLayers;
+	uint32_t next;
+
+	uint32_t destinationLayer;
+	/// layers emptied during the last step, reset on the next one
+	std::vector<uint32_t> emptiedLayers;
+	/// reset layers ready to receive regions
+	std::vector<uint32_t> freeLayers;
+
+	uint32_t regionsPerStep;
+};
 
-int32_t RectanglePacker::fit(uint32_t _skylineNodeIndex, uint16_t _width, uint16_t _height)
+/// Sort regions by source layer, then by decreasing height so that the
+/// destination skyline stays flat.
+struct CompactionOrder
 {
-	int32_t width = _width;
-	int32_t height = _height;
-
-	const Node& baseNode = m_skyline[_skylineNodeIndex];
-
-	int32_t xx = baseNode.x, yy;
-	int32_t widthLeft = width;
-	int32_t ii = _skylineNodeIndex;
-
-	if ( (xx + width) > (int32_t)(m_width - 1) )
+	CompactionOrder(const AtlasRegion* _regions, const uint32_t* _layers)
+		: regions(_regions)
+		, layers(_layers)
 	{
-		return -1;
 	}
 
-	yy = baseNode.y;
-	while (widthLeft > 0)
+	bool operator()(uint16_t _a, uint16_t _b) const
 	{
-		const Node& node = m_skyline[ii];
-		if (node.y > yy)
-		{
-			yy = node.y;
-		}
-
-		if ( (yy + height) > (int32_t)(m_height - 1) )
+		if (layers[_a] != layers[_b])
 		{
-			return -1;
+			return layers[_a] < layers[_b];
 		}
 
-		widthLeft -= node.width;
-		++ii;
+		return regions[_a].height > regions[_b].height;
 	}
 
-	return yy;
-}
-
-void RectanglePacker::merge()
-{
-	Node* node;
-	Node* next;
-	uint32_t ii;
-
-	for (ii = 0; ii < m_skyline.size() - 1; ++ii)
-	{
-		node = (Node*) &m_skyline[ii];
-		next = (Node*) &m_skyline[ii + 1];
-		if (node->y == next->y)
-		{
-			node->width += next->width;
-			m_skyline.erase(m_skyline.begin() + ii + 1);
-			--ii;
-		}
-	}
-}
-
-struct Atlas::PackedLayer
-{
-	RectanglePacker packer;
-	AtlasRegion faceRegion;
+	const AtlasRegion* regions;
+	const uint32_t* layers;
 };
 
-Atlas::Atlas(uint16_t _textureSize, uint16_t _maxRegionsCount)
-	: m_usedLayers(0)
+Atlas::Atlas(uint16_t _textureSize, uint16_t _maxRegionsCount, AtlasFormat::Enum _format, uint16_t _maxTextureSize, PackerType::Enum _packerType)
+	: m_format(_format)
+	, m_usedLayers(0)
 	, m_usedFaces(0)
 	, m_textureSize(_textureSize)
+	, m_maxTextureSize(_maxTextureSize > _textureSize ? _maxTextureSize : _textureSize)
 	, m_regionCount(0)
 	, m_maxRegionCount(_maxRegionsCount)
+	, m_freeRegionCount(0)
+	, m_frameIndex(0)
+	, m_generation(0)
+	, m_removalGeneration(0)
+	, m_compaction(NULL)
+	, m_dirtyRects(new std::vector<AtlasRect>[ATLAS_MAX_PAGES])
+	, m_textureBuffer(NULL)
+	, m_pageCapacity(1)
+	, m_texelBytes(AtlasFormat::Pages == _format ? 1 : 4)
+	, m_uploadedBytes(0)
+	, m_failedInserts(0)
 {
+	memset(&m_uploadStats, 0, sizeof(m_uploadStats) );
+	memset(&m_lastUploadStats, 0, sizeof(m_lastUploadStats) );
+	memset(&m_stats, 0, sizeof(m_stats) );
+	memset(m_pages, 0, sizeof(m_pages) );
+
 	BX_CHECK(_textureSize >= 64 && _textureSize <= 4096, "Invalid _textureSize %d.", _textureSize);
+	BX_CHECK(_maxTextureSize <= 4096, "Invalid _maxTextureSize %d.", _maxTextureSize);
 	BX_CHECK(_maxRegionsCount >= 64 && _maxRegionsCount <= 32000, "Invalid _maxRegionsCount %d.", _maxRegionsCount);
 
 	init();
@@ -267,36 +118,82 @@ Atlas::Atlas(uint16_t _textureSize, uint16_t _maxRegionsCount)
 	m_layers = new PackedLayer[24];
 	for (int ii = 0; ii < 24; ++ii)
 	{
-		m_layers[ii].packer.init(_textureSize, _textureSize);
+		m_layers[ii].packer = createRectanglePacker(_packerType);
+		m_layers[ii].packer->init(_textureSize, _textureSize);
 	}
 
 	m_regions = new AtlasRegion[_maxRegionsCount];
-	m_textureBuffer = new uint8_t[ _textureSize * _textureSize * 6 * 4 ];
-	memset(m_textureBuffer, 0, _textureSize * _textureSize * 6 * 4);
+	m_regionLastUse = new uint32_t[_maxRegionsCount];
+	m_regionOutline = new uint8_t[_maxRegionsCount];
+	m_freeRegions = new uint16_t[_maxRegionsCount];
+	createUVTable();
 
-	m_textureHandle = bgfx::createTextureCube(_textureSize
-		, 1
-		, bgfx::TextureFormat::BGRA8
-		);
+	if (AtlasFormat::Pages == m_format)
+	{
+		// Pages are allocated along with the faces that use them.
+		m_textureHandle = bgfx::createTexture2D(_textureSize
+			, _textureSize * m_pageCapacity
+			, 1
+			, bgfx::TextureFormat::R8
+			);
+	}
+	else
+	{
+		m_textureBuffer = new uint8_t[ _textureSize * _textureSize * 6 * 4 ];
+		memset(m_textureBuffer, 0, _textureSize * _textureSize * 6 * 4);
+
+		m_textureHandle = bgfx::createTextureCube(_textureSize
+			, 1
+			, bgfx::TextureFormat::BGRA8
+			);
+	}
 }
 
 Atlas::Atlas(uint16_t _textureSize, const uint8_t* _textureBuffer, uint16_t _regionCount, const uint8_t* _regionBuffer, uint16_t _maxRegionsCount)
-	: m_usedLayers(24)
+	: m_format(AtlasFormat::Cube)
+	, m_usedLayers(24)
 	, m_usedFaces(6)
 	, m_textureSize(_textureSize)
+	, m_maxTextureSize(_textureSize)
 	, m_regionCount(_regionCount)
 	, m_maxRegionCount(_regionCount < _maxRegionsCount ? _regionCount : _maxRegionsCount)
+	, m_freeRegionCount(0)
+	, m_frameIndex(0)
+	, m_generation(0)
+	, m_removalGeneration(0)
+	, m_compaction(NULL)
+	, m_dirtyRects(new std::vector<AtlasRect>[ATLAS_MAX_PAGES])
+	, m_pageCapacity(0)
+	, m_texelBytes(4)
+	, m_uploadedBytes(0)
+	, m_failedInserts(0)
 {
+	memset(&m_uploadStats, 0, sizeof(m_uploadStats) );
+	memset(&m_lastUploadStats, 0, sizeof(m_lastUploadStats) );
+	memset(&m_stats, 0, sizeof(m_stats) );
+	memset(m_pages, 0, sizeof(m_pages) );
+
 	BX_CHECK(_regionCount <= 64 && _maxRegionsCount <= 4096, "_regionCount %d, _maxRegionsCount %d", _regionCount, _maxRegionsCount);
 
 	init();
 
 	m_regions = new AtlasRegion[_regionCount];
+	m_regionLastUse = new uint32_t[_regionCount];
+	m_regionOutline = new uint8_t[_regionCount];
+	m_freeRegions = new uint16_t[_regionCount];
 	m_textureBuffer = new uint8_t[getTextureBufferSize()];
+	createUVTable();
 
 	memcpy(m_regions, _regionBuffer, _regionCount * sizeof(AtlasRegion) );
+	memset(m_regionLastUse, 0, _regionCount * sizeof(uint32_t) );
+	memset(m_regionOutline, 0, _regionCount * sizeof(uint8_t) );
 	memcpy(m_textureBuffer, _textureBuffer, getTextureBufferSize() );
 
+	for (uint16_t ii = 0; ii < _regionCount; ++ii)
+	{
+		updateRegionUV(ii);
+	}
+
 	m_textureHandle = bgfx::createTextureCube(_textureSize
 		, 1
 		, bgfx::TextureFormat::BGRA8
@@ -308,14 +205,81 @@ Atlas::Atlas(uint16_t _textureSize, const uint8_t* _textureBuffer, uint16_t _reg
 Atlas::~Atlas()
 {
 	bgfx::destroyTexture(m_textureHandle);
+	bgfx::destroyTexture(m_uvTableHandle);
 
+	delete m_compaction;
+	delete [] m_dirtyRects;
 	delete [] m_layers;
 	delete [] m_regions;
+	delete [] m_regionLastUse;
+	delete [] m_regionOutline;
+	delete [] m_regionUVs;
+	delete [] m_freeRegions;
 	delete [] m_textureBuffer;
+
+	for (uint32_t ii = 0; ii < ATLAS_MAX_PAGES; ++ii)
+	{
+		delete [] m_pages[ii];
+	}
+}
+
+const AtlasStats& Atlas::getStats()
+{
+	m_stats.layerCount = m_usedLayers;
+	for (uint32_t ii = 0; ii < m_usedLayers; ++ii)
+	{
+		const PackedLayer& layer = m_layers[ii];
+		AtlasLayerStats& stats = m_stats.layers[ii];
+		stats.usedArea = layer.packer->getUsedSurface();
+		stats.wastedArea = layer.packer->getWastedSurface();
+		stats.totalArea = layer.packer->getTotalSurface();
+		stats.faceIndex = (uint8_t)layer.faceRegion.getFaceIndex();
+		stats.componentIndex = (uint8_t)layer.faceRegion.getComponentIndex();
+	}
+
+	m_stats.regionCount = m_regionCount - m_freeRegionCount;
+	m_stats.maxRegionCount = m_maxRegionCount;
+	m_stats.textureSize = m_textureSize;
+	m_stats.maxTextureSize = m_maxTextureSize;
+	m_stats.uploadedBytes = m_uploadedBytes;
+	m_stats.failedInserts = m_failedInserts;
+
+	m_uploadedBytes = 0;
+	return m_stats;
+}
+
+void Atlas::createUVTable()
+{
+	// Room for the face layers after the regions, rounded up to whole rows
+	// so that rows can be uploaded straight from m_regionUVs.
+	uint32_t numEntries = m_maxRegionCount + 24;
+	m_uvTableHeight = (uint16_t)( (numEntries + UV_TABLE_REGIONS_PER_ROW - 1) / UV_TABLE_REGIONS_PER_ROW);
+	numEntries = m_uvTableHeight * UV_TABLE_REGIONS_PER_ROW;
+
+	m_regionUVs = new AtlasRegionUV[numEntries];
+	memset(m_regionUVs, 0, numEntries * sizeof(AtlasRegionUV) );
+	m_uvDirtyBegin = UINT32_MAX;
+	m_uvDirtyEnd = 0;
+
+	m_uvTableHandle = bgfx::createTexture2D(UV_TABLE_WIDTH
+		, m_uvTableHeight
+		, 1
+		, bgfx::TextureFormat::RGBA16
+		, BGFX_TEXTURE_MIN_POINT | BGFX_TEXTURE_MAG_POINT | BGFX_TEXTURE_U_CLAMP | BGFX_TEXTURE_V_CLAMP
+		);
 }
 
 void Atlas::init()
 {
+	if (AtlasFormat::Pages == m_format)
+	{
+		// Plain [0, 1] coordinates within a page.
+		m_texelSize = float(INT16_MAX) / float(m_textureSize);
+		m_texelOffset[0] = 0.0f;
+		m_texelOffset[1] = 0.0f;
+		return;
+	}
+
 	m_texelSize = float(UINT16_MAX) / float(m_textureSize);
 	float texelHalf = m_texelSize/2.0f;
 	switch (bgfx::getRendererType())
@@ -339,8 +303,10 @@ void Atlas::init()
 
 uint16_t Atlas::addRegion(uint16_t _width, uint16_t _height, const uint8_t* _bitmapBuffer, AtlasRegion::Type _type, uint16_t outline)
 {
-	if (m_regionCount >= m_maxRegionCount)
+	if (m_regionCount >= m_maxRegionCount
+	&&  0 == m_freeRegionCount)
 	{
+		++m_failedInserts;
 		return UINT16_MAX;
 	}
 
@@ -349,8 +315,7 @@ uint16_t Atlas::addRegion(uint16_t _width, uint16_t _height, const uint8_t* _bit
 	uint32_t idx = 0;
 	while (idx < m_usedLayers)
 	{
-		if (m_layers[idx].faceRegion.getType() == _type
-		&&  m_layers[idx].packer.addRectangle(_width + 1, _height + 1, xx, yy) )
+		if (packInLayer(idx, _type, _width + 1, _height + 1, xx, yy) )
 		{
 			break;
 		}
@@ -360,32 +325,34 @@ uint16_t Atlas::addRegion(uint16_t _width, uint16_t _height, const uint8_t* _bit
 
 	if (idx >= m_usedLayers)
 	{
-		if ( (idx + _type) > 24
-		|| m_usedFaces >= 6)
-		{
-			return UINT16_MAX;
-		}
+		bool added = addFace(_type)
+			&& packInLayer(idx, _type, _width + 1, _height + 1, xx, yy)
+			;
 
-		for (int ii = 0; ii < _type; ++ii)
+		// Out of faces, or the region is larger than a face: double the
+		// texture size and retry, the new space is in every layer.
+		while (!added && grow() )
 		{
-			AtlasRegion& region = m_layers[idx + ii].faceRegion;
-			region.x = 0;
-			region.y = 0;
-			region.width = m_textureSize;
-			region.height = m_textureSize;
-			region.setMask(_type, m_usedFaces, ii);
+			for (idx = 0; idx < m_usedLayers; ++idx)
+			{
+				if (packInLayer(idx, _type, _width + 1, _height + 1, xx, yy) )
+				{
+					added = true;
+					break;
+				}
+			}
 		}
 
-		m_usedLayers += _type;
-		m_usedFaces++;
-
-		if (!m_layers[idx].packer.addRectangle(_width + 1, _height + 1, xx, yy) )
+		if (!added)
 		{
+			++m_failedInserts;
 			return UINT16_MAX;
 		}
 	}
 
-	AtlasRegion& region = m_regions[m_regionCount];
+	uint16_t handle = 0 != m_freeRegionCount ? m_freeRegions[--m_freeRegionCount] : m_regionCount++;
+
+	AtlasRegion& region = m_regions[handle];
 	region.x = xx;
 	region.y = yy;
 	region.width = _width;
@@ -399,17 +366,610 @@ uint16_t Atlas::addRegion(uint16_t _width, uint16_t _height, const uint8_t* _bit
 	region.width -= (outline * 2);
 	region.height -= (outline * 2);
 
-	return m_regionCount++;
+	m_regionLastUse[handle] = m_frameIndex;
+	m_regionOutline[handle] = (uint8_t)outline;
+	updateRegionUV(handle);
+
+	return handle;
+}
+
+bool Atlas::packInLayer(uint32_t _layer, AtlasRegion::Type _type, uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY)
+{
+	PackedLayer& layer = m_layers[_layer];
+	if (layer.faceRegion.getType() != _type
+	||  layer.compacting
+	|| (_width >= layer.failedWidth && _height >= layer.failedHeight) )
+	{
+		return false;
+	}
+
+	if (layer.packer->addRectangle(_width, _height, _outX, _outY) )
+	{
+		return true;
+	}
+
+	if (_width <= layer.failedWidth
+	&&  _height <= layer.failedHeight)
+	{
+		layer.failedWidth = _width;
+		layer.failedHeight = _height;
+	}
+
+	return false;
+}
+
+void Atlas::removeRegion(uint16_t _handle)
+{
+	BX_CHECK(_handle < m_regionCount, "Invalid region handle %d", _handle);
+
+	AtlasRegion& region = m_regions[_handle];
+	BX_CHECK(0 != region.mask, "Region %d already removed", _handle);
+
+	uint16_t outline = m_regionOutline[_handle];
+	uint16_t xx = region.x - outline;
+	uint16_t yy = region.y - outline;
+	uint16_t width = region.width + outline * 2;
+	uint16_t height = region.height + outline * 2;
+
+	for (uint32_t ii = 0; ii < m_usedLayers; ++ii)
+	{
+		if (m_layers[ii].faceRegion.mask == region.mask)
+		{
+			m_layers[ii].packer->freeRectangle(xx, yy, width + 1, height + 1);
+			m_layers[ii].resetFailed();
+			break;
+		}
+	}
+
+	// Clear the texels so a smaller region reusing the space doesn't sample
+	// leftovers through its padding.
+	uint32_t face = region.getFaceIndex();
+	uint8_t* lineBuffer = getTexel(face, xx, yy);
+	for (int ii = 0; ii < height; ++ii)
+	{
+		if (region.getType() == AtlasRegion::TYPE_BGRA8)
+		{
+			memset(lineBuffer, 0, width * 4);
+		}
+		else
+		{
+			uint32_t component = region.getComponentIndex();
+			for (int jj = 0; jj < width; ++jj)
+			{
+				lineBuffer[(jj * m_texelBytes) + component] = 0;
+			}
+		}
+
+		lineBuffer += m_textureSize * m_texelBytes;
+	}
+
+	invalidateRect(face, xx, yy, width, height);
+
+	region.mask = 0;
+	region.width = 0;
+	region.height = 0;
+	m_freeRegions[m_freeRegionCount++] = _handle;
+	++m_generation;
+	++m_removalGeneration;
+}
+
+bool Atlas::addFace(AtlasRegion::Type _type)
+{
+	uint32_t idx = m_usedLayers;
+	if ( (idx + _type) > 24
+	|| m_usedFaces >= getMaxFaceCount() )
+	{
+		return false;
+	}
+
+	if (AtlasFormat::Pages == m_format)
+	{
+		BX_CHECK(AtlasRegion::TYPE_GRAY == _type, "Paged atlases only store gray regions");
+
+		m_pages[m_usedFaces] = new uint8_t[m_textureSize * m_textureSize];
+		memset(m_pages[m_usedFaces], 0, m_textureSize * m_textureSize);
+
+		if (m_usedFaces >= m_pageCapacity)
+		{
+			// Grow the texture; regions keep their page relative UVs, only
+			// the page count given to the shader changes.
+			m_pageCapacity *= 2;
+			bgfx::destroyTexture(m_textureHandle);
+			m_textureHandle = bgfx::createTexture2D(m_textureSize
+				, m_textureSize * m_pageCapacity
+				, 1
+				, bgfx::TextureFormat::R8
+				);
+
+			for (uint32_t ii = 0; ii < m_usedFaces; ++ii)
+			{
+				invalidateRect(ii, 0, 0, m_textureSize, m_textureSize);
+			}
+		}
+	}
+
+	for (int ii = 0; ii < _type; ++ii)
+	{
+		AtlasRegion& region = m_layers[idx + ii].faceRegion;
+		region.x = 0;
+		region.y = 0;
+		region.width = m_textureSize;
+		region.height = m_textureSize;
+		region.setMask(_type, m_usedFaces, ii);
+		updateLayerUV(idx + ii);
+	}
+
+	m_usedLayers += _type;
+	m_usedFaces++;
+	return true;
+}
+
+bool Atlas::grow()
+{
+	if (m_textureSize >= m_maxTextureSize)
+	{
+		return false;
+	}
+
+	// Regions keep their texel coordinates: copy each face to the top left
+	// corner of a face twice as large, then only their UVs change.
+	uint16_t size = m_textureSize;
+	uint16_t newSize = size * 2;
+	uint32_t rowSize = size * m_texelBytes;
+	uint32_t newRowSize = newSize * m_texelBytes;
+
+	if (AtlasFormat::Pages == m_format)
+	{
+		for (uint32_t page = 0; page < m_usedFaces; ++page)
+		{
+			uint8_t* buffer = new uint8_t[newSize * newSize];
+			memset(buffer, 0, newSize * newSize);
+			for (uint32_t yy = 0; yy < size; ++yy)
+			{
+				memcpy(buffer + yy * newRowSize, m_pages[page] + yy * rowSize, rowSize);
+			}
+
+			delete [] m_pages[page];
+			m_pages[page] = buffer;
+		}
+	}
+	else
+	{
+		uint8_t* buffer = new uint8_t[newSize * newSize * 6 * 4];
+		memset(buffer, 0, newSize * newSize * 6 * 4);
+		for (uint32_t face = 0; face < 6; ++face)
+		{
+			const uint8_t* src = m_textureBuffer + face * size * rowSize;
+			uint8_t* dst = buffer + face * newSize * newRowSize;
+			for (uint32_t yy = 0; yy < size; ++yy)
+			{
+				memcpy(dst + yy * newRowSize, src + yy * rowSize, rowSize);
+			}
+		}
+
+		delete [] m_textureBuffer;
+		m_textureBuffer = buffer;
+	}
+
+	for (uint32_t ii = 0; ii < m_usedLayers; ++ii)
+	{
+		m_layers[ii].packer->grow(newSize, newSize);
+		m_layers[ii].resetFailed();
+		m_layers[ii].faceRegion.width = newSize;
+		m_layers[ii].faceRegion.height = newSize;
+	}
+
+	for (uint32_t ii = m_usedLayers; ii < 24; ++ii)
+	{
+		m_layers[ii].packer->init(newSize, newSize);
+	}
+
+	m_textureSize = newSize;
+	init();
+
+	for (uint16_t ii = 0; ii < m_regionCount; ++ii)
+	{
+		if (0 != m_regions[ii].mask)
+		{
+			updateRegionUV(ii);
+		}
+	}
+
+	for (uint32_t ii = 0; ii < m_usedLayers; ++ii)
+	{
+		updateLayerUV(ii);
+	}
+
+	bgfx::destroyTexture(m_textureHandle);
+	if (AtlasFormat::Pages == m_format)
+	{
+		m_textureHandle = bgfx::createTexture2D(newSize
+			, newSize * m_pageCapacity
+			, 1
+			, bgfx::TextureFormat::R8
+			);
+	}
+	else
+	{
+		m_textureHandle = bgfx::createTextureCube(newSize
+			, 1
+			, bgfx::TextureFormat::BGRA8
+			);
+	}
+
+	for (uint32_t face = 0; face < m_usedFaces; ++face)
+	{
+		m_dirtyRects[face].clear();
+		invalidateRect(face, 0, 0, newSize, newSize);
+	}
+
+	++m_generation;
+	return true;
+}
+
+bool Atlas::compact(uint32_t _regionsPerStep)
+{
+	BX_CHECK(_regionsPerStep > 0, "_regionsPerStep must be > 0");
+
+	if (NULL != m_compaction)
+	{
+		return true;
+	}
+
+	// Nothing is changed before every check passed, a failed call leaves
+	// the atlas as it was.
+	uint32_t* regionLayers = new uint32_t[m_regionCount];
+	std::vector<uint16_t> regions;
+	for (uint16_t ii = 0; ii < m_regionCount; ++ii)
+	{
+		const AtlasRegion& region = m_regions[ii];
+		if (region.getType() != AtlasRegion::TYPE_GRAY)
+		{
+			continue;
+		}
+
+		for (uint32_t jj = 0; jj < m_usedLayers; ++jj)
+		{
+			if (m_layers[jj].faceRegion.mask == region.mask)
+			{
+				regionLayers[ii] = jj;
+				regions.push_back(ii);
+				break;
+			}
+		}
+	}
+
+	if (regions.empty() )
+	{
+		delete [] regionLayers;
+		return false;
+	}
+
+	// Regions are re-packed into a fresh layer: an empty one, or the first
+	// layer of a new face.
+	uint32_t destinationLayer = UINT32_MAX;
+	for (uint32_t ii = 0; ii < m_usedLayers; ++ii)
+	{
+		if (m_layers[ii].faceRegion.getType() == AtlasRegion::TYPE_GRAY
+		&&  0 == m_layers[ii].packer->getUsedSurface() )
+		{
+			destinationLayer = ii;
+			break;
+		}
+	}
+
+	if (UINT32_MAX == destinationLayer)
+	{
+		destinationLayer = m_usedLayers;
+		if (!addFace(AtlasRegion::TYPE_GRAY) )
+		{
+			delete [] regionLayers;
+			return false;
+		}
+	}
+
+	m_layers[destinationLayer].packer->clear();
+	m_layers[destinationLayer].resetFailed();
+
+	for (uint32_t ii = 0, num = (uint32_t)regions.size(); ii < num; ++ii)
+	{
+		m_layers[regionLayers[regions[ii] ] ].compacting = true;
+	}
+
+	std::sort(regions.begin(), regions.end(), CompactionOrder(m_regions, regionLayers) );
+
+	m_compaction = new Compaction;
+	m_compaction->regions = regions;
+	m_compaction->regionLayers.resize(regions.size() );
+	for (uint32_t ii = 0, num = (uint32_t)regions.size(); ii < num; ++ii)
+	{
+		m_compaction->regionLayers[ii] = regionLayers[regions[ii] ];
+	}
+
+	m_compaction->next = 0;
+	m_compaction->destinationLayer = destinationLayer;
+	m_compaction->regionsPerStep = _regionsPerStep;
+
+	delete [] regionLayers;
+	return true;
+}
+
+void Atlas::clearLayer(uint32_t _layer)
+{
+	PackedLayer& layer = m_layers[_layer];
+	layer.packer->clear();
+	layer.resetFailed();
+	layer.compacting = false;
+
+	uint32_t component = layer.faceRegion.getComponentIndex();
+	uint8_t* faceBuffer = getTexel(layer.faceRegion.getFaceIndex(), 0, 0);
+	for (uint32_t ii = 0, num = m_textureSize * m_textureSize; ii < num; ++ii)
+	{
+		faceBuffer[(ii * m_texelBytes) + component] = 0;
+	}
+
+	invalidateRect(layer.faceRegion.getFaceIndex(), 0, 0, m_textureSize, m_textureSize);
+}
+
+void Atlas::moveRegion(uint16_t _handle, uint32_t _destinationLayer, uint16_t _x, uint16_t _y)
+{
+	AtlasRegion& region = m_regions[_handle];
+	const AtlasRegion& destination = m_layers[_destinationLayer].faceRegion;
+
+	uint16_t outline = m_regionOutline[_handle];
+	uint16_t width = region.width + outline * 2;
+	uint16_t height = region.height + outline * 2;
+
+	uint32_t srcComponent = region.getComponentIndex();
+	uint32_t dstComponent = destination.getComponentIndex();
+	const uint8_t* srcLineBuffer = getTexel(region.getFaceIndex(), region.x - outline, region.y - outline);
+	uint8_t* dstLineBuffer = getTexel(destination.getFaceIndex(), _x, _y);
+
+	// Copy the region and clear its one pixel padding, the destination may
+	// hold texels of a layout that was reset.
+	for (int yy = 0; yy <= height; ++yy)
+	{
+		for (int xx = 0; xx <= width; ++xx)
+		{
+			dstLineBuffer[(xx * m_texelBytes) + dstComponent] = (yy < height && xx < width) ? srcLineBuffer[(xx * m_texelBytes) + srcComponent] : 0;
+		}
+
+		srcLineBuffer += m_textureSize * m_texelBytes;
+		dstLineBuffer += m_textureSize * m_texelBytes;
+	}
+
+	region.x = _x + outline;
+	region.y = _y + outline;
+	region.mask = destination.mask;
+	updateRegionUV(_handle);
+
+	invalidateRect(destination.getFaceIndex(), _x, _y, width + 1, height + 1);
+}
+
+void Atlas::stepCompaction()
+{
+	Compaction& compaction = *m_compaction;
+
+	// Layers emptied on the previous step are only reset now: text laid out
+	// before that step still sampled them until it was re-laid out.
+	for (uint32_t ii = 0, num = (uint32_t)compaction.emptiedLayers.size(); ii < num; ++ii)
+	{
+		uint32_t layer = compaction.emptiedLayers[ii];
+		clearLayer(layer);
+		compaction.freeLayers.push_back(layer);
+	}
+
+	compaction.emptiedLayers.clear();
+
+	uint32_t moved = 0;
+	const uint32_t num = (uint32_t)compaction.regions.size();
+	while (compaction.next < num
+	&&     moved < compaction.regionsPerStep)
+	{
+		uint16_t handle = compaction.regions[compaction.next];
+		uint32_t sourceLayer = compaction.regionLayers[compaction.next];
+		const AtlasRegion& region = m_regions[handle];
+
+		// Regions removed since the compaction started are skipped.
+		if (region.mask == m_layers[sourceLayer].faceRegion.mask)
+		{
+			uint16_t outline = m_regionOutline[handle];
+			uint16_t xx;
+			uint16_t yy;
+			if (!m_layers[compaction.destinationLayer].packer->addRectangle(region.width + outline * 2 + 1, region.height + outline * 2 + 1, xx, yy) )
+			{
+				if (compaction.freeLayers.empty() )
+				{
+					break;
+				}
+
+				compaction.destinationLayer = compaction.freeLayers.back();
+				compaction.freeLayers.pop_back();
+				continue;
+			}
+
+			moveRegion(handle, compaction.destinationLayer, xx, yy);
+			++moved;
+		}
+
+		++compaction.next;
+		if (compaction.next == num
+		||  compaction.regionLayers[compaction.next] != sourceLayer)
+		{
+			compaction.emptiedLayers.push_back(sourceLayer);
+		}
+	}
+
+	if (0 != moved)
+	{
+		++m_generation;
+	}
+
+	bool stalled = compaction.next < num
+		&& 0 == moved
+		&& compaction.emptiedLayers.empty();
+
+	if (stalled
+	|| (compaction.next == num && compaction.emptiedLayers.empty() ) )
+	{
+		// Done, or the destination is full and no layer will be freed:
+		// leave the remaining regions where they are.
+		for (uint32_t ii = 0; ii < m_usedLayers; ++ii)
+		{
+			m_layers[ii].compacting = false;
+		}
+
+		delete m_compaction;
+		m_compaction = NULL;
+	}
+}
+
+void Atlas::update()
+{
+	if (NULL != m_compaction)
+	{
+		stepCompaction();
+	}
+
+	flushUploads();
+	++m_frameIndex;
+}
+
+static uint32_t rectArea(const AtlasRect& _rect)
+{
+	return (uint32_t)_rect.width * _rect.height;
+}
+
+static AtlasRect rectUnion(const AtlasRect& _a, const AtlasRect& _b)
+{
+	uint16_t x0 = _a.x < _b.x ? _a.x : _b.x;
+	uint16_t y0 = _a.y < _b.y ? _a.y : _b.y;
+	uint16_t x1 = (_a.x + _a.width) > (_b.x + _b.width) ? (_a.x + _a.width) : (_b.x + _b.width);
+	uint16_t y1 = (_a.y + _a.height) > (_b.y + _b.height) ? (_a.y + _a.height) : (_b.y + _b.height);
+	AtlasRect rect = { x0, y0, uint16_t(x1 - x0), uint16_t(y1 - y0) };
+	return rect;
+}
+
+/// Two dirty rectangles are merged when their union doesn't upload much
+/// more than the rectangles themselves; glyphs packed side by side on the
+/// skyline end up as a few rows.
+static bool mergeRect(AtlasRect& _a, const AtlasRect& _b)
+{
+	AtlasRect merged = rectUnion(_a, _b);
+	uint32_t area = rectArea(_a) + rectArea(_b);
+	if (rectArea(merged) > area + area / 4)
+	{
+		return false;
+	}
+
+	_a = merged;
+	return true;
+}
+
+void Atlas::invalidateRect(uint32_t _faceIndex, uint16_t _x, uint16_t _y, uint16_t _width, uint16_t _height)
+{
+	std::vector<AtlasRect>& dirtyRects = m_dirtyRects[_faceIndex];
+	AtlasRect rect = { _x, _y, _width, _height };
+	++m_uploadStats.dirtyRects;
+
+	for (uint32_t ii = 0, num = (uint32_t)dirtyRects.size(); ii < num; ++ii)
+	{
+		if (mergeRect(dirtyRects[ii], rect) )
+		{
+			return;
+		}
+	}
+
+	dirtyRects.push_back(rect);
+}
+
+void Atlas::flushUploads()
+{
+	m_lastUploadStats = m_uploadStats;
+	m_uploadStats.dirtyRects = 0;
+	m_uploadStats.uploads = 0;
+	m_uploadStats.bytes = 0;
+
+	for (uint32_t face = 0; face < m_usedFaces; ++face)
+	{
+		std::vector<AtlasRect>& dirtyRects = m_dirtyRects[face];
+		if (dirtyRects.empty() )
+		{
+			continue;
+		}
+
+		// Rectangles grown by later insertions may now merge together.
+		for (uint32_t ii = 0; ii < dirtyRects.size(); ++ii)
+		{
+			for (uint32_t jj = ii + 1; jj < dirtyRects.size(); )
+			{
+				if (mergeRect(dirtyRects[ii], dirtyRects[jj]) )
+				{
+					dirtyRects[jj] = dirtyRects.back();
+					dirtyRects.pop_back();
+					jj = ii + 1;
+				}
+				else
+				{
+					++jj;
+				}
+			}
+		}
+
+		for (uint32_t ii = 0, num = (uint32_t)dirtyRects.size(); ii < num; ++ii)
+		{
+			const AtlasRect& rect = dirtyRects[ii];
+			const bgfx::Memory* mem = bgfx::alloc(rect.width * rect.height * m_texelBytes);
+			const uint8_t* inLineBuffer = getTexel(face, rect.x, rect.y);
+			for (int yy = 0; yy < rect.height; ++yy)
+			{
+				memcpy(mem->data + yy * rect.width * m_texelBytes, inLineBuffer, rect.width * m_texelBytes);
+				inLineBuffer += m_textureSize * m_texelBytes;
+			}
+
+			if (AtlasFormat::Pages == m_format)
+			{
+				bgfx::updateTexture2D(m_textureHandle, 0, rect.x, (uint16_t)(face * m_textureSize + rect.y), rect.width, rect.height, mem);
+			}
+			else
+			{
+				bgfx::updateTextureCube(m_textureHandle, (uint8_t)face, 0, rect.x, rect.y, rect.width, rect.height, mem);
+			}
+
+			m_lastUploadStats.uploads++;
+			m_lastUploadStats.bytes += mem->size;
+			m_uploadedBytes += mem->size;
+		}
+
+		dirtyRects.clear();
+	}
+
+	if (m_uvDirtyBegin < m_uvDirtyEnd)
+	{
+		uint32_t firstRow = m_uvDirtyBegin / UV_TABLE_REGIONS_PER_ROW;
+		uint32_t lastRow = (m_uvDirtyEnd - 1) / UV_TABLE_REGIONS_PER_ROW;
+		uint32_t rowSize = UV_TABLE_REGIONS_PER_ROW * sizeof(AtlasRegionUV);
+		uint32_t numRows = lastRow - firstRow + 1;
+
+		const bgfx::Memory* mem = bgfx::alloc(numRows * rowSize);
+		memcpy(mem->data, &m_regionUVs[firstRow * UV_TABLE_REGIONS_PER_ROW], numRows * rowSize);
+		bgfx::updateTexture2D(m_uvTableHandle, 0, 0, (uint16_t)firstRow, UV_TABLE_WIDTH, (uint16_t)numRows, mem);
+
+		m_lastUploadStats.uploads++;
+		m_lastUploadStats.bytes += mem->size;
+		m_uploadedBytes += mem->size;
+
+		m_uvDirtyBegin = UINT32_MAX;
+		m_uvDirtyEnd = 0;
+	}
 }
 
 void Atlas::updateRegion(const AtlasRegion& _region, const uint8_t* _bitmapBuffer)
 {
-	const bgfx::Memory* mem = bgfx::alloc(_region.width * _region.height * 4);
-	memset(mem->data, 0, mem->size);
 	if (_region.getType() == AtlasRegion::TYPE_BGRA8)
 	{
 		const uint8_t* inLineBuffer = _bitmapBuffer;
-		uint8_t* outLineBuffer = m_textureBuffer + _region.getFaceIndex() * (m_textureSize * m_textureSize * 4) + ( ( (_region.y * m_textureSize) + _region.x) * 4);
+		uint8_t* outLineBuffer = getTexel(_region.getFaceIndex(), _region.x, _region.y);
 
 		for (int yy = 0; yy < _region.height; ++yy)
 		{
@@ -417,29 +977,26 @@ void Atlas::updateRegion(const AtlasRegion& _region, const uint8_t* _bitmapBuffe
 			inLineBuffer += _region.width * 4;
 			outLineBuffer += m_textureSize * 4;
 		}
-
-		memcpy(mem->data, _bitmapBuffer, mem->size);
 	}
 	else
 	{
 		uint32_t layer = _region.getComponentIndex();
 		const uint8_t* inLineBuffer = _bitmapBuffer;
-		uint8_t* outLineBuffer = (m_textureBuffer + _region.getFaceIndex() * (m_textureSize * m_textureSize * 4) + ( ( (_region.y * m_textureSize) + _region.x) * 4) );
+		uint8_t* outLineBuffer = getTexel(_region.getFaceIndex(), _region.x, _region.y);
 
 		for (int yy = 0; yy < _region.height; ++yy)
 		{
 			for (int xx = 0; xx < _region.width; ++xx)
 			{
-				outLineBuffer[(xx * 4) + layer] = inLineBuffer[xx];
+				outLineBuffer[(xx * m_texelBytes) + layer] = inLineBuffer[xx];
 			}
 
-			memcpy(mem->data + yy * _region.width * 4, outLineBuffer, _region.width * 4);
 			inLineBuffer += _region.width;
-			outLineBuffer += m_textureSize * 4;
+			outLineBuffer += m_textureSize * m_texelBytes;
 		}
 	}
 
-	bgfx::updateTextureCube(m_textureHandle, (uint8_t)_region.getFaceIndex(), 0, _region.x, _region.y, _region.width, _region.height, mem);
+	invalidateRect(_region.getFaceIndex(), _region.x, _region.y, _region.width, _region.height);
 }
 
 void Atlas::packFaceLayerUV(uint32_t _idx, uint8_t* _vertexBuffer, uint32_t _offset, uint32_t _stride) const
@@ -447,10 +1004,22 @@ void Atlas::packFaceLayerUV(uint32_t _idx, uint8_t* _vertexBuffer, uint32_t _off
 	packUV(m_layers[_idx].faceRegion, _vertexBuffer, _offset, _stride);
 }
 
+void Atlas::updateLayerUV(uint32_t _idx)
+{
+	uint32_t entry = getLayerUVIndex(_idx);
+	packUV(m_layers[_idx].faceRegion, (uint8_t*)&m_regionUVs[entry], 0, sizeof(m_regionUVs[entry].xyzw[0]) );
+	invalidateUVs(entry);
+}
+
 void Atlas::packUV(uint16_t _regionHandle, uint8_t* _vertexBuffer, uint32_t _offset, uint32_t _stride) const
 {
-	const AtlasRegion& region = m_regions[_regionHandle];
-	packUV(region, _vertexBuffer, _offset, _stride);
+	const AtlasRegionUV& uv = m_regionUVs[_regionHandle];
+	_vertexBuffer += _offset;
+	for (uint32_t ii = 0; ii < 4; ++ii)
+	{
+		memcpy(_vertexBuffer, uv.xyzw[ii], sizeof(uv.xyzw[ii]) );
+		_vertexBuffer += _stride;
+	}
 }
 
 static void writeUV(uint8_t* _vertexBuffer, int16_t _x, int16_t _y, int16_t _z, int16_t _w)
@@ -464,6 +1033,22 @@ static void writeUV(uint8_t* _vertexBuffer, int16_t _x, int16_t _y, int16_t _z,
 
 void Atlas::packUV(const AtlasRegion& _region, uint8_t* _vertexBuffer, uint32_t _offset, uint32_t _stride) const
 {
+	if (AtlasFormat::Pages == m_format)
+	{
+		int16_t x0 = (int16_t)( (float)_region.x * m_texelSize);
+		int16_t y0 = (int16_t)( (float)_region.y * m_texelSize);
+		int16_t x1 = (int16_t)( ( (float)_region.x + _region.width) * m_texelSize);
+		int16_t y1 = (int16_t)( ( (float)_region.y + _region.height) * m_texelSize);
+		int16_t ww = (int16_t)( (INT16_MAX / ATLAS_MAX_PAGES) * _region.getFaceIndex() );
+
+		_vertexBuffer += _offset;
+		writeUV(_vertexBuffer, x0, y0, 0, ww); _vertexBuffer += _stride;
+		writeUV(_vertexBuffer, x0, y1, 0, ww); _vertexBuffer += _stride;
+		writeUV(_vertexBuffer, x1, y1, 0, ww); _vertexBuffer += _stride;
+		writeUV(_vertexBuffer, x1, y0, 0, ww); _vertexBuffer += _stride;
+		return;
+	}
+
 	int16_t x0 = (int16_t)( ( (float)_region.x * m_texelSize + m_texelOffset[0]) - float(INT16_MAX) );
 	int16_t y0 = (int16_t)( ( (float)_region.y * m_texelSize + m_texelOffset[1]) - float(INT16_MAX) );
 	int16_t x1 = (int16_t)( ( ( (float)_region.x + _region.width) * m_texelSize + m_texelOffset[0]) - float(INT16_MAX) );
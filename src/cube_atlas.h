@@ -11,11 +11,13 @@
 /// The actual implementation is based on the article by Jukka Jylänki : "A
 /// Thousand Ways to Pack the Bin - A Practical Approach to Two-Dimensional
 /// Rectangle Bin Packing", February 27, 2010.
-/// More precisely, this is an implementation of the Skyline Bottom-Left
-/// algorithm based on C++ sources provided by Jukka Jylänki at:
-/// http://clb.demon.fi/files/RectangleBinPack/
+/// The packing algorithms of the layers are in rect_packer.h, Skyline
+/// Bottom-Left by default.
 
 #include <bgfx.h>
+#include <vector>
+
+#include "rect_packer.h"
 
 struct AtlasRegion
 {
@@ -50,13 +52,95 @@ struct AtlasRegion
 	}
 };
 
+/// Packed UV coordinates of the four corners of a region, in the order and
+/// format written by Atlas::packUV().
+struct AtlasRegionUV
+{
+	int16_t xyzw[4][4];
+};
+
+/// Texture layout of a dynamic atlas.
+struct AtlasFormat
+{
+	enum Enum
+	{
+		/// One BGRA8 texture cube; gray regions are stored in one of the four
+		/// channels of a face.
+		Cube,
+
+		/// R8 pages stacked in a 2D texture and allocated on demand; regions
+		/// use plain normalized UVs within their page.
+		Pages,
+	};
+};
+
+#define ATLAS_MAX_PAGES 16
+
+/// The UV table texture holds the AtlasRegionUV of each region as four
+/// RGBA16 texels, UV_TABLE_REGIONS_PER_ROW regions per row.
+#define UV_TABLE_REGIONS_PER_ROW 64
+#define UV_TABLE_WIDTH (UV_TABLE_REGIONS_PER_ROW * 4)
+
+struct AtlasRect
+{
+	uint16_t x, y;
+	uint16_t width, height;
+};
+
+/// Texture upload counters of a frame.
+struct AtlasUploadStats
+{
+	/// Rectangles modified during the frame.
+	uint32_t dirtyRects;
+	/// Texture updates issued once the rectangles were merged.
+	uint32_t uploads;
+	/// Bytes uploaded.
+	uint32_t bytes;
+};
+
+/// Occupancy of an atlas layer, in squared texels.
+struct AtlasLayerStats
+{
+	/// Area of the regions, including their padding.
+	uint32_t usedArea;
+	/// Free area the packer can no longer hand out.
+	uint32_t wastedArea;
+	uint32_t totalArea;
+	uint8_t faceIndex;
+	uint8_t componentIndex;
+};
+
+/// Occupancy and fragmentation of an atlas, see Atlas::getStats().
+struct AtlasStats
+{
+	uint32_t layerCount;
+	AtlasLayerStats layers[24];
+
+	/// Live regions, and the maximum the atlas can hold.
+	uint32_t regionCount;
+	uint32_t maxRegionCount;
+
+	uint16_t textureSize;
+	uint16_t maxTextureSize;
+
+	/// Bytes uploaded to the texture since the previous call to getStats().
+	uint32_t uploadedBytes;
+	/// Regions that couldn't be added since the atlas was created.
+	uint32_t failedInserts;
+};
+
 class Atlas
 {
 public:
 	/// create an empty dynamic atlas (region can be updated and added)
-	/// @param textureSize an atlas creates a texture cube of 6 faces with size equal to (textureSize*textureSize * sizeof(RGBA))
+	/// @param textureSize an atlas creates a texture cube of 6 faces with size equal to (textureSize*textureSize * sizeof(RGBA)),
+	///   or pages of textureSize*textureSize bytes
 	/// @param maxRegionCount maximum number of region allowed in the atlas
-	Atlas(uint16_t _textureSize, uint16_t _maxRegionsCount = 4096);
+	/// @param format texture layout of the atlas
+	/// @param maxTextureSize size up to which the atlas doubles its textureSize when it is full,
+	///   0 keeps the size fixed
+	/// @param packerType rectangle packing algorithm of the layers
+	Atlas(uint16_t _textureSize, uint16_t _maxRegionsCount = 4096, AtlasFormat::Enum _format = AtlasFormat::Cube, uint16_t _maxTextureSize = 0, PackerType::Enum _packerType = PackerType::Skyline);
 
 	/// initialize a static atlas with serialized data	(region can be updated but not added)
 	/// @param textureSize an atlas creates a texture cube of 6 faces with size equal to (textureSize*textureSize * sizeof(RGBA))
@@ -70,15 +154,79 @@ public:
 	/// add a region to the atlas, and copy the content of mem to the underlying texture
 	uint16_t addRegion(uint16_t _width, uint16_t _height, const uint8_t* _bitmapBuffer, AtlasRegion::Type _type = AtlasRegion::TYPE_BGRA8, uint16_t outline = 0);
 
+	/// remove a region from the atlas, its space and its handle are reused
+	/// by later additions
+	void removeRegion(uint16_t _handle);
+
 	/// update a preallocated region
 	void updateRegion(const AtlasRegion& _region, const uint8_t* _bitmapBuffer);
 
+	/// mark a region as used during the current frame
+	void touchRegion(uint16_t _handle)
+	{
+		m_regionLastUse[_handle] = m_frameIndex;
+	}
+
+	/// retrieve the last frame a region was added or touched
+	uint32_t getRegionLastUse(uint16_t _handle) const
+	{
+		return m_regionLastUse[_handle];
+	}
+
+	/// retrieve the current frame index
+	uint32_t getFrameIndex() const
+	{
+		return m_frameIndex;
+	}
+
+	/// start re-packing all the live gray regions into fresh layers, to
+	/// reclaim the holes left by removed regions. The work is spread over
+	/// the following calls to update(), moving at most _regionsPerStep
+	/// regions per frame. Region handles stay valid, only their position
+	/// changes, see getGeneration().
+	/// @return false if no fresh layer is available to re-pack into
+	bool compact(uint32_t _regionsPerStep = 64);
+
+	/// return true while a compaction is in progress
+	bool isCompacting() const
+	{
+		return NULL != m_compaction;
+	}
+
+	/// retrieve a counter incremented whenever regions are moved or removed,
+	/// or the texture grows; UV coordinates packed before a change must be
+	/// packed again
+	uint32_t getGeneration() const
+	{
+		return m_generation;
+	}
+
+	/// retrieve a counter incremented whenever regions are removed; their
+	/// handles may since have been given to other regions, so anything
+	/// referencing a handle from before a change must be rebuilt
+	uint32_t getRemovalGeneration() const
+	{
+		return m_removalGeneration;
+	}
+
+	/// upload the regions modified during the frame, merged into a few
+	/// texture updates, then advance to the next frame. Call once per frame
+	/// before bgfx::frame().
+	void update();
+
+	/// retrieve the texture upload counters of the last update()
+	const AtlasUploadStats& getUploadStats() const
+	{
+		return m_lastUploadStats;
+	}
+
 	/// Pack the UV coordinates of the four corners of a region to a vertex buffer using the supplied vertex format.
 	/// v0 -- v3
 	/// |     |     encoded in that order:  v0,v1,v2,v3
 	/// v1 -- v2
 	/// @remark the UV are four signed short normalized components.
 	/// @remark the x,y,z components encode cube uv coordinates. The w component encode the color channel if any.
+	/// @remark with AtlasFormat::Pages, x,y are the UV within the page and w encodes the page index.
 	/// @param handle handle to the region we are interested in
 	/// @param vertexBuffer address of the first vertex we want to update. Must be valid up to vertexBuffer + offset + 3*stride + 4*sizeof(int16_t), which means the buffer must contains at least 4 vertex includind the first.
 	/// @param offset byte offset to the first uv coordinate of the vertex in the buffer
@@ -86,10 +234,56 @@ public:
 	void packUV(uint16_t _regionHandle, uint8_t* _vertexBuffer, uint32_t _offset, uint32_t _stride) const;
 	void packUV(const AtlasRegion& _region, uint8_t* _vertexBuffer, uint32_t _offset, uint32_t _stride) const;
 
+	/// retrieve the UVs of a region, packed when it was added and kept up to
+	/// date when it moves or the atlas grows
+	const AtlasRegionUV& getRegionUV(uint16_t _regionHandle) const
+	{
+		return m_regionUVs[_regionHandle];
+	}
+
+	/// retrieve the UVs of every region, indexed by region handle
+	const AtlasRegionUV* getRegionUVBuffer() const
+	{
+		return m_regionUVs;
+	}
+
 	/// Same as packUV but pack a whole face of the atlas cube, mostly used for debugging and visualizing atlas
 	void packFaceLayerUV(uint32_t _idx, uint8_t* _vertexBuffer, uint32_t _offset, uint32_t _stride) const;
 
-	/// return the TextureHandle (cube) of the atlas
+	/// retrieve the texture holding the UVs of every region, for shaders
+	/// expanding quads themselves. Entry i is at texels (i % 64 * 4 + corner,
+	/// i / 64), the int16 components are stored as their unsigned bits.
+	/// @remark uploaded by update()
+	bgfx::TextureHandle getUVTableHandle() const
+	{
+		return m_uvTableHandle;
+	}
+
+	/// retrieve the number of rows of the UV table texture
+	uint16_t getUVTableHeight() const
+	{
+		return m_uvTableHeight;
+	}
+
+	/// retrieve the UV table entry of a whole face layer, see packFaceLayerUV()
+	uint32_t getLayerUVIndex(uint32_t _idx) const
+	{
+		return m_maxRegionCount + _idx;
+	}
+
+	/// return the texture layout of the atlas
+	AtlasFormat::Enum getFormat() const
+	{
+		return m_format;
+	}
+
+	/// return the number of pages the 2D texture of a paged atlas can hold
+	uint32_t getPageCapacity() const
+	{
+		return m_pageCapacity;
+	}
+
+	/// return the TextureHandle (cube, or 2D for paged atlases) of the atlas
 	bgfx::TextureHandle getTextureHandle() const
 	{
 		return m_textureHandle;
@@ -107,10 +301,17 @@ public:
 		return m_textureSize;
 	}
 
-	/// retrieve the usage ratio of the atlas
-	//float getUsageRatio() const { return 0.0f; }
+	/// retrieve the occupancy of each layer and the atlas counters, and
+	/// restart counting the uploaded bytes
+	const AtlasStats& getStats();
 
-	/// retrieve the numbers of region in the atlas
+	/// retrieve the number of region handles the atlas can allocate
+	uint16_t getMaxRegionCount() const
+	{
+		return m_maxRegionCount;
+	}
+
+	/// retrieve the numbers of region handles in use or free in the atlas
 	uint16_t getRegionCount() const
 	{
 		return m_regionCount;
@@ -122,36 +323,108 @@ public:
 		return m_regions;
 	}
 
-	/// retrieve the byte size of the texture
+	/// retrieve the byte size of the texture (cube atlases only)
 	uint32_t getTextureBufferSize() const
 	{
 		return 6 * m_textureSize * m_textureSize * 4;
 	}
 
-	/// retrieve the mirrored texture buffer (to serialize it)
+	/// retrieve the mirrored texture buffer (to serialize it, cube atlases only)
 	const uint8_t* getTextureBuffer() const
 	{
+		BX_CHECK(AtlasFormat::Cube == m_format, "Paged atlases have no single texture buffer");
 		return m_textureBuffer;
 	}
 
 private:
 	void init();
 
+	uint32_t getMaxFaceCount() const
+	{
+		return AtlasFormat::Pages == m_format ? ATLAS_MAX_PAGES : 6;
+	}
+
+	/// address of a texel in the CPU mirror of a face (or page)
+	uint8_t* getTexel(uint32_t _faceIndex, uint16_t _x, uint16_t _y) const
+	{
+		uint8_t* faceBuffer = AtlasFormat::Pages == m_format
+			? m_pages[_faceIndex]
+			: m_textureBuffer + _faceIndex * (m_textureSize * m_textureSize * 4)
+			;
+		return faceBuffer + ( (_y * m_textureSize) + _x) * m_texelBytes;
+	}
+
+	bool addFace(AtlasRegion::Type _type);
+	bool grow();
+	void updateRegionUV(uint16_t _handle)
+	{
+		packUV(m_regions[_handle], (uint8_t*)&m_regionUVs[_handle], 0, sizeof(m_regionUVs[_handle].xyzw[0]) );
+		invalidateUVs(_handle);
+	}
+
+	void updateLayerUV(uint32_t _idx);
+
+	void invalidateUVs(uint32_t _entry)
+	{
+		m_uvDirtyBegin = _entry < m_uvDirtyBegin ? _entry : m_uvDirtyBegin;
+		m_uvDirtyEnd = _entry + 1 > m_uvDirtyEnd ? _entry + 1 : m_uvDirtyEnd;
+	}
+
+	void createUVTable();
+
+	bool packInLayer(uint32_t _layer, AtlasRegion::Type _type, uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY);
+	void clearLayer(uint32_t _layer);
+	void moveRegion(uint16_t _handle, uint32_t _destinationLayer, uint16_t _x, uint16_t _y);
+	void stepCompaction();
+	void invalidateRect(uint32_t _faceIndex, uint16_t _x, uint16_t _y, uint16_t _width, uint16_t _height);
+	void flushUploads();
+
 	struct PackedLayer;
+	struct Compaction;
+	AtlasFormat::Enum m_format;
 	PackedLayer* m_layers;
 	AtlasRegion* m_regions;
-	uint8_t* m_textureBuffer;
+	AtlasRegionUV* m_regionUVs; //< regions, then the 24 face layers
+	uint32_t* m_regionLastUse;
+	uint8_t* m_regionOutline;
+	uint16_t* m_freeRegions;
 
 	uint32_t m_usedLayers;
 	uint32_t m_usedFaces;
 
 	bgfx::TextureHandle m_textureHandle;
+	bgfx::TextureHandle m_uvTableHandle;
+	uint16_t m_uvTableHeight;
+	uint32_t m_uvDirtyBegin; //< UV table entries to upload on the next update
+	uint32_t m_uvDirtyEnd;
 	uint16_t m_textureSize;
+	uint16_t m_maxTextureSize;
 	float m_texelSize;
 	float m_texelOffset[2];
 
 	uint16_t m_regionCount;
 	uint16_t m_maxRegionCount;
+	uint16_t m_freeRegionCount;
+
+	uint32_t m_frameIndex;
+	uint32_t m_generation;
+	uint32_t m_removalGeneration;
+
+	Compaction* m_compaction;
+
+	/// per face (or page) rectangles to upload from the CPU mirror on the next update
+	std::vector<AtlasRect>* m_dirtyRects;
+
+	uint8_t* m_textureBuffer;
+	uint8_t* m_pages[ATLAS_MAX_PAGES];
+	uint32_t m_pageCapacity;
+	uint32_t m_texelBytes;
+	AtlasUploadStats m_uploadStats;
+	AtlasUploadStats m_lastUploadStats;
+
+	AtlasStats m_stats;
+	uint32_t m_uploadedBytes; //< since the last getStats()
+	uint32_t m_failedInserts;
 };
 
 #endif // CUBE_ATLAS_H_HEADER_GUARD
@@ -0,0 +1,386 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "fake_bgfx.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <bgfx.h>
+
+#include <map>
+#include <vector>
+
+namespace fake_bgfx {
+namespace {
+
+struct VertexBuffer {
+  std::vector<uint8_t> data;
+  uint16_t stride;
+};
+
+Uploads g_uploads;
+std::vector<uint8_t> g_draw_data;
+
+std::vector<uint16_t> g_free_handles;
+uint16_t g_next_handle = 0;
+
+std::map<uint16_t, VertexBuffer> g_vertex_buffers;
+std::map<uint16_t, uint32_t> g_uniform_sizes;
+std::map<uint16_t, bgfx::TextureFormat::Enum> g_texture_formats;
+
+// Transient and instance data, and the memory handed to bgfx, released by
+// the next submit() as bgfx does at the end of the frame: callers may still
+// read a memory block after passing it.
+std::vector<uint8_t*> g_transient_data;
+std::vector<const bgfx::Memory*> g_released_memory;
+
+// Data of the next draw.
+const uint8_t* g_vertices = NULL;
+uint32_t g_vertices_size = 0;
+const uint8_t* g_instances = NULL;
+uint32_t g_instances_size = 0;
+
+uint16_t AllocHandle() {
+  if (!g_free_handles.empty()) {
+    const uint16_t handle = g_free_handles.back();
+    g_free_handles.pop_back();
+    return handle;
+  }
+  return g_next_handle++;
+}
+
+void FreeHandle(uint16_t handle) {
+  g_free_handles.push_back(handle);
+}
+
+void Release(const bgfx::Memory* mem) {
+  g_released_memory.push_back(mem);
+}
+
+uint8_t* AllocTransient(uint32_t size) {
+  uint8_t* data = new uint8_t[size];
+  g_transient_data.push_back(data);
+  return data;
+}
+
+void EndFrame() {
+  for (size_t i = 0; i < g_transient_data.size(); ++i)
+    delete[] g_transient_data[i];
+  g_transient_data.clear();
+  for (size_t i = 0; i < g_released_memory.size(); ++i)
+    free(const_cast<bgfx::Memory*>(g_released_memory[i]));
+  g_released_memory.clear();
+}
+
+void CountTextureUpdate(uint16_t handle, const bgfx::Memory* mem) {
+  if (g_texture_formats[handle] == bgfx::TextureFormat::RGBA16)
+    g_uploads.uv_table_bytes += mem->size;
+  else
+    g_uploads.texel_bytes += mem->size;
+}
+
+uint16_t CreateVertexBuffer(const bgfx::Memory* mem,
+                            const bgfx::VertexDecl& decl) {
+  const uint16_t handle = AllocHandle();
+  VertexBuffer& buffer = g_vertex_buffers[handle];
+  buffer.data.assign(mem->data, mem->data + mem->size);
+  buffer.stride = decl.m_stride;
+  g_uploads.vertex_bytes += mem->size;
+  Release(mem);
+  return handle;
+}
+
+void DestroyVertexBuffer(uint16_t handle) {
+  g_vertex_buffers.erase(handle);
+  FreeHandle(handle);
+}
+
+void SetVertexBuffer(uint16_t handle, uint32_t num_vertices) {
+  const VertexBuffer& buffer = g_vertex_buffers[handle];
+  const uint64_t size = (uint64_t)num_vertices * buffer.stride;
+  g_vertices = buffer.data.empty() ? NULL : &buffer.data[0];
+  g_vertices_size =
+      size < buffer.data.size() ? (uint32_t)size : (uint32_t)buffer.data.size();
+}
+
+}  // namespace
+
+void Reset() {
+  memset(&g_uploads, 0, sizeof(g_uploads));
+  g_draw_data.clear();
+}
+
+const Uploads& GetUploads() {
+  return g_uploads;
+}
+
+const std::vector<uint8_t>& GetDrawData() {
+  return g_draw_data;
+}
+
+}  // namespace fake_bgfx
+
+namespace bgfx {
+
+using namespace fake_bgfx;
+
+const Memory* alloc(uint32_t _size) {
+  Memory* mem = (Memory*)malloc(sizeof(Memory) + _size);
+  mem->data = (uint8_t*)(mem + 1);
+  mem->size = _size;
+  return mem;
+}
+
+const Memory* makeRef(const void* _data, uint32_t _size) {
+  Memory* mem = (Memory*)malloc(sizeof(Memory));
+  mem->data = (uint8_t*)const_cast<void*>(_data);
+  mem->size = _size;
+  return mem;
+}
+
+const Caps* getCaps() {
+  static Caps caps;
+  caps.rendererType = RendererType::OpenGL;
+  caps.supported = BGFX_CAPS_INSTANCING;
+  return &caps;
+}
+
+RendererType::Enum getRendererType() {
+  return RendererType::OpenGL;
+}
+
+ShaderHandle createShader(const Memory* _mem) {
+  Release(_mem);
+  ShaderHandle handle = {AllocHandle()};
+  return handle;
+}
+
+void destroyShader(ShaderHandle _handle) {
+  FreeHandle(_handle.idx);
+}
+
+ProgramHandle createProgram(ShaderHandle _vsh,
+                            ShaderHandle _fsh,
+                            bool _destroyShaders) {
+  if (_destroyShaders) {
+    destroyShader(_vsh);
+    destroyShader(_fsh);
+  }
+  ProgramHandle handle = {AllocHandle()};
+  return handle;
+}
+
+void destroyProgram(ProgramHandle _handle) {
+  FreeHandle(_handle.idx);
+}
+
+UniformHandle createUniform(const char* _name,
+                            UniformType::Enum _type,
+                            uint16_t _num) {
+  UniformHandle handle = {AllocHandle()};
+  uint32_t size;
+  switch (_type) {
+    case UniformType::Uniform2fv: size = 8; break;
+    case UniformType::Uniform3fv: size = 12; break;
+    case UniformType::Uniform4fv: size = 16; break;
+    case UniformType::Uniform3x3fv: size = 36; break;
+    case UniformType::Uniform4x4fv: size = 64; break;
+    default: size = 4; break;
+  }
+  g_uniform_sizes[handle.idx] = size;
+  return handle;
+}
+
+void destroyUniform(UniformHandle _handle) {
+  g_uniform_sizes.erase(_handle.idx);
+  FreeHandle(_handle.idx);
+}
+
+TextureHandle createTexture2D(uint16_t _width,
+                              uint16_t _height,
+                              uint8_t _numMips,
+                              TextureFormat::Enum _format,
+                              uint32_t _flags,
+                              const Memory* _mem) {
+  TextureHandle handle = {AllocHandle()};
+  g_texture_formats[handle.idx] = _format;
+  if (NULL != _mem) {
+    CountTextureUpdate(handle.idx, _mem);
+    Release(_mem);
+  }
+  return handle;
+}
+
+TextureHandle createTextureCube(uint16_t _size,
+                                uint8_t _numMips,
+                                TextureFormat::Enum _format,
+                                uint32_t _flags,
+                                const Memory* _mem) {
+  return createTexture2D(_size, _size, _numMips, _format, _flags, _mem);
+}
+
+void updateTexture2D(TextureHandle _handle,
+                     uint8_t _mip,
+                     uint16_t _x,
+                     uint16_t _y,
+                     uint16_t _width,
+                     uint16_t _height,
+                     const Memory* _mem,
+                     uint16_t _pitch) {
+  CountTextureUpdate(_handle.idx, _mem);
+  Release(_mem);
+}
+
+void updateTextureCube(TextureHandle _handle,
+                       uint8_t _side,
+                       uint8_t _mip,
+                       uint16_t _x,
+                       uint16_t _y,
+                       uint16_t _width,
+                       uint16_t _height,
+                       const Memory* _mem,
+                       uint16_t _pitch) {
+  CountTextureUpdate(_handle.idx, _mem);
+  Release(_mem);
+}
+
+void destroyTexture(TextureHandle _handle) {
+  g_texture_formats.erase(_handle.idx);
+  FreeHandle(_handle.idx);
+}
+
+IndexBufferHandle createIndexBuffer(const Memory* _mem) {
+  Release(_mem);
+  IndexBufferHandle handle = {AllocHandle()};
+  return handle;
+}
+
+void destroyIndexBuffer(IndexBufferHandle _handle) {
+  FreeHandle(_handle.idx);
+}
+
+VertexBufferHandle createVertexBuffer(const Memory* _mem,
+                                      const VertexDecl& _decl) {
+  VertexBufferHandle handle = {CreateVertexBuffer(_mem, _decl)};
+  return handle;
+}
+
+void destroyVertexBuffer(VertexBufferHandle _handle) {
+  DestroyVertexBuffer(_handle.idx);
+}
+
+DynamicVertexBufferHandle createDynamicVertexBuffer(const Memory* _mem,
+                                                    const VertexDecl& _decl) {
+  DynamicVertexBufferHandle handle = {CreateVertexBuffer(_mem, _decl)};
+  return handle;
+}
+
+void updateDynamicVertexBuffer(DynamicVertexBufferHandle _handle,
+                               uint32_t _startVertex,
+                               const Memory* _mem) {
+  VertexBuffer& buffer = g_vertex_buffers[_handle.idx];
+  const uint32_t offset = _startVertex * buffer.stride;
+  if (buffer.data.size() < offset + _mem->size)
+    buffer.data.resize(offset + _mem->size);
+  memcpy(&buffer.data[offset], _mem->data, _mem->size);
+  g_uploads.vertex_bytes += _mem->size;
+  Release(_mem);
+}
+
+void destroyDynamicVertexBuffer(DynamicVertexBufferHandle _handle) {
+  DestroyVertexBuffer(_handle.idx);
+}
+
+void allocTransientVertexBuffer(TransientVertexBuffer* _tvb,
+                                uint32_t _num,
+                                const VertexDecl& _decl) {
+  _tvb->size = _num * _decl.m_stride;
+  _tvb->data = AllocTransient(_tvb->size);
+  _tvb->startVertex = 0;
+  _tvb->stride = _decl.m_stride;
+  g_uploads.vertex_bytes += _tvb->size;
+}
+
+const InstanceDataBuffer* allocInstanceDataBuffer(uint32_t _num,
+                                                  uint16_t _stride) {
+  InstanceDataBuffer* idb =
+      (InstanceDataBuffer*)AllocTransient(sizeof(InstanceDataBuffer));
+  idb->size = _num * _stride;
+  idb->data = AllocTransient(idb->size);
+  idb->offset = 0;
+  idb->stride = _stride;
+  idb->num = _num;
+  g_uploads.instance_bytes += idb->size;
+  return idb;
+}
+
+void setUniform(UniformHandle _handle, const void* _value, uint16_t _num) {
+  g_uploads.uniform_bytes += g_uniform_sizes[_handle.idx] * _num;
+}
+
+void setTexture(uint8_t _stage,
+                UniformHandle _sampler,
+                TextureHandle _handle,
+                uint32_t _flags) {
+}
+
+void setProgram(ProgramHandle _handle) {
+}
+
+void setState(uint64_t _state, uint32_t _rgba) {
+}
+
+uint32_t setTransform(const void* _mtx, uint16_t _num) {
+  return 0;
+}
+
+void setTransform(uint32_t _cache, uint16_t _num) {
+}
+
+void setIndexBuffer(IndexBufferHandle _handle,
+                    uint32_t _firstIndex,
+                    uint32_t _numIndices) {
+}
+
+void setVertexBuffer(VertexBufferHandle _handle, uint32_t _numVertices) {
+  SetVertexBuffer(_handle.idx, _numVertices);
+}
+
+void setVertexBuffer(DynamicVertexBufferHandle _handle,
+                     uint32_t _numVertices) {
+  SetVertexBuffer(_handle.idx, _numVertices);
+}
+
+void setVertexBuffer(const TransientVertexBuffer* _tvb,
+                     uint32_t _numVertices) {
+  const uint64_t size = (uint64_t)_numVertices * _tvb->stride;
+  g_vertices = _tvb->data;
+  g_vertices_size = size < _tvb->size ? (uint32_t)size : _tvb->size;
+}
+
+void setInstanceDataBuffer(const InstanceDataBuffer* _idb, uint16_t _num) {
+  const uint32_t size = (uint32_t)_num * _idb->stride;
+  g_instances = _idb->data;
+  g_instances_size = size < _idb->size ? size : _idb->size;
+}
+
+uint32_t submit(uint8_t _id, int32_t _depth) {
+  // The corners shared by the instances aren't recorded.
+  if (NULL != g_instances) {
+    g_draw_data.insert(
+        g_draw_data.end(), g_instances, g_instances + g_instances_size);
+  } else if (NULL != g_vertices) {
+    g_draw_data.insert(
+        g_draw_data.end(), g_vertices, g_vertices + g_vertices_size);
+  }
+  ++g_uploads.draws;
+
+  g_vertices = NULL;
+  g_instances = NULL;
+  EndFrame();
+  return 0;
+}
+
+}  // namespace bgfx
@@ -0,0 +1,39 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Stand-in for the bgfx calls of the text rendering, so that the tests and
+// benchmarks run without a window or a GPU. Resources are bare handles, the
+// data handed to bgfx is only counted and the draws recorded.
+
+#ifndef FAKE_BGFX_H_HEADER_GUARD
+#define FAKE_BGFX_H_HEADER_GUARD
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace fake_bgfx {
+
+// Bytes handed to bgfx since the last Reset().
+struct Uploads {
+  uint64_t vertex_bytes;    // Static, dynamic and transient vertices.
+  uint64_t instance_bytes;  // Instance data buffers.
+  uint64_t uniform_bytes;   // setUniform() calls.
+  uint64_t texel_bytes;     // Texture updates, but for the UV tables.
+  uint64_t uv_table_bytes;  // Updates of RGBA16 textures, the UV tables.
+  uint32_t draws;
+};
+
+// Clears the counters and the recorded draws.
+void Reset();
+
+const Uploads& GetUploads();
+
+// Vertices of the draws since the last Reset(), in submit order. Instanced
+// draws add their instance data instead.
+const std::vector<uint8_t>& GetDrawData();
+
+}  // namespace fake_bgfx
+
+#endif  // FAKE_BGFX_H_HEADER_GUARD
@@ -0,0 +1,144 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "filtered_line_view.h"
+
+#include <algorithm>
+
+#include "text_search.h"
+
+FilteredLineView::FilteredLineView(uint32_t _numThreads)
+	: m_jobPool(_numThreads)
+	, m_lineIndex(NULL)
+	, m_isRegex(false)
+	, m_firstLine(0)
+{
+}
+
+bool FilteredLineView::setFilter(const LineIndex& _lineIndex, const char* _pattern, uint32_t _length, bool _regex)
+{
+	m_lineIndex = &_lineIndex;
+	m_pattern.assign(_pattern, _length);
+	m_regex = Regex();
+	m_isRegex = _regex;
+	m_lines.clear();
+
+	if (_regex
+	&&  !m_regex.compile(_pattern, _length) )
+	{
+		return false;
+	}
+
+	update(0);
+	return true;
+}
+
+void FilteredLineView::update(uint32_t _firstLine)
+{
+	if (NULL == m_lineIndex
+	||  '\0' != getError()[0])
+	{
+		return;
+	}
+
+	// The last line kept may have continued.
+	while (!m_lines.empty()
+	&&     m_lines.back() >= _firstLine)
+	{
+		m_lines.pop_back();
+	}
+
+	const uint32_t lineCount = m_lineIndex->getLineCount();
+	if (_firstLine >= lineCount)
+	{
+		return;
+	}
+
+	m_firstLine = _firstLine;
+	m_chunks.resize( (lineCount - _firstLine + FILTER_CHUNK_LINES - 1) / FILTER_CHUNK_LINES);
+	m_jobPool.parallelFor( (uint32_t)m_chunks.size(), 1, filterChunksJob, this);
+
+	for (uint32_t ii = 0; ii < m_chunks.size(); ++ii)
+	{
+		m_lines.insert(m_lines.end(), m_chunks[ii].begin(), m_chunks[ii].end() );
+	}
+	m_chunks.clear();
+}
+
+void FilteredLineView::getLines(uint32_t _firstLine, uint32_t _lastLine, const uint32_t*& _begin, const uint32_t*& _end) const
+{
+	const uint32_t lineCount = getLineCount();
+	const uint32_t first = _firstLine < lineCount ? _firstLine : lineCount;
+	const uint32_t last = _lastLine < lineCount ? _lastLine + 1 : lineCount;
+	_begin = m_lines.empty() ? NULL : &m_lines[0] + first;
+	_end = m_lines.empty() ? NULL : &m_lines[0] + (last > first ? last : first);
+}
+
+uint32_t FilteredLineView::findViewLine(uint32_t _line) const
+{
+	return (uint32_t)(std::lower_bound(m_lines.begin(), m_lines.end(), _line) - m_lines.begin() );
+}
+
+void FilteredLineView::filterChunksJob(void* _userData, uint32_t _begin, uint32_t _end)
+{
+	FilteredLineView* view = (FilteredLineView*)_userData;
+	const uint32_t lineCount = view->m_lineIndex->getLineCount();
+	for (uint32_t ii = _begin; ii < _end; ++ii)
+	{
+		const uint32_t firstLine = view->m_firstLine + ii * FILTER_CHUNK_LINES;
+		const uint32_t lastLine = lineCount - firstLine > FILTER_CHUNK_LINES ? firstLine + FILTER_CHUNK_LINES : lineCount;
+		std::vector<uint32_t>& lines = view->m_chunks[ii];
+		lines.clear();
+		view->filterLines(firstLine, lastLine, &lines);
+	}
+}
+
+void FilteredLineView::filterLines(uint32_t _firstLine, uint32_t _lastLine, std::vector<uint32_t>* _lines) const
+{
+	const LineIndex& lineIndex = *m_lineIndex;
+	const std::string& literal = m_isRegex ? m_regex.getRequiredLiteral() : m_pattern;
+	const uint32_t length = (uint32_t)literal.size();
+
+	RegexMatcher matcher(m_regex);
+	const char* end = lineIndex.getLineEnd(_lastLine - 1);
+	for (uint32_t line = _firstLine; line < _lastLine; ++line)
+	{
+		const char* lineBegin = lineIndex.getLineBegin(line);
+		const char* lineEnd = lineIndex.getLineEnd(line);
+
+		// Skip to the next line holding the literal.
+		if (0 != length)
+		{
+			if ( (uint32_t)(end - lineBegin) < length)
+			{
+				break;
+			}
+
+			const char* hit = findLiteral(lineBegin, end - length + 1, literal.data(), length);
+			if (NULL == hit)
+			{
+				break;
+			}
+
+			while (hit > lineEnd)
+			{
+				++line;
+				lineBegin = lineIndex.getLineBegin(line);
+				lineEnd = lineIndex.getLineEnd(line);
+			}
+
+			// Found across a line feed.
+			if (hit + length > lineEnd)
+			{
+				continue;
+			}
+		}
+
+		if (!m_isRegex
+		||  matcher.isMatch(lineBegin, lineEnd) )
+		{
+			_lines->push_back(line);
+		}
+	}
+}
@@ -0,0 +1,84 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef FILTERED_LINE_VIEW_H_HEADER_GUARD
+#define FILTERED_LINE_VIEW_H_HEADER_GUARD
+
+#include <bx/bx.h>
+
+#include <string>
+#include <vector>
+
+#include "job_pool.h"
+#include "line_index.h"
+#include "regex_matcher.h"
+
+/// Lines filtered by a job, in order.
+#define FILTER_CHUNK_LINES (64 << 10)
+
+/// The lines of a text holding a substring or matching a regex, as a sorted
+/// array of line numbers. A view scrolls through it as through the lines of
+/// the whole text: view line i is document line getLine(i).
+///
+/// The lines are filtered in chunks on the workers of a job pool. Only the
+/// lines holding the literal the pattern requires are run through the regex
+/// matcher.
+class FilteredLineView
+{
+public:
+	/// @param _numThreads workers to start in addition to the calling thread
+	FilteredLineView(uint32_t _numThreads);
+
+	/// Keep the lines of _lineIndex matching _pattern, a Regex if _regex is
+	/// set or else a substring. The index must outlive the view.
+	/// @return false if the regex doesn't compile, see getError()
+	bool setFilter(const LineIndex& _lineIndex, const char* _pattern, uint32_t _length, bool _regex);
+
+	/// Filter the lines from _firstLine on, once LineIndex::append()
+	/// returned it. The lines before are kept as they are.
+	void update(uint32_t _firstLine);
+
+	/// Why the regex didn't compile, empty if it did.
+	const char* getError() const
+	{
+		return m_regex.getError();
+	}
+
+	/// Number of lines matching.
+	uint32_t getLineCount() const
+	{
+		return (uint32_t)m_lines.size();
+	}
+
+	/// Return the document line shown at _viewLine.
+	uint32_t getLine(uint32_t _viewLine) const
+	{
+		BX_CHECK(_viewLine < getLineCount(), "Invalid line");
+		return m_lines[_viewLine];
+	}
+
+	/// Return the document lines shown in the [_firstLine, _lastLine] range
+	/// of the view, clamped to its end.
+	void getLines(uint32_t _firstLine, uint32_t _lastLine, const uint32_t*& _begin, const uint32_t*& _end) const;
+
+	/// Return the first view line showing _line, or a line after it.
+	uint32_t findViewLine(uint32_t _line) const;
+
+private:
+	static void filterChunksJob(void* _userData, uint32_t _begin, uint32_t _end);
+	void filterLines(uint32_t _firstLine, uint32_t _lastLine, std::vector<uint32_t>* _lines) const;
+
+	JobPool m_jobPool;
+	const LineIndex* m_lineIndex;
+	std::string m_pattern;
+	Regex m_regex;
+	bool m_isRegex;
+	std::vector<uint32_t> m_lines;
+
+	/// lines of the chunks being filtered, from m_firstLine on
+	std::vector<std::vector<uint32_t> > m_chunks;
+	uint32_t m_firstLine;
+};
+
+#endif // FILTERED_LINE_VIEW_H_HEADER_GUARD
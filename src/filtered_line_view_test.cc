@@ -0,0 +1,112 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Checks that FilteredLineView keeps the same lines when the text is appended
+// in pieces, filtered by update(), as when it is filtered whole.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "filtered_line_view.h"
+#include "line_index.h"
+
+namespace {
+
+const uint32_t kWorkerThreads = 2;
+
+struct Filter {
+  const char* pattern;
+  bool regex;
+};
+
+const Filter kFilters[] = {
+    {"ab", false},
+    {"abca", false},
+    {"a b", false},
+    {"ab+c$", true},
+    {"^c", true},
+    {"(ab|ba)c", true},
+    {"[^ab ]{3}", true},
+};
+
+// Short lines of a few letters, many of them empty.
+std::string MakeText(uint32_t size) {
+  const char kBytes[] = "abc \n\n";
+  std::string text;
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < size; ++i) {
+    seed = seed * 1103515245 + 12345;
+    text += kBytes[(seed >> 16) % (sizeof(kBytes) - 1)];
+  }
+  return text;
+}
+
+// Lines of |line_index| holding |pattern|.
+std::vector<uint32_t> FindLines(const LineIndex& line_index,
+                                const char* pattern) {
+  std::vector<uint32_t> lines;
+  for (uint32_t i = 0; i < line_index.getLineCount(); ++i) {
+    std::string line(line_index.getLineBegin(i), line_index.getLineEnd(i));
+    if (line.find(pattern) != std::string::npos)
+      lines.push_back(i);
+  }
+  return lines;
+}
+
+std::vector<uint32_t> GetLines(const FilteredLineView& view) {
+  std::vector<uint32_t> lines;
+  for (uint32_t i = 0; i < view.getLineCount(); ++i)
+    lines.push_back(view.getLine(i));
+  return lines;
+}
+
+}  // namespace
+
+int main() {
+  // Enough lines for several chunks.
+  const std::string text = MakeText(3 * FILTER_CHUNK_LINES * 3);
+
+  LineIndex whole_index;
+  whole_index.reset(text.data(), (uint32_t)text.size());
+
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(kFilters) / sizeof(kFilters[0]); ++i) {
+    const Filter& filter = kFilters[i];
+    const uint32_t length = (uint32_t)strlen(filter.pattern);
+
+    FilteredLineView whole(kWorkerThreads);
+    whole.setFilter(whole_index, filter.pattern, length, filter.regex);
+
+    // Pieces ending mid line, growing a copy that moves as it reallocates.
+    std::string grown;
+    LineIndex grown_index;
+    grown_index.reset(grown.data(), 0);
+    FilteredLineView incremental(kWorkerThreads);
+    incremental.setFilter(grown_index, filter.pattern, length, filter.regex);
+    for (uint32_t offset = 0, piece = 7; offset < text.size();
+         offset += piece, piece = piece * 3 % 65521) {
+      grown.append(text, offset, piece);
+      incremental.update(
+          grown_index.append(grown.data(), (uint32_t)grown.size()));
+    }
+
+    if (!filter.regex &&
+        GetLines(whole) != FindLines(whole_index, filter.pattern)) {
+      fprintf(stderr, "%s: wrong lines kept\n", filter.pattern);
+      ++failures;
+    }
+    if (GetLines(incremental) != GetLines(whole)) {
+      fprintf(stderr, "%s: %u lines kept incrementally, %u whole\n",
+              filter.pattern, incremental.getLineCount(),
+              whole.getLineCount());
+      ++failures;
+    }
+  }
+
+  printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
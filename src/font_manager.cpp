@@ -8,6 +8,9 @@
 #include <edtaa3/edtaa3func.cpp>
 #include <wchar.h> // wcslen
 
+#include <algorithm> // std::lower_bound, std::sort
+#include <vector>
+
 #include <tinystl/allocator.h>
 #include <tinystl/unordered_map.h>
 namespace stl = tinystl;
@@ -50,6 +53,15 @@ public:
 	/// @ remark buffer min size: glyphInfo.m_width * glyphInfo * height * sizeof(char)
 	bool bakeGlyphDistance(CodePoint _codePoint, GlyphInfo& _outGlyphInfo, uint8_t* _outBuffer);
 
+	/// return true if the face carries kerning information
+	bool hasKerning() const;
+
+	/// return the unfitted kerning between two glyph indices in 26.6 pixels
+	int32_t getKerning(uint32_t _leftGlyphIndex, uint32_t _rightGlyphIndex);
+
+	/// return the glyph index of a code point (0 if the face doesn't have it)
+	uint32_t getGlyphIndex(CodePoint _codePoint);
+
 private:
 	FTHolder* m_font;
 };
@@ -405,20 +417,205 @@ bool TrueTypeFont::bakeGlyphDistance(CodePoint _codePoint, GlyphInfo& _glyphInfo
 	return true;
 }
 
+bool TrueTypeFont::hasKerning() const
+{
+	BX_CHECK(m_font != NULL, "TrueTypeFont not initialized");
+	return 0 != FT_HAS_KERNING(m_font->face);
+}
+
+int32_t TrueTypeFont::getKerning(uint32_t _leftGlyphIndex, uint32_t _rightGlyphIndex)
+{
+	BX_CHECK(m_font != NULL, "TrueTypeFont not initialized");
+
+	FT_Vector delta;
+	FT_Error error = FT_Get_Kerning(m_font->face, _leftGlyphIndex, _rightGlyphIndex, FT_KERNING_UNFITTED, &delta);
+	if (error)
+	{
+		return 0;
+	}
+
+	return (int32_t)delta.x;
+}
+
+uint32_t TrueTypeFont::getGlyphIndex(CodePoint _codePoint)
+{
+	BX_CHECK(m_font != NULL, "TrueTypeFont not initialized");
+	return FT_Get_Char_Index(m_font->face, _codePoint);
+}
+
+#define KERNING_ASCII_FIRST 0x20
+#define KERNING_ASCII_COUNT 96
+
+/// Kerning pairs of a TrueType face. Printable ASCII pairs are extracted
+/// once into a dense matrix, every other pair is queried lazily and kept in
+/// a table sorted by (left, right) code point.
+class KerningTable
+{
+public:
+	KerningTable(TrueTypeFont* _font);
+
+	/// return the kerning in pixels to apply between _left and _right
+	float getKerning(CodePoint _left, CodePoint _right);
+
+	/// return false if the pair isn't cached yet
+	bool findKerning(CodePoint _left, CodePoint _right, float* _kerning) const;
+
+private:
+	struct Pair
+	{
+		uint64_t key;
+		int32_t kerning;
+
+		bool operator<(const Pair& _other) const
+		{
+			return key < _other.key;
+		}
+	};
+
+	TrueTypeFont* m_font;
+	std::vector<Pair> m_pairs;
+	int16_t m_ascii[KERNING_ASCII_COUNT * KERNING_ASCII_COUNT]; // 26.6 pixels
+};
+
+KerningTable::KerningTable(TrueTypeFont* _font)
+	: m_font(_font)
+{
+	uint32_t glyphIndices[KERNING_ASCII_COUNT];
+	for (uint32_t ii = 0; ii < KERNING_ASCII_COUNT; ++ii)
+	{
+		glyphIndices[ii] = _font->getGlyphIndex(KERNING_ASCII_FIRST + ii);
+	}
+
+	for (uint32_t ii = 0; ii < KERNING_ASCII_COUNT; ++ii)
+	{
+		for (uint32_t jj = 0; jj < KERNING_ASCII_COUNT; ++jj)
+		{
+			int32_t kerning = 0;
+			if (0 != glyphIndices[ii]
+			&&  0 != glyphIndices[jj])
+			{
+				kerning = _font->getKerning(glyphIndices[ii], glyphIndices[jj]);
+			}
+
+			m_ascii[ii * KERNING_ASCII_COUNT + jj] = (int16_t)kerning;
+		}
+	}
+}
+
+float KerningTable::getKerning(CodePoint _left, CodePoint _right)
+{
+	uint32_t left = (uint32_t)_left - KERNING_ASCII_FIRST;
+	uint32_t right = (uint32_t)_right - KERNING_ASCII_FIRST;
+	if (left < KERNING_ASCII_COUNT
+	&&  right < KERNING_ASCII_COUNT)
+	{
+		return m_ascii[left * KERNING_ASCII_COUNT + right] / 64.0f;
+	}
+
+	Pair pair;
+	pair.key = ( (uint64_t)(uint32_t)_left << 32) | (uint32_t)_right;
+
+	std::vector<Pair>::iterator it = std::lower_bound(m_pairs.begin(), m_pairs.end(), pair);
+	if (it == m_pairs.end()
+	||  it->key != pair.key)
+	{
+		// Pairs without kerning are cached too, so that FreeType is queried
+		// at most once per pair.
+		uint32_t leftGlyphIndex = m_font->getGlyphIndex(_left);
+		uint32_t rightGlyphIndex = m_font->getGlyphIndex(_right);
+		pair.kerning = 0;
+		if (0 != leftGlyphIndex
+		&&  0 != rightGlyphIndex)
+		{
+			pair.kerning = m_font->getKerning(leftGlyphIndex, rightGlyphIndex);
+		}
+
+		it = m_pairs.insert(it, pair);
+	}
+
+	return it->kerning / 64.0f;
+}
+
+bool KerningTable::findKerning(CodePoint _left, CodePoint _right, float* _kerning) const
+{
+	uint32_t left = (uint32_t)_left - KERNING_ASCII_FIRST;
+	uint32_t right = (uint32_t)_right - KERNING_ASCII_FIRST;
+	if (left < KERNING_ASCII_COUNT
+	&&  right < KERNING_ASCII_COUNT)
+	{
+		*_kerning = m_ascii[left * KERNING_ASCII_COUNT + right] / 64.0f;
+		return true;
+	}
+
+	Pair pair;
+	pair.key = ( (uint64_t)(uint32_t)_left << 32) | (uint32_t)_right;
+
+	std::vector<Pair>::const_iterator it = std::lower_bound(m_pairs.begin(), m_pairs.end(), pair);
+	if (it == m_pairs.end()
+	||  it->key != pair.key)
+	{
+		return false;
+	}
+
+	*_kerning = it->kerning / 64.0f;
+	return true;
+}
+
 typedef stl::unordered_map<CodePoint, GlyphInfo> GlyphHashMap;
+typedef stl::unordered_map<CodePoint, uint32_t> EvictedGlyphHashMap;
+
+// ASCII code points, also cached in a flat page of the fonts.
+#define ASCII_GLYPH_COUNT 128
 
 // cache font data
 struct FontManager::CachedFont
 {
 	CachedFont()
 		: trueTypeFont(NULL)
+		, kerningTable(NULL)
 	{
 		masterFontHandle.idx = bx::HandleAlloc::invalid;
+		clearGlyphs();
+	}
+
+	void cacheGlyph(CodePoint _codePoint, const GlyphInfo& _glyphInfo)
+	{
+		cachedGlyphs[_codePoint] = _glyphInfo;
+		if ( (uint32_t)_codePoint < ASCII_GLYPH_COUNT)
+		{
+			asciiGlyphs[_codePoint] = _glyphInfo;
+		}
+	}
+
+	void eraseGlyph(CodePoint _codePoint)
+	{
+		cachedGlyphs.erase(cachedGlyphs.find(_codePoint) );
+		if ( (uint32_t)_codePoint < ASCII_GLYPH_COUNT)
+		{
+			asciiGlyphs[_codePoint].regionIndex = bx::HandleAlloc::invalid;
+		}
+	}
+
+	void clearGlyphs()
+	{
+		cachedGlyphs.clear();
+		for (uint32_t ii = 0; ii < ASCII_GLYPH_COUNT; ++ii)
+		{
+			asciiGlyphs[ii].regionIndex = bx::HandleAlloc::invalid;
+		}
 	}
 
 	FontInfo fontInfo;
 	GlyphHashMap cachedGlyphs;
+	// copy of the cached ASCII glyphs indexed by code point, the region of
+	// glyphs not cached is invalid
+	GlyphInfo asciiGlyphs[ASCII_GLYPH_COUNT];
+	// number of times each glyph was evicted from the atlas, to count re-bakes
+	EvictedGlyphHashMap evictedGlyphs;
 	TrueTypeFont* trueTypeFont;
+	// kerning pairs of the TrueType face, NULL for scaled fonts (they use
+	// their master's table) and faces without kerning
+	KerningTable* kerningTable;
 	// an handle to a master font in case of sub distance field font
 	FontHandle masterFontHandle;
 	int16_t padding;
@@ -433,15 +630,17 @@ FontManager::FontManager(Atlas* _atlas)
 	init();
 }
 
-FontManager::FontManager(uint32_t _textureSideWidth) 
+FontManager::FontManager(uint32_t _textureSideWidth, uint16_t _maxRegionCount)
 	: m_ownAtlas(true)
-	, m_atlas(new Atlas(_textureSideWidth) )
+	, m_atlas(new Atlas(_textureSideWidth, _maxRegionCount) )
 {
 	init();
 }
 
 void FontManager::init()
 {
+	memset(&m_glyphCacheStats, 0, sizeof(m_glyphCacheStats) );
+
 	m_cachedFiles = new CachedFile[MAX_OPENED_FILES];
 	m_cachedFonts = new CachedFont[MAX_OPENED_FONT];
 	m_buffer = new uint8_t[MAX_FONT_BUFFER_SIZE];
@@ -489,7 +688,7 @@ TrueTypeHandle FontManager::createTtf(const uint8_t* _buffer, uint32_t _size)
 void FontManager::destroyTtf(TrueTypeHandle _handle)
 {
 	BX_CHECK(bgfx::isValid(_handle), "Invalid handle used");
-	delete m_cachedFiles[_handle.idx].buffer;
+	delete [] m_cachedFiles[_handle.idx].buffer;
 	m_cachedFiles[_handle.idx].bufferSize = 0;
 	m_cachedFiles[_handle.idx].buffer = NULL;
 	m_filesHandles.free(_handle.idx);
@@ -512,10 +711,12 @@ FontHandle FontManager::createFontByPixelSize(TrueTypeHandle _ttfHandle, uint32_
 
 	CachedFont& font = m_cachedFonts[fontIdx];
 	font.trueTypeFont = ttf;
+	font.kerningTable = ttf->hasKerning() ? new KerningTable(ttf) : NULL;
 	font.fontInfo = ttf->getFontInfo();
 	font.fontInfo.fontType = _fontType;
 	font.fontInfo.pixelSize = _pixelSize;
-	font.cachedGlyphs.clear();
+	font.clearGlyphs();
+	font.evictedGlyphs.clear();
 	font.masterFontHandle.idx = bx::HandleAlloc::invalid;
 
 	FontHandle handle = { fontIdx };
@@ -542,9 +743,11 @@ FontHandle FontManager::createScaledFontToPixelSize(FontHandle _baseFontHandle,
 	BX_CHECK(fontIdx != bx::HandleAlloc::invalid, "Invalid handle used");
 
 	CachedFont& font = m_cachedFonts[fontIdx];
-	font.cachedGlyphs.clear();
+	font.clearGlyphs();
+	font.evictedGlyphs.clear();
 	font.fontInfo = newFontInfo;
 	font.trueTypeFont = NULL;
+	font.kerningTable = NULL;
 	font.masterFontHandle = _baseFontHandle;
 
 	FontHandle handle = { fontIdx };
@@ -563,7 +766,14 @@ void FontManager::destroyFont(FontHandle _handle)
 		font.trueTypeFont = NULL;
 	}
 
-	font.cachedGlyphs.clear();
+	if (font.kerningTable != NULL)
+	{
+		delete font.kerningTable;
+		font.kerningTable = NULL;
+	}
+
+	font.clearGlyphs();
+	font.evictedGlyphs.clear();
 	m_fontHandles.free(_handle.idx);
 }
 
@@ -625,9 +835,16 @@ bool FontManager::preloadGlyph(FontHandle _handle, CodePoint _codePoint)
 
 		if (!addBitmap(glyphInfo, m_buffer) )
 		{
+			++m_glyphCacheStats.failedGlyphs;
 			return false;
 		}
 
+		++m_glyphCacheStats.bakedGlyphs;
+		if (font.evictedGlyphs.find(_codePoint) != font.evictedGlyphs.end() )
+		{
+			++m_glyphCacheStats.rebakedGlyphs;
+		}
+
 		glyphInfo.advance_x = (glyphInfo.advance_x * fontInfo.scale);
 		glyphInfo.advance_y = (glyphInfo.advance_y * fontInfo.scale);
 		glyphInfo.offset_x = (glyphInfo.offset_x * fontInfo.scale);
@@ -635,7 +852,7 @@ bool FontManager::preloadGlyph(FontHandle _handle, CodePoint _codePoint)
 		glyphInfo.height = (glyphInfo.height * fontInfo.scale);
 		glyphInfo.width = (glyphInfo.width * fontInfo.scale);
 
-		font.cachedGlyphs[_codePoint] = glyphInfo;
+		font.cacheGlyph(_codePoint, glyphInfo);
 		return true;
 	}
 
@@ -652,7 +869,7 @@ bool FontManager::preloadGlyph(FontHandle _handle, CodePoint _codePoint)
 		glyphInfo.height = (glyphInfo.height * fontInfo.scale);
 		glyphInfo.width = (glyphInfo.width * fontInfo.scale);
 
-		font.cachedGlyphs[_codePoint] = glyphInfo;
+		font.cacheGlyph(_codePoint, glyphInfo);
 		return true;
 	}
 
@@ -681,11 +898,203 @@ const GlyphInfo* FontManager::getGlyphInfo(FontHandle _handle, CodePoint _codePo
 	}
 
 	BX_CHECK(it != cachedGlyphs.end(), "Failed to preload glyph.");
+	m_atlas->touchRegion(it->second.regionIndex);
 	return &it->second;
 }
 
+void FontManager::update()
+{
+	m_atlas->update();
+}
+
+bool FontManager::compactAtlas(uint32_t _regionsPerFrame)
+{
+	return m_atlas->compact(_regionsPerFrame);
+}
+
+float FontManager::getKerning(FontHandle _handle, CodePoint _left, CodePoint _right)
+{
+	BX_CHECK(bgfx::isValid(_handle), "Invalid handle used");
+	const CachedFont& font = m_cachedFonts[_handle.idx];
+
+	KerningTable* kerningTable = font.kerningTable;
+	if (isValid(font.masterFontHandle) )
+	{
+		kerningTable = m_cachedFonts[font.masterFontHandle.idx].kerningTable;
+	}
+
+	if (NULL == kerningTable)
+	{
+		return 0.0f;
+	}
+
+	return kerningTable->getKerning(_left, _right) * font.fontInfo.scale;
+}
+
+const GlyphInfo* FontManager::getAsciiGlyphInfo(FontHandle _handle, char _char)
+{
+	BX_CHECK(0 == (_char & 0x80), "Not an ASCII character");
+	const GlyphInfo& glyph = m_cachedFonts[_handle.idx].asciiGlyphs[(uint8_t)_char];
+	if (bx::HandleAlloc::invalid == glyph.regionIndex)
+	{
+		return getGlyphInfo(_handle, (CodePoint)_char);
+	}
+
+	m_atlas->touchRegion(glyph.regionIndex);
+	return &glyph;
+}
+
+const GlyphInfo* FontManager::findGlyphInfo(FontHandle _handle, CodePoint _codePoint) const
+{
+	if ( (uint32_t)_codePoint < ASCII_GLYPH_COUNT)
+	{
+		const GlyphInfo& glyph = m_cachedFonts[_handle.idx].asciiGlyphs[_codePoint];
+		return bx::HandleAlloc::invalid != glyph.regionIndex ? &glyph : NULL;
+	}
+
+	const GlyphHashMap& cachedGlyphs = m_cachedFonts[_handle.idx].cachedGlyphs;
+	GlyphHashMap::const_iterator it = cachedGlyphs.find(_codePoint);
+	if (it == cachedGlyphs.end() )
+	{
+		return NULL;
+	}
+
+	return &it->second;
+}
+
+bool FontManager::findKerning(FontHandle _handle, CodePoint _left, CodePoint _right, float* _kerning) const
+{
+	BX_CHECK(bgfx::isValid(_handle), "Invalid handle used");
+	const CachedFont& font = m_cachedFonts[_handle.idx];
+
+	const KerningTable* kerningTable = font.kerningTable;
+	if (isValid(font.masterFontHandle) )
+	{
+		kerningTable = m_cachedFonts[font.masterFontHandle.idx].kerningTable;
+	}
+
+	if (NULL == kerningTable)
+	{
+		*_kerning = 0.0f;
+		return true;
+	}
+
+	if (!kerningTable->findKerning(_left, _right, _kerning) )
+	{
+		return false;
+	}
+
+	*_kerning *= font.fontInfo.scale;
+	return true;
+}
+
+void FontManager::touchRegions(const uint32_t* _regionBits, uint32_t _numWords)
+{
+	for (uint32_t ii = 0; ii < _numWords; ++ii)
+	{
+		for (uint32_t bits = _regionBits[ii], bit = 0; 0 != bits; bits >>= 1, ++bit)
+		{
+			if (bits & 1)
+			{
+				m_atlas->touchRegion( (uint16_t)(ii * 32 + bit) );
+			}
+		}
+	}
+}
+
 bool FontManager::addBitmap(GlyphInfo& _glyphInfo, const uint8_t* _data)
 {
-	_glyphInfo.regionIndex = m_atlas->addRegion( (uint16_t) ceil(_glyphInfo.width), (uint16_t) ceil(_glyphInfo.height), _data, AtlasRegion::TYPE_GRAY);
+	uint16_t width = (uint16_t) ceil(_glyphInfo.width);
+	uint16_t height = (uint16_t) ceil(_glyphInfo.height);
+
+	_glyphInfo.regionIndex = m_atlas->addRegion(width, height, _data, AtlasRegion::TYPE_GRAY);
+	if (UINT16_MAX == _glyphInfo.regionIndex
+	&&  evictGlyphs() )
+	{
+		_glyphInfo.regionIndex = m_atlas->addRegion(width, height, _data, AtlasRegion::TYPE_GRAY);
+	}
+
+	return UINT16_MAX != _glyphInfo.regionIndex;
+}
+
+bool FontManager::evictGlyphs()
+{
+	const uint32_t frameIndex = m_atlas->getFrameIndex();
+	const uint16_t* fontHandles = m_fontHandles.getHandles();
+	const uint16_t fontCount = m_fontHandles.getNumHandles();
+
+	// Collect the regions of the baked glyphs not used during the current
+	// frame, keyed by last use so that sorting puts the coldest first.
+	std::vector<uint64_t> candidates;
+	for (uint16_t ii = 0; ii < fontCount; ++ii)
+	{
+		const CachedFont& font = m_cachedFonts[fontHandles[ii] ];
+		if (NULL == font.trueTypeFont)
+		{
+			continue;
+		}
+
+		for (GlyphHashMap::const_iterator it = font.cachedGlyphs.begin(), itEnd = font.cachedGlyphs.end(); it != itEnd; ++it)
+		{
+			uint16_t regionIndex = it->second.regionIndex;
+			uint32_t lastUse = m_atlas->getRegionLastUse(regionIndex);
+			if (lastUse != frameIndex)
+			{
+				candidates.push_back( ( (uint64_t)lastUse << 16) | regionIndex);
+			}
+		}
+	}
+
+	if (candidates.empty() )
+	{
+		return false;
+	}
+
+	std::sort(candidates.begin(), candidates.end() );
+
+	// Evict a quarter of the cold glyphs at once, so that a burst of new
+	// glyphs doesn't run a pass per glyph.
+	uint32_t evictCount = (uint32_t)candidates.size() / 4;
+	if (0 == evictCount)
+	{
+		evictCount = 1;
+	}
+
+	std::vector<bool> evicted(m_atlas->getRegionCount(), false);
+	for (uint32_t ii = 0; ii < evictCount; ++ii)
+	{
+		uint16_t regionIndex = (uint16_t)(candidates[ii] & 0xffff);
+		evicted[regionIndex] = true;
+		m_atlas->removeRegion(regionIndex);
+	}
+
+	// Drop every glyph pointing at an evicted region, including the copies
+	// held by scaled fonts.
+	std::vector<CodePoint> codePoints;
+	for (uint16_t ii = 0; ii < fontCount; ++ii)
+	{
+		CachedFont& font = m_cachedFonts[fontHandles[ii] ];
+
+		codePoints.clear();
+		for (GlyphHashMap::const_iterator it = font.cachedGlyphs.begin(), itEnd = font.cachedGlyphs.end(); it != itEnd; ++it)
+		{
+			if (evicted[it->second.regionIndex])
+			{
+				codePoints.push_back(it->first);
+			}
+		}
+
+		for (uint32_t jj = 0, num = (uint32_t)codePoints.size(); jj < num; ++jj)
+		{
+			font.eraseGlyph(codePoints[jj]);
+			if (NULL != font.trueTypeFont)
+			{
+				++font.evictedGlyphs[codePoints[jj] ];
+			}
+		}
+	}
+
+	m_glyphCacheStats.evictedGlyphs += evictCount;
+	++m_glyphCacheStats.evictionPasses;
 	return true;
 }
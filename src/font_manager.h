@@ -9,6 +9,8 @@
 #include <bx/handlealloc.h>
 #include <bgfx.h>
 
+#include "utf8.h"
+
 class Atlas;
 
 #define MAX_OPENED_FILES 64
@@ -75,9 +77,6 @@ struct FontInfo
 //              |                                   |
 //              |------------- advance_x ---------->|
 
-/// Unicode value of a character
-typedef int32_t CodePoint;
-
 /// A structure that describe a glyph.
 struct GlyphInfo
 {
@@ -113,6 +112,21 @@ struct GlyphInfo
 	uint16_t regionIndex;
 };
 
+/// Counters of the glyph cache, used to size the atlas budget.
+struct GlyphCacheStats
+{
+	/// Glyphs rasterized and added to the atlas.
+	uint32_t bakedGlyphs;
+	/// Glyphs baked again after having been evicted.
+	uint32_t rebakedGlyphs;
+	/// Glyphs evicted from the atlas to make room for new ones.
+	uint32_t evictedGlyphs;
+	/// Number of times the atlas was full and glyphs were evicted.
+	uint32_t evictionPasses;
+	/// Glyphs that couldn't be added, even after eviction.
+	uint32_t failedGlyphs;
+};
+
 BGFX_HANDLE(TrueTypeHandle);
 BGFX_HANDLE(FontHandle);
 
@@ -125,7 +139,11 @@ public:
 
 	/// Create the font manager and create the texture cube as BGRA8 with
 	/// linear filtering.
-	FontManager(uint32_t _textureSideWidth = 512);
+	///
+	/// @remark The texture size and the region count are a fixed budget:
+	///   when the atlas is full, the glyphs least recently used are evicted
+	///   and baked again when needed.
+	FontManager(uint32_t _textureSideWidth = 512, uint16_t _maxRegionCount = 4096);
 
 	~FontManager();
 
@@ -172,11 +190,51 @@ public:
 	///
 	const GlyphInfo* getGlyphInfo(FontHandle _handle, CodePoint _codePoint);
 
+	/// Same as getGlyphInfo() for an ASCII character, cached glyphs are
+	/// read from a flat page instead of the glyph hash map.
+	const GlyphInfo* getAsciiGlyphInfo(FontHandle _handle, char _char);
+
+	/// Return the horizontal kerning in pixels to apply between two
+	/// consecutive code points. Scaled fonts use their master's kerning
+	/// pairs, scaled.
+	float getKerning(FontHandle _handle, CodePoint _left, CodePoint _right);
+
+	/// Return the glyph if it is already cached, NULL otherwise. Neither
+	/// loads the glyph nor marks it as used, see touchRegions().
+	///
+	/// @remark safe to call from several threads while no glyph is loaded.
+	const GlyphInfo* findGlyphInfo(FontHandle _handle, CodePoint _codePoint) const;
+
+	/// Return false if the kerning of the pair isn't cached yet, getKerning()
+	/// caches it. Same thread safety as findGlyphInfo().
+	bool findKerning(FontHandle _handle, CodePoint _left, CodePoint _right, float* _kerning) const;
+
+	/// Mark as used during the current frame the atlas regions set in a bit
+	/// set of region handles, 32 per word.
+	void touchRegions(const uint32_t* _regionBits, uint32_t _numWords);
+
 	const GlyphInfo& getBlackGlyph() const
 	{
 		return m_blackGlyph;
 	}
 
+	/// Upload the glyphs baked during the frame and advance the glyph cache
+	/// to the next frame. Glyphs used during the current frame are never
+	/// evicted. Call once per frame, before bgfx::frame().
+	void update();
+
+	/// Start an incremental compaction of the atlas, reclaiming the space
+	/// lost to evictions. It progresses on each update().
+	///
+	/// @return false if the atlas has no room to re-pack into.
+	bool compactAtlas(uint32_t _regionsPerFrame = 64);
+
+	/// Return the glyph cache counters.
+	const GlyphCacheStats& getGlyphCacheStats() const
+	{
+		return m_glyphCacheStats;
+	}
+
 private:
 	struct CachedFont;
 	struct CachedFile
@@ -187,6 +245,7 @@ private:
 
 	void init();
 	bool addBitmap(GlyphInfo& _glyphInfo, const uint8_t* _data);
+	bool evictGlyphs();
 
 	bool m_ownAtlas;
 	Atlas* m_atlas;
@@ -198,6 +257,7 @@ private:
 	CachedFile* m_cachedFiles;
 
 	GlyphInfo m_blackGlyph;
+	GlyphCacheStats m_glyphCacheStats;
 
 	//temporary buffer to raster glyph
 	uint8_t* m_buffer;
@@ -0,0 +1,32 @@
+$input v_color0, v_texcoord0
+
+#include "common.sh"
+
+// x: 1.0/page capacity, y: page size in texels, z: page capacity.
+uniform vec4 u_atlasPages;
+
+SAMPLER2D(u_texColor, 0);
+
+void main()
+{
+	vec2 dx2 = dFdx(v_texcoord0.xy);
+	vec2 dy2 = dFdy(v_texcoord0.xy);
+	vec2 decal = 0.166667 * dx2;
+	vec2 sampleLeft = v_texcoord0.xy - decal;
+	vec2 sampleRight = v_texcoord0.xy + decal;
+
+	float left_dist = texture2D(u_texColor, sampleLeft).x;
+	float right_dist = texture2D(u_texColor, sampleRight).x;
+
+	float dist = 0.5 * (left_dist + right_dist);
+
+	// Same edge width as the cube shader, measured in page texels.
+	vec2 texels = vec2(u_atlasPages.y, u_atlasPages.y * u_atlasPages.z);
+	float dx = length(dx2 * texels);
+	float dy = length(dy2 * texels);
+	float w = 16.0*(dx+dy)/u_atlasPages.y;
+
+	vec3 sub_color = smoothstep(0.5 - w, 0.5 + w, vec3(left_dist, dist, right_dist));
+	gl_FragColor.xyz = sub_color*v_color0.w;
+	gl_FragColor.w = dist * v_color0.w;
+}
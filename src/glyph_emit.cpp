@@ -0,0 +1,147 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stddef.h> // offsetof
+#include <memory.h> // memcpy, memset
+
+#include "glyph_emit.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define GLYPH_EMIT_SSE2 1
+#else
+#	define GLYPH_EMIT_SSE2 0
+#endif // SSE2
+
+// The SSE2 path loads width, height, offset_x and offset_y with one load.
+BX_STATIC_ASSERT(offsetof(GlyphInfo, height) == offsetof(GlyphInfo, width) + 4);
+BX_STATIC_ASSERT(offsetof(GlyphInfo, offset_x) == offsetof(GlyphInfo, width) + 8);
+BX_STATIC_ASSERT(offsetof(GlyphInfo, offset_y) == offsetof(GlyphInfo, width) + 12);
+BX_STATIC_ASSERT(sizeof(GlyphVertex) == 20);
+BX_STATIC_ASSERT(sizeof(AtlasRegionUV) == 32);
+
+static void emitGlyphQuad(const GlyphRun& _run, uint32_t _idx, const AtlasRegionUV* _regionUVs, GlyphVertex* _vertices, uint8_t* _styles, uint32_t* _quadRegions)
+{
+	const GlyphInfo& glyph = *_run.glyphs[_idx];
+	const AtlasRegionUV& uv = _regionUVs[glyph.regionIndex];
+
+	float x0 = _run.penX[_idx] + glyph.offset_x;
+	float y0 = _run.baselineY + glyph.offset_y;
+	float x1 = x0 + glyph.width;
+	float y1 = y0 + glyph.height;
+
+	GlyphVertex* vertex = &_vertices[_idx * 4];
+	vertex[0].x = x0; vertex[0].y = y0;
+	vertex[1].x = x0; vertex[1].y = y1;
+	vertex[2].x = x1; vertex[2].y = y1;
+	vertex[3].x = x1; vertex[3].y = y0;
+
+	for (uint32_t ii = 0; ii < 4; ++ii)
+	{
+		memcpy(&vertex[ii].u, uv.xyzw[ii], sizeof(uv.xyzw[ii]) );
+		vertex[ii].rgba = _run.rgba;
+	}
+
+	memset(&_styles[_idx * 4], 0, 4);
+	_quadRegions[_idx] = glyph.regionIndex;
+}
+
+void emitGlyphQuadsScalar(const GlyphRun& _run, const AtlasRegionUV* _regionUVs, GlyphVertex* _vertices, uint8_t* _styles, uint32_t* _quadRegions)
+{
+	for (uint32_t ii = 0; ii < _run.count; ++ii)
+	{
+		emitGlyphQuad(_run, ii, _regionUVs, _vertices, _styles, _quadRegions);
+	}
+}
+
+#if GLYPH_EMIT_SSE2
+// Write the four vertices of a quad, 80 bytes, with five unaligned stores.
+// _pos is (x0, y0, x1, y1) and _rgba the color in every lane. The UVs are
+// only moved around by the shuffles, never used as floats.
+static inline void storeQuadSse(float* _dst, __m128 _pos, __m128 _rgba, const AtlasRegionUV& _uv)
+{
+	const __m128 uv01 = _mm_loadu_ps( (const float*)_uv.xyzw[0]); // uv0 uv0 uv1 uv1
+	const __m128 uv23 = _mm_loadu_ps( (const float*)_uv.xyzw[2]); // uv2 uv2 uv3 uv3
+
+	// x0 y0 uv0 uv0
+	const __m128 s0 = _mm_shuffle_ps(_pos, uv01, _MM_SHUFFLE(1, 0, 1, 0) );
+
+	// rgba x0 y1 uv1
+	const __m128 cx0 = _mm_unpacklo_ps(_rgba, _pos);
+	const __m128 y1uv1 = _mm_shuffle_ps(_pos, uv01, _MM_SHUFFLE(2, 2, 3, 3) );
+	const __m128 s1 = _mm_shuffle_ps(cx0, y1uv1, _MM_SHUFFLE(2, 0, 1, 0) );
+
+	// uv1 rgba x1 y1
+	const __m128 uv1c = _mm_shuffle_ps(uv01, _rgba, _MM_SHUFFLE(0, 0, 3, 3) );
+	const __m128 s2 = _mm_shuffle_ps(uv1c, _pos, _MM_SHUFFLE(3, 2, 2, 0) );
+
+	// uv2 uv2 rgba x1
+	const __m128 cx1 = _mm_unpackhi_ps(_rgba, _pos);
+	const __m128 s3 = _mm_shuffle_ps(uv23, cx1, _MM_SHUFFLE(1, 0, 1, 0) );
+
+	// y0 uv3 uv3 rgba
+	const __m128 y0uv3 = _mm_shuffle_ps(_pos, uv23, _MM_SHUFFLE(2, 2, 1, 1) );
+	const __m128 uv3c = _mm_shuffle_ps(uv23, _rgba, _MM_SHUFFLE(0, 0, 3, 3) );
+	const __m128 s4 = _mm_shuffle_ps(y0uv3, uv3c, _MM_SHUFFLE(2, 0, 2, 0) );
+
+	_mm_storeu_ps(_dst +  0, s0);
+	_mm_storeu_ps(_dst +  4, s1);
+	_mm_storeu_ps(_dst +  8, s2);
+	_mm_storeu_ps(_dst + 12, s3);
+	_mm_storeu_ps(_dst + 16, s4);
+}
+
+// (x0, y0, x1, y1) of a glyph, _pen is (pen x, baseline y, pen x, baseline y).
+static inline __m128 glyphPosSse(__m128 _pen, const GlyphInfo& _glyph)
+{
+	const __m128 metrics = _mm_loadu_ps(&_glyph.width);                              // w h ox oy
+	const __m128 offset = _mm_shuffle_ps(metrics, metrics, _MM_SHUFFLE(3, 2, 3, 2) ); // ox oy ox oy
+	const __m128 size = _mm_movelh_ps(_mm_setzero_ps(), metrics);                    // 0 0 w h
+	return _mm_add_ps(_mm_add_ps(_pen, offset), size);
+}
+#endif // GLYPH_EMIT_SSE2
+
+void emitGlyphQuads(const GlyphRun& _run, const AtlasRegionUV* _regionUVs, GlyphVertex* _vertices, uint8_t* _styles, uint32_t* _quadRegions)
+{
+	uint32_t ii = 0;
+
+#if GLYPH_EMIT_SSE2
+	const __m128 rgba = _mm_castsi128_ps(_mm_set1_epi32( (int32_t)_run.rgba) );
+	const __m128 baseline = _mm_set1_ps(_run.baselineY);
+	const __m128i styles = _mm_setzero_si128();
+
+	// Four glyphs per iteration, the pen positions are loaded together.
+	for (uint32_t num = _run.count & ~3; ii < num; ii += 4)
+	{
+		const GlyphInfo& glyph0 = *_run.glyphs[ii + 0];
+		const GlyphInfo& glyph1 = *_run.glyphs[ii + 1];
+		const GlyphInfo& glyph2 = *_run.glyphs[ii + 2];
+		const GlyphInfo& glyph3 = *_run.glyphs[ii + 3];
+
+		const __m128 penX = _mm_loadu_ps(&_run.penX[ii]);
+		const __m128 pen0 = _mm_unpacklo_ps(_mm_shuffle_ps(penX, penX, _MM_SHUFFLE(0, 0, 0, 0) ), baseline);
+		const __m128 pen1 = _mm_unpacklo_ps(_mm_shuffle_ps(penX, penX, _MM_SHUFFLE(1, 1, 1, 1) ), baseline);
+		const __m128 pen2 = _mm_unpacklo_ps(_mm_shuffle_ps(penX, penX, _MM_SHUFFLE(2, 2, 2, 2) ), baseline);
+		const __m128 pen3 = _mm_unpacklo_ps(_mm_shuffle_ps(penX, penX, _MM_SHUFFLE(3, 3, 3, 3) ), baseline);
+
+		float* dst = (float*)&_vertices[ii * 4];
+		storeQuadSse(dst +  0, glyphPosSse(pen0, glyph0), rgba, _regionUVs[glyph0.regionIndex]);
+		storeQuadSse(dst + 20, glyphPosSse(pen1, glyph1), rgba, _regionUVs[glyph1.regionIndex]);
+		storeQuadSse(dst + 40, glyphPosSse(pen2, glyph2), rgba, _regionUVs[glyph2.regionIndex]);
+		storeQuadSse(dst + 60, glyphPosSse(pen3, glyph3), rgba, _regionUVs[glyph3.regionIndex]);
+
+		_mm_storeu_si128( (__m128i*)&_styles[ii * 4], styles);
+
+		_quadRegions[ii + 0] = glyph0.regionIndex;
+		_quadRegions[ii + 1] = glyph1.regionIndex;
+		_quadRegions[ii + 2] = glyph2.regionIndex;
+		_quadRegions[ii + 3] = glyph3.regionIndex;
+	}
+#endif // GLYPH_EMIT_SSE2
+
+	for (; ii < _run.count; ++ii)
+	{
+		emitGlyphQuad(_run, ii, _regionUVs, _vertices, _styles, _quadRegions);
+	}
+}
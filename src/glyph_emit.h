@@ -0,0 +1,42 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef GLYPH_EMIT_H_HEADER_GUARD
+#define GLYPH_EMIT_H_HEADER_GUARD
+
+#include "font_manager.h"
+#include "cube_atlas.h"
+
+/// Glyphs resolved by the text buffers, emitted by the run at most.
+#define MAX_GLYPH_RUN 64
+
+/// Vertex of the text buffers, four per quad.
+struct GlyphVertex
+{
+	float x, y;
+	int16_t u, v, w, t;
+	uint32_t rgba;
+};
+
+/// Glyphs of a line sharing a color, without decorations.
+struct GlyphRun
+{
+	const GlyphInfo* const* glyphs; //< resolved glyphs
+	const float* penX;              //< pen position of each glyph, advances and kerning included
+	uint32_t count;
+	float baselineY;                //< pen y + line ascender
+	uint32_t rgba;                  //< ABGR
+};
+
+/// Write one quad per glyph of the run: four vertices, a style byte per
+/// vertex and the atlas region of the quad. Uses SSE2 when available, the
+/// output is the same as emitGlyphQuadsScalar().
+///
+/// @param _regionUVs UVs of the atlas regions, see Atlas::getRegionUVBuffer()
+void emitGlyphQuads(const GlyphRun& _run, const AtlasRegionUV* _regionUVs, GlyphVertex* _vertices, uint8_t* _styles, uint32_t* _quadRegions);
+
+/// Portable version of emitGlyphQuads().
+void emitGlyphQuadsScalar(const GlyphRun& _run, const AtlasRegionUV* _regionUVs, GlyphVertex* _vertices, uint8_t* _styles, uint32_t* _quadRegions);
+
+#endif // GLYPH_EMIT_H_HEADER_GUARD
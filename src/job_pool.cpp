@@ -0,0 +1,113 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "job_pool.h"
+
+JobPool::JobPool(uint32_t _numThreads)
+	: m_threads(NULL)
+	, m_numThreads(_numThreads)
+	, m_fn(NULL)
+	, m_userData(NULL)
+	, m_count(0)
+	, m_batchSize(1)
+	, m_next(0)
+	, m_quit(false)
+{
+	if (0 == m_numThreads)
+	{
+		return;
+	}
+
+	m_threads = new bx::Thread[m_numThreads];
+	for (uint32_t ii = 0; ii < m_numThreads; ++ii)
+	{
+		m_threads[ii].init(workerFunc, this);
+	}
+}
+
+JobPool::~JobPool()
+{
+	m_quit = true;
+	m_workSem.post(m_numThreads);
+
+	for (uint32_t ii = 0; ii < m_numThreads; ++ii)
+	{
+		m_threads[ii].shutdown();
+	}
+
+	delete [] m_threads;
+}
+
+void JobPool::parallelFor(uint32_t _count, uint32_t _batchSize, JobFn _fn, void* _userData)
+{
+	BX_CHECK(0 != _batchSize, "_batchSize must be > 0");
+
+	if (0 == _count)
+	{
+		return;
+	}
+
+	// Not worth waking the workers up for a single batch.
+	if (0 == m_numThreads
+	||  _count <= _batchSize)
+	{
+		_fn(_userData, 0, _count);
+		return;
+	}
+
+	m_fn = _fn;
+	m_userData = _userData;
+	m_count = _count;
+	m_batchSize = _batchSize;
+	m_next = 0;
+
+	// The semaphores order these writes before the workers read them.
+	m_workSem.post(m_numThreads);
+	runBatches();
+
+	for (uint32_t ii = 0; ii < m_numThreads; ++ii)
+	{
+		m_doneSem.wait();
+	}
+
+	m_fn = NULL;
+	m_userData = NULL;
+}
+
+void JobPool::runBatches()
+{
+	for (;;)
+	{
+		uint32_t begin;
+		{
+			bx::MutexScope lock(m_mutex);
+			begin = m_next;
+			m_next = begin < m_count ? begin + m_batchSize : m_count;
+		}
+
+		if (begin >= m_count)
+		{
+			return;
+		}
+
+		uint32_t end = begin + m_batchSize;
+		m_fn(m_userData, begin, end < m_count ? end : m_count);
+	}
+}
+
+int32_t JobPool::workerFunc(void* _userData)
+{
+	JobPool* pool = (JobPool*)_userData;
+	for (;;)
+	{
+		pool->m_workSem.wait();
+		if (pool->m_quit)
+		{
+			return 0;
+		}
+
+		pool->runBatches();
+		pool->m_doneSem.post();
+	}
+}
@@ -0,0 +1,57 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef JOB_POOL_H_HEADER_GUARD
+#define JOB_POOL_H_HEADER_GUARD
+
+#include <bx/bx.h>
+#include <bx/mutex.h>
+#include <bx/sem.h>
+#include <bx/thread.h>
+
+/// Worker threads running data parallel loops. The calling thread takes part
+/// in the work and parallelFor() only returns once every item is processed,
+/// so jobs can use the caller's stack.
+class JobPool
+{
+public:
+	/// process [_begin, _end) of the items of a parallelFor()
+	typedef void (*JobFn)(void* _userData, uint32_t _begin, uint32_t _end);
+
+	/// @param numThreads worker threads to start, in addition to the
+	///   thread calling parallelFor()
+	JobPool(uint32_t _numThreads);
+	~JobPool();
+
+	/// split [0, _count) in batches of _batchSize items and run _fn on all
+	/// of them, then wait for completion
+	/// @remark not reentrant, jobs must not call parallelFor()
+	void parallelFor(uint32_t _count, uint32_t _batchSize, JobFn _fn, void* _userData);
+
+	/// return the number of threads running jobs, including the caller
+	uint32_t getThreadCount() const
+	{
+		return m_numThreads + 1;
+	}
+
+private:
+	static int32_t workerFunc(void* _userData);
+	void runBatches();
+
+	bx::Thread* m_threads;
+	uint32_t m_numThreads;
+
+	bx::Semaphore m_workSem; //< one post per worker for each parallelFor()
+	bx::Semaphore m_doneSem; //< one post per worker once it ran out of batches
+	bx::Mutex m_mutex;       //< guards m_next
+
+	JobFn m_fn;
+	void* m_userData;
+	uint32_t m_count;
+	uint32_t m_batchSize;
+	uint32_t m_next;
+	bool m_quit;
+};
+
+#endif // JOB_POOL_H_HEADER_GUARD
@@ -0,0 +1,58 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "line_index.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+LineIndex::LineIndex()
+	: m_text(NULL)
+	, m_size(0)
+{
+	m_lineStarts.push_back(0);
+}
+
+void LineIndex::reset(const char* _text, uint32_t _size)
+{
+	m_text = _text;
+	m_size = _size;
+	m_lineStarts.clear();
+	m_lineStarts.push_back(0);
+	indexLines(0);
+}
+
+uint32_t LineIndex::append(const char* _text, uint32_t _size)
+{
+	BX_CHECK(_size >= m_size, "The text can only grow");
+	uint32_t begin = m_size;
+	uint32_t lastLine = getLineCount() - 1;
+	m_text = _text;
+	m_size = _size;
+	indexLines(begin);
+	return lastLine;
+}
+
+uint32_t LineIndex::findLine(uint32_t _offset) const
+{
+	// Last line starting at or before _offset.
+	std::vector<uint32_t>::const_iterator it = std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), _offset);
+	return (uint32_t)(it - m_lineStarts.begin() ) - 1;
+}
+
+void LineIndex::indexLines(uint32_t _begin)
+{
+	const char* end = m_text + m_size;
+	for (const char* str = m_text + _begin; str < end; ++str)
+	{
+		str = (const char*)memchr(str, '\n', end - str);
+		if (NULL == str)
+		{
+			break;
+		}
+
+		m_lineStarts.push_back( (uint32_t)(str + 1 - m_text) );
+	}
+}
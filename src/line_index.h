@@ -0,0 +1,73 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LINE_INDEX_H_HEADER_GUARD
+#define LINE_INDEX_H_HEADER_GUARD
+
+#include <bx/bx.h>
+
+#include <vector>
+
+/// Offsets of the lines of a text, for random access to any line without
+/// scanning the text from its beginning. The text isn't copied and must
+/// outlive the index, or be given again when it moves. Offsets are 32 bit,
+/// texts are less than 4 GiB.
+class LineIndex
+{
+public:
+	LineIndex();
+
+	/// Index the lines of [_text, _text + _size).
+	void reset(const char* _text, uint32_t _size);
+
+	/// Index the bytes added at the end of the text. _text is the whole
+	/// text, it may have moved since the previous call.
+	/// @return first line modified, the last line of the text may continue.
+	uint32_t append(const char* _text, uint32_t _size);
+
+	/// Number of lines, a text without line feed has one line.
+	uint32_t getLineCount() const
+	{
+		return (uint32_t)m_lineStarts.size();
+	}
+
+	/// First byte of a line.
+	const char* getLineBegin(uint32_t _line) const
+	{
+		BX_CHECK(_line < getLineCount(), "Invalid line");
+		return m_text + m_lineStarts[_line];
+	}
+
+	/// End of a line, on its line feed.
+	const char* getLineEnd(uint32_t _line) const
+	{
+		BX_CHECK(_line < getLineCount(), "Invalid line");
+		return _line + 1 < getLineCount()
+			? m_text + m_lineStarts[_line + 1] - 1
+			: m_text + m_size
+			;
+	}
+
+	/// Return the line holding the byte at _offset.
+	uint32_t findLine(uint32_t _offset) const;
+
+	const char* getText() const
+	{
+		return m_text;
+	}
+
+	uint32_t getSize() const
+	{
+		return m_size;
+	}
+
+private:
+	void indexLines(uint32_t _begin);
+
+	const char* m_text;
+	uint32_t m_size;
+	std::vector<uint32_t> m_lineStarts;
+};
+
+#endif // LINE_INDEX_H_HEADER_GUARD
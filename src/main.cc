@@ -4,13 +4,23 @@
 #include <bx/timer.h>
 #include "fpumath.h"
 
-#include "font/font_manager.h"
-#include "font/text_metrics.h"
-#include "font/text_buffer_manager.h"
+#include "cube_atlas.h"
+#include "ansi_parser.h"
+#include "filtered_line_view.h"
+#include "font_manager.h"
+#include "job_pool.h"
+#include "line_index.h"
+#include "syntax_highlighter.h"
+#include "text_metrics.h"
+#include "text_buffer_manager.h"
+#include "text_search.h"
 
 #include <stdio.h>
 #include <string.h>
 
+#include <string>
+#include <vector>
+
 #include "system.h"
 
 float Slide(float to, float current, float rate = 0.08) {
@@ -19,6 +29,189 @@ float Slide(float to, float current, float rate = 0.08) {
   return current;
 }
 
+// Lines the highlighter caches the state of each frame, ahead of scrolling.
+const uint32_t kHighlightLinesPerFrame = 4096;
+
+// Threads searching the text, in addition to the search thread.
+const uint32_t kSearchWorkerThreads = 3;
+
+// Background of the search matches.
+const uint32_t kSearchHighlightColor = 0x073642ff;
+
+// Threads filtering the lines, in addition to the main thread.
+const uint32_t kFilterWorkerThreads = 3;
+
+// Threads laying out the visible text, in addition to the main thread.
+const uint32_t kLayoutWorkerThreads = 3;
+
+// Solarized dark.
+void SetHighlightColors(SyntaxHighlighter* highlighter) {
+  highlighter->setColor(TokenType::Default, 0x839496ff);
+  highlighter->setColor(TokenType::Keyword, 0x859900ff);
+  highlighter->setColor(TokenType::Type, 0xb58900ff);
+  highlighter->setColor(TokenType::Number, 0xd33682ff);
+  highlighter->setColor(TokenType::String, 0x2aa198ff);
+  highlighter->setColor(TokenType::Comment, 0x586e75ff);
+  highlighter->setColor(TokenType::Preprocessor, 0xcb4b16ff);
+}
+
+// Returns the offset of the first byte of |line| in the text, or the size
+// of the text past its last line.
+uint32_t GetLineOffset(const LineIndex& line_index, uint32_t line) {
+  if (line >= line_index.getLineCount())
+    return line_index.getSize();
+  return (uint32_t)(line_index.getLineBegin(line) - line_index.getText());
+}
+
+// Returns the line of the text shown at |view_line|, every line is shown
+// unless |filter| is set. Past the end of the view, returns the line count.
+uint32_t GetDocumentLine(const LineIndex& line_index,
+                         const FilteredLineView* filter,
+                         uint32_t view_line) {
+  if (NULL == filter)
+    return view_line;
+  if (view_line >= filter->getLineCount())
+    return line_index.getLineCount();
+  return filter->getLine(view_line);
+}
+
+// The visible lines and their style runs, for
+// TextBufferManager::appendLines().
+struct VisibleLines {
+  std::vector<TextLine> lines;
+  std::vector<StyleRun> runs;
+  // Index in |runs| of the first run of each line.
+  std::vector<uint32_t> first_runs;
+  // Runs of lines [first_line, first_line + num_lines), line feeds included.
+  std::vector<StyleRun> text_runs;
+};
+
+// Returns in |visible->text_runs| the runs of lines [first_line,
+// first_line + num_lines), with the colors of their escape sequences when
+// |ansi_parser| is set, or else colored by the highlighter, and the matches
+// of |search| highlighted. Returns false when the colors are a guess, until
+// the highlighter caught up with the first line.
+bool GetTextRuns(const LineIndex& line_index,
+                 const AnsiParser* ansi_parser,
+                 SyntaxHighlighter* highlighter,
+                 const TextSearch& search,
+                 uint32_t first_line,
+                 uint32_t num_lines,
+                 VisibleLines* visible) {
+  bool exact = true;
+  if (NULL != ansi_parser) {
+    ansi_parser->getRuns(first_line, num_lines, &visible->text_runs);
+  } else {
+    exact =
+        highlighter->highlightLines(first_line, num_lines, &visible->text_runs);
+  }
+  search.highlightMatches(GetLineOffset(line_index, first_line),
+                          kSearchHighlightColor,
+                          &visible->text_runs);
+  return exact;
+}
+
+// Adds lines [first_line, first_line + num_lines) to |visible|, with
+// |visible->text_runs| cut at their line feeds.
+void AddLines(const LineIndex& line_index,
+              uint32_t first_line,
+              uint32_t num_lines,
+              VisibleLines* visible) {
+  const std::vector<StyleRun>& text_runs = visible->text_runs;
+  const char* text = line_index.getLineBegin(first_line);
+  size_t run = 0;
+  uint32_t run_begin = 0;
+  const uint32_t end_line = first_line + num_lines < line_index.getLineCount()
+                                ? first_line + num_lines
+                                : line_index.getLineCount();
+  for (uint32_t line = first_line; line < end_line; ++line) {
+    TextLine text_line;
+    text_line.begin = line_index.getLineBegin(line);
+    text_line.end = line_index.getLineEnd(line);
+    text_line.runs = NULL;
+    text_line.numRuns = 0;
+    const uint32_t begin = (uint32_t)(text_line.begin - text);
+    const uint32_t end = (uint32_t)(text_line.end - text);
+
+    while (run < text_runs.size() &&
+           run_begin + text_runs[run].length <= begin) {
+      run_begin += text_runs[run].length;
+      ++run;
+    }
+    visible->first_runs.push_back((uint32_t)visible->runs.size());
+    uint32_t piece_begin = begin;
+    for (size_t i = run, i_begin = run_begin;
+         i < text_runs.size() && piece_begin < end;
+         i_begin += text_runs[i].length, ++i) {
+      const uint32_t i_end = (uint32_t)i_begin + text_runs[i].length;
+      const uint32_t piece_end = i_end < end ? i_end : end;
+      if (piece_end <= piece_begin)
+        continue;
+      StyleRun piece = text_runs[i];
+      piece.length = piece_end - piece_begin;
+      visible->runs.push_back(piece);
+      ++text_line.numRuns;
+      piece_begin = piece_end;
+    }
+    // The last run stretches over the rest of the line, as appendRuns() would
+    // draw it.
+    if (0 != text_line.numRuns)
+      visible->runs.back().length += end - piece_begin;
+    visible->lines.push_back(text_line);
+  }
+}
+
+// Appends the lines shown at [first_line, first_line + num_lines) of the view,
+// the lines kept by |filter| when it is set, laid out on |job_pool|. Returns
+// false when the colors are a guess, see GetTextRuns().
+bool AppendVisibleLines(TextBufferManager* text_buffer_manager,
+                        TextBufferHandle buffer,
+                        FontHandle font,
+                        const LineIndex& line_index,
+                        const AnsiParser* ansi_parser,
+                        SyntaxHighlighter* highlighter,
+                        const TextSearch& search,
+                        const FilteredLineView* filter,
+                        uint32_t first_line,
+                        uint32_t num_lines,
+                        JobPool* job_pool,
+                        VisibleLines* visible) {
+  visible->lines.clear();
+  visible->runs.clear();
+  visible->first_runs.clear();
+
+  bool exact = true;
+  if (NULL == filter) {
+    if (first_line < line_index.getLineCount()) {
+      exact = GetTextRuns(line_index, ansi_parser, highlighter, search,
+                          first_line, num_lines, visible);
+      AddLines(line_index, first_line, num_lines, visible);
+    }
+  } else {
+    const uint32_t* begin;
+    const uint32_t* end;
+    filter->getLines(first_line, first_line + num_lines - 1, begin, end);
+    for (const uint32_t* line = begin; line != end; ++line) {
+      exact &= GetTextRuns(line_index, ansi_parser, highlighter, search,
+                           *line, 1, visible);
+      AddLines(line_index, *line, 1, visible);
+    }
+  }
+
+  if (visible->lines.empty())
+    return exact;
+  for (size_t i = 0; i < visible->lines.size(); ++i) {
+    if (0 != visible->lines[i].numRuns)
+      visible->lines[i].runs = &visible->runs[visible->first_runs[i]];
+  }
+  text_buffer_manager->appendLines(buffer,
+                                   font,
+                                   &visible->lines[0],
+                                   (uint32_t)visible->lines.size(),
+                                   job_pool);
+  return exact;
+}
+
 long int fsize(FILE* _file) {
   long int pos = ftell(_file);
   fseek(_file, 0L, SEEK_END);
@@ -30,7 +223,15 @@ long int fsize(FILE* _file) {
 static char* loadText(const char* _filePath) {
   FILE* file = fopen(_filePath, "rb");
   if (NULL != file) {
-    uint32_t size = (uint32_t)fsize(file);
+    // Text offsets are 32 bit, from the line index to the search matches.
+    long int fileSize = fsize(file);
+    if (fileSize < 0 || (uint64_t)fileSize >= UINT32_MAX) {
+      fprintf(stderr, "%s is too large, texts are limited to 4 GiB\n",
+              _filePath);
+      fclose(file);
+      return NULL;
+    }
+    uint32_t size = (uint32_t)fileSize;
     char* mem = (char*)malloc(size + 1);
     size_t ignore = fread(mem, 1, size, file);
     BX_UNUSED(ignore);
@@ -67,6 +268,41 @@ static float s_scale = 1.f;
 static float s_text_scroll = 0;
 static bool s_exit = false;
 
+// Search prompt, opened by Ctrl+F and closed by Esc. Return jumps to the next
+// match, Ctrl+R switches between substring and regex search.
+static bool s_search_prompt = false;
+static bool s_search_regex = false;
+static std::string s_search_pattern;
+static bool s_search_changed = false;
+static bool s_search_next = false;
+
+// Ctrl+G shows only the lines matching the search pattern, or every line
+// again.
+static bool s_filter_toggled = false;
+
+void EditSearchPattern(Key::Enum key) {
+  size_t length = s_search_pattern.size();
+  if (key >= Key::KeyA && key <= Key::KeyZ) {
+    s_search_pattern += (char)('a' + (key - Key::KeyA));
+  } else if (key >= Key::Key0 && key <= Key::Key9) {
+    s_search_pattern += (char)('0' + (key - Key::Key0));
+  } else if (key == Key::Space) {
+    s_search_pattern += ' ';
+  } else if (key == Key::Minus) {
+    s_search_pattern += '-';
+  } else if (key == Key::Plus) {
+    s_search_pattern += '+';
+  } else if (key == Key::Backspace && length > 0) {
+    s_search_pattern.erase(length - 1);
+  } else if (key == Key::Return) {
+    s_search_next = true;
+  } else if (key == Key::Esc) {
+    s_search_prompt = false;
+    s_search_pattern.clear();
+  }
+  s_search_changed |= length != s_search_pattern.size();
+}
+
 bool ProcessEvents(uint32_t& _width,
                    uint32_t& _height,
                    uint32_t& _debug,
@@ -94,10 +330,20 @@ bool ProcessEvents(uint32_t& _width,
 
         case Event::Key: {
           const KeyEvent* key = static_cast<const KeyEvent*>(ev);
-          if (key->key == Key::Key0 &&
-                     (key->modifiers &
-                      (Modifier::LeftCtrl | Modifier::RightCtrl))) {
+          const bool ctrl = 0 != (key->modifiers &
+                                  (Modifier::LeftCtrl | Modifier::RightCtrl));
+          if (key->key == Key::Key0 && ctrl) {
             s_scale_target = 1.f;
+          } else if (key->key == Key::KeyF && ctrl) {
+            s_search_prompt = true;
+          } else if (key->key == Key::KeyR && ctrl && key->down) {
+            s_search_prompt = true;
+            s_search_regex = !s_search_regex;
+            s_search_changed = true;
+          } else if (key->key == Key::KeyG && ctrl && key->down) {
+            s_filter_toggled = true;
+          } else if (s_search_prompt && key->down) {
+            EditSearchPattern(key->key);
           }
         } break;
 
@@ -139,7 +385,24 @@ bool ProcessEvents(uint32_t& _width,
   return s_exit;
 }
 
-int RealMain(int /*_argc*/, char** /*_argv*/) {
+int RealMain(int argc, char** argv) {
+  const char* textPath = argc > 1 ? argv[1] : "src/main.cc";
+  char* bigText = loadText(textPath);
+  if (NULL == bigText) {
+    fprintf(stderr, "Can't read %s\n", textPath);
+    return 1;
+  }
+
+  // A regex to search from the start. Typed patterns are limited to the keys
+  // the prompt handles.
+  if (argc > 2) {
+    s_search_prompt = true;
+    s_search_regex = true;
+    s_search_pattern = argv[2];
+    s_search_changed = true;
+  }
+
+
   uint32_t width = 1280;
   uint32_t height = 720;
   uint32_t debug = BGFX_DEBUG_TEXT;
@@ -158,10 +421,12 @@ int RealMain(int /*_argc*/, char** /*_argv*/) {
   //bgfx::setViewClear(
       //0, BGFX_CLEAR_COLOR_BIT | BGFX_CLEAR_DEPTH_BIT, 0x000000ff, 1.0f, 0);
 
-  char* bigText = loadText("src/main.cc");
-
   // Init the text rendering system.
-  FontManager* fontManager = new FontManager(512);
+  // Glyphs are single channel distance fields: use R8 pages, which take a
+  // quarter of the memory and upload bandwidth of the BGRA8 cube. Start
+  // small, the atlas adds pages then doubles them as glyphs come in.
+  Atlas* atlas = new Atlas(128, 4096, AtlasFormat::Pages, 1024);
+  FontManager* fontManager = new FontManager(atlas);
   TextBufferManager* textBufferManager = new TextBufferManager(fontManager);
 
   //TrueTypeHandle font = loadTtf(fontManager, "art/Envy Code R.ttf");
@@ -184,35 +449,163 @@ int RealMain(int /*_argc*/, char** /*_argv*/) {
 
   int visibleLineCount = 50;
 
-  const char* textBegin = 0;
-  const char* textEnd = 0;
-  metrics.getSubText(bigText, 0, visibleLineCount, textBegin, textEnd);
+  // Build and debugger output keeps the colors of its escape sequences,
+  // anything else is highlighted as C++.
+  const uint32_t bigTextSize = (uint32_t)strlen(bigText);
+  const bool ansiText = NULL != memchr(bigText, 0x1b, bigTextSize);
+  AnsiParser ansiParser;
+  LineIndex sourceLineIndex;
+  if (ansiText) {
+    ansiParser.setDefaultColors(0x839496ff, 0x002b36ff);
+    ansiParser.append(bigText, bigTextSize);
+  } else {
+    sourceLineIndex.reset(bigText, bigTextSize);
+  }
+  const LineIndex& lineIndex =
+      ansiText ? ansiParser.getLineIndex() : sourceLineIndex;
 
-  TextBufferHandle scrollableBuffer = textBufferManager->createTextBuffer(
-      FONT_TYPE_DISTANCE_SUBPIXEL, BufferType::Transient);
-  textBufferManager->setTextColor(scrollableBuffer, 0x839496ff);
-  //textBufferManager->setTextColor(scrollableBuffer, 0xffffffff);
+  CppTokenizer cppTokenizer;
+  SyntaxHighlighter highlighter(&cppTokenizer, &sourceLineIndex);
+  SetHighlightColors(&highlighter);
 
-  textBufferManager->appendText(
-      scrollableBuffer, fontScaled, textBegin, textEnd);
+  TextBufferHandle scrollableBuffer = textBufferManager->createTextBuffer(
+      FONT_TYPE_DISTANCE_SUBPIXEL, BufferType::Adaptive);
+
+  TextSearch textSearch(kSearchWorkerThreads);
+  uint32_t searchJumpFrom = 0;
+  bool searchJumpPending = false;
+
+  // Scroll positions are lines of the filtered view while it is shown.
+  FilteredLineView filteredView(kFilterWorkerThreads);
+  const FilteredLineView* filter = NULL;
+
+  JobPool layoutJobPool(kLayoutWorkerThreads);
+  VisibleLines visibleLines;
+  bool visibleExact = AppendVisibleLines(textBufferManager,
+                                         scrollableBuffer,
+                                         fontScaled,
+                                         lineIndex,
+                                         ansiText ? &ansiParser : NULL,
+                                         &highlighter,
+                                         textSearch,
+                                         filter,
+                                         0,
+                                         visibleLineCount,
+                                         &layoutJobPool,
+                                         &visibleLines);
+  uint32_t firstVisibleLine = 0;
+  uint32_t lastVisibleLine = visibleLineCount;
+  bool visibleSearched = true;
 
   float textScroll = 0;
+  uint32_t evictionPasses = 0;
+  uint32_t atlasRemovals = fontManager->getAtlas()->getRemovalGeneration();
+  uint64_t atlasUploadedBytes = 0;
 
   bgfx::setDebug(BGFX_DEBUG_STATS | BGFX_DEBUG_TEXT);
 
   while (!ProcessEvents(width, height, debug, reset)) {
-    bool recomputeVisibleText = textScroll != s_text_scroll;
+    // Reclaim the holes left by evicted glyphs.
+    const GlyphCacheStats& glyphCacheStats = fontManager->getGlyphCacheStats();
+    if (evictionPasses != glyphCacheStats.evictionPasses) {
+      evictionPasses = glyphCacheStats.evictionPasses;
+      fontManager->compactAtlas();
+    }
+
+    // Cache the lexer states ahead of scrolling, a jump far down the text is
+    // colored from a guessed state until the highlighter gets there.
+    highlighter.update(kHighlightLinesPerFrame);
+
+    // The filtered view follows the search pattern. The line at the top of
+    // the view stays there when the filter changes, or the next line kept.
+    bool filterChanged =
+        s_filter_toggled || (NULL != filter && s_search_changed);
+    if (filterChanged) {
+      uint32_t topLine =
+          GetDocumentLine(lineIndex, filter, (uint32_t)s_text_scroll);
+      if (s_filter_toggled) {
+        s_filter_toggled = false;
+        filter = NULL == filter ? &filteredView : NULL;
+      }
+      if (NULL != filter) {
+        filteredView.setFilter(lineIndex,
+                               s_search_pattern.data(),
+                               (uint32_t)s_search_pattern.size(),
+                               s_search_regex);
+        topLine = filteredView.findViewLine(topLine);
+      }
+      s_text_scroll = (float)topLine;
+    }
+
+    // A new pattern jumps to its first match from the top of the view, Return
+    // to the next one below it.
+    bool searchChanged = s_search_changed;
+    if (s_search_changed) {
+      s_search_changed = false;
+      textSearch.start(lineIndex.getText(),
+                       lineIndex.getSize(),
+                       s_search_pattern.data(),
+                       (uint32_t)s_search_pattern.size(),
+                       s_search_regex);
+      searchJumpFrom = GetLineOffset(
+          lineIndex,
+          GetDocumentLine(lineIndex, filter, (uint32_t)s_text_scroll));
+      searchJumpPending = true;
+    }
+    if (s_search_next) {
+      s_search_next = false;
+      searchJumpFrom = GetLineOffset(
+          lineIndex,
+          GetDocumentLine(lineIndex, filter, (uint32_t)s_text_scroll + 1));
+      searchJumpPending = true;
+    }
+    TextMatch match;
+    if (searchJumpPending && textSearch.findNextMatch(searchJumpFrom, &match)) {
+      searchJumpPending = false;
+      if (match.offset != UINT32_MAX) {
+        uint32_t line = lineIndex.findLine(match.offset);
+        s_text_scroll =
+            (float)(NULL != filter ? filter->findViewLine(line) : line);
+      }
+    }
+
+    // Regions evicted from the atlas may still be referenced by the buffer.
+    // Moved regions and atlas growth are handled by the buffer manager.
+    // Matches show up as the chunks of the text holding them are searched.
+    bool recomputeVisibleText =
+        textScroll != s_text_scroll ||
+        atlasRemovals != fontManager->getAtlas()->getRemovalGeneration() ||
+        (!visibleExact &&
+         highlighter.getExactLineCount() > firstVisibleLine) ||
+        searchChanged ||
+        filterChanged ||
+        (!visibleSearched &&
+         textSearch.isSearched(GetLineOffset(lineIndex, firstVisibleLine),
+                               GetLineOffset(lineIndex, lastVisibleLine)));
 
     if (recomputeVisibleText) {
       textScroll = s_text_scroll;
+      atlasRemovals = fontManager->getAtlas()->getRemovalGeneration();
       textBufferManager->clearTextBuffer(scrollableBuffer);
-      metrics.getSubText(bigText,
-                         (uint32_t)textScroll,
-                         (uint32_t)(textScroll + visibleLineCount),
-                         textBegin,
-                         textEnd);
-      textBufferManager->appendText(
-          scrollableBuffer, fontScaled, textBegin, textEnd);
+      firstVisibleLine =
+          GetDocumentLine(lineIndex, filter, (uint32_t)textScroll);
+      lastVisibleLine = GetDocumentLine(
+          lineIndex, filter, (uint32_t)textScroll + visibleLineCount);
+      visibleSearched =
+          textSearch.isSearched(GetLineOffset(lineIndex, firstVisibleLine),
+                                GetLineOffset(lineIndex, lastVisibleLine));
+      visibleExact = AppendVisibleLines(textBufferManager,
+                                        scrollableBuffer,
+                                        fontScaled,
+                                        lineIndex,
+                                        ansiText ? &ansiParser : NULL,
+                                        &highlighter,
+                                        textSearch,
+                                        filter,
+                                        (uint32_t)textScroll,
+                                        visibleLineCount,
+                                        &layoutJobPool,
+                                        &visibleLines);
     }
 
     // Set view 0 default viewport.
@@ -278,17 +671,78 @@ int RealMain(int /*_argc*/, char** /*_argv*/) {
     float tmpMat3[16];
     mtxMul(tmpMat3, tmpMat2, screenCenterMat);
 
-    // Set model matrix for rendering.
-    bgfx::setTransform(tmpMat3);
+    // Draw your text, with the model matrix used by all its draws.
+    textBufferManager->submitTextBuffer(scrollableBuffer, 0, 0, tmpMat3);
 
-    // Draw your text.
-    textBufferManager->submitTextBuffer(scrollableBuffer, 0);
+    fontManager->update();
+
+    // Atlas budget overlay, below the bgfx stats.
+    const AtlasStats& atlasStats = atlas->getStats();
+    atlasUploadedBytes += atlasStats.uploadedBytes;
+    bgfx::dbgTextClear();
+    bgfx::dbgTextPrintf(0,
+                        4,
+                        0x0f,
+                        "Atlas %dpx (max %dpx), regions %d/%d, failed %d",
+                        atlasStats.textureSize,
+                        atlasStats.maxTextureSize,
+                        atlasStats.regionCount,
+                        atlasStats.maxRegionCount,
+                        atlasStats.failedInserts);
+    bgfx::dbgTextPrintf(0,
+                        5,
+                        0x0f,
+                        "Uploaded %7d bytes this frame, %llu total",
+                        atlasStats.uploadedBytes,
+                        (unsigned long long)atlasUploadedBytes);
+    for (uint32_t i = 0; i < atlasStats.layerCount; ++i) {
+      const AtlasLayerStats& layer = atlasStats.layers[i];
+      bgfx::dbgTextPrintf(0,
+                          6 + i,
+                          0x0f,
+                          "  layer %2d (face %d.%d) %5.1f%% used %5.1f%% wasted",
+                          i,
+                          layer.faceIndex,
+                          layer.componentIndex,
+                          100.0f * layer.usedArea / layer.totalArea,
+                          100.0f * layer.wastedArea / layer.totalArea);
+    }
+
+    if (s_search_prompt && '\0' != textSearch.getError()[0]) {
+      bgfx::dbgTextPrintf(0,
+                          7 + atlasStats.layerCount,
+                          0x0f,
+                          "Regex: %s_  %s",
+                          s_search_pattern.c_str(),
+                          textSearch.getError());
+    } else if (s_search_prompt) {
+      bgfx::dbgTextPrintf(0,
+                          7 + atlasStats.layerCount,
+                          0x0f,
+                          "%s: %s_  %d matches%s",
+                          s_search_regex ? "Regex" : "Find",
+                          s_search_pattern.c_str(),
+                          textSearch.getMatchCount(),
+                          !textSearch.isDone() ? ", searching"
+                          : textSearch.isTruncated() ? ", stopped" : "");
+    }
+
+    if (NULL != filter) {
+      bgfx::dbgTextPrintf(0,
+                          8 + atlasStats.layerCount,
+                          0x0f,
+                          "Showing %u of %u lines",
+                          filter->getLineCount(),
+                          lineIndex.getLineCount());
+    }
 
     // Advance to next frame. Rendering thread will be kicked to
     // process submitted rendering primitives.
     bgfx::frame();
   }
 
+  // The search threads read the text.
+  textSearch.cancel();
   free(bigText);
 
   fontManager->destroyTtf(font);
@@ -300,6 +754,7 @@ int RealMain(int /*_argc*/, char** /*_argv*/) {
 
   delete textBufferManager;
   delete fontManager;
+  delete atlas;
 
   // Shutdown bgfx.
   bgfx::shutdown();
@@ -0,0 +1,683 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "common.h"
+
+#include <limits.h> // INT_MAX
+#include <vector>
+
+#include "rect_packer.h"
+
+struct PackerRect
+{
+	uint16_t x, y;
+	uint16_t width, height;
+};
+
+static bool intersects(const PackerRect& _a, const PackerRect& _b)
+{
+	return _a.x < _b.x + _b.width
+		&& _b.x < _a.x + _a.width
+		&& _a.y < _b.y + _b.height
+		&& _b.y < _a.y + _a.height
+		;
+}
+
+static bool contains(const PackerRect& _outer, const PackerRect& _inner)
+{
+	return _inner.x >= _outer.x
+		&& _inner.y >= _outer.y
+		&& _inner.x + _inner.width <= _outer.x + _outer.width
+		&& _inner.y + _inner.height <= _outer.y + _outer.height
+		;
+}
+
+/// Best area fit in a list of disjoint free rectangles; the leftover of the
+/// chosen one is split along the shorter leftover axis.
+static bool takeFreeRectangle(std::vector<PackerRect>& _freeRects, uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY)
+{
+	uint32_t bestIndex = UINT32_MAX;
+	uint32_t bestArea = UINT32_MAX;
+	for (uint32_t ii = 0, num = (uint32_t)_freeRects.size(); ii < num; ++ii)
+	{
+		const PackerRect& rect = _freeRects[ii];
+		uint32_t area = rect.width * rect.height;
+		if (rect.width >= _width
+		&&  rect.height >= _height
+		&&  area < bestArea)
+		{
+			bestIndex = ii;
+			bestArea = area;
+		}
+	}
+
+	if (UINT32_MAX == bestIndex)
+	{
+		return false;
+	}
+
+	PackerRect rect = _freeRects[bestIndex];
+	_freeRects[bestIndex] = _freeRects.back();
+	_freeRects.pop_back();
+
+	_outX = rect.x;
+	_outY = rect.y;
+
+	uint16_t leftoverWidth = rect.width - _width;
+	uint16_t leftoverHeight = rect.height - _height;
+	PackerRect right = { uint16_t(rect.x + _width), rect.y, leftoverWidth, 0 };
+	PackerRect bottom = { rect.x, uint16_t(rect.y + _height), 0, leftoverHeight };
+	if (leftoverWidth < leftoverHeight)
+	{
+		right.height = _height;
+		bottom.width = rect.width;
+	}
+	else
+	{
+		right.height = rect.height;
+		bottom.width = _width;
+	}
+
+	if (0 != right.width && 0 != right.height)
+	{
+		_freeRects.push_back(right);
+	}
+
+	if (0 != bottom.width && 0 != bottom.height)
+	{
+		_freeRects.push_back(bottom);
+	}
+
+	return true;
+}
+
+RectanglePacker::RectanglePacker()
+	: m_width(0)
+	, m_height(0)
+	, m_usedSpace(0)
+{
+}
+
+RectanglePacker::~RectanglePacker()
+{
+}
+
+void RectanglePacker::init(uint32_t _width, uint32_t _height)
+{
+	BX_CHECK(_width > 2, "_width must be > 2");
+	BX_CHECK(_height > 2, "_height must be > 2");
+	m_width = _width;
+	m_height = _height;
+	clear();
+}
+
+float RectanglePacker::getUsageRatio() const
+{
+	uint32_t total = m_width * m_height;
+	if (total > 0)
+	{
+		return (float)m_usedSpace / (float)total;
+	}
+
+	return 0.0f;
+}
+
+/// Skyline Bottom-Left. Freed rectangles are below the skyline and can't be
+/// given back to it, they are kept in a separate list and tried first.
+class SkylinePacker : public RectanglePacker
+{
+public:
+	virtual bool addRectangle(uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY);
+	virtual void freeRectangle(uint16_t _x, uint16_t _y, uint16_t _width, uint16_t _height);
+	virtual void grow(uint32_t _width, uint32_t _height);
+	virtual void clear();
+
+	virtual uint32_t getWastedSurface() const;
+
+	virtual const char* getName() const
+	{
+		return "skyline";
+	}
+
+private:
+	int32_t fit(uint32_t _skylineNodeIndex, uint16_t _width, uint16_t _height) const;
+
+	struct Node
+	{
+		Node(int16_t _x, int16_t _y, int32_t _width) : x(_x), y(_y), width(_width)
+		{
+		}
+
+		int16_t x;     //< The starting x-coordinate (leftmost).
+		int16_t y;     //< The y-coordinate of the skyline level line.
+		int32_t width; //< The line _width. The ending coordinate (inclusive) will be x+width-1.
+	};
+
+	std::vector<Node> m_skyline;          //< node of the skyline algorithm
+	std::vector<PackerRect> m_freeRects;  //< freed rectangles below the skyline
+};
+
+bool SkylinePacker::addRectangle(uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY)
+{
+	_outX = 0;
+	_outY = 0;
+
+	if (takeFreeRectangle(m_freeRects, _width, _height, _outX, _outY) )
+	{
+		m_usedSpace += _width * _height;
+		return true;
+	}
+
+	int32_t bestHeight = INT_MAX;
+	int32_t bestWidth = INT_MAX;
+	uint32_t bestIndex = UINT32_MAX;
+	for (uint32_t ii = 0, num = (uint32_t)m_skyline.size(); ii < num; ++ii)
+	{
+		const Node& node = m_skyline[ii];
+
+		// The rectangle can't end lower than the node it starts on.
+		if (node.y + _height > bestHeight)
+		{
+			continue;
+		}
+
+		int32_t yy = fit(ii, _width, _height);
+		if (yy >= 0)
+		{
+			if ( (yy + _height) < bestHeight
+			|| ( (yy + _height) == bestHeight && node.width < bestWidth) )
+			{
+				bestHeight = yy + _height;
+				bestIndex = ii;
+				bestWidth = node.width;
+				_outX = node.x;
+				_outY = (uint16_t)yy;
+			}
+		}
+	}
+
+	if (UINT32_MAX == bestIndex)
+	{
+		return false;
+	}
+
+	// Nodes fully covered by the new one are replaced in a single erase, the
+	// one partially covered is shrunk.
+	int32_t end = _outX + _width;
+	uint32_t last = bestIndex;
+	while (last < m_skyline.size()
+	&&     m_skyline[last].x + m_skyline[last].width <= end)
+	{
+		++last;
+	}
+
+	if (last < m_skyline.size()
+	&&  m_skyline[last].x < end)
+	{
+		Node& node = m_skyline[last];
+		node.width -= end - node.x;
+		node.x = (int16_t)end;
+	}
+
+	Node newNode(_outX, (int16_t)(_outY + _height), _width);
+	if (last > bestIndex)
+	{
+		m_skyline[bestIndex] = newNode;
+		m_skyline.erase(m_skyline.begin() + bestIndex + 1, m_skyline.begin() + last);
+	}
+	else
+	{
+		m_skyline.insert(m_skyline.begin() + bestIndex, newNode);
+	}
+
+	// Only the neighbours of the new node can be at the same level.
+	if (bestIndex + 1 < m_skyline.size()
+	&&  m_skyline[bestIndex + 1].y == m_skyline[bestIndex].y)
+	{
+		m_skyline[bestIndex].width += m_skyline[bestIndex + 1].width;
+		m_skyline.erase(m_skyline.begin() + bestIndex + 1);
+	}
+
+	if (bestIndex > 0
+	&&  m_skyline[bestIndex - 1].y == m_skyline[bestIndex].y)
+	{
+		m_skyline[bestIndex - 1].width += m_skyline[bestIndex].width;
+		m_skyline.erase(m_skyline.begin() + bestIndex);
+	}
+
+	m_usedSpace += _width * _height;
+	return true;
+}
+
+void SkylinePacker::freeRectangle(uint16_t _x, uint16_t _y, uint16_t _width, uint16_t _height)
+{
+	PackerRect rect = { _x, _y, _width, _height };
+	m_freeRects.push_back(rect);
+	m_usedSpace -= _width * _height;
+}
+
+void SkylinePacker::grow(uint32_t _width, uint32_t _height)
+{
+	BX_CHECK(_width >= m_width && _height >= m_height, "A packer can only grow");
+
+	// The old right border becomes usable, the new one is kept free.
+	if (_width > m_width)
+	{
+		Node& back = m_skyline.back();
+		if (1 == back.y)
+		{
+			back.width += _width - m_width;
+		}
+		else
+		{
+			m_skyline.push_back(Node( (int16_t)(m_width - 1), 1, _width - m_width) );
+		}
+	}
+
+	m_width = _width;
+	m_height = _height;
+}
+
+uint32_t SkylinePacker::getWastedSurface() const
+{
+	// Whatever is neither used, above the skyline nor in a freed rectangle.
+	uint32_t reachable = 0;
+	for (uint32_t ii = 0, num = (uint32_t)m_skyline.size(); ii < num; ++ii)
+	{
+		const Node& node = m_skyline[ii];
+		reachable += (m_height - 1 - node.y) * node.width;
+	}
+
+	for (uint32_t ii = 0, num = (uint32_t)m_freeRects.size(); ii < num; ++ii)
+	{
+		reachable += m_freeRects[ii].width * m_freeRects[ii].height;
+	}
+
+	return (m_width - 2) * (m_height - 2) - m_usedSpace - reachable;
+}
+
+void SkylinePacker::clear()
+{
+	m_freeRects.clear();
+	m_skyline.clear();
+	m_usedSpace = 0;
+	m_skyline.push_back(Node(1, 1, m_width - 2) );
+}
+
+int32_t SkylinePacker::fit(uint32_t _skylineNodeIndex, uint16_t _width, uint16_t _height) const
+{
+	int32_t width = _width;
+	int32_t height = _height;
+
+	const Node& baseNode = m_skyline[_skylineNodeIndex];
+
+	int32_t xx = baseNode.x, yy;
+	int32_t widthLeft = width;
+	uint32_t ii = _skylineNodeIndex;
+
+	if ( (xx + width) > (int32_t)(m_width - 1) )
+	{
+		return -1;
+	}
+
+	yy = baseNode.y;
+	while (widthLeft > 0)
+	{
+		const Node& node = m_skyline[ii];
+		if (node.y > yy)
+		{
+			yy = node.y;
+		}
+
+		if ( (yy + height) > (int32_t)(m_height - 1) )
+		{
+			return -1;
+		}
+
+		widthLeft -= node.width;
+		++ii;
+	}
+
+	return yy;
+}
+
+/// MaxRects keeps every maximal free rectangle, overlapping each other, and
+/// places the new rectangle where its shorter leftover side is the smallest.
+class MaxRectsPacker : public RectanglePacker
+{
+public:
+	virtual bool addRectangle(uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY);
+	virtual void freeRectangle(uint16_t _x, uint16_t _y, uint16_t _width, uint16_t _height);
+	virtual void grow(uint32_t _width, uint32_t _height);
+	virtual void clear();
+
+	/// every free texel is in a maximal free rectangle
+	virtual uint32_t getWastedSurface() const
+	{
+		return 0;
+	}
+
+	virtual const char* getName() const
+	{
+		return "maxrects-bssf";
+	}
+
+private:
+	/// @return the index of the first rectangle created by the split
+	uint32_t splitFreeRectangles(const PackerRect& _used);
+
+	/// remove the free rectangles contained in another one; the ones before
+	/// _first are known not to contain each other
+	void pruneFreeRectangles(uint32_t _first = 0);
+
+	std::vector<PackerRect> m_freeRects;
+	std::vector<PackerRect> m_splitRects;
+};
+
+bool MaxRectsPacker::addRectangle(uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY)
+{
+	_outX = 0;
+	_outY = 0;
+
+	int32_t bestShortSide = INT_MAX;
+	int32_t bestLongSide = INT_MAX;
+	uint32_t bestIndex = UINT32_MAX;
+	for (uint32_t ii = 0, num = (uint32_t)m_freeRects.size(); ii < num; ++ii)
+	{
+		const PackerRect& rect = m_freeRects[ii];
+		if (rect.width < _width
+		||  rect.height < _height)
+		{
+			continue;
+		}
+
+		int32_t leftoverWidth = rect.width - _width;
+		int32_t leftoverHeight = rect.height - _height;
+		int32_t shortSide = leftoverWidth < leftoverHeight ? leftoverWidth : leftoverHeight;
+		int32_t longSide = leftoverWidth < leftoverHeight ? leftoverHeight : leftoverWidth;
+		if (shortSide < bestShortSide
+		|| (shortSide == bestShortSide && longSide < bestLongSide) )
+		{
+			bestShortSide = shortSide;
+			bestLongSide = longSide;
+			bestIndex = ii;
+		}
+	}
+
+	if (UINT32_MAX == bestIndex)
+	{
+		return false;
+	}
+
+	PackerRect used = { m_freeRects[bestIndex].x, m_freeRects[bestIndex].y, _width, _height };
+	pruneFreeRectangles(splitFreeRectangles(used) );
+
+	_outX = used.x;
+	_outY = used.y;
+	m_usedSpace += _width * _height;
+	return true;
+}
+
+void MaxRectsPacker::freeRectangle(uint16_t _x, uint16_t _y, uint16_t _width, uint16_t _height)
+{
+	// Not necessarily maximal, but free: good enough until the layer is
+	// compacted.
+	PackerRect rect = { _x, _y, _width, _height };
+	m_freeRects.push_back(rect);
+	pruneFreeRectangles( (uint32_t)m_freeRects.size() - 1);
+	m_usedSpace -= _width * _height;
+}
+
+void MaxRectsPacker::grow(uint32_t _width, uint32_t _height)
+{
+	BX_CHECK(_width >= m_width && _height >= m_height, "A packer can only grow");
+
+	if (_width > m_width)
+	{
+		PackerRect right = { uint16_t(m_width - 1), 1, uint16_t(_width - m_width), uint16_t(_height - 2) };
+		m_freeRects.push_back(right);
+	}
+
+	if (_height > m_height)
+	{
+		PackerRect bottom = { 1, uint16_t(m_height - 1), uint16_t(_width - 2), uint16_t(_height - m_height) };
+		m_freeRects.push_back(bottom);
+	}
+
+	m_width = _width;
+	m_height = _height;
+	pruneFreeRectangles();
+}
+
+void MaxRectsPacker::clear()
+{
+	m_freeRects.clear();
+	m_usedSpace = 0;
+
+	PackerRect rect = { 1, 1, uint16_t(m_width - 2), uint16_t(m_height - 2) };
+	m_freeRects.push_back(rect);
+}
+
+uint32_t MaxRectsPacker::splitFreeRectangles(const PackerRect& _used)
+{
+	// Untouched rectangles are kept in front, the split ones are rebuilt
+	// after them.
+	m_splitRects.clear();
+	uint32_t kept = 0;
+	for (uint32_t ii = 0, num = (uint32_t)m_freeRects.size(); ii < num; ++ii)
+	{
+		const PackerRect& rect = m_freeRects[ii];
+		if (intersects(rect, _used) )
+		{
+			m_splitRects.push_back(rect);
+		}
+		else
+		{
+			m_freeRects[kept++] = rect;
+		}
+	}
+
+	m_freeRects.resize(kept);
+	for (uint32_t ii = 0, num = (uint32_t)m_splitRects.size(); ii < num; ++ii)
+	{
+		const PackerRect rect = m_splitRects[ii];
+
+		// Up to four maximal rectangles around the used one.
+		if (_used.x > rect.x)
+		{
+			PackerRect left = { rect.x, rect.y, uint16_t(_used.x - rect.x), rect.height };
+			m_freeRects.push_back(left);
+		}
+
+		if (_used.x + _used.width < rect.x + rect.width)
+		{
+			PackerRect right = { uint16_t(_used.x + _used.width), rect.y, uint16_t(rect.x + rect.width - _used.x - _used.width), rect.height };
+			m_freeRects.push_back(right);
+		}
+
+		if (_used.y > rect.y)
+		{
+			PackerRect top = { rect.x, rect.y, rect.width, uint16_t(_used.y - rect.y) };
+			m_freeRects.push_back(top);
+		}
+
+		if (_used.y + _used.height < rect.y + rect.height)
+		{
+			PackerRect bottom = { rect.x, uint16_t(_used.y + _used.height), rect.width, uint16_t(rect.y + rect.height - _used.y - _used.height) };
+			m_freeRects.push_back(bottom);
+		}
+	}
+
+	return kept;
+}
+
+void MaxRectsPacker::pruneFreeRectangles(uint32_t _first)
+{
+	// Only pairs involving a new rectangle need to be tested.
+	for (uint32_t ii = _first; ii < m_freeRects.size(); ++ii)
+	{
+		for (uint32_t jj = 0; jj < m_freeRects.size(); ++jj)
+		{
+			if (ii == jj)
+			{
+				continue;
+			}
+
+			if (contains(m_freeRects[jj], m_freeRects[ii]) )
+			{
+				m_freeRects.erase(m_freeRects.begin() + ii);
+				--ii;
+				break;
+			}
+
+			if (contains(m_freeRects[ii], m_freeRects[jj]) )
+			{
+				m_freeRects.erase(m_freeRects.begin() + jj);
+				if (jj < ii)
+				{
+					--ii;
+				}
+
+				if (jj < _first)
+				{
+					--_first;
+				}
+
+				--jj;
+			}
+		}
+	}
+}
+
+/// Guillotine keeps disjoint free rectangles, each insertion splits the
+/// chosen one in two.
+class GuillotinePacker : public RectanglePacker
+{
+public:
+	virtual bool addRectangle(uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY);
+	virtual void freeRectangle(uint16_t _x, uint16_t _y, uint16_t _width, uint16_t _height);
+	virtual void grow(uint32_t _width, uint32_t _height);
+	virtual void clear();
+
+	virtual uint32_t getWastedSurface() const;
+
+	virtual const char* getName() const
+	{
+		return "guillotine-baf";
+	}
+
+private:
+	std::vector<PackerRect> m_freeRects;
+};
+
+bool GuillotinePacker::addRectangle(uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY)
+{
+	_outX = 0;
+	_outY = 0;
+
+	if (!takeFreeRectangle(m_freeRects, _width, _height, _outX, _outY) )
+	{
+		return false;
+	}
+
+	m_usedSpace += _width * _height;
+	return true;
+}
+
+void GuillotinePacker::freeRectangle(uint16_t _x, uint16_t _y, uint16_t _width, uint16_t _height)
+{
+	PackerRect rect = { _x, _y, _width, _height };
+	m_usedSpace -= _width * _height;
+
+	// Merge with free neighbours sharing a whole edge, until none is left.
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (uint32_t ii = 0, num = (uint32_t)m_freeRects.size(); ii < num; ++ii)
+		{
+			const PackerRect& other = m_freeRects[ii];
+			if (other.y == rect.y && other.height == rect.height
+			&& (other.x + other.width == rect.x || rect.x + rect.width == other.x) )
+			{
+				rect.x = other.x < rect.x ? other.x : rect.x;
+				rect.width += other.width;
+				merged = true;
+			}
+			else if (other.x == rect.x && other.width == rect.width
+			     && (other.y + other.height == rect.y || rect.y + rect.height == other.y) )
+			{
+				rect.y = other.y < rect.y ? other.y : rect.y;
+				rect.height += other.height;
+				merged = true;
+			}
+
+			if (merged)
+			{
+				m_freeRects[ii] = m_freeRects.back();
+				m_freeRects.pop_back();
+				break;
+			}
+		}
+	}
+
+	m_freeRects.push_back(rect);
+}
+
+void GuillotinePacker::grow(uint32_t _width, uint32_t _height)
+{
+	BX_CHECK(_width >= m_width && _height >= m_height, "A packer can only grow");
+
+	// Disjoint strips: full height on the right, old width at the bottom.
+	if (_width > m_width)
+	{
+		PackerRect right = { uint16_t(m_width - 1), 1, uint16_t(_width - m_width), uint16_t(_height - 2) };
+		m_freeRects.push_back(right);
+	}
+
+	if (_height > m_height)
+	{
+		PackerRect bottom = { 1, uint16_t(m_height - 1), uint16_t(m_width - 2), uint16_t(_height - m_height) };
+		m_freeRects.push_back(bottom);
+	}
+
+	m_width = _width;
+	m_height = _height;
+}
+
+uint32_t GuillotinePacker::getWastedSurface() const
+{
+	// Free rectangles are disjoint, anything else unused is lost.
+	uint32_t reachable = 0;
+	for (uint32_t ii = 0, num = (uint32_t)m_freeRects.size(); ii < num; ++ii)
+	{
+		reachable += m_freeRects[ii].width * m_freeRects[ii].height;
+	}
+
+	return (m_width - 2) * (m_height - 2) - m_usedSpace - reachable;
+}
+
+void GuillotinePacker::clear()
+{
+	m_freeRects.clear();
+	m_usedSpace = 0;
+
+	PackerRect rect = { 1, 1, uint16_t(m_width - 2), uint16_t(m_height - 2) };
+	m_freeRects.push_back(rect);
+}
+
+RectanglePacker* createRectanglePacker(PackerType::Enum _type)
+{
+	switch (_type)
+	{
+	case PackerType::MaxRects:
+		return new MaxRectsPacker;
+
+	case PackerType::Guillotine:
+		return new GuillotinePacker;
+
+	default:
+		return new SkylinePacker;
+	}
+}
@@ -0,0 +1,91 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef RECT_PACKER_H_HEADER_GUARD
+#define RECT_PACKER_H_HEADER_GUARD
+
+/// Rectangle packers used by the atlas layers. The implementations follow
+/// the article by Jukka Jylänki : "A Thousand Ways to Pack the Bin - A
+/// Practical Approach to Two-Dimensional Rectangle Bin Packing", February 27,
+/// 2010, and the C++ sources provided by Jukka Jylänki at:
+/// http://clb.demon.fi/files/RectangleBinPack/
+///
+/// All packers keep a one pixel border around the whole area to avoid any
+/// artifact when sampling the texture.
+
+#include <stdint.h>
+
+struct PackerType
+{
+	enum Enum
+	{
+		/// Skyline Bottom-Left, freed rectangles are reused best area fit.
+		Skyline,
+
+		/// MaxRects Best Short Side Fit: tightest packing, slowest inserts.
+		MaxRects,
+
+		/// Guillotine Best Area Fit, split along the shorter leftover axis.
+		Guillotine,
+
+		Count
+	};
+};
+
+class RectanglePacker
+{
+public:
+	RectanglePacker();
+	virtual ~RectanglePacker();
+
+	/// non constructor initialization
+	void init(uint32_t _width, uint32_t _height);
+
+	/// find a suitable position for the given rectangle
+	/// @return true if the rectangle can be added, false otherwise
+	virtual bool addRectangle(uint16_t _width, uint16_t _height, uint16_t& _outX, uint16_t& _outY) = 0;
+
+	/// give back a rectangle previously returned by addRectangle, so its
+	/// space can be reused by later insertions
+	virtual void freeRectangle(uint16_t _x, uint16_t _y, uint16_t _width, uint16_t _height) = 0;
+
+	/// extend the packed area to the right and to the bottom, keeping the
+	/// rectangles already added
+	virtual void grow(uint32_t _width, uint32_t _height) = 0;
+
+	/// reset to initial state
+	virtual void clear() = 0;
+
+	/// return the used surface in squared unit
+	uint32_t getUsedSurface() const
+	{
+		return m_usedSpace;
+	}
+
+	/// return the total available surface in squared unit
+	uint32_t getTotalSurface() const
+	{
+		return m_width * m_height;
+	}
+
+	/// return the usage ratio of the available surface [0:1]
+	float getUsageRatio() const;
+
+	/// return the free surface that can no longer be handed out, in squared
+	/// unit (e.g. below the skyline)
+	virtual uint32_t getWastedSurface() const = 0;
+
+	/// return the name of the algorithm, for reports
+	virtual const char* getName() const = 0;
+
+protected:
+	uint32_t m_width;     //< width (in pixels) of the underlying texture
+	uint32_t m_height;    //< height (in pixels) of the underlying texture
+	uint32_t m_usedSpace; //< Surface used in squared pixel
+};
+
+/// create an uninitialized packer, call init() before use
+RectanglePacker* createRectanglePacker(PackerType::Enum _type);
+
+#endif // RECT_PACKER_H_HEADER_GUARD
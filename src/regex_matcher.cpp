@@ -0,0 +1,928 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "regex_matcher.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#define REGEX_INFINITE UINT32_MAX
+#define MAX_REGEX_REPEAT 1000
+
+// RegexMatcher transitions hold the offset of the next state row, shifted
+// left of these flags.
+#define DFA_ACCEPT  1
+#define DFA_DEAD    2
+#define DFA_UNKNOWN UINT32_MAX
+
+// Parses a pattern to a syntax tree, then compiles it to the NFA of a
+// Regex, last node first.
+struct RegexParser
+{
+	struct NodeType
+	{
+		enum Enum
+		{
+			Empty,
+			Bytes,     //< a byte of charClass
+			Concat,
+			Alternate,
+			Repeat,    //< children[0] from min to max times
+			LineBegin,
+			LineEnd,
+		};
+	};
+
+	struct Node
+	{
+		NodeType::Enum type;
+		uint32_t charClass;
+		uint32_t min;
+		uint32_t max;
+		std::vector<uint32_t> children;
+	};
+
+	RegexParser(Regex& _regex, const char* _pattern, uint32_t _length)
+		: m_regex(_regex)
+		, m_str(_pattern)
+		, m_end(_pattern + _length)
+	{
+	}
+
+	uint32_t addNode(NodeType::Enum _type)
+	{
+		Node node;
+		node.type = _type;
+		node.charClass = 0;
+		node.min = 1;
+		node.max = 1;
+		m_nodes.push_back(node);
+		return (uint32_t)m_nodes.size() - 1;
+	}
+
+	uint32_t addClass(const Regex::ByteSet& _set)
+	{
+		m_regex.m_classes.push_back(_set);
+		uint32_t node = addNode(NodeType::Bytes);
+		m_nodes[node].charClass = (uint32_t)m_regex.m_classes.size() - 1;
+		return node;
+	}
+
+	bool fail(const char* _error)
+	{
+		if (m_regex.m_error.empty() )
+		{
+			m_regex.m_error = _error;
+		}
+		return false;
+	}
+
+	static void setByte(Regex::ByteSet& _set, uint8_t _byte)
+	{
+		_set.bits[_byte >> 5] |= 1u << (_byte & 31);
+	}
+
+	static void setRange(Regex::ByteSet& _set, uint8_t _first, uint8_t _last)
+	{
+		for (uint32_t ii = _first; ii <= _last; ++ii)
+		{
+			setByte(_set, (uint8_t)ii);
+		}
+	}
+
+	// Add the bytes of \d \w \s and their negations, return false for other
+	// escapes.
+	static bool addShorthand(Regex::ByteSet& _set, char _ch)
+	{
+		Regex::ByteSet set;
+		memset(&set, 0, sizeof(set) );
+		switch (_ch)
+		{
+		case 'd': case 'D':
+			setRange(set, '0', '9');
+			break;
+
+		case 'w': case 'W':
+			setRange(set, '0', '9');
+			setRange(set, 'a', 'z');
+			setRange(set, 'A', 'Z');
+			setByte(set, '_');
+			break;
+
+		case 's': case 'S':
+			setByte(set, ' ');
+			setRange(set, '\t', '\r');
+			break;
+
+		default:
+			return false;
+		}
+
+		const bool negate = _ch >= 'A' && _ch <= 'Z';
+		for (uint32_t ii = 0; ii < 8; ++ii)
+		{
+			_set.bits[ii] |= negate ? ~set.bits[ii] : set.bits[ii];
+		}
+		return true;
+	}
+
+	static char unescape(char _ch)
+	{
+		switch (_ch)
+		{
+		case 't': return '\t';
+		case 'n': return '\n';
+		case 'r': return '\r';
+		case 'f': return '\f';
+		case 'v': return '\v';
+		default:  return _ch;
+		}
+	}
+
+	bool parseAlternate(uint32_t* _node)
+	{
+		uint32_t node;
+		if (!parseConcat(&node) )
+		{
+			return false;
+		}
+
+		if (m_str == m_end || *m_str != '|')
+		{
+			*_node = node;
+			return true;
+		}
+
+		uint32_t alternate = addNode(NodeType::Alternate);
+		m_nodes[alternate].children.push_back(node);
+		while (m_str != m_end && *m_str == '|')
+		{
+			++m_str;
+			if (!parseConcat(&node) )
+			{
+				return false;
+			}
+			m_nodes[alternate].children.push_back(node);
+		}
+
+		*_node = alternate;
+		return true;
+	}
+
+	bool parseConcat(uint32_t* _node)
+	{
+		uint32_t concat = addNode(NodeType::Concat);
+		while (m_str != m_end && *m_str != '|' && *m_str != ')')
+		{
+			uint32_t node;
+			if (!parseRepeat(&node) )
+			{
+				return false;
+			}
+			m_nodes[concat].children.push_back(node);
+		}
+
+		*_node = concat;
+		return true;
+	}
+
+	bool parseNumber(uint32_t* _value)
+	{
+		if (m_str == m_end || *m_str < '0' || *m_str > '9')
+		{
+			return false;
+		}
+
+		uint32_t value = 0;
+		for (; m_str != m_end && *m_str >= '0' && *m_str <= '9'; ++m_str)
+		{
+			value = value * 10 + (*m_str - '0');
+			if (value > MAX_REGEX_REPEAT)
+			{
+				return fail("Repetition count too large");
+			}
+		}
+
+		*_value = value;
+		return true;
+	}
+
+	bool parseRepeat(uint32_t* _node)
+	{
+		uint32_t node;
+		if (!parseAtom(&node) )
+		{
+			return false;
+		}
+
+		while (m_str != m_end)
+		{
+			uint32_t min;
+			uint32_t max;
+			switch (*m_str)
+			{
+			case '*': min = 0; max = REGEX_INFINITE; ++m_str; break;
+			case '+': min = 1; max = REGEX_INFINITE; ++m_str; break;
+			case '?': min = 0; max = 1;              ++m_str; break;
+
+			case '{':
+				++m_str;
+				if (!parseNumber(&min) )
+				{
+					return fail("Expected a repetition count");
+				}
+
+				max = min;
+				if (m_str != m_end && *m_str == ',')
+				{
+					++m_str;
+					max = REGEX_INFINITE;
+					if (m_str != m_end && *m_str != '}' && !parseNumber(&max) )
+					{
+						return fail("Expected a repetition count");
+					}
+				}
+
+				if (m_str == m_end || *m_str != '}')
+				{
+					return fail("Missing '}'");
+				}
+				++m_str;
+
+				if (max < min)
+				{
+					return fail("Invalid repetition range");
+				}
+				break;
+
+			default:
+				*_node = node;
+				return true;
+			}
+
+			uint32_t repeat = addNode(NodeType::Repeat);
+			m_nodes[repeat].min = min;
+			m_nodes[repeat].max = max;
+			m_nodes[repeat].children.push_back(node);
+			node = repeat;
+		}
+
+		*_node = node;
+		return true;
+	}
+
+	bool parseClass(uint32_t* _node)
+	{
+		Regex::ByteSet set;
+		memset(&set, 0, sizeof(set) );
+
+		const bool negate = m_str != m_end && *m_str == '^';
+		if (negate)
+		{
+			++m_str;
+		}
+
+		// ']' first is a literal.
+		for (bool first = true; m_str != m_end && (first || *m_str != ']'); first = false)
+		{
+			char ch = *m_str++;
+			if (ch == '\\')
+			{
+				if (m_str == m_end)
+				{
+					return fail("Trailing '\\'");
+				}
+
+				ch = *m_str++;
+				if (addShorthand(set, ch) )
+				{
+					continue;
+				}
+				ch = unescape(ch);
+			}
+
+			char last = ch;
+			if (m_str + 1 < m_end && *m_str == '-' && m_str[1] != ']')
+			{
+				last = m_str[1];
+				m_str += 2;
+				if (last == '\\')
+				{
+					if (m_str == m_end)
+					{
+						return fail("Trailing '\\'");
+					}
+					last = unescape(*m_str++);
+				}
+
+				if ( (uint8_t)last < (uint8_t)ch)
+				{
+					return fail("Invalid class range");
+				}
+			}
+
+			setRange(set, (uint8_t)ch, (uint8_t)last);
+		}
+
+		if (m_str == m_end)
+		{
+			return fail("Missing ']'");
+		}
+		++m_str;
+
+		if (negate)
+		{
+			for (uint32_t ii = 0; ii < 8; ++ii)
+			{
+				set.bits[ii] = ~set.bits[ii];
+			}
+		}
+
+		*_node = addClass(set);
+		return true;
+	}
+
+	bool parseAtom(uint32_t* _node)
+	{
+		Regex::ByteSet set;
+		memset(&set, 0, sizeof(set) );
+
+		char ch = *m_str++;
+		switch (ch)
+		{
+		case '(':
+			if (!parseAlternate(_node) )
+			{
+				return false;
+			}
+
+			if (m_str == m_end || *m_str != ')')
+			{
+				return fail("Missing ')'");
+			}
+			++m_str;
+			return true;
+
+		case '[':
+			return parseClass(_node);
+
+		case '.':
+			setRange(set, 0, 255);
+			set.bits['\n' >> 5] &= ~(1u << ('\n' & 31) );
+			*_node = addClass(set);
+			return true;
+
+		case '^':
+			*_node = addNode(NodeType::LineBegin);
+			return true;
+
+		case '$':
+			*_node = addNode(NodeType::LineEnd);
+			return true;
+
+		case '*':
+		case '+':
+		case '?':
+		case '{':
+			return fail("Nothing to repeat");
+
+		case '\\':
+			if (m_str == m_end)
+			{
+				return fail("Trailing '\\'");
+			}
+
+			ch = *m_str++;
+			if (!addShorthand(set, ch) )
+			{
+				setByte(set, (uint8_t)unescape(ch) );
+			}
+			*_node = addClass(set);
+			return true;
+
+		default:
+			setByte(set, (uint8_t)ch);
+			*_node = addClass(set);
+			return true;
+		}
+	}
+
+	// Return the byte of a class holding a single one, or -1.
+	int32_t getSingleByte(uint32_t _charClass) const
+	{
+		const Regex::ByteSet& set = m_regex.m_classes[_charClass];
+		int32_t byte = -1;
+		for (uint32_t ii = 0; ii < 256; ++ii)
+		{
+			if (set.test( (uint8_t)ii) )
+			{
+				if (-1 != byte)
+				{
+					return -1;
+				}
+				byte = (int32_t)ii;
+			}
+		}
+
+		return byte;
+	}
+
+	// Keep the longest run of bytes every match goes through.
+	void flushLiteral(std::string& _current, std::string& _best) const
+	{
+		if (_current.size() > _best.size() )
+		{
+			_best = _current;
+		}
+		_current.clear();
+	}
+
+	void collectLiteral(uint32_t _node, std::string& _current, std::string& _best) const
+	{
+		const Node& node = m_nodes[_node];
+		switch (node.type)
+		{
+		case NodeType::Bytes:
+			{
+				int32_t byte = getSingleByte(node.charClass);
+				if (-1 == byte)
+				{
+					flushLiteral(_current, _best);
+				}
+				else
+				{
+					_current += (char)byte;
+				}
+			}
+			break;
+
+		case NodeType::Concat:
+			for (uint32_t ii = 0; ii < node.children.size(); ++ii)
+			{
+				collectLiteral(node.children[ii], _current, _best);
+			}
+			break;
+
+		case NodeType::Repeat:
+			// The first repetition is required, what follows may vary.
+			if (0 == node.min)
+			{
+				flushLiteral(_current, _best);
+				break;
+			}
+
+			collectLiteral(node.children[0], _current, _best);
+			if (1 != node.max)
+			{
+				flushLiteral(_current, _best);
+			}
+			break;
+
+		case NodeType::Empty:
+		case NodeType::LineBegin:
+		case NodeType::LineEnd:
+			break;
+
+		default:
+			flushLiteral(_current, _best);
+			break;
+		}
+	}
+
+	bool emit(uint32_t _node, uint32_t _next, uint32_t* _start)
+	{
+		if (m_regex.m_states.size() > MAX_REGEX_NFA_STATES)
+		{
+			return fail("Pattern too complex");
+		}
+
+		const Node& node = m_nodes[_node];
+		uint32_t start = _next;
+		switch (node.type)
+		{
+		case NodeType::Empty:
+			break;
+
+		case NodeType::Bytes:
+			start = m_regex.addState(Regex::NfaType::Byte, _next, UINT32_MAX, node.charClass);
+			break;
+
+		case NodeType::LineBegin:
+			start = m_regex.addState(Regex::NfaType::LineBegin, _next);
+			break;
+
+		case NodeType::LineEnd:
+			start = m_regex.addState(Regex::NfaType::LineEnd, _next);
+			break;
+
+		case NodeType::Concat:
+			for (uint32_t ii = (uint32_t)node.children.size(); ii > 0; --ii)
+			{
+				if (!emit(node.children[ii - 1], start, &start) )
+				{
+					return false;
+				}
+			}
+			break;
+
+		case NodeType::Alternate:
+			if (!emit(node.children.back(), _next, &start) )
+			{
+				return false;
+			}
+
+			for (uint32_t ii = (uint32_t)node.children.size() - 1; ii > 0; --ii)
+			{
+				uint32_t child;
+				if (!emit(node.children[ii - 1], _next, &child) )
+				{
+					return false;
+				}
+				start = m_regex.addState(Regex::NfaType::Split, child, start);
+			}
+			break;
+
+		case NodeType::Repeat:
+			{
+				const uint32_t child = node.children[0];
+				if (REGEX_INFINITE == node.max)
+				{
+					uint32_t loop = m_regex.addState(Regex::NfaType::Split, UINT32_MAX, _next);
+					uint32_t body;
+					if (!emit(child, loop, &body) )
+					{
+						return false;
+					}
+					m_regex.m_states[loop].out = body;
+					start = loop;
+				}
+				else
+				{
+					// Optional repetitions, each one may end the repeat.
+					for (uint32_t ii = node.min; ii < node.max; ++ii)
+					{
+						uint32_t body;
+						if (!emit(child, start, &body) )
+						{
+							return false;
+						}
+						start = m_regex.addState(Regex::NfaType::Split, body, _next);
+					}
+				}
+
+				for (uint32_t ii = 0; ii < node.min; ++ii)
+				{
+					if (!emit(child, start, &start) )
+					{
+						return false;
+					}
+				}
+			}
+			break;
+		}
+
+		*_start = start;
+		return true;
+	}
+
+	Regex& m_regex;
+	const char* m_str;
+	const char* m_end;
+	std::vector<Node> m_nodes;
+};
+
+Regex::Regex()
+	: m_start(0)
+	, m_numByteClasses(1)
+{
+	memset(m_byteClass, 0, sizeof(m_byteClass) );
+	m_states.push_back(NfaState() );
+	m_states[0].type = NfaType::Match;
+}
+
+bool Regex::compile(const char* _pattern, uint32_t _length)
+{
+	*this = Regex();
+	m_states.clear();
+
+	RegexParser parser(*this, _pattern, _length);
+	uint32_t root;
+	bool ok = parser.parseAlternate(&root);
+	if (ok
+	&&  parser.m_str != parser.m_end)
+	{
+		ok = parser.fail("Unmatched ')'");
+	}
+
+	if (ok)
+	{
+		uint32_t match = addState(NfaType::Match, UINT32_MAX);
+		ok = parser.emit(root, match, &m_start);
+	}
+
+	if (!ok)
+	{
+		// Keep the error, and a regex matching nothing but the empty string.
+		std::string error;
+		error.swap(m_error);
+		*this = Regex();
+		m_error.swap(error);
+		return false;
+	}
+
+	std::string current;
+	parser.collectLiteral(root, current, m_literal);
+	parser.flushLiteral(current, m_literal);
+
+	computeByteClasses();
+	return true;
+}
+
+uint32_t Regex::addState(NfaType::Enum _type, uint32_t _out, uint32_t _out1, uint32_t _charClass)
+{
+	NfaState state;
+	state.type = _type;
+	state.out = _out;
+	state.out1 = _out1;
+	state.charClass = _charClass;
+	m_states.push_back(state);
+	return (uint32_t)m_states.size() - 1;
+}
+
+void Regex::computeByteClasses()
+{
+	// Split the bytes by membership of each class in turn.
+	memset(m_byteClass, 0, sizeof(m_byteClass) );
+	m_numByteClasses = 1;
+	for (uint32_t ii = 0; ii < m_classes.size(); ++ii)
+	{
+		int32_t remap[512];
+		memset(remap, -1, sizeof(remap) );
+
+		uint32_t numByteClasses = 0;
+		for (uint32_t byte = 0; byte < 256; ++byte)
+		{
+			uint32_t key = m_byteClass[byte] * 2 + (m_classes[ii].test( (uint8_t)byte) ? 1 : 0);
+			if (-1 == remap[key])
+			{
+				remap[key] = (int32_t)numByteClasses++;
+			}
+			m_byteClass[byte] = (uint8_t)remap[key];
+		}
+		m_numByteClasses = numByteClasses;
+	}
+}
+
+RegexMatcher::RegexMatcher(const Regex& _regex)
+	: m_regex(_regex)
+	, m_mark(0)
+{
+	m_marks.resize(m_regex.m_states.size(), 0);
+	m_anchored.flushes = 0;
+	m_anchored.unanchored = false;
+	resetDfa(m_anchored);
+	m_unanchored.flushes = 0;
+	m_unanchored.unanchored = true;
+	resetDfa(m_unanchored);
+}
+
+bool RegexMatcher::isMatch(const char* _begin, const char* _end)
+{
+	uint32_t state = encodeState(m_unanchored, getStartState(m_unanchored, true) );
+	for (const char* str = _begin; str < _end; ++str)
+	{
+		if (0 != (state & DFA_ACCEPT) )
+		{
+			return true;
+		}
+
+		// Known transitions without the call.
+		const uint8_t byte = (uint8_t)*str;
+		const uint32_t next = m_unanchored.transitions[(state >> 2) + m_regex.m_byteClass[byte] ];
+		state = DFA_UNKNOWN != next ? next : getNextState(m_unanchored, state, byte);
+	}
+
+	return 0 != (state & DFA_ACCEPT)
+		|| m_unanchored.states[(state >> 2) / m_regex.m_numByteClasses].acceptAtEnd
+		;
+}
+
+bool RegexMatcher::find(const char* _begin, const char* _end, const char* _str, const char** _matchBegin, const char** _matchEnd)
+{
+	for (const char* start = _str; start < _end; ++start)
+	{
+		uint32_t state = encodeState(m_anchored, getStartState(m_anchored, start == _begin) );
+		const char* matchEnd = NULL;
+		const char* str = start;
+		for (; str < _end && 0 == (state & DFA_DEAD); ++str)
+		{
+			const uint8_t byte = (uint8_t)*str;
+			const uint32_t next = m_anchored.transitions[(state >> 2) + m_regex.m_byteClass[byte] ];
+			state = DFA_UNKNOWN != next ? next : getNextState(m_anchored, state, byte);
+			if (0 != (state & DFA_ACCEPT) )
+			{
+				matchEnd = str + 1;
+			}
+		}
+
+		if (str == _end
+		&&  str > start
+		&&  m_anchored.states[(state >> 2) / m_regex.m_numByteClasses].acceptAtEnd)
+		{
+			matchEnd = str;
+		}
+
+		if (NULL != matchEnd)
+		{
+			*_matchBegin = start;
+			*_matchEnd = matchEnd;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void RegexMatcher::resetDfa(Dfa& _dfa)
+{
+	_dfa.states.clear();
+	_dfa.transitions.clear();
+	_dfa.ids.clear();
+	_dfa.startIds[0] = UINT32_MAX;
+	_dfa.startIds[1] = UINT32_MAX;
+	++_dfa.flushes;
+}
+
+uint32_t RegexMatcher::getStartState(Dfa& _dfa, bool _lineBegin)
+{
+	uint32_t& id = _dfa.startIds[_lineBegin ? 1 : 0];
+	if (UINT32_MAX == id)
+	{
+		m_scratch.clear();
+		nextMark();
+		addClosure(m_scratch, m_regex.m_start, _lineBegin);
+		uint32_t state = addDfaState(_dfa, m_scratch, _lineBegin);
+
+		// A flush resets the start states.
+		_dfa.startIds[_lineBegin ? 1 : 0] = state;
+	}
+
+	return _dfa.startIds[_lineBegin ? 1 : 0];
+}
+
+uint32_t RegexMatcher::encodeState(const Dfa& _dfa, uint32_t _state) const
+{
+	const Dfa::State& state = _dfa.states[_state];
+	return (_state * m_regex.m_numByteClasses) << 2
+		| (state.accept ? DFA_ACCEPT : 0)
+		| (state.nfaStates.empty() ? DFA_DEAD : 0)
+		;
+}
+
+uint32_t RegexMatcher::getNextState(Dfa& _dfa, uint32_t _state, uint8_t _byte)
+{
+	const uint32_t index = (_state >> 2) + m_regex.m_byteClass[_byte];
+	if (DFA_UNKNOWN != _dfa.transitions[index])
+	{
+		return _dfa.transitions[index];
+	}
+
+	m_scratch.clear();
+	nextMark();
+
+	const std::vector<uint32_t>& nfaStates = _dfa.states[(_state >> 2) / m_regex.m_numByteClasses].nfaStates;
+	for (uint32_t ii = 0; ii < nfaStates.size(); ++ii)
+	{
+		const Regex::NfaState& nfaState = m_regex.m_states[nfaStates[ii] ];
+		if (Regex::NfaType::Byte == nfaState.type
+		&&  m_regex.m_classes[nfaState.charClass].test(_byte) )
+		{
+			addClosure(m_scratch, nfaState.out, false);
+		}
+	}
+
+	if (_dfa.unanchored)
+	{
+		addClosure(m_scratch, m_regex.m_start, false);
+	}
+
+	const uint32_t flushes = _dfa.flushes;
+	const uint32_t state = encodeState(_dfa, addDfaState(_dfa, m_scratch, false) );
+	if (flushes == _dfa.flushes)
+	{
+		_dfa.transitions[index] = state;
+	}
+
+	return state;
+}
+
+uint32_t RegexMatcher::addDfaState(Dfa& _dfa, std::vector<uint32_t>& _nfaStates, bool _lineBegin)
+{
+	std::sort(_nfaStates.begin(), _nfaStates.end() );
+
+	// At the beginning of the line, $^ matches the empty line. Key that
+	// state apart from the same set anywhere else.
+	if (_lineBegin)
+	{
+		_nfaStates.push_back(UINT32_MAX);
+	}
+
+	std::map<std::vector<uint32_t>, uint32_t>::const_iterator it = _dfa.ids.find(_nfaStates);
+	if (it != _dfa.ids.end() )
+	{
+		return it->second;
+	}
+
+	std::vector<uint32_t> key;
+	if (_lineBegin)
+	{
+		key = _nfaStates;
+		_nfaStates.pop_back();
+	}
+
+	// Out of memory for states, start over from this one.
+	if (_dfa.states.size() >= MAX_REGEX_DFA_STATES)
+	{
+		resetDfa(_dfa);
+	}
+
+	Dfa::State state;
+	state.nfaStates = _nfaStates;
+	state.accept = false;
+	state.acceptAtEnd = false;
+
+	// Matches, and matches through the $ assertions at the end of the line.
+	std::vector<uint32_t> atEnd;
+	nextMark();
+	for (uint32_t ii = 0; ii < _nfaStates.size(); ++ii)
+	{
+		const Regex::NfaState& nfaState = m_regex.m_states[_nfaStates[ii] ];
+		state.accept |= Regex::NfaType::Match == nfaState.type;
+		if (Regex::NfaType::LineEnd == nfaState.type)
+		{
+			addClosure(atEnd, nfaState.out, _lineBegin);
+		}
+	}
+
+	for (uint32_t ii = 0; ii < atEnd.size(); ++ii)
+	{
+		const Regex::NfaState& nfaState = m_regex.m_states[atEnd[ii] ];
+		state.acceptAtEnd |= Regex::NfaType::Match == nfaState.type;
+		if (Regex::NfaType::LineEnd == nfaState.type)
+		{
+			addClosure(atEnd, nfaState.out, _lineBegin);
+		}
+	}
+
+	const uint32_t id = (uint32_t)_dfa.states.size();
+	_dfa.states.push_back(state);
+	_dfa.transitions.resize(_dfa.transitions.size() + m_regex.m_numByteClasses, DFA_UNKNOWN);
+	_dfa.ids[_lineBegin ? key : _nfaStates] = id;
+	return id;
+}
+
+void RegexMatcher::addClosure(std::vector<uint32_t>& _nfaStates, uint32_t _state, bool _lineBegin)
+{
+	m_stack.push_back(_state);
+	while (!m_stack.empty() )
+	{
+		const uint32_t index = m_stack.back();
+		m_stack.pop_back();
+		if (m_marks[index] == m_mark)
+		{
+			continue;
+		}
+		m_marks[index] = m_mark;
+
+		const Regex::NfaState& state = m_regex.m_states[index];
+		switch (state.type)
+		{
+		case Regex::NfaType::Split:
+			m_stack.push_back(state.out1);
+			m_stack.push_back(state.out);
+			break;
+
+		case Regex::NfaType::LineBegin:
+			if (_lineBegin)
+			{
+				m_stack.push_back(state.out);
+			}
+			break;
+
+		default:
+			_nfaStates.push_back(index);
+			break;
+		}
+	}
+}
+
+void RegexMatcher::nextMark()
+{
+	if (0 == ++m_mark)
+	{
+		std::fill(m_marks.begin(), m_marks.end(), 0);
+		m_mark = 1;
+	}
+}
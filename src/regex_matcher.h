@@ -0,0 +1,157 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef REGEX_MATCHER_H_HEADER_GUARD
+#define REGEX_MATCHER_H_HEADER_GUARD
+
+#include <bx/bx.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/// NFA states a compiled regex may have, repetitions included.
+#define MAX_REGEX_NFA_STATES 8192
+
+/// DFA states cached by a RegexMatcher before its cache is flushed.
+#define MAX_REGEX_DFA_STATES 2048
+
+/// Regular expression matched against single lines of bytes.
+///
+/// Syntax: literal bytes, '.', classes as [a-z_] or [^0-9] with \d \w \s
+/// \D \W \S inside or outside of them, escaped metacharacters, ^ and $ at
+/// the beginning and end of the line, groups, alternation, and the greedy
+/// repetitions * + ? {n} {n,} {n,m}.
+///
+/// Compiled to a Thompson NFA, RegexMatcher runs it as a DFA built on
+/// demand. Immutable once compiled, it can be shared by the matchers of
+/// several threads.
+class Regex
+{
+public:
+	Regex();
+
+	/// @return false if the pattern is invalid, see getError()
+	bool compile(const char* _pattern, uint32_t _length);
+
+	const char* getError() const
+	{
+		return m_error.c_str();
+	}
+
+	/// Bytes every match contains, empty if no literal is required. Lines
+	/// without it can be skipped without running the matcher.
+	const std::string& getRequiredLiteral() const
+	{
+		return m_literal;
+	}
+
+private:
+	friend class RegexMatcher;
+	friend struct RegexParser;
+
+	struct NfaType
+	{
+		enum Enum
+		{
+			Byte,      //< consume a byte of m_classes[charClass], then out
+			Split,     //< out and out1
+			LineBegin, //< out at the beginning of the line
+			LineEnd,   //< out at the end of the line
+			Match,
+		};
+	};
+
+	struct NfaState
+	{
+		NfaType::Enum type;
+		uint32_t out;
+		uint32_t out1;
+		uint32_t charClass;
+	};
+
+	/// 256 bits set of bytes
+	struct ByteSet
+	{
+		uint32_t bits[8];
+
+		bool test(uint8_t _byte) const
+		{
+			return 0 != (bits[_byte >> 5] & (1u << (_byte & 31) ) );
+		}
+	};
+
+	uint32_t addState(NfaType::Enum _type, uint32_t _out, uint32_t _out1 = UINT32_MAX, uint32_t _charClass = 0);
+	void computeByteClasses();
+
+	std::vector<NfaState> m_states;
+	std::vector<ByteSet> m_classes;
+	uint32_t m_start;
+
+	/// bytes sharing transitions in every state, to shrink the DFA table
+	uint8_t m_byteClass[256];
+	uint32_t m_numByteClasses;
+
+	std::string m_literal;
+	std::string m_error;
+};
+
+/// Lazy DFA running a compiled Regex. Not thread safe, each thread needs
+/// its own matcher.
+class RegexMatcher
+{
+public:
+	/// @remark the regex must outlive the matcher
+	RegexMatcher(const Regex& _regex);
+
+	/// Return true if the line [_begin, _end) holds a match.
+	bool isMatch(const char* _begin, const char* _end);
+
+	/// Find the leftmost longest non empty match starting in [_str, _end)
+	/// of the line [_begin, _end).
+	/// @return false if there is none
+	bool find(const char* _begin, const char* _end, const char* _str, const char** _matchBegin, const char** _matchEnd);
+
+private:
+	/// DFA over sets of NFA states, unanchored DFAs restart the NFA at
+	/// every byte.
+	struct Dfa
+	{
+		struct State
+		{
+			std::vector<uint32_t> nfaStates; //< sorted, empty when dead
+			bool accept;      //< a match ends before the next byte
+			bool acceptAtEnd; //< a match ends here if the line does
+		};
+
+		std::vector<State> states;
+		std::vector<uint32_t> transitions; //< per state and byte class, see encodeState()
+		std::map<std::vector<uint32_t>, uint32_t> ids;
+		uint32_t startIds[2]; //< when not at and at the line beginning, UINT32_MAX until computed
+		uint32_t flushes;
+		bool unanchored;
+	};
+
+	void resetDfa(Dfa& _dfa);
+
+	uint32_t getStartState(Dfa& _dfa, bool _lineBegin);
+	/// Pack the offset of the transitions of a state with its flags.
+	uint32_t encodeState(const Dfa& _dfa, uint32_t _state) const;
+
+	/// Return the encoded state following the encoded _state on _byte.
+	uint32_t getNextState(Dfa& _dfa, uint32_t _state, uint8_t _byte);
+	uint32_t addDfaState(Dfa& _dfa, std::vector<uint32_t>& _nfaStates, bool _lineBegin);
+	void addClosure(std::vector<uint32_t>& _nfaStates, uint32_t _state, bool _lineBegin);
+	void nextMark();
+
+	const Regex& m_regex;
+	Dfa m_anchored;
+	Dfa m_unanchored;
+	std::vector<uint32_t> m_marks; //< per NFA state, m_mark once added to the closure
+	uint32_t m_mark;
+	std::vector<uint32_t> m_stack;
+	std::vector<uint32_t> m_scratch;
+};
+
+#endif // REGEX_MATCHER_H_HEADER_GUARD
@@ -0,0 +1,236 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Checks the errors of Regex, the matches RegexMatcher finds, and that the
+// literal required by a regex is in every line it matches.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "regex_matcher.h"
+
+namespace {
+
+struct ErrorCase {
+  const char* pattern;
+  const char* error;
+};
+
+const ErrorCase kErrorCases[] = {
+    {"(a", "Missing ')'"},
+    {"a)", "Unmatched ')'"},
+    {"[a", "Missing ']'"},
+    {"[^]", "Missing ']'"},
+    {"a\\", "Trailing '\\'"},
+    {"[a\\", "Trailing '\\'"},
+    {"*a", "Nothing to repeat"},
+    {"a|+", "Nothing to repeat"},
+    {"a{x}", "Expected a repetition count"},
+    {"a{2,x}", "Expected a repetition count"},
+    {"a{2", "Missing '}'"},
+    {"a{2,1}", "Invalid repetition range"},
+    {"a{1001}", "Repetition count too large"},
+    {"[z-a]", "Invalid class range"},
+    {"((a{1000}){1000})", "Pattern too complex"},
+};
+
+struct FindCase {
+  const char* pattern;
+  const char* line;
+  bool is_match;
+  int start;  // Offset find() starts at.
+  int begin;  // Expected match, -1 if none.
+  int end;
+};
+
+const FindCase kFindCases[] = {
+    // Leftmost, then longest.
+    {"b+", "abbbc", true, 0, 1, 4},
+    {"a|ab", "xab", true, 0, 1, 3},
+    {"(a|b)*c", "xababcab", true, 0, 1, 6},
+    {"(a*)(b*)", "ccabb", true, 0, 2, 5},
+    // Patterns matching the empty string only find non empty matches.
+    {"x*", "aaa", true, 0, -1, -1},
+    {"x*", "axxb", true, 0, 1, 3},
+    {"a?", "bab", true, 0, 1, 2},
+    {"$", "abc", true, 0, -1, -1},
+    {"^$", "", true, 0, -1, -1},
+    {"a*$", "baa", true, 0, 1, 3},
+    // Anchors hold at the ends of the line, not at the start of find().
+    {"^ab", "abab", true, 0, 0, 2},
+    {"^ab", "abab", true, 2, -1, -1},
+    {"ab$", "abab", true, 0, 2, 4},
+    {"^a$", "aa", false, 0, -1, -1},
+    {"$^", "", true, 0, -1, -1},
+    // Classes and escapes.
+    {"[a-c]+", "xxbcaz", true, 0, 2, 5},
+    {"[^a-c]+", "abxyc", true, 0, 2, 4},
+    {"[]a]+", "x]a]", true, 0, 1, 4},
+    {"[\\d-]+", "x1-2y", true, 0, 1, 4},
+    {"\\w+\\s\\W", "foo bar !x", true, 0, 4, 9},
+    {"\\D\\S", "1 a2b", true, 0, 1, 3},
+    {"\\.", "a.b", true, 0, 1, 2},
+    {"a\\.b", "axb", false, 0, -1, -1},
+    {"\\t[\\t]", "a\t\tb", true, 0, 1, 3},
+    {"a.c", "abc", true, 0, 0, 3},
+    // Counted repetitions.
+    {"\\d{2,3}", "a12345", true, 0, 1, 4},
+    {"a{3}", "aaaaaaa", true, 0, 0, 3},
+    {"a{3}", "aaaaaaa", true, 3, 3, 6},
+    {"a{3}", "aaaaaaa", true, 6, -1, -1},
+    {"a{2,}", "baaaab", true, 0, 1, 5},
+    {"a{0,2}b", "aaab", true, 0, 1, 4},
+    {"(ab){2}", "abababx", true, 0, 0, 4},
+    {"x{0}y", "xy", true, 0, 1, 2},
+};
+
+struct LiteralCase {
+  const char* pattern;
+  const char* literal;
+};
+
+const LiteralCase kLiteralCases[] = {
+    {"abc", "abc"},
+    {"ab+c", "ab"},
+    {"x?yz", "yz"},
+    {"(abc)+d", "abc"},
+    {"a|b", ""},
+    {"^int\\s+main", "main"},
+    {"[a]bc{2}", "abc"},
+    {"foo.*barbaz", "barbaz"},
+};
+
+uint32_t Random(uint32_t* seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 16;
+}
+
+// Random patterns over a few letters, with every operator.
+std::string MakePattern(uint32_t* seed, int depth) {
+  std::string pattern;
+  const uint32_t num_atoms = 1 + Random(seed) % 3;
+  for (uint32_t i = 0; i < num_atoms; ++i) {
+    const uint32_t atom = Random(seed);
+    switch (atom % 10) {
+      case 0: pattern += "."; break;
+      case 1: pattern += "[ab]"; break;
+      case 2: pattern += "[^a]"; break;
+      case 3: pattern += "^"; break;
+      case 4: pattern += "$"; break;
+      case 5:
+        if (depth < 2) {
+          pattern += "(" + MakePattern(seed, depth + 1) + ")";
+          break;
+        }
+        // Fall through.
+      default: pattern += "abc"[atom % 3]; break;
+    }
+    const uint32_t repeat = Random(seed);
+    const char* const kRepeats[] = {"*", "+", "?", "{2}", "{1,3}", "{2,}"};
+    if (repeat % 12 < 6)
+      pattern += kRepeats[repeat % 12];
+  }
+  if (depth < 2 && Random(seed) % 4 == 0)
+    pattern += "|" + MakePattern(seed, depth + 1);
+  return pattern;
+}
+
+}  // namespace
+
+int main() {
+  int failures = 0;
+
+  for (size_t i = 0; i < sizeof(kErrorCases) / sizeof(kErrorCases[0]); ++i) {
+    const ErrorCase& c = kErrorCases[i];
+    Regex regex;
+    if (regex.compile(c.pattern, (uint32_t)strlen(c.pattern)) ||
+        strcmp(regex.getError(), c.error) != 0) {
+      fprintf(stderr, "%s: error \"%s\", expected \"%s\"\n", c.pattern,
+              regex.getError(), c.error);
+      ++failures;
+    }
+  }
+
+  for (size_t i = 0; i < sizeof(kFindCases) / sizeof(kFindCases[0]); ++i) {
+    const FindCase& c = kFindCases[i];
+    Regex regex;
+    if (!regex.compile(c.pattern, (uint32_t)strlen(c.pattern)) ||
+        regex.getError()[0] != '\0') {
+      fprintf(stderr, "%s: %s\n", c.pattern, regex.getError());
+      ++failures;
+      continue;
+    }
+
+    RegexMatcher matcher(regex);
+    const char* begin = c.line;
+    const char* end = c.line + strlen(c.line);
+    if (matcher.isMatch(begin, end) != c.is_match) {
+      fprintf(stderr, "%s on \"%s\": isMatch() is %d\n", c.pattern, c.line,
+              !c.is_match);
+      ++failures;
+    }
+
+    const char* match_begin = NULL;
+    const char* match_end = NULL;
+    int found_begin = -1;
+    int found_end = -1;
+    if (matcher.find(begin, end, begin + c.start, &match_begin, &match_end)) {
+      found_begin = (int)(match_begin - begin);
+      found_end = (int)(match_end - begin);
+    }
+    if (found_begin != c.begin || found_end != c.end) {
+      fprintf(stderr,
+              "%s on \"%s\" from %d: found [%d, %d), expected [%d, %d)\n",
+              c.pattern, c.line, c.start, found_begin, found_end, c.begin,
+              c.end);
+      ++failures;
+    }
+  }
+
+  for (size_t i = 0; i < sizeof(kLiteralCases) / sizeof(kLiteralCases[0]);
+       ++i) {
+    const LiteralCase& c = kLiteralCases[i];
+    Regex regex;
+    regex.compile(c.pattern, (uint32_t)strlen(c.pattern));
+    if (regex.getRequiredLiteral() != c.literal) {
+      fprintf(stderr, "%s: literal \"%s\", expected \"%s\"\n", c.pattern,
+              regex.getRequiredLiteral().c_str(), c.literal);
+      ++failures;
+    }
+  }
+
+  // Lines without the required literal are skipped by the searches, none of
+  // them may match.
+  uint32_t seed = 1;
+  for (int i = 0; i < 2000; ++i) {
+    const std::string pattern = MakePattern(&seed, 0);
+    Regex regex;
+    if (!regex.compile(pattern.data(), (uint32_t)pattern.size())) {
+      fprintf(stderr, "%s: %s\n", pattern.c_str(), regex.getError());
+      ++failures;
+      continue;
+    }
+
+    const std::string& literal = regex.getRequiredLiteral();
+    RegexMatcher matcher(regex);
+    for (int j = 0; j < 20; ++j) {
+      std::string line;
+      const uint32_t length = Random(&seed) % 12;
+      for (uint32_t k = 0; k < length; ++k)
+        line += "abcx"[Random(&seed) % 4];
+
+      if (line.find(literal) == std::string::npos &&
+          matcher.isMatch(line.data(), line.data() + line.size())) {
+        fprintf(stderr, "%s matches \"%s\" without \"%s\"\n", pattern.c_str(),
+                line.c_str(), literal.c_str());
+        ++failures;
+      }
+    }
+  }
+
+  printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
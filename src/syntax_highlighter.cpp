@@ -0,0 +1,584 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "syntax_highlighter.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+// Lines tokenized from a guessed state above a line far from the exact
+// states, most constructs spanning lines are shorter.
+#define HIGHLIGHT_SYNC_LINES 256
+
+namespace
+{
+	// States of the C++ tokenizer at the end of a line.
+	enum CppState
+	{
+		CPP_NORMAL,
+		CPP_BLOCK_COMMENT,
+		CPP_LINE_COMMENT,  //< continued by a backslash
+		CPP_STRING,        //< continued by a backslash
+		CPP_PREPROCESSOR,  //< continued by a backslash
+	};
+
+	// Sorted for findWord().
+	const char* const s_cppKeywords[] =
+	{
+		"alignas", "alignof", "asm", "break", "case", "catch", "class", "const",
+		"const_cast", "constexpr", "continue", "decltype", "default", "delete",
+		"do", "dynamic_cast", "else", "enum", "explicit", "export", "extern",
+		"false", "for", "friend", "goto", "if", "inline", "mutable", "namespace",
+		"new", "noexcept", "nullptr", "operator", "private", "protected",
+		"public", "register", "reinterpret_cast", "return", "sizeof", "static",
+		"static_assert", "static_cast", "struct", "switch", "template", "this",
+		"thread_local", "throw", "true", "try", "typedef", "typeid", "typename",
+		"union", "using", "virtual", "volatile", "while",
+	};
+
+	const char* const s_cppTypes[] =
+	{
+		"auto", "bool", "char", "char16_t", "char32_t", "double", "float",
+		"int", "int16_t", "int32_t", "int64_t", "int8_t", "intptr_t", "long",
+		"ptrdiff_t", "short", "signed", "size_t", "uint16_t", "uint32_t",
+		"uint64_t", "uint8_t", "uintptr_t", "unsigned", "void", "wchar_t",
+	};
+
+	// String literal prefixes, the quote follows them without space.
+	const char* const s_cppStringPrefixes[] =
+	{
+		"L", "LR", "R", "U", "UR", "u", "u8", "u8R", "uR",
+	};
+
+	bool findWord(const char* const* _words, uint32_t _count, const char* _word, uint32_t _length)
+	{
+		uint32_t lo = 0;
+		uint32_t hi = _count;
+		while (lo < hi)
+		{
+			uint32_t mid = (lo + hi) / 2;
+			int32_t cmp = strncmp(_words[mid], _word, _length);
+			if (0 == cmp)
+			{
+				cmp = '\0' == _words[mid][_length] ? 0 : 1;
+			}
+
+			if (0 == cmp)
+			{
+				return true;
+			}
+
+			if (cmp < 0)
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+
+		return false;
+	}
+
+	bool isIdentifierStart(char _ch)
+	{
+		return (_ch >= 'a' && _ch <= 'z')
+			|| (_ch >= 'A' && _ch <= 'Z')
+			|| _ch == '_'
+			|| (uint8_t)_ch >= 0x80 // utf-8
+			;
+	}
+
+	bool isDigit(char _ch)
+	{
+		return _ch >= '0' && _ch <= '9';
+	}
+
+	bool isIdentifier(char _ch)
+	{
+		return isIdentifierStart(_ch) || isDigit(_ch);
+	}
+
+	// A backslash at the end of a line joins it with the next one.
+	bool continuesOnNextLine(const char* _begin, const char* _end)
+	{
+		if (_end > _begin && _end[-1] == '\r')
+		{
+			--_end;
+		}
+
+		return _end > _begin && _end[-1] == '\\';
+	}
+
+	void pushToken(std::vector<Token>* _tokens, const char* _begin, const char* _end, TokenType::Enum _type)
+	{
+		if (NULL == _tokens
+		||  _begin == _end)
+		{
+			return;
+		}
+
+		uint32_t length = (uint32_t)(_end - _begin);
+		if (!_tokens->empty()
+		&&  _tokens->back().type == _type)
+		{
+			_tokens->back().length += length;
+			return;
+		}
+
+		Token token;
+		token.length = length;
+		token.type = _type;
+		_tokens->push_back(token);
+	}
+
+	// Return the end of a block comment, after its "*/", or _end.
+	const char* scanBlockComment(const char* _str, const char* _end, bool* _closed)
+	{
+		for (; _str + 1 < _end; ++_str)
+		{
+			if (_str[0] == '*' && _str[1] == '/')
+			{
+				*_closed = true;
+				return _str + 2;
+			}
+		}
+
+		*_closed = false;
+		return _end;
+	}
+
+	// Return the end of a quoted literal, after its closing quote, or _end.
+	const char* scanQuoted(const char* _str, const char* _end, char _quote, bool* _closed)
+	{
+		for (; _str < _end; ++_str)
+		{
+			if (*_str == '\\'
+			&&  _str + 1 < _end)
+			{
+				++_str;
+			}
+			else if (*_str == _quote)
+			{
+				*_closed = true;
+				return _str + 1;
+			}
+		}
+
+		*_closed = false;
+		return _end;
+	}
+
+	// Return the end of a preprocessor directive on this line, at a comment
+	// or _end.
+	const char* scanPreprocessor(const char* _str, const char* _end)
+	{
+		for (; _str + 1 < _end; ++_str)
+		{
+			if (_str[0] == '/' && (_str[1] == '/' || _str[1] == '*') )
+			{
+				return _str;
+			}
+		}
+
+		return _end;
+	}
+
+	const char* scanNumber(const char* _str, const char* _end)
+	{
+		char prev = '\0';
+		for (; _str < _end; prev = *_str++)
+		{
+			char ch = *_str;
+			bool exponentSign = (ch == '+' || ch == '-')
+				&& (prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P')
+				;
+			bool separator = ch == '\'' && _str + 1 < _end && isIdentifier(_str[1]);
+			if (!isIdentifier(ch)
+			&&  ch != '.'
+			&&  !exponentSign
+			&&  !separator)
+			{
+				break;
+			}
+		}
+
+		return _str;
+	}
+
+} // namespace
+
+LexerState CppTokenizer::tokenize(LexerState _state, const char* _begin, const char* _end, std::vector<Token>* _tokens) const
+{
+	const char* str = _begin;
+	bool closed;
+
+	// Constructs continued from the previous line.
+	switch (_state)
+	{
+	case CPP_BLOCK_COMMENT:
+		str = scanBlockComment(str, _end, &closed);
+		pushToken(_tokens, _begin, str, TokenType::Comment);
+		if (!closed)
+		{
+			return CPP_BLOCK_COMMENT;
+		}
+		break;
+
+	case CPP_LINE_COMMENT:
+		pushToken(_tokens, _begin, _end, TokenType::Comment);
+		return continuesOnNextLine(_begin, _end) ? CPP_LINE_COMMENT : CPP_NORMAL;
+
+	case CPP_STRING:
+		str = scanQuoted(str, _end, '"', &closed);
+		pushToken(_tokens, _begin, str, TokenType::String);
+		if (!closed)
+		{
+			return continuesOnNextLine(_begin, _end) ? CPP_STRING : CPP_NORMAL;
+		}
+		break;
+
+	case CPP_PREPROCESSOR:
+		str = scanPreprocessor(str, _end);
+		pushToken(_tokens, _begin, str, TokenType::Preprocessor);
+		if (str == _end)
+		{
+			return continuesOnNextLine(_begin, _end) ? CPP_PREPROCESSOR : CPP_NORMAL;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	bool lineStart = str == _begin;
+	while (str < _end)
+	{
+		const char* token = str;
+		char ch = *str;
+		char next = str + 1 < _end ? str[1] : '\0';
+
+		if (ch == ' ' || ch == '\t' || ch == '\r')
+		{
+			while (str < _end && (*str == ' ' || *str == '\t' || *str == '\r') )
+			{
+				++str;
+			}
+			pushToken(_tokens, token, str, TokenType::Default);
+			continue;
+		}
+
+		if (ch == '#' && lineStart)
+		{
+			str = scanPreprocessor(str, _end);
+			pushToken(_tokens, token, str, TokenType::Preprocessor);
+			if (str == _end && continuesOnNextLine(_begin, _end) )
+			{
+				return CPP_PREPROCESSOR;
+			}
+		}
+		else if (ch == '/' && next == '/')
+		{
+			pushToken(_tokens, token, _end, TokenType::Comment);
+			return continuesOnNextLine(_begin, _end) ? CPP_LINE_COMMENT : CPP_NORMAL;
+		}
+		else if (ch == '/' && next == '*')
+		{
+			str = scanBlockComment(str + 2, _end, &closed);
+			pushToken(_tokens, token, str, TokenType::Comment);
+			if (!closed)
+			{
+				return CPP_BLOCK_COMMENT;
+			}
+		}
+		else if (ch == '"' || ch == '\'')
+		{
+			str = scanQuoted(str + 1, _end, ch, &closed);
+			pushToken(_tokens, token, str, TokenType::String);
+			if (!closed && ch == '"' && continuesOnNextLine(_begin, _end) )
+			{
+				return CPP_STRING;
+			}
+		}
+		else if (isDigit(ch) || (ch == '.' && isDigit(next) ) )
+		{
+			str = scanNumber(str, _end);
+			pushToken(_tokens, token, str, TokenType::Number);
+		}
+		else if (isIdentifierStart(ch) )
+		{
+			while (str < _end && isIdentifier(*str) )
+			{
+				++str;
+			}
+
+			uint32_t length = (uint32_t)(str - token);
+			if (str < _end
+			&&  (*str == '"' || *str == '\'')
+			&&  findWord(s_cppStringPrefixes, BX_COUNTOF(s_cppStringPrefixes), token, length) )
+			{
+				char quote = *str;
+				str = scanQuoted(str + 1, _end, quote, &closed);
+				pushToken(_tokens, token, str, TokenType::String);
+				if (!closed && quote == '"' && continuesOnNextLine(_begin, _end) )
+				{
+					return CPP_STRING;
+				}
+			}
+			else if (findWord(s_cppKeywords, BX_COUNTOF(s_cppKeywords), token, length) )
+			{
+				pushToken(_tokens, token, str, TokenType::Keyword);
+			}
+			else if (findWord(s_cppTypes, BX_COUNTOF(s_cppTypes), token, length) )
+			{
+				pushToken(_tokens, token, str, TokenType::Type);
+			}
+			else
+			{
+				pushToken(_tokens, token, str, TokenType::Default);
+			}
+		}
+		else
+		{
+			++str;
+			pushToken(_tokens, token, str, TokenType::Default);
+		}
+
+		lineStart = false;
+	}
+
+	return CPP_NORMAL;
+}
+
+SyntaxHighlighter::SyntaxHighlighter(const LineTokenizer* _tokenizer, const LineIndex* _lineIndex)
+	: m_tokenizer(_tokenizer)
+	, m_lineIndex(_lineIndex)
+{
+	for (uint32_t ii = 0; ii < TokenType::Count; ++ii)
+	{
+		m_colors[ii] = 0xffffffff;
+		m_backgroundColors[ii] = 0x000000ff;
+		m_styles[ii] = STYLE_NORMAL;
+	}
+
+	reset();
+}
+
+void SyntaxHighlighter::setColor(TokenType::Enum _type, uint32_t _rgba)
+{
+	m_colors[_type] = _rgba;
+}
+
+void SyntaxHighlighter::setBackgroundColor(TokenType::Enum _type, uint32_t _rgba)
+{
+	m_backgroundColors[_type] = _rgba;
+}
+
+void SyntaxHighlighter::setStyle(TokenType::Enum _type, uint32_t _flags)
+{
+	m_styles[_type] = _flags;
+}
+
+void SyntaxHighlighter::reset()
+{
+	m_states.assign(1, 0);
+	m_exactLines = 1;
+	m_editedLines.clear();
+}
+
+void SyntaxHighlighter::invalidateLines(uint32_t _line, uint32_t _numRemoved, uint32_t _numInserted)
+{
+	// The cached states past the exact ones were never checked since an
+	// earlier edit, which advance() already dropped: the last exact line is
+	// edited again so that a convergence above doesn't skip them.
+	if (m_exactLines < m_states.size() )
+	{
+		const uint32_t line = m_exactLines - 1;
+		std::vector<uint32_t>::iterator it = std::lower_bound(m_editedLines.begin(), m_editedLines.end(), line);
+		if (it == m_editedLines.end()
+		||  *it != line)
+		{
+			m_editedLines.insert(it, line);
+		}
+	}
+
+	// Lines after the edit are renumbered. The new lines are edited, or the
+	// line now following the edit when lines were only removed.
+	const uint32_t numEdited = 0 != _numInserted ? _numInserted : 1;
+	std::vector<uint32_t> editedLines;
+	editedLines.reserve(m_editedLines.size() + numEdited);
+	for (uint32_t ii = 0; ii < m_editedLines.size() && m_editedLines[ii] < _line; ++ii)
+	{
+		editedLines.push_back(m_editedLines[ii]);
+	}
+
+	for (uint32_t ii = 0; ii < numEdited; ++ii)
+	{
+		editedLines.push_back(_line + ii);
+	}
+
+	for (uint32_t ii = 0; ii < m_editedLines.size(); ++ii)
+	{
+		uint32_t line = m_editedLines[ii];
+		if (line >= _line + _numRemoved)
+		{
+			line = line - _numRemoved + _numInserted;
+			if (line >= _line + numEdited)
+			{
+				editedLines.push_back(line);
+			}
+		}
+	}
+	m_editedLines.swap(editedLines);
+
+	if (_line < m_states.size() )
+	{
+		// The state at the start of _line doesn't change. The states inside
+		// the replaced lines are dropped, the state of the line following
+		// them is kept as the candidate for convergence.
+		const uint32_t kept = 0 != _numRemoved && 0 != _numInserted ? 1 : 0;
+		const uint32_t available = (uint32_t)m_states.size() - (_line + 1);
+		uint32_t numErased = _numRemoved - kept;
+		numErased = numErased < available ? numErased : available;
+
+		const LexerState state = m_states[_line];
+		std::vector<LexerState>::iterator it = m_states.begin() + _line + 1;
+		it = m_states.erase(it, it + numErased);
+		m_states.insert(it, _numInserted - kept, state);
+
+		uint32_t lineCount = m_lineIndex->getLineCount();
+		if (m_states.size() > lineCount)
+		{
+			m_states.resize(lineCount);
+		}
+	}
+
+	m_exactLines = _line + 1 < m_exactLines ? _line + 1 : m_exactLines;
+	m_exactLines = m_exactLines < m_states.size() ? m_exactLines : (uint32_t)m_states.size();
+}
+
+void SyntaxHighlighter::update(uint32_t _maxLines)
+{
+	advance(_maxLines);
+}
+
+void SyntaxHighlighter::advance(uint32_t _numLines)
+{
+	const uint32_t lineCount = m_lineIndex->getLineCount();
+	for (uint32_t ii = 0; ii < _numLines && m_exactLines < lineCount; ++ii)
+	{
+		// The end state of the last exact line starts the next one.
+		const uint32_t line = m_exactLines - 1;
+		LexerState state = m_tokenizer->tokenize(m_states[line], m_lineIndex->getLineBegin(line), m_lineIndex->getLineEnd(line), NULL);
+
+		while (!m_editedLines.empty()
+		&&     m_editedLines.front() <= line)
+		{
+			m_editedLines.erase(m_editedLines.begin() );
+		}
+
+		const uint32_t next = line + 1;
+		if (next < m_states.size()
+		&&  m_states[next] == state)
+		{
+			// Converged, the cached states are right up to the next edit.
+			uint32_t exact = m_editedLines.empty() ? UINT32_MAX : m_editedLines.front() + 1;
+			m_exactLines = exact < m_states.size() ? exact : (uint32_t)m_states.size();
+			continue;
+		}
+
+		if (next < m_states.size() )
+		{
+			m_states[next] = state;
+		}
+		else
+		{
+			m_states.push_back(state);
+		}
+
+		m_exactLines = next + 1;
+	}
+}
+
+bool SyntaxHighlighter::highlightLines(uint32_t _firstLine, uint32_t _numLines, std::vector<StyleRun>* _runs)
+{
+	_runs->clear();
+
+	const uint32_t lineCount = m_lineIndex->getLineCount();
+	if (_firstLine >= lineCount)
+	{
+		return true;
+	}
+
+	_numLines = _numLines < lineCount - _firstLine ? _numLines : lineCount - _firstLine;
+
+	// Catch up when close enough, the visible lines are cached on the way.
+	if (_firstLine < m_exactLines + HIGHLIGHT_SYNC_LINES)
+	{
+		uint32_t lastLine = _firstLine + _numLines - 1;
+		if (lastLine >= m_exactLines)
+		{
+			advance(lastLine + 1 - m_exactLines);
+		}
+	}
+
+	bool exact = _firstLine < m_exactLines;
+	LexerState state;
+	if (exact)
+	{
+		state = m_states[_firstLine];
+	}
+	else
+	{
+		// Too far to catch up now: start a few lines above, from the state
+		// cached there before edits if any, and count on convergence.
+		uint32_t line = _firstLine - HIGHLIGHT_SYNC_LINES;
+		state = line < m_states.size() ? m_states[line] : 0;
+		for (; line < _firstLine; ++line)
+		{
+			state = m_tokenizer->tokenize(state, m_lineIndex->getLineBegin(line), m_lineIndex->getLineEnd(line), NULL);
+		}
+	}
+
+	for (uint32_t ii = 0; ii < _numLines; ++ii)
+	{
+		const uint32_t line = _firstLine + ii;
+		m_tokens.clear();
+		state = m_tokenizer->tokenize(state, m_lineIndex->getLineBegin(line), m_lineIndex->getLineEnd(line), &m_tokens);
+
+		for (uint32_t jj = 0; jj < m_tokens.size(); ++jj)
+		{
+			appendRun(_runs, m_tokens[jj].length, m_tokens[jj].type);
+		}
+
+		// line feed
+		if (ii + 1 < _numLines)
+		{
+			appendRun(_runs, 1, TokenType::Default);
+		}
+	}
+
+	return exact;
+}
+
+void SyntaxHighlighter::appendRun(std::vector<StyleRun>* _runs, uint32_t _length, TokenType::Enum _type) const
+{
+	if (!_runs->empty()
+	&&  _runs->back().textColor == m_colors[_type]
+	&&  _runs->back().backgroundColor == m_backgroundColors[_type]
+	&&  _runs->back().styleFlags == m_styles[_type])
+	{
+		_runs->back().length += _length;
+		return;
+	}
+
+	StyleRun run;
+	run.length = _length;
+	run.textColor = m_colors[_type];
+	run.backgroundColor = m_backgroundColors[_type];
+	run.styleFlags = m_styles[_type];
+	_runs->push_back(run);
+}
@@ -0,0 +1,121 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SYNTAX_HIGHLIGHTER_H_HEADER_GUARD
+#define SYNTAX_HIGHLIGHTER_H_HEADER_GUARD
+
+#include <vector>
+
+#include "line_index.h"
+#include "text_buffer_manager.h"
+
+/// Tokenizer state at a line boundary, 0 at the beginning of a text.
+typedef uint32_t LexerState;
+
+struct TokenType
+{
+	enum Enum
+	{
+		Default,
+		Keyword,
+		Type,
+		Number,
+		String,
+		Comment,
+		Preprocessor,
+
+		Count
+	};
+};
+
+struct Token
+{
+	uint32_t length; //< bytes
+	TokenType::Enum type;
+};
+
+/// Splits the lines of a language in tokens. A line only depends on the
+/// state left by the previous one, which is how the highlighter resumes
+/// anywhere in a text.
+class LineTokenizer
+{
+public:
+	virtual ~LineTokenizer() {}
+
+	/// Tokenize [_begin, _end), a line without its line feed, starting in
+	/// _state. Tokens are appended to _tokens, adjacent tokens of the same
+	/// type are merged. Only the state is computed when _tokens is NULL.
+	/// @return state at the end of the line
+	virtual LexerState tokenize(LexerState _state, const char* _begin, const char* _end, std::vector<Token>* _tokens) const = 0;
+};
+
+/// C and C++ tokenizer. Raw string literals are tokenized as regular
+/// string literals.
+class CppTokenizer : public LineTokenizer
+{
+public:
+	virtual LexerState tokenize(LexerState _state, const char* _begin, const char* _end, std::vector<Token>* _tokens) const;
+};
+
+/// Colors the lines of a text, caching the tokenizer state at the start of
+/// each line. Lines are highlighted from the state cached for them, after
+/// an edit only the lines following it are tokenized again, until their
+/// states are the ones cached before the edit.
+class SyntaxHighlighter
+{
+public:
+	/// @remark the ownership of the tokenizer and of the index is not taken
+	SyntaxHighlighter(const LineTokenizer* _tokenizer, const LineIndex* _lineIndex);
+
+	void setColor(TokenType::Enum _type, uint32_t _rgba);
+	void setBackgroundColor(TokenType::Enum _type, uint32_t _rgba);
+	void setStyle(TokenType::Enum _type, uint32_t _flags);
+
+	/// Drop every cached state, after the whole text changed.
+	void reset();
+
+	/// Lines [_line, _line + _numRemoved) of the text were replaced by
+	/// _numInserted lines, the line index must be up to date.
+	void invalidateLines(uint32_t _line, uint32_t _numRemoved, uint32_t _numInserted);
+
+	/// Tokenize up to _maxLines lines past the exact cached states, to be
+	/// called when idle so that jumps deep in the text find their state.
+	void update(uint32_t _maxLines);
+
+	/// Number of lines whose start state is exact.
+	uint32_t getExactLineCount() const
+	{
+		return m_exactLines;
+	}
+
+	/// Style runs of lines [_firstLine, _firstLine + _numLines), line feeds
+	/// included, for TextBufferManager::appendRuns() with the text starting
+	/// at the beginning of _firstLine. A line far past the exact states
+	/// starts from a state guessed a few lines above it.
+	/// @return true when the lines were highlighted from exact states
+	bool highlightLines(uint32_t _firstLine, uint32_t _numLines, std::vector<StyleRun>* _runs);
+
+private:
+	void advance(uint32_t _numLines);
+	void appendRun(std::vector<StyleRun>* _runs, uint32_t _length, TokenType::Enum _type) const;
+
+	const LineTokenizer* m_tokenizer;
+	const LineIndex* m_lineIndex;
+	uint32_t m_colors[TokenType::Count];
+	uint32_t m_backgroundColors[TokenType::Count];
+	uint32_t m_styles[TokenType::Count];
+
+	/// State at the start of each line, exact up to m_exactLines, then
+	/// cached before edits
+	std::vector<LexerState> m_states;
+	uint32_t m_exactLines;
+
+	/// Sorted lines edited since their end state was computed, convergence
+	/// never skips them.
+	std::vector<uint32_t> m_editedLines;
+
+	std::vector<Token> m_tokens;
+};
+
+#endif // SYNTAX_HIGHLIGHTER_H_HEADER_GUARD
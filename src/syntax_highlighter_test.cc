@@ -0,0 +1,182 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Checks that a SyntaxHighlighter kept up to date by invalidateLines() and
+// incremental updates colors a text like a new highlighter does, over random
+// edits of C++-ish text that open and close comments, strings and
+// preprocessor lines continued by a backslash.
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "line_index.h"
+#include "syntax_highlighter.h"
+
+namespace {
+
+const uint32_t kEdits = 3000;
+// More than the lines the highlighter resyncs over, so that lines far past
+// the exact states are guessed.
+const uint32_t kInitialSnippets = 4000;
+// Every few edits, the highlighter is brought up to date and every line
+// checked, rather than the exact ones.
+const uint32_t kFullCheckEdits = 16;
+
+// Pieces of text, many of which change the state of the tokenizer.
+const char* const kSnippets[] = {
+    "/*",      "*/",     "\"",        "\\",        "\n",        "\n",
+    "\n",      "\\\n",   "// ",       "#define X", "#include ", "int ",
+    "return ", "x = 1;", "'c'",       "0x1f",      " ",         "abc",
+    "{",       "}",      "\"a\\\"b\"", "/* c */",   "R\"(",      ")\"",
+};
+
+uint32_t Random(uint32_t* seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 16;
+}
+
+std::string RandomText(uint32_t num_snippets, uint32_t* seed) {
+  std::string text;
+  const uint32_t kNumSnippets = sizeof(kSnippets) / sizeof(kSnippets[0]);
+  for (uint32_t i = 0; i < num_snippets; ++i)
+    text += kSnippets[Random(seed) % kNumSnippets];
+  return text;
+}
+
+uint32_t CountLineFeeds(const std::string& text, size_t begin, size_t end) {
+  uint32_t count = 0;
+  for (size_t i = begin; i < end; ++i)
+    count += '\n' == text[i] ? 1 : 0;
+  return count;
+}
+
+// Distinct colors per token type, so that runs of different types don't
+// merge.
+void SetColors(SyntaxHighlighter* highlighter) {
+  for (uint32_t i = 0; i < TokenType::Count; ++i)
+    highlighter->setColor((TokenType::Enum)i, 0x10203000 + i);
+}
+
+bool SameRuns(const std::vector<StyleRun>& a, const std::vector<StyleRun>& b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].length != b[i].length || a[i].textColor != b[i].textColor ||
+        a[i].backgroundColor != b[i].backgroundColor ||
+        a[i].styleFlags != b[i].styleFlags) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Replaces a random part of |text| and tells |highlighter|, after updating
+// |line_index|. Edits replace bytes within and across lines, or insert or
+// remove whole lines.
+void Edit(std::string* text,
+          LineIndex* line_index,
+          SyntaxHighlighter* highlighter,
+          uint32_t* seed) {
+  const uint32_t line_count = line_index->getLineCount();
+  const char* base = line_index->getText();
+  uint32_t line;
+  uint32_t num_removed;
+  uint32_t num_inserted;
+  const uint32_t kind = Random(seed) % 4;
+  if (0 == kind) {
+    // Whole lines inserted before a line.
+    line = Random(seed) % line_count;
+    std::string inserted = RandomText(Random(seed) % 8, seed) + "\n";
+    const size_t offset = line_index->getLineBegin(line) - base;
+    num_removed = 0;
+    num_inserted = CountLineFeeds(inserted, 0, inserted.size());
+    text->insert(offset, inserted);
+  } else if (1 == kind && line_count > 1) {
+    // Whole lines removed, the last line stays.
+    line = Random(seed) % (line_count - 1);
+    const uint32_t max_removed = line_count - 1 - line;
+    num_removed = 1 + Random(seed) % (max_removed < 4 ? max_removed : 4);
+    num_inserted = 0;
+    const size_t begin = line_index->getLineBegin(line) - base;
+    const size_t end = line_index->getLineBegin(line + num_removed) - base;
+    text->erase(begin, end - begin);
+  } else {
+    // Bytes replaced, from one line to the lines the removed bytes spanned.
+    const size_t begin = Random(seed) % (text->size() + 1);
+    size_t end = begin + Random(seed) % 24;
+    end = end < text->size() ? end : text->size();
+    const std::string inserted = RandomText(Random(seed) % 4, seed);
+    line = CountLineFeeds(*text, 0, begin);
+    num_removed = 1 + CountLineFeeds(*text, begin, end);
+    num_inserted = 1 + CountLineFeeds(inserted, 0, inserted.size());
+    text->replace(begin, end - begin, inserted);
+  }
+  line_index->reset(text->data(), (uint32_t)text->size());
+  highlighter->invalidateLines(line, num_removed, num_inserted);
+}
+
+}  // namespace
+
+int main() {
+  CppTokenizer tokenizer;
+  uint32_t seed = 1;
+  std::string text = RandomText(kInitialSnippets, &seed);
+  LineIndex line_index;
+  line_index.reset(text.data(), (uint32_t)text.size());
+  SyntaxHighlighter highlighter(&tokenizer, &line_index);
+  SetColors(&highlighter);
+
+  int failures = 0;
+  std::vector<StyleRun> runs;
+  std::vector<StyleRun> expected_runs;
+  for (uint32_t edit = 0; edit < kEdits && failures < 10; ++edit) {
+    Edit(&text, &line_index, &highlighter, &seed);
+    const uint32_t line_count = line_index.getLineCount();
+
+    // What the viewer does between edits: idle updates, and the lines
+    // shown, which may be far past the exact states.
+    switch (Random(&seed) % 3) {
+      case 0:
+        highlighter.update(Random(&seed) % 64);
+        break;
+      case 1: {
+        const uint32_t first = Random(&seed) % line_count;
+        highlighter.highlightLines(first, 1 + Random(&seed) % 60, &runs);
+        break;
+      }
+      default:
+        break;
+    }
+
+    // The lines with exact states, or all of them, are colored as from
+    // scratch. Lines are highlighted one at a time, from their cached state.
+    const bool full = 0 == edit % kFullCheckEdits;
+    if (full)
+      highlighter.update(line_count);
+    const uint32_t num_lines = highlighter.getExactLineCount();
+    if (full && num_lines != line_count) {
+      fprintf(stderr, "edit %d: %d exact lines of %d after a full update\n",
+              (int)edit, (int)num_lines, (int)line_count);
+      ++failures;
+    }
+    SyntaxHighlighter expected(&tokenizer, &line_index);
+    SetColors(&expected);
+    expected.update(num_lines);
+    for (uint32_t line = 0; line < num_lines; ++line) {
+      expected.highlightLines(line, 1, &expected_runs);
+      highlighter.highlightLines(line, 1, &runs);
+      if (!SameRuns(runs, expected_runs)) {
+        fprintf(stderr, "edit %d: line %d of %d differs\n", (int)edit,
+                (int)line, (int)line_count);
+        ++failures;
+        break;
+      }
+    }
+  }
+
+  printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
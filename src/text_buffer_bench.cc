@@ -0,0 +1,304 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Offline benchmarks of the text buffers against fake_bgfx, run from the
+// repository root: text_buffer_bench [font.ttf]
+
+#include <bx/bx.h>
+#include <bx/timer.h>
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "cube_atlas.h"
+#include "fake_bgfx.h"
+#include "font_manager.h"
+#include "job_pool.h"
+#include "text_buffer_manager.h"
+
+namespace {
+
+const uint32_t kIterations = 20;
+
+// A log scrolled by a whole screen per frame: 4K at 12px, 320 columns by
+// 180 lines, some of them empty.
+const uint32_t kColumns = 320;
+const uint32_t kLines = 180;
+
+// The fonts and buffers of the viewer, in the growing paged atlas.
+class Scene {
+ public:
+  Scene()
+      : atlas_(new Atlas(128, 4096, AtlasFormat::Pages, 1024)),
+        font_manager_(new FontManager(atlas_)),
+        text_buffer_manager_(new TextBufferManager(font_manager_)) {
+    ttf_.idx = bgfx::invalidHandle;
+    base_font_.idx = bgfx::invalidHandle;
+    font_.idx = bgfx::invalidHandle;
+  }
+
+  ~Scene() {
+    if (bgfx::isValid(font_)) {
+      font_manager_->destroyFont(font_);
+      font_manager_->destroyFont(base_font_);
+    }
+    if (bgfx::isValid(ttf_))
+      font_manager_->destroyTtf(ttf_);
+    delete text_buffer_manager_;
+    delete font_manager_;
+    delete atlas_;
+  }
+
+  bool LoadFont(const char* path, uint32_t font_type) {
+    FILE* file = fopen(path, "rb");
+    if (NULL == file)
+      return false;
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+      data.insert(data.end(), buffer, buffer + size);
+    fclose(file);
+    ttf_ = font_manager_->createTtf(&data[0], (uint32_t)data.size());
+    if (!bgfx::isValid(ttf_))
+      return false;
+    base_font_ = font_manager_->createFontByPixelSize(
+        ttf_, 0, 48, font_type);
+    font_ = font_manager_->createScaledFontToPixelSize(base_font_, 12);
+    return true;
+  }
+
+  FontManager* font_manager() { return font_manager_; }
+  TextBufferManager* text_buffer_manager() { return text_buffer_manager_; }
+  FontHandle font() const { return font_; }
+
+ private:
+  Atlas* atlas_;
+  FontManager* font_manager_;
+  TextBufferManager* text_buffer_manager_;
+  TrueTypeHandle ttf_;
+  FontHandle base_font_;
+  FontHandle font_;
+};
+
+// Lines of printable ASCII of up to |kColumns| characters.
+std::vector<std::string> MakeLines() {
+  std::vector<std::string> lines;
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < kLines; ++i) {
+    seed = seed * 1103515245 + 12345;
+    const uint32_t length = (seed >> 16) % (kColumns + 1);
+    std::string line;
+    for (uint32_t j = 0; j < length; ++j) {
+      seed = seed * 1103515245 + 12345;
+      line += (char)(' ' + (seed >> 16) % 95);
+    }
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+double Seconds(int64_t elapsed) {
+  return double(elapsed) / double(bx::getHPFrequency());
+}
+
+// appendLines() of a screen of text with no job pool, then with pools of
+// more and more threads. The glyphs are in the atlas before timing.
+void BenchAppendLines(Scene* scene) {
+  const std::vector<std::string> lines = MakeLines();
+  std::vector<TextLine> text_lines(lines.size());
+  uint32_t glyphs = 0;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    text_lines[i].begin = lines[i].data();
+    text_lines[i].end = lines[i].data() + lines[i].size();
+    glyphs += (uint32_t)lines[i].size();
+  }
+
+  TextBufferManager* text_buffer_manager = scene->text_buffer_manager();
+  TextBufferHandle buffer = text_buffer_manager->createTextBuffer(
+      FONT_TYPE_DISTANCE, BufferType::Transient);
+
+  printf("appendLines() of %d lines, %d glyphs:\n",
+         static_cast<int>(lines.size()),
+         static_cast<int>(glyphs));
+  const uint32_t kWorkerThreads[] = {0, 1, 2, 3, 5, 7};
+  double serial = 0.0;
+  for (size_t i = 0; i < BX_COUNTOF(kWorkerThreads); ++i) {
+    JobPool* job_pool =
+        0 == i ? NULL : new JobPool(kWorkerThreads[i]);
+    int64_t elapsed = 0;
+    for (uint32_t iteration = 0; iteration <= kIterations; ++iteration) {
+      text_buffer_manager->clearTextBuffer(buffer);
+      int64_t start = bx::getHPCounter();
+      text_buffer_manager->appendLines(buffer,
+                                       scene->font(),
+                                       &text_lines[0],
+                                       (uint32_t)text_lines.size(),
+                                       job_pool);
+      // The first iteration loads the glyphs.
+      if (0 != iteration)
+        elapsed += bx::getHPCounter() - start;
+      text_buffer_manager->submitTextBuffer(buffer, 0);
+      scene->font_manager()->update();
+    }
+    const double milliseconds = Seconds(elapsed) * 1000.0 / kIterations;
+    if (NULL == job_pool)
+      serial = milliseconds;
+    printf("  %d threads %8.3f ms (%.2fx)\n",
+           static_cast<int>(NULL == job_pool ? 1
+                                             : job_pool->getThreadCount()),
+           milliseconds,
+           milliseconds > 0.0 ? serial / milliseconds : 0.0);
+    delete job_pool;
+  }
+
+  text_buffer_manager->destroyTextBuffer(buffer);
+}
+
+// Appends |text| to |buffer| |kIterations| times, after once to load the
+// glyphs, and returns the glyphs appended per second. The vertices of the
+// last frame are left in |vertices|.
+template <typename Char>
+double AppendText(Scene* scene,
+                  TextBufferHandle buffer,
+                  const std::basic_string<Char>& text,
+                  uint32_t glyphs,
+                  std::vector<uint8_t>* vertices) {
+  TextBufferManager* text_buffer_manager = scene->text_buffer_manager();
+  int64_t elapsed = 0;
+  for (uint32_t iteration = 0; iteration <= kIterations; ++iteration) {
+    text_buffer_manager->clearTextBuffer(buffer);
+    fake_bgfx::Reset();
+    int64_t start = bx::getHPCounter();
+    text_buffer_manager->appendText(
+        buffer, scene->font(), text.data(), text.data() + text.size());
+    if (0 != iteration)
+      elapsed += bx::getHPCounter() - start;
+    text_buffer_manager->submitTextBuffer(buffer, 0);
+    scene->font_manager()->update();
+  }
+  *vertices = fake_bgfx::GetDrawData();
+  const double seconds = Seconds(elapsed);
+  return seconds > 0.0 ? double(glyphs) * kIterations / seconds : 0.0;
+}
+
+// appendText() of a screen of text: utf-8 is resolved in glyph runs written
+// by emitGlyphQuads(), wide characters glyph by glyph by writeQuad().
+void BenchAppendText(Scene* scene) {
+  const std::vector<std::string> lines = MakeLines();
+  std::string text;
+  uint32_t glyphs = 0;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    text += (0 == i ? "" : "\n") + lines[i];
+    glyphs += (uint32_t)lines[i].size();
+  }
+  // The lines are ASCII.
+  const std::wstring wide_text(text.begin(), text.end());
+
+  TextBufferHandle buffer = scene->text_buffer_manager()->createTextBuffer(
+      FONT_TYPE_DISTANCE, BufferType::Transient);
+  std::vector<uint8_t> glyph_vertices;
+  std::vector<uint8_t> run_vertices;
+  const double per_glyph =
+      AppendText(scene, buffer, wide_text, glyphs, &glyph_vertices);
+  const double runs = AppendText(scene, buffer, text, glyphs, &run_vertices);
+  scene->text_buffer_manager()->destroyTextBuffer(buffer);
+
+  printf("appendText() of %d glyphs:\n", static_cast<int>(glyphs));
+  printf("  by glyph %12.0f glyphs/s\n", per_glyph);
+  printf("  by run   %12.0f glyphs/s (%.1fx)%s\n",
+         runs,
+         per_glyph > 0.0 ? runs / per_glyph : 0.0,
+         run_vertices == glyph_vertices ? "" : " OUTPUT MISMATCH");
+}
+
+void PrintUploads(const char* name,
+                  const fake_bgfx::Uploads& uploads,
+                  uint32_t frames) {
+  const double kKB = 1024.0 * frames;
+  const uint64_t total = uploads.vertex_bytes + uploads.instance_bytes +
+                         uploads.uniform_bytes + uploads.uv_table_bytes +
+                         uploads.texel_bytes;
+  printf("  %-16s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+         name,
+         uploads.vertex_bytes / kKB,
+         uploads.instance_bytes / kKB,
+         uploads.uniform_bytes / kKB,
+         uploads.uv_table_bytes / kKB,
+         uploads.texel_bytes / kKB,
+         total / kKB);
+}
+
+// Bytes handed to bgfx per submit of a screen of text, a color per line, by
+// a transient buffer and by an instanced one, in scenes of their own: the
+// first frame loads the glyphs, the next ones only upload the text.
+void BenchUploadBytes(const char* font_path) {
+  const uint32_t kColors[] = {0x839496ff, 0xdc322fff, 0x859900ff, 0x268bd2ff};
+  const std::vector<std::string> lines = MakeLines();
+  std::string text;
+  std::vector<StyleRun> runs(lines.size());
+  uint32_t glyphs = 0;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    // Line feeds go with the line before them.
+    const std::string line = lines[i] + (i + 1 < lines.size() ? "\n" : "");
+    text += line;
+    runs[i].length = (uint32_t)line.size();
+    runs[i].textColor = kColors[i % BX_COUNTOF(kColors)];
+    runs[i].backgroundColor = 0x002b36ff;
+    runs[i].styleFlags = STYLE_NORMAL;
+    glyphs += (uint32_t)lines[i].size();
+  }
+
+  printf("upload per submit of %d glyphs in %d colors, KB:\n",
+         static_cast<int>(glyphs),
+         static_cast<int>(BX_COUNTOF(kColors)));
+  printf("  %-16s %9s %9s %9s %9s %9s %9s\n", "", "vertices", "instances",
+         "uniforms", "uv table", "texels", "total");
+  const BufferType::Enum kBufferTypes[] = {BufferType::Transient,
+                                           BufferType::Instanced};
+  const char* const kNames[] = {"transient", "instanced"};
+  for (size_t i = 0; i < BX_COUNTOF(kBufferTypes); ++i) {
+    Scene scene;
+    if (!scene.LoadFont(font_path, FONT_TYPE_DISTANCE_SUBPIXEL))
+      return;
+    TextBufferManager* text_buffer_manager = scene.text_buffer_manager();
+    TextBufferHandle buffer = text_buffer_manager->createTextBuffer(
+        FONT_TYPE_DISTANCE_SUBPIXEL, kBufferTypes[i]);
+    for (uint32_t iteration = 0; iteration <= kIterations; ++iteration) {
+      // Counted from the first frame, then over the next ones.
+      if (iteration <= 1)
+        fake_bgfx::Reset();
+      text_buffer_manager->clearTextBuffer(buffer);
+      text_buffer_manager->appendRuns(
+          buffer, scene.font(), text.data(), &runs[0], (uint32_t)runs.size());
+      text_buffer_manager->submitTextBuffer(buffer, 0);
+      scene.font_manager()->update();
+      if (0 == iteration) {
+        const std::string name = std::string(kNames[i]) + ", first";
+        PrintUploads(name.c_str(), fake_bgfx::GetUploads(), 1);
+      }
+    }
+    PrintUploads(kNames[i], fake_bgfx::GetUploads(), kIterations);
+    text_buffer_manager->destroyTextBuffer(buffer);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* font_path = argc > 1 ? argv[1] : "art/VeraMono.ttf";
+
+  Scene scene;
+  if (!scene.LoadFont(font_path, FONT_TYPE_DISTANCE)) {
+    fprintf(stderr, "Unable to load %s\n", font_path);
+    return 1;
+  }
+
+  BenchAppendLines(&scene);
+  BenchAppendText(&scene);
+  BenchUploadBytes(font_path);
+  return 0;
+}
@@ -6,16 +6,97 @@
 #include <bgfx.h>
 #include <stddef.h> // offsetof
 #include <memory.h> // memcpy
+#include <math.h>   // floorf
+#include <string.h> // strlen, memchr
 #include <wchar.h>  // wcslen
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define TEXT_BUFFER_SSE2 1
+#else
+#	define TEXT_BUFFER_SSE2 0
+#endif // SSE2
+
 #include "text_buffer_manager.h"
 #include "utf8.h"
 #include "cube_atlas.h"
+#include "glyph_emit.h"
+#include "job_pool.h"
 
 #include "../.build/vs_fontsdf.bin.h"
 #include "../.build/fs_fontsdf.bin.h"
+#include "../.build/vs_fontsdf_pages.bin.h"
+#include "../.build/fs_fontsdf_pages.bin.h"
+#include "../.build/vs_fontsdf_instanced.bin.h"
+
+// Indices are 16-bit, large buffers are split in chunks of 64K vertices that
+// are submitted as separate draws. All the chunks share the same quad index
+// buffer.
+#define MAX_CHUNK_VERTICES 65536
+#define MAX_CHUNK_QUADS (MAX_CHUNK_VERTICES / 4)
+
+// Quads allocated by the first append, the storage doubles when full.
+#define MIN_BUFFERED_QUADS 256
+
+// Flags a quad showing a whole atlas layer rather than a region.
+#define QUAD_ATLAS_LAYER UINT32_C(0x80000000)
+
+// Colors an instanced text buffer can use, see vs_fontsdf_instanced.sc.
+#define MAX_PALETTE_COLORS 64
+
+// Instanced quad sizes are stored in quarter pixels on 12 bits.
+#define MAX_INSTANCE_QUAD_SIZE 4095
+
+// Decorations drawn under or over the glyphs, in drawing order.
+#define NUM_DECORATIONS 4
+static const uint32_t s_decorationStyles[NUM_DECORATIONS] =
+{
+	STYLE_BACKGROUND,
+	STYLE_UNDERLINE,
+	STYLE_OVERLINE,
+	STYLE_STRIKE_THROUGH,
+};
+
+// Bytes appendText() checks at once for ASCII characters.
+#define ASCII_BLOCK_SIZE 16
+
+// Adaptive buffers are kept on the GPU after that many submits without
+// changes, and streamed again after that many submits with changes.
+#define ADAPTIVE_PROMOTE_FRAMES 30
+#define ADAPTIVE_DEMOTE_FRAMES 4
 
-#define MAX_BUFFERED_CHARACTERS (8192 - 5)
+/// Return true if the ASCII_BLOCK_SIZE bytes at _str are ASCII characters.
+static inline bool isAsciiBlock(const char* _str)
+{
+#if TEXT_BUFFER_SSE2
+	const __m128i block = _mm_loadu_si128( (const __m128i*)_str);
+	return 0 == _mm_movemask_epi8(block);
+#else
+	uint32_t highBits = 0;
+	for (uint32_t ii = 0; ii < ASCII_BLOCK_SIZE; ii += 4)
+	{
+		uint32_t word;
+		memcpy(&word, &_str[ii], sizeof(word) );
+		highBits |= word;
+	}
+
+	return 0 == (highBits & UINT32_C(0x80808080) );
+#endif // TEXT_BUFFER_SSE2
+}
+
+/// Run _fn on [0, _count) on the threads of _jobPool, or on the calling
+/// thread without a pool.
+static void parallelFor(JobPool* _jobPool, uint32_t _count, uint32_t _batchSize, JobPool::JobFn _fn, void* _userData)
+{
+	if (NULL != _jobPool)
+	{
+		_jobPool->parallelFor(_count, _batchSize, _fn, _userData);
+	}
+	else
+	{
+		_fn(_userData, 0, _count);
+	}
+}
 
 class TextBuffer
 {
@@ -23,11 +104,17 @@ public:
 
 	/// TextBuffer is bound to a fontManager for glyph retrieval
 	/// @remark the ownership of the manager is not taken
-	TextBuffer(FontManager* _fontManager);
+	/// @param instanced store one GlyphInstance per quad instead of four vertices
+	TextBuffer(FontManager* _fontManager, bool _instanced = false);
 	~TextBuffer();
 
 	void setStyle(uint32_t _flags = STYLE_NORMAL)
 	{
+		if (_flags != m_styleFlags)
+		{
+			closeSpans(m_spans);
+		}
+
 		m_styleFlags = _flags;
 	}
 
@@ -59,6 +146,8 @@ public:
 	void setPenPosition(float _x, float _y)
 	{
 		m_penX = _x; m_penY = _y;
+		m_previousFontHandle.idx = bx::HandleAlloc::invalid;
+		closeSpans(m_spans);
 	}
 
 	/// Append an ASCII/utf-8 string to the buffer using current pen
@@ -68,6 +157,13 @@ public:
 	/// Append a wide char unicode string to the buffer using current pen
 	/// position and color.
 	void appendText(FontHandle _fontHandle, const wchar_t* _string, const wchar_t* _end = NULL);
+
+	/// Append utf-8 text, switching color and style at each run.
+	void appendRuns(FontHandle _fontHandle, const char* _string, const StyleRun* _runs, uint32_t _numRuns);
+
+	/// Append utf-8 lines of text as if separated by line feeds, laid out
+	/// on the threads of _jobPool, or on the calling thread if NULL.
+	void appendLines(FontHandle _fontHandle, const TextLine* _lines, uint32_t _numLines, JobPool* _jobPool = NULL);
 	
 	/// Append a whole face of the atlas cube, mostly used for debugging
 	/// and visualizing atlas.
@@ -76,11 +172,9 @@ public:
 	/// Clear the text buffer and reset its state (pen/color)
 	void clearTextBuffer();
 
-	/// Get pointer to the vertex buffer to submit it to the graphic card.
-	const uint8_t* getVertexBuffer()
-	{
-		return (uint8_t*) m_vertexBuffer;
-	}
+	/// Pack the UVs of every quad again, after the atlas moved regions or
+	/// grew. The regions must still be alive.
+	void repackUVs();
 
 	/// Number of vertex in the vertex buffer.
 	uint32_t getVertexCount() const
@@ -94,22 +188,77 @@ public:
 		return sizeof(TextVertex);
 	}
 
-	/// get a pointer to the index buffer to submit it to the graphic
-	const uint16_t* getIndexBuffer() const
+	/// Number of draws needed to submit the buffer, each chunk holds at most
+	/// MAX_CHUNK_VERTICES vertices.
+	uint32_t getChunkCount() const
+	{
+		return (m_vertexCount + MAX_CHUNK_VERTICES - 1) / MAX_CHUNK_VERTICES;
+	}
+
+	/// Get pointer to the vertices of a chunk to submit it to the graphic card.
+	const uint8_t* getChunkVertexBuffer(uint32_t _chunk) const
+	{
+		return (const uint8_t*) &m_vertexBuffer[_chunk * MAX_CHUNK_VERTICES];
+	}
+
+	/// Number of vertex in a chunk.
+	uint32_t getChunkVertexCount(uint32_t _chunk) const
+	{
+		uint32_t remaining = m_vertexCount - _chunk * MAX_CHUNK_VERTICES;
+		return remaining < MAX_CHUNK_VERTICES ? remaining : MAX_CHUNK_VERTICES;
+	}
+
+	/// Number of index to draw a chunk with the shared quad index buffer.
+	uint32_t getChunkIndexCount(uint32_t _chunk) const
+	{
+		return getChunkVertexCount(_chunk) / 4 * 6;
+	}
+
+	/// Return true if the quads are stored as glyph instances.
+	bool isInstanced() const
+	{
+		return m_instanced;
+	}
+
+	/// Get pointer to the glyph instances of a chunk, one per quad.
+	const uint8_t* getChunkInstanceBuffer(uint32_t _chunk) const
+	{
+		return (const uint8_t*) &m_instanceBuffer[_chunk * MAX_CHUNK_QUADS];
+	}
+
+	/// Size in bytes of a glyph instance.
+	uint32_t getInstanceSize() const
+	{
+		return sizeof(GlyphInstance);
+	}
+
+	/// Colors referenced by the glyph instances, ABGR.
+	const uint32_t* getPalette() const
+	{
+		return m_palette;
+	}
+
+	uint32_t getPaletteCount() const
+	{
+		return m_paletteCount;
+	}
+
+	/// First vertex modified since the last call to clearDirtyRange().
+	uint32_t getDirtyBegin() const
 	{
-		return m_indexBuffer;
+		return m_dirtyBegin;
 	}
 
-	/// number of index in the index buffer
-	uint32_t getIndexCount() const
+	/// One past the last vertex modified, the range is empty when clean.
+	uint32_t getDirtyEnd() const
 	{
-		return m_indexCount;
+		return m_dirtyEnd;
 	}
 
-	/// Size in bytes of an index.
-	uint32_t getIndexSize() const
+	void clearDirtyRange()
 	{
-		return sizeof(uint16_t);
+		m_dirtyBegin = UINT32_MAX;
+		m_dirtyEnd = 0;
 	}
 
 	uint32_t getTextColor() const
@@ -123,9 +272,102 @@ public:
 	}
 
 private:
+	/// Decoration quad stretched over consecutive glyphs of a line, until
+	/// the style, color, font or line changes.
+	struct DecorationSpan
+	{
+		uint32_t quad; //< UINT32_MAX when closed
+		uint32_t rgba;
+		uint32_t numGlyphs;
+	};
+
+	static void closeSpans(DecorationSpan* _spans)
+	{
+		for (uint32_t ii = 0; ii < NUM_DECORATIONS; ++ii)
+		{
+			_spans[ii].quad = UINT32_MAX;
+		}
+	}
+
+	/// colors and style of the quads of a glyph
+	struct GlyphStyle
+	{
+		uint32_t textColor;
+		uint32_t styleFlags;
+		uint32_t decorations[NUM_DECORATIONS]; //< by s_decorationStyles index, 0 if not drawn
+		uint32_t numDecorations;               //< decorations drawn
+	};
+
+	/// layout of a line appended by appendLines()
+	struct LineLayout
+	{
+		uint32_t firstQuad;
+		uint32_t numQuads;
+		float penY;
+		float penX;      //< pen position at the end of the line
+		float width;     //< furthest pen position on the line
+		CodePoint previousCodePoint; //< last glyph, for kerning
+		bool hasPrevious;
+		bool complete;   //< every glyph and kerning pair was cached
+		const StyleRun* style; //< attributes at the start of the line, NULL for those of the buffer
+	};
+
+	/// shared by the jobs of appendLines(), each line is only written by
+	/// the job owning it
+	struct LinesJob
+	{
+		TextBuffer* textBuffer;
+		FontHandle fontHandle;
+		const FontInfo* font;
+		const TextLine* lines;
+		LineLayout* layouts;
+		uint32_t* regionBits; //< regions used by each batch of lines
+		uint32_t regionWords;
+		uint32_t batchSize;
+	};
+
+	static void measureLinesJob(void* _userData, uint32_t _begin, uint32_t _end);
+	static void writeLinesJob(void* _userData, uint32_t _begin, uint32_t _end);
+	void measureLine(const LinesJob& _job, uint32_t _line, uint32_t* _regionBits) const;
+	void prepareLine(const LinesJob& _job, uint32_t _line);
+	void writeLine(const LinesJob& _job, uint32_t _line);
+	uint32_t emitRun(const GlyphRun& _run, uint32_t _quad);
+	void appendRun(GlyphRun& _run);
+
+	void appendUtf8(FontHandle _fontHandle, const char* _string, const char* _end);
+	void appendUtf8Glyph(FontHandle _fontHandle, const FontInfo& _font, CodePoint _codePoint, const GlyphInfo* _glyph, bool _emitRuns);
 	void appendGlyph(FontHandle _handle, CodePoint _codePoint);
+	void appendGlyph(FontHandle _handle, CodePoint _codePoint, const GlyphInfo* _glyph);
+	void updateLineMetrics(const FontInfo& _font);
+	uint32_t getQuadsPerGlyph() const;
+	uint32_t getSpanGlyphLimit(const FontInfo& _font) const;
+	/// style of the glyphs of _run, or of the buffer for NULL
+	void getGlyphStyle(GlyphStyle& _style, const StyleRun* _run) const;
+	/// quads writeGlyphQuads() writes for _numGlyphs glyphs following _spans
+	static uint32_t countGlyphQuads(uint32_t _numGlyphs, const GlyphStyle& _style, DecorationSpan* _spans, uint32_t _spanGlyphLimit);
+	uint32_t writeGlyphQuads(uint32_t _quad, const GlyphInfo& _glyph, const FontInfo& _font, float _penX, float _penY, float _kerning, float _lineAscender, float _lineDescender, float _lineGap, const GlyphStyle& _style, DecorationSpan* _spans, uint32_t _spanGlyphLimit);
+	void stretchQuad(uint32_t _quad, float _x1);
+	void reserveQuads(uint32_t _count);
+	void appendQuad(uint32_t _region, float _x0, float _y0, float _x1, float _y1, uint32_t _rgba, uint8_t _style = STYLE_NORMAL);
+	void writeQuad(uint32_t _quad, uint32_t _region, float _x0, float _y0, float _x1, float _y1, uint32_t _rgba, uint8_t _style);
 	void verticalCenterLastLine(float _txtDecalY, float _top, float _bottom);
 
+	void invalidateVertices(uint32_t _begin, uint32_t _end)
+	{
+		m_dirtyBegin = _begin < m_dirtyBegin ? _begin : m_dirtyBegin;
+		m_dirtyEnd = _end > m_dirtyEnd ? _end : m_dirtyEnd;
+	}
+	uint32_t getPaletteIndex(uint32_t _rgba);
+
+	static float packInstanceSize(float _width, float _height)
+	{
+		uint32_t width = (uint32_t)(_width * 4.0f + 0.5f);
+		uint32_t height = (uint32_t)(_height * 4.0f + 0.5f);
+		width = width < MAX_INSTANCE_QUAD_SIZE ? width : MAX_INSTANCE_QUAD_SIZE;
+		height = height < MAX_INSTANCE_QUAD_SIZE ? height : MAX_INSTANCE_QUAD_SIZE;
+		return (float)(width * 4096 + height);
+	}
+
 	static uint32_t toABGR(uint32_t _rgba)
 	{
 		return ( ( (_rgba >>  0) & 0xff) << 24)
@@ -156,6 +398,18 @@ private:
 	float m_lineDescender;
 	float m_lineGap;
 
+	// last glyph appended on the current line, for kerning
+	FontHandle m_previousFontHandle;
+	CodePoint m_previousCodePoint;
+
+	// decorations of the current line, by s_decorationStyles index
+	DecorationSpan m_spans[NUM_DECORATIONS];
+
+	// undecorated glyphs of appendUtf8() waiting for appendRun()
+	const GlyphInfo* m_runGlyphs[MAX_GLYPH_RUN];
+	float m_runPenX[MAX_GLYPH_RUN];
+	GlyphRun m_run;
+
 	TextRectangle m_rectangle;
 	FontManager* m_fontManager;
 
@@ -167,23 +421,47 @@ private:
 		m_styleBuffer[_i] = _style;
 	}
 
-	struct TextVertex
+	/// copy the UVs packed by the atlas to the four vertices of a quad
+	void setUV(uint32_t _i, const AtlasRegionUV& _uv)
 	{
-		float x, y;
-		int16_t u, v, w, t;
-		uint32_t rgba;
+		memcpy(&m_vertexBuffer[_i + 0].u, _uv.xyzw[0], sizeof(_uv.xyzw[0]) );
+		memcpy(&m_vertexBuffer[_i + 1].u, _uv.xyzw[1], sizeof(_uv.xyzw[1]) );
+		memcpy(&m_vertexBuffer[_i + 2].u, _uv.xyzw[2], sizeof(_uv.xyzw[2]) );
+		memcpy(&m_vertexBuffer[_i + 3].u, _uv.xyzw[3], sizeof(_uv.xyzw[3]) );
+	}
+
+	typedef GlyphVertex TextVertex;
+
+	/// Quad expanded by vs_fontsdf_instanced.sc, exact as long as the packed
+	/// values stay below 2^24.
+	struct GlyphInstance
+	{
+		float x, y;  //< top left corner
+		float size;  //< width and height in quarter pixels, packed as w*4096 + h
+		float data;  //< UV table entry*MAX_PALETTE_COLORS + palette index
 	};
 
+	bool m_instanced;
 	TextVertex* m_vertexBuffer;
-	uint16_t* m_indexBuffer;
+	GlyphInstance* m_instanceBuffer;
 	uint8_t* m_styleBuffer;
+	uint32_t* m_quadRegionBuffer; //< atlas region of each quad
+
+	uint32_t m_palette[MAX_PALETTE_COLORS];
+	uint32_t m_paletteCount;
 
-	uint32_t m_indexCount;
+	uint32_t m_quadCapacity;
+	uint32_t m_dirtyBegin; //< vertices to upload again, see getDirtyBegin()
+	uint32_t m_dirtyEnd;
 	uint32_t m_lineStartIndex;
-	uint16_t m_vertexCount;
+	uint32_t m_vertexCount;
+
+	// scratch of appendLines(), kept between calls
+	std::vector<LineLayout> m_lineLayouts;
+	std::vector<uint32_t> m_regionBits;
 };
 
-TextBuffer::TextBuffer(FontManager* _fontManager)
+TextBuffer::TextBuffer(FontManager* _fontManager, bool _instanced)
 	: m_styleFlags(STYLE_NORMAL)
 	, m_textColor(0xffffffff)
 	, m_backgroundColor(0xffffffff)
@@ -197,23 +475,38 @@ TextBuffer::TextBuffer(FontManager* _fontManager)
 	, m_lineAscender(0)
 	, m_lineDescender(0)
 	, m_lineGap(0)
+	, m_previousCodePoint(0)
 	, m_fontManager(_fontManager)
-	, m_vertexBuffer(new TextVertex[MAX_BUFFERED_CHARACTERS * 4])
-	, m_indexBuffer(new uint16_t[MAX_BUFFERED_CHARACTERS * 6])
-	, m_styleBuffer(new uint8_t[MAX_BUFFERED_CHARACTERS * 4])
-	, m_indexCount(0)
+	, m_instanced(_instanced)
+	, m_vertexBuffer(NULL)
+	, m_instanceBuffer(NULL)
+	, m_styleBuffer(NULL)
+	, m_quadRegionBuffer(NULL)
+	, m_paletteCount(0)
+	, m_quadCapacity(0)
+	, m_dirtyBegin(UINT32_MAX)
+	, m_dirtyEnd(0)
 	, m_lineStartIndex(0)
 	, m_vertexCount(0)
 {
 	m_rectangle.width = 0;
 	m_rectangle.height = 0;
+	m_previousFontHandle.idx = bx::HandleAlloc::invalid;
+	closeSpans(m_spans);
+
+	m_run.glyphs = m_runGlyphs;
+	m_run.penX = m_runPenX;
+	m_run.count = 0;
+	m_run.baselineY = 0.0f;
+	m_run.rgba = 0;
 }
 
 TextBuffer::~TextBuffer()
 {
 	delete [] m_vertexBuffer;
-	delete [] m_indexBuffer;
+	delete [] m_instanceBuffer;
 	delete [] m_styleBuffer;
+	delete [] m_quadRegionBuffer;
 }
 
 void TextBuffer::appendText(FontHandle _fontHandle, const char* _string, const char* _end)
@@ -227,18 +520,145 @@ void TextBuffer::appendText(FontHandle _fontHandle, const char* _string, const c
 		m_lineGap = 0;
 	}
 
-	CodePoint codepoint = 0;
-	uint32_t state = 0;
+	if (_end == NULL)
+	{
+		_end = _string + strlen(_string);
+	}
+	BX_CHECK(_end >= _string);
+
+	const char* nul = (const char*)memchr(_string, 0, _end - _string);
+	if (NULL != nul)
+	{
+		_end = nul;
+	}
+
+	appendUtf8(_fontHandle, _string, _end);
+}
+
+void TextBuffer::appendRuns(FontHandle _fontHandle, const char* _string, const StyleRun* _runs, uint32_t _numRuns)
+{
+	if (m_vertexCount == 0)
+	{
+		m_originX = m_penX;
+		m_originY = m_penY;
+		m_lineDescender = 0;
+		m_lineAscender = 0;
+		m_lineGap = 0;
+	}
+
+	const char* str = _string;
+	for (uint32_t ii = 0; ii < _numRuns; ++ii)
+	{
+		const StyleRun& run = _runs[ii];
+		m_textColor = toABGR(run.textColor);
+		m_backgroundColor = toABGR(run.backgroundColor);
+		setStyle(run.styleFlags);
+
+		appendUtf8(_fontHandle, str, str + run.length);
+		str += run.length;
+	}
+}
+
+void TextBuffer::appendUtf8(FontHandle _fontHandle, const char* _string, const char* _end)
+{
+	const FontInfo& font = m_fontManager->getFontInfo(_fontHandle);
+
+	// Undecorated glyphs are resolved in runs emitted by emitGlyphQuads(),
+	// line feeds and decorated glyphs go through appendGlyph().
+	const bool emitRuns = !m_instanced && 1 == getQuadsPerGlyph();
+	m_run.count = 0;
+	m_run.rgba = m_textColor;
+
+	if (emitRuns)
+	{
+		closeSpans(m_spans);
+	}
 
-	for (; *_string && _string<_end ; ++_string)
+	CodePoint codePoints[UTF8_CHUNK_SIZE];
+	for (const char* str = _string; str < _end;)
 	{
-		if (utf8_decode(&state, (uint32_t*)&codepoint, *_string) == UTF8_ACCEPT )
+		// Blocks of ASCII characters skip the decoder, and the glyph hash map
+		// for the flat page of ASCII glyphs of the font.
+		if (_end - str >= ASCII_BLOCK_SIZE
+		&&  isAsciiBlock(str) )
+		{
+			for (const char* blockEnd = str + ASCII_BLOCK_SIZE; str < blockEnd; ++str)
+			{
+				appendUtf8Glyph(_fontHandle, font, (CodePoint)*str, m_fontManager->getAsciiGlyphInfo(_fontHandle, *str), emitRuns);
+			}
+
+			continue;
+		}
+
+		// Other blocks are decoded, with the end of a sequence they cut.
+		const char* chunk = str;
+		const char* chunkEnd = _end - str > ASCII_BLOCK_SIZE ? str + ASCII_BLOCK_SIZE : _end;
+		for (uint32_t ii = 0; ii < 3 && chunkEnd < _end && 0x80 == (*chunkEnd & 0xc0); ++ii)
+		{
+			++chunkEnd;
+		}
+
+		uint32_t error;
+		uint32_t numErrors;
+		uint32_t num = utf8_decode_chunk(&str, chunkEnd, codePoints, &error, 1, &numErrors);
+		BX_WARN(0 == numErrors, "Invalid utf-8 at byte %d replaced by U+FFFD", (int32_t)(chunk - _string + error) );
+
+		for (uint32_t ii = 0; ii < num; ++ii)
 		{
-			appendGlyph(_fontHandle, codepoint);
+			CodePoint codePoint = codePoints[ii];
+			const GlyphInfo* glyph = codePoint < 0x80
+				? m_fontManager->getAsciiGlyphInfo(_fontHandle, (char)codePoint)
+				: m_fontManager->getGlyphInfo(_fontHandle, codePoint)
+				;
+			appendUtf8Glyph(_fontHandle, font, codePoint, glyph, emitRuns);
 		}
 	}
 
-	BX_CHECK(state == UTF8_ACCEPT, "The string is not well-formed");	
+	appendRun(m_run);
+}
+
+void TextBuffer::appendUtf8Glyph(FontHandle _fontHandle, const FontInfo& _font, CodePoint _codePoint, const GlyphInfo* _glyph, bool _emitRuns)
+{
+	if (!_emitRuns
+	||  NULL == _glyph
+	||  L'\n' == _codePoint)
+	{
+		appendRun(m_run);
+		appendGlyph(_fontHandle, _codePoint, _glyph);
+		return;
+	}
+
+	if (0 == m_run.count)
+	{
+		updateLineMetrics(_font);
+		m_run.baselineY = m_penY + m_lineAscender;
+	}
+
+	float kerning = 0.0f;
+	if (m_previousFontHandle.idx == _fontHandle.idx)
+	{
+		kerning = m_fontManager->getKerning(_fontHandle, m_previousCodePoint, _codePoint);
+	}
+
+	m_penX += kerning;
+	m_previousFontHandle = _fontHandle;
+	m_previousCodePoint = _codePoint;
+
+	// Glyphs used this frame aren't evicted, those of the run stay valid
+	// until emitted.
+	m_runGlyphs[m_run.count] = _glyph;
+	m_runPenX[m_run.count] = m_penX;
+
+	m_penX += _glyph->advance_x;
+	if (m_penX > m_rectangle.width)
+	{
+		m_rectangle.width = m_penX;
+	}
+
+	if (MAX_GLYPH_RUN == ++m_run.count)
+	{
+		appendRun(m_run);
+	}
 }
 
 void TextBuffer::appendText(FontHandle _fontHandle, const wchar_t* _string, const wchar_t* _end)
@@ -252,50 +672,595 @@ void TextBuffer::appendText(FontHandle _fontHandle, const wchar_t* _string, cons
 		m_lineGap = 0;
 	}
 
-	if (_end == NULL)
+	if (_end == NULL)
+	{
+		_end = _string + (uint32_t) wcslen(_string);
+	}
+	BX_CHECK(_end >= _string);
+
+	for (const wchar_t* _current = _string; _current < _end; ++_current)
+	{
+		uint32_t _codePoint = *_current;
+		appendGlyph(_fontHandle, _codePoint);
+	}
+}
+
+void TextBuffer::appendLines(FontHandle _fontHandle, const TextLine* _lines, uint32_t _numLines, JobPool* _jobPool)
+{
+	if (0 == _numLines)
+	{
+		return;
+	}
+
+	if (m_vertexCount == 0)
+	{
+		m_originX = m_penX;
+		m_originY = m_penY;
+		m_lineDescender = 0;
+		m_lineAscender = 0;
+		m_lineGap = 0;
+	}
+
+	const FontInfo& font = m_fontManager->getFontInfo(_fontHandle);
+	updateLineMetrics(font);
+
+	// Each line has its own decoration spans.
+	closeSpans(m_spans);
+
+	// The first line continues the current one, the others use the metrics
+	// of the font. Lines without runs keep the attributes of the last run.
+	m_lineLayouts.resize(_numLines);
+	float penY = m_penY;
+	const StyleRun* lastRun = NULL;
+	for (uint32_t ii = 0; ii < _numLines; ++ii)
+	{
+		m_lineLayouts[ii].penY = penY;
+		penY += 0 == ii
+			? m_lineGap + m_lineAscender - m_lineDescender
+			: font.lineGap + font.ascender - font.descender
+			;
+
+		m_lineLayouts[ii].style = lastRun;
+		if (0 != _lines[ii].numRuns)
+		{
+			lastRun = &_lines[ii].runs[_lines[ii].numRuns - 1];
+		}
+	}
+
+	// Colors are added to the palette now, the jobs only look them up.
+	if (m_instanced)
+	{
+		for (uint32_t ii = 0; ii < _numLines; ++ii)
+		{
+			const uint32_t numRuns = 0 != _lines[ii].numRuns ? _lines[ii].numRuns : 1;
+			for (uint32_t jj = 0; jj < numRuns; ++jj)
+			{
+				GlyphStyle style;
+				getGlyphStyle(style, 0 != _lines[ii].numRuns ? &_lines[ii].runs[jj] : m_lineLayouts[ii].style);
+				getPaletteIndex(style.textColor);
+
+				for (uint32_t kk = 0; kk < NUM_DECORATIONS; ++kk)
+				{
+					if (0 != style.decorations[kk])
+					{
+						getPaletteIndex(style.decorations[kk]);
+					}
+				}
+			}
+		}
+	}
+
+	// A few batches per thread, to balance lines of uneven length.
+	uint32_t numThreads = NULL == _jobPool ? 1 : _jobPool->getThreadCount();
+	uint32_t batchSize = (_numLines + numThreads * 4 - 1) / (numThreads * 4);
+	uint32_t numBatches = (_numLines + batchSize - 1) / batchSize;
+
+	LinesJob job;
+	job.textBuffer = this;
+	job.fontHandle = _fontHandle;
+	job.font = &font;
+	job.lines = _lines;
+	job.layouts = &m_lineLayouts[0];
+	job.regionWords = (m_fontManager->getAtlas()->getMaxRegionCount() + 31) / 32;
+	job.batchSize = batchSize;
+
+	m_regionBits.assign(numBatches * job.regionWords, 0);
+	job.regionBits = &m_regionBits[0];
+
+	// Count the quads of each line, with lookups in the glyph and kerning
+	// caches only.
+	parallelFor(_jobPool, _numLines, batchSize, measureLinesJob, &job);
+
+	// Mark the glyphs in use before loading the missing ones, so that they
+	// aren't evicted to make room.
+	for (uint32_t ii = 1; ii < numBatches; ++ii)
+	{
+		const uint32_t* bits = &m_regionBits[ii * job.regionWords];
+		for (uint32_t jj = 0; jj < job.regionWords; ++jj)
+		{
+			m_regionBits[jj] |= bits[jj];
+		}
+	}
+
+	m_fontManager->touchRegions(&m_regionBits[0], job.regionWords);
+
+	bool loaded = false;
+	for (uint32_t ii = 0; ii < _numLines; ++ii)
+	{
+		if (!m_lineLayouts[ii].complete)
+		{
+			prepareLine(job, ii);
+			loaded = true;
+		}
+	}
+
+	// Loads only evict glyphs unused during this frame, but a line measured
+	// before a load must not lose a glyph the write pass then misses: the
+	// lines are measured again once every load is done.
+	if (loaded)
+	{
+		parallelFor(_jobPool, _numLines, batchSize, measureLinesJob, &job);
+	}
+
+	// Reserve a slice of the buffer for each line.
+	uint32_t firstQuad = m_vertexCount / 4;
+	uint32_t numQuads = 0;
+	for (uint32_t ii = 0; ii < _numLines; ++ii)
+	{
+		LineLayout& layout = m_lineLayouts[ii];
+		layout.firstQuad = firstQuad + numQuads;
+		numQuads += layout.numQuads;
+	}
+
+	reserveQuads(firstQuad + numQuads);
+
+	parallelFor(_jobPool, _numLines, batchSize, writeLinesJob, &job);
+
+	invalidateVertices(m_vertexCount, m_vertexCount + numQuads * 4);
+	m_vertexCount += numQuads * 4;
+
+	for (uint32_t ii = 0; ii < _numLines; ++ii)
+	{
+		const LineLayout& layout = m_lineLayouts[ii];
+		if (0 == layout.numQuads)
+		{
+			continue;
+		}
+
+		float bottom = 0 == ii
+			? layout.penY + m_lineAscender - m_lineDescender + m_lineGap
+			: layout.penY + font.ascender - font.descender + font.lineGap
+			;
+
+		m_rectangle.width = layout.width > m_rectangle.width ? layout.width : m_rectangle.width;
+		m_rectangle.height = bottom > m_rectangle.height ? bottom : m_rectangle.height;
+	}
+
+	// The pen is left at the end of the last line, like appendText().
+	const LineLayout& last = m_lineLayouts[_numLines - 1];
+	m_penX = last.penX;
+	m_penY = last.penY;
+	if (_numLines > 1)
+	{
+		m_lineGap = font.lineGap;
+		m_lineDescender = font.descender;
+		m_lineAscender = font.ascender;
+		m_lineStartIndex = last.firstQuad * 4;
+		m_previousFontHandle.idx = bx::HandleAlloc::invalid;
+	}
+
+	if (last.hasPrevious)
+	{
+		m_previousFontHandle = _fontHandle;
+		m_previousCodePoint = last.previousCodePoint;
+	}
+
+	if (NULL != lastRun)
+	{
+		m_textColor = toABGR(lastRun->textColor);
+		m_backgroundColor = toABGR(lastRun->backgroundColor);
+		m_styleFlags = lastRun->styleFlags;
+	}
+
+	closeSpans(m_spans);
+}
+
+void TextBuffer::measureLinesJob(void* _userData, uint32_t _begin, uint32_t _end)
+{
+	const LinesJob& job = *(const LinesJob*)_userData;
+	uint32_t* regionBits = &job.regionBits[_begin / job.batchSize * job.regionWords];
+	for (uint32_t ii = _begin; ii < _end; ++ii)
+	{
+		job.textBuffer->measureLine(job, ii, regionBits);
+	}
+}
+
+void TextBuffer::writeLinesJob(void* _userData, uint32_t _begin, uint32_t _end)
+{
+	const LinesJob& job = *(const LinesJob*)_userData;
+	for (uint32_t ii = _begin; ii < _end; ++ii)
+	{
+		job.textBuffer->writeLine(job, ii);
+	}
+}
+
+void TextBuffer::measureLine(const LinesJob& _job, uint32_t _line, uint32_t* _regionBits) const
+{
+	LineLayout& layout = _job.layouts[_line];
+	const TextLine& line = _job.lines[_line];
+	layout.numQuads = 0;
+	layout.complete = true;
+
+	bool hasPrevious = 0 == _line && m_previousFontHandle.idx == _job.fontHandle.idx;
+	CodePoint previous = m_previousCodePoint;
+
+	// Decoration spans as cut by writeGlyphQuads(), a change of style
+	// closes them like setStyle().
+	DecorationSpan spans[NUM_DECORATIONS];
+	closeSpans(spans);
+	const uint32_t spanGlyphLimit = getSpanGlyphLimit(*_job.font);
+	uint32_t styleFlags = STYLE_NORMAL;
+
+	const uint32_t numRuns = 0 != line.numRuns ? line.numRuns : 1;
+	const char* begin = line.begin;
+	for (uint32_t rr = 0; rr < numRuns; ++rr)
+	{
+		const StyleRun* styleRun = 0 != line.numRuns ? &line.runs[rr] : layout.style;
+		const char* end = 0 != line.numRuns ? begin + styleRun->length : line.end;
+
+		GlyphStyle style;
+		getGlyphStyle(style, styleRun);
+		if (style.styleFlags != styleFlags)
+		{
+			closeSpans(spans);
+			styleFlags = style.styleFlags;
+		}
+
+		uint32_t numGlyphs = 0;
+		CodePoint codePoints[UTF8_CHUNK_SIZE];
+		for (const char* str = begin; str < end;)
+		{
+			uint32_t num = utf8_decode_chunk(&str, end, codePoints);
+			for (uint32_t ii = 0; ii < num; ++ii)
+			{
+				CodePoint codePoint = codePoints[ii];
+				const GlyphInfo* glyph = m_fontManager->findGlyphInfo(_job.fontHandle, codePoint);
+				if (NULL == glyph)
+				{
+					layout.complete = false;
+					continue;
+				}
+
+				float kerning;
+				if (hasPrevious
+				&&  !m_fontManager->findKerning(_job.fontHandle, previous, codePoint, &kerning) )
+				{
+					layout.complete = false;
+				}
+
+				hasPrevious = true;
+				previous = codePoint;
+
+				_regionBits[glyph->regionIndex / 32] |= UINT32_C(1) << (glyph->regionIndex % 32);
+
+				++numGlyphs;
+			}
+		}
+
+		layout.numQuads += countGlyphQuads(numGlyphs, style, spans, spanGlyphLimit);
+		begin = end;
+	}
+
+	BX_CHECK(begin == line.end, "The runs of line %d don't cover it", _line);
+}
+
+void TextBuffer::prepareLine(const LinesJob& _job, uint32_t _line)
+{
+	bool hasPrevious = 0 == _line && m_previousFontHandle.idx == _job.fontHandle.idx;
+	CodePoint previous = m_previousCodePoint;
+
+	// Load the glyphs and kerning pairs the caches miss. Glyphs the font
+	// doesn't have are looked for again on every append.
+	CodePoint codePoints[UTF8_CHUNK_SIZE];
+	for (const char* str = _job.lines[_line].begin; str < _job.lines[_line].end;)
+	{
+		uint32_t num = utf8_decode_chunk(&str, _job.lines[_line].end, codePoints);
+		for (uint32_t ii = 0; ii < num; ++ii)
+		{
+			CodePoint codePoint = codePoints[ii];
+			const GlyphInfo* glyph = m_fontManager->getGlyphInfo(_job.fontHandle, codePoint);
+			BX_WARN(NULL != glyph, "Glyph not found (font handle %d, code point %d)", _job.fontHandle.idx, codePoint);
+			if (NULL == glyph)
+			{
+				continue;
+			}
+
+			if (hasPrevious)
+			{
+				m_fontManager->getKerning(_job.fontHandle, previous, codePoint);
+			}
+
+			hasPrevious = true;
+			previous = codePoint;
+		}
+	}
+}
+
+void TextBuffer::writeLine(const LinesJob& _job, uint32_t _line)
+{
+	LineLayout& layout = _job.layouts[_line];
+	const TextLine& line = _job.lines[_line];
+	const FontInfo& font = *_job.font;
+
+	float penX = 0 == _line ? m_penX : m_originX;
+	float lineAscender = 0 == _line ? m_lineAscender : font.ascender;
+	float lineDescender = 0 == _line ? m_lineDescender : font.descender;
+	float lineGap = 0 == _line ? m_lineGap : font.lineGap;
+
+	bool hasPrevious = 0 == _line && m_previousFontHandle.idx == _job.fontHandle.idx;
+	CodePoint previous = m_previousCodePoint;
+
+	uint32_t quad = layout.firstQuad;
+	float width = 0.0f;
+
+	const GlyphInfo* runGlyphs[MAX_GLYPH_RUN];
+	float runPenX[MAX_GLYPH_RUN];
+
+	GlyphRun run;
+	run.glyphs = runGlyphs;
+	run.penX = runPenX;
+	run.count = 0;
+	run.baselineY = layout.penY + lineAscender;
+
+	DecorationSpan spans[NUM_DECORATIONS];
+	closeSpans(spans);
+	const uint32_t spanGlyphLimit = getSpanGlyphLimit(font);
+	uint32_t styleFlags = STYLE_NORMAL;
+
+	const uint32_t numRuns = 0 != line.numRuns ? line.numRuns : 1;
+	const char* begin = line.begin;
+	for (uint32_t rr = 0; rr < numRuns; ++rr)
+	{
+		const StyleRun* styleRun = 0 != line.numRuns ? &line.runs[rr] : layout.style;
+		const char* end = 0 != line.numRuns ? begin + styleRun->length : line.end;
+
+		GlyphStyle style;
+		getGlyphStyle(style, styleRun);
+		if (style.styleFlags != styleFlags)
+		{
+			closeSpans(spans);
+			styleFlags = style.styleFlags;
+		}
+
+		// Undecorated glyphs are resolved in runs emitted by emitGlyphQuads().
+		if (0 == style.numDecorations)
+		{
+			closeSpans(spans);
+		}
+
+		const bool emitRuns = !m_instanced && 0 == style.numDecorations;
+		run.rgba = style.textColor;
+
+		CodePoint codePoints[UTF8_CHUNK_SIZE];
+		for (const char* str = begin; str < end;)
+		{
+			uint32_t num = utf8_decode_chunk(&str, end, codePoints);
+			for (uint32_t ii = 0; ii < num; ++ii)
+			{
+				CodePoint codePoint = codePoints[ii];
+				const GlyphInfo* glyph = m_fontManager->findGlyphInfo(_job.fontHandle, codePoint);
+				if (NULL == glyph)
+				{
+					continue;
+				}
+
+				float kerning = 0.0f;
+				if (hasPrevious
+				&&  !m_fontManager->findKerning(_job.fontHandle, previous, codePoint, &kerning) )
+				{
+					kerning = 0.0f;
+				}
+
+				penX += kerning;
+				hasPrevious = true;
+				previous = codePoint;
+
+				if (emitRuns)
+				{
+					runGlyphs[run.count] = glyph;
+					runPenX[run.count] = penX;
+					if (MAX_GLYPH_RUN == ++run.count)
+					{
+						quad += emitRun(run, quad);
+						run.count = 0;
+					}
+				}
+				else
+				{
+					quad += writeGlyphQuads(quad, *glyph, font, penX, layout.penY, kerning, lineAscender, lineDescender, lineGap, style, spans, spanGlyphLimit);
+				}
+
+				penX += glyph->advance_x;
+				width = penX > width ? penX : width;
+			}
+		}
+
+		quad += emitRun(run, quad);
+		run.count = 0;
+		begin = end;
+	}
+
+	BX_CHECK(quad == layout.firstQuad + layout.numQuads, "Line %d changed since it was measured", _line);
+
+	layout.penX = penX;
+	layout.width = width;
+	layout.hasPrevious = hasPrevious;
+	layout.previousCodePoint = previous;
+}
+
+uint32_t TextBuffer::emitRun(const GlyphRun& _run, uint32_t _quad)
+{
+	if (0 != _run.count)
+	{
+		emitGlyphQuads(_run
+			, m_fontManager->getAtlas()->getRegionUVBuffer()
+			, &m_vertexBuffer[_quad * 4]
+			, &m_styleBuffer[_quad * 4]
+			, &m_quadRegionBuffer[_quad]
+			);
+	}
+
+	return _run.count;
+}
+
+void TextBuffer::appendRun(GlyphRun& _run)
+{
+	if (0 == _run.count)
+	{
+		return;
+	}
+
+	uint32_t quad = m_vertexCount / 4;
+	reserveQuads(quad + _run.count);
+	uint32_t numQuads = emitRun(_run, quad);
+
+	invalidateVertices(m_vertexCount, m_vertexCount + numQuads * 4);
+	m_vertexCount += numQuads * 4;
+	_run.count = 0;
+
+	if ( (m_penY +m_lineAscender - m_lineDescender+m_lineGap) > m_rectangle.height)
+	{
+		m_rectangle.height = (m_penY +m_lineAscender - m_lineDescender+m_lineGap);
+	}
+}
+
+void TextBuffer::appendAtlasFace(uint16_t _faceIndex)
+{
+	float x0 = m_penX;
+	float y0 = m_penY;
+	float x1 = x0 + (float)m_fontManager->getAtlas()->getTextureSize();
+	float y1 = y0 + (float)m_fontManager->getAtlas()->getTextureSize();
+
+	appendQuad(QUAD_ATLAS_LAYER | _faceIndex, x0, y0, x1, y1, m_backgroundColor);
+}
+
+void TextBuffer::repackUVs()
+{
+	if (m_instanced)
+	{
+		// Instances reference the UV table of the atlas, kept up to date by
+		// the atlas itself.
+		return;
+	}
+
+	const Atlas* atlas = m_fontManager->getAtlas();
+	for (uint32_t ii = 0, num = m_vertexCount / 4; ii < num; ++ii)
+	{
+		uint32_t region = m_quadRegionBuffer[ii];
+		uint32_t offset = sizeof(TextVertex) * ii * 4 + offsetof(TextVertex, u);
+		if (region & QUAD_ATLAS_LAYER)
+		{
+			atlas->packFaceLayerUV(region & ~QUAD_ATLAS_LAYER, (uint8_t*)m_vertexBuffer, offset, sizeof(TextVertex) );
+		}
+		else
+		{
+			setUV(ii * 4, atlas->getRegionUV( (uint16_t)region) );
+		}
+	}
+
+	invalidateVertices(0, m_vertexCount);
+}
+
+void TextBuffer::reserveQuads(uint32_t _count)
+{
+	if (_count <= m_quadCapacity)
+	{
+		return;
+	}
+
+	uint32_t capacity = m_quadCapacity == 0 ? MIN_BUFFERED_QUADS : m_quadCapacity * 2;
+	while (capacity < _count)
+	{
+		capacity *= 2;
+	}
+
+	uint32_t numQuads = m_vertexCount / 4;
+
+	uint8_t* styleBuffer = new uint8_t[capacity * 4];
+	memcpy(styleBuffer, m_styleBuffer, numQuads * 4 * sizeof(uint8_t) );
+	delete [] m_styleBuffer;
+	m_styleBuffer = styleBuffer;
+
+	if (m_instanced)
 	{
-		_end = _string + (uint32_t) wcslen(_string);
+		GlyphInstance* instanceBuffer = new GlyphInstance[capacity];
+		memcpy(instanceBuffer, m_instanceBuffer, numQuads * sizeof(GlyphInstance) );
+		delete [] m_instanceBuffer;
+		m_instanceBuffer = instanceBuffer;
 	}
-	BX_CHECK(_end >= _string);
-
-	for (const wchar_t* _current = _string; _current < _end; ++_current)
+	else
 	{
-		uint32_t _codePoint = *_current;
-		appendGlyph(_fontHandle, _codePoint);
+		TextVertex* vertexBuffer = new TextVertex[capacity * 4];
+		uint32_t* quadRegionBuffer = new uint32_t[capacity];
+		memcpy(vertexBuffer, m_vertexBuffer, numQuads * 4 * sizeof(TextVertex) );
+		memcpy(quadRegionBuffer, m_quadRegionBuffer, numQuads * sizeof(uint32_t) );
+		delete [] m_vertexBuffer;
+		delete [] m_quadRegionBuffer;
+		m_vertexBuffer = vertexBuffer;
+		m_quadRegionBuffer = quadRegionBuffer;
 	}
+
+	m_quadCapacity = capacity;
 }
 
-void TextBuffer::appendAtlasFace(uint16_t _faceIndex)
+void TextBuffer::appendQuad(uint32_t _region, float _x0, float _y0, float _x1, float _y1, uint32_t _rgba, uint8_t _style)
+{
+	reserveQuads(m_vertexCount / 4 + 1);
+	writeQuad(m_vertexCount / 4, _region, _x0, _y0, _x1, _y1, _rgba, _style);
+
+	invalidateVertices(m_vertexCount, m_vertexCount + 4);
+	m_vertexCount += 4;
+}
+
+void TextBuffer::writeQuad(uint32_t _quad, uint32_t _region, float _x0, float _y0, float _x1, float _y1, uint32_t _rgba, uint8_t _style)
 {
-	if( m_vertexCount/4 >= MAX_BUFFERED_CHARACTERS)
+	const Atlas* atlas = m_fontManager->getAtlas();
+	uint32_t vertex = _quad * 4;
+	if (m_instanced)
 	{
+		uint32_t entry = (_region & QUAD_ATLAS_LAYER)
+			? atlas->getLayerUVIndex(_region & ~QUAD_ATLAS_LAYER)
+			: _region
+			;
+
+		GlyphInstance& instance = m_instanceBuffer[_quad];
+		instance.x = _x0;
+		instance.y = _y0;
+		instance.size = packInstanceSize(_x1 - _x0, _y1 - _y0);
+		instance.data = (float)(entry * MAX_PALETTE_COLORS + getPaletteIndex(_rgba) );
+		m_styleBuffer[vertex] = _style;
 		return;
 	}
 
-	float x0 = m_penX;
-	float y0 = m_penY;
-	float x1 = x0 + (float)m_fontManager->getAtlas()->getTextureSize();
-	float y1 = y0 + (float)m_fontManager->getAtlas()->getTextureSize();
+	if (_region & QUAD_ATLAS_LAYER)
+	{
+		atlas->packFaceLayerUV(_region & ~QUAD_ATLAS_LAYER
+			, (uint8_t*)m_vertexBuffer
+			, sizeof(TextVertex) * vertex + offsetof(TextVertex, u)
+			, sizeof(TextVertex)
+			);
+	}
+	else
+	{
+		setUV(vertex, atlas->getRegionUV( (uint16_t)_region) );
+	}
 
-	m_fontManager->getAtlas()->packFaceLayerUV(_faceIndex
-		, (uint8_t*)m_vertexBuffer
-		, sizeof(TextVertex) * m_vertexCount + offsetof(TextVertex, u)
-		, sizeof(TextVertex)
-		);
+	m_quadRegionBuffer[_quad] = _region;
 
-	setVertex(m_vertexCount + 0, x0, y0, m_backgroundColor);
-	setVertex(m_vertexCount + 1, x0, y1, m_backgroundColor);
-	setVertex(m_vertexCount + 2, x1, y1, m_backgroundColor);
-	setVertex(m_vertexCount + 3, x1, y0, m_backgroundColor);
-
-	m_indexBuffer[m_indexCount + 0] = m_vertexCount + 0;
-	m_indexBuffer[m_indexCount + 1] = m_vertexCount + 1;
-	m_indexBuffer[m_indexCount + 2] = m_vertexCount + 2;
-	m_indexBuffer[m_indexCount + 3] = m_vertexCount + 0;
-	m_indexBuffer[m_indexCount + 4] = m_vertexCount + 2;
-	m_indexBuffer[m_indexCount + 5] = m_vertexCount + 3;
-	m_vertexCount += 4;
-	m_indexCount += 6;
+	setVertex(vertex + 0, _x0, _y0, _rgba, _style);
+	setVertex(vertex + 1, _x0, _y1, _rgba, _style);
+	setVertex(vertex + 2, _x1, _y1, _rgba, _style);
+	setVertex(vertex + 3, _x1, _y0, _rgba, _style);
 }
 
 void TextBuffer::clearTextBuffer()
@@ -306,31 +1271,32 @@ void TextBuffer::clearTextBuffer()
 	m_originY = 0;
 
 	m_vertexCount = 0;
-	m_indexCount = 0;
+	m_paletteCount = 0;
 	m_lineStartIndex = 0;
 	m_lineAscender = 0;
 	m_lineDescender = 0;
 	m_lineGap = 0;
 	m_rectangle.width = 0;
 	m_rectangle.height = 0;
+	m_previousFontHandle.idx = bx::HandleAlloc::invalid;
+	closeSpans(m_spans);
 }
 
 void TextBuffer::appendGlyph(FontHandle _handle, CodePoint _codePoint)
 {
-	const GlyphInfo* glyph = m_fontManager->getGlyphInfo(_handle, _codePoint);
-	BX_WARN(NULL != glyph, "Glyph not found (font handle %d, code point %d)", _handle.idx, _codePoint);
-	if (NULL == glyph)
+	appendGlyph(_handle, _codePoint, m_fontManager->getGlyphInfo(_handle, _codePoint) );
+}
+
+void TextBuffer::appendGlyph(FontHandle _handle, CodePoint _codePoint, const GlyphInfo* _glyph)
+{
+	BX_WARN(NULL != _glyph, "Glyph not found (font handle %d, code point %d)", _handle.idx, _codePoint);
+	if (NULL == _glyph)
 	{
 		return;
 	}
 
 	const FontInfo& font = m_fontManager->getFontInfo(_handle);
 
-	if( m_vertexCount/4 >= MAX_BUFFERED_CHARACTERS)
-	{
-		return;
-	}
-
 	if (_codePoint == L'\n')
 	{
 		m_penX = m_originX;
@@ -339,187 +1305,314 @@ void TextBuffer::appendGlyph(FontHandle _handle, CodePoint _codePoint)
 		m_lineDescender = font.descender;
 		m_lineAscender = font.ascender;
 		m_lineStartIndex = m_vertexCount;
+		m_previousFontHandle.idx = bx::HandleAlloc::invalid;
+		closeSpans(m_spans);
 		return;
 	}
 
+	updateLineMetrics(font);
+
+	float kerning = 0.0f;
+	if (m_previousFontHandle.idx == _handle.idx)
+	{
+		kerning = m_fontManager->getKerning(_handle, m_previousCodePoint, _codePoint);
+	}
+	else
+	{
+		closeSpans(m_spans);
+	}
+
+	m_penX += kerning;
+	m_previousFontHandle = _handle;
+	m_previousCodePoint = _codePoint;
+
+	// Open spans may be stretched, their quads are uploaded again.
+	uint32_t dirtyBegin = m_vertexCount;
+	for (uint32_t ii = 0; ii < NUM_DECORATIONS; ++ii)
+	{
+		if (UINT32_MAX != m_spans[ii].quad
+		&&  m_spans[ii].quad * 4 < dirtyBegin)
+		{
+			dirtyBegin = m_spans[ii].quad * 4;
+		}
+	}
+
+	GlyphStyle style;
+	getGlyphStyle(style, NULL);
+
+	uint32_t quad = m_vertexCount / 4;
+	reserveQuads(quad + 1 + style.numDecorations);
+	uint32_t numQuads = writeGlyphQuads(quad, *_glyph, font, m_penX, m_penY, kerning, m_lineAscender, m_lineDescender, m_lineGap, style, m_spans, getSpanGlyphLimit(font) );
+
+	invalidateVertices(dirtyBegin, m_vertexCount + numQuads * 4);
+	m_vertexCount += numQuads * 4;
+
+	m_penX += _glyph->advance_x;
+	if (m_penX > m_rectangle.width)
+	{
+		m_rectangle.width = m_penX;
+	}
+
+	if ( (m_penY +m_lineAscender - m_lineDescender+m_lineGap) > m_rectangle.height)
+	{
+		m_rectangle.height = (m_penY +m_lineAscender - m_lineDescender+m_lineGap);
+	}
+}
+
+void TextBuffer::updateLineMetrics(const FontInfo& _font)
+{
 	//is there a change of font size that require the text on the left to be centered again ?
-	if (font.ascender > m_lineAscender
-		|| (font.descender < m_lineDescender) )
+	if (_font.ascender > m_lineAscender
+		|| (_font.descender < m_lineDescender) )
 	{
-		if (font.descender < m_lineDescender)
+		if (_font.descender < m_lineDescender)
 		{
-			m_lineDescender = font.descender;
-			m_lineGap = font.lineGap;
+			m_lineDescender = _font.descender;
+			m_lineGap = _font.lineGap;
 		}
 
-		float txtDecals = (font.ascender - m_lineAscender);
-		m_lineAscender = font.ascender;
-		m_lineGap = font.lineGap;		
+		float txtDecals = (_font.ascender - m_lineAscender);
+		m_lineAscender = _font.ascender;
+		m_lineGap = _font.lineGap;		
 		verticalCenterLastLine( (txtDecals), (m_penY - m_lineAscender), (m_penY + m_lineAscender - m_lineDescender + m_lineGap) );
 	}
+}
 
-	float kerning = 0 * font.scale;
-	m_penX += kerning;
-
-	const GlyphInfo& blackGlyph = m_fontManager->getBlackGlyph();
-	const Atlas* atlas = m_fontManager->getAtlas();
+uint32_t TextBuffer::getQuadsPerGlyph() const
+{
+	GlyphStyle style;
+	getGlyphStyle(style, NULL);
+	return 1 + style.numDecorations;
+}
 
-	if (m_styleFlags & STYLE_BACKGROUND
-	&&  m_backgroundColor & 0xFF000000)
+uint32_t TextBuffer::getSpanGlyphLimit(const FontInfo& _font) const
+{
+	if (!m_instanced)
 	{
-		float x0 = (m_penX - kerning);
-		float y0 = (m_penY);
-		float x1 = ( (float)x0 + (glyph->advance_x) );
-		float y1 = (m_penY + m_lineAscender - m_lineDescender + m_lineGap);
+		return UINT32_MAX;
+	}
 
-		atlas->packUV(blackGlyph.regionIndex
-			, (uint8_t*)m_vertexBuffer
-			, sizeof(TextVertex) * m_vertexCount + offsetof(TextVertex, u)
-			, sizeof(TextVertex)
-			);
+	// Instanced quads are at most MAX_INSTANCE_QUAD_SIZE quarter pixels
+	// wide, kerning aside.
+	const float maxWidth = MAX_INSTANCE_QUAD_SIZE * 0.25f;
+	return _font.maxAdvanceWidth > 0.0f && _font.maxAdvanceWidth < maxWidth
+		? (uint32_t)(maxWidth / _font.maxAdvanceWidth)
+		: 1
+		;
+}
+
+void TextBuffer::getGlyphStyle(GlyphStyle& _style, const StyleRun* _run) const
+{
+	_style.textColor = NULL == _run ? m_textColor : toABGR(_run->textColor);
+	_style.styleFlags = NULL == _run ? m_styleFlags : _run->styleFlags;
+	_style.numDecorations = 0;
 
-		const uint16_t vertexCount = m_vertexCount;
-		setVertex(vertexCount + 0, x0, y0, m_backgroundColor, STYLE_BACKGROUND);
-		setVertex(vertexCount + 1, x0, y1, m_backgroundColor, STYLE_BACKGROUND);
-		setVertex(vertexCount + 2, x1, y1, m_backgroundColor, STYLE_BACKGROUND);
-		setVertex(vertexCount + 3, x1, y0, m_backgroundColor, STYLE_BACKGROUND);
+	for (uint32_t ii = 0; ii < NUM_DECORATIONS; ++ii)
+	{
+		const uint32_t style = s_decorationStyles[ii];
+		uint32_t rgba = 0;
+		switch (style)
+		{
+		case STYLE_BACKGROUND:     rgba = NULL == _run ? m_backgroundColor : toABGR(_run->backgroundColor); break;
+		case STYLE_UNDERLINE:      rgba = m_underlineColor;     break;
+		case STYLE_OVERLINE:       rgba = m_overlineColor;      break;
+		case STYLE_STRIKE_THROUGH: rgba = m_strikeThroughColor; break;
+		default: break;
+		}
 
-		m_indexBuffer[m_indexCount + 0] = vertexCount + 0;
-		m_indexBuffer[m_indexCount + 1] = vertexCount + 1;
-		m_indexBuffer[m_indexCount + 2] = vertexCount + 2;
-		m_indexBuffer[m_indexCount + 3] = vertexCount + 0;
-		m_indexBuffer[m_indexCount + 4] = vertexCount + 2;
-		m_indexBuffer[m_indexCount + 5] = vertexCount + 3;
-		m_vertexCount += 4;
-		m_indexCount += 6;
+		_style.decorations[ii] = (_style.styleFlags & style) && (rgba & 0xFF000000) ? rgba : 0;
+		_style.numDecorations += 0 != _style.decorations[ii];
 	}
+}
 
-	if (m_styleFlags & STYLE_UNDERLINE
-	&&  m_underlineColor & 0xFF000000)
+uint32_t TextBuffer::countGlyphQuads(uint32_t _numGlyphs, const GlyphStyle& _style, DecorationSpan* _spans, uint32_t _spanGlyphLimit)
+{
+	uint32_t numQuads = _numGlyphs;
+	for (uint32_t ii = 0; ii < NUM_DECORATIONS; ++ii)
 	{
-		float x0 = (m_penX - kerning);
-		float y0 = (m_penY + m_lineAscender - m_lineDescender * 0.5f);
-		float x1 = ( (float)x0 + (glyph->advance_x) );
-		float y1 = y0 + font.underlineThickness;
-
-		atlas->packUV(blackGlyph.regionIndex
-			, (uint8_t*)m_vertexBuffer
-			, sizeof(TextVertex) * m_vertexCount + offsetof(TextVertex, u)
-			, sizeof(TextVertex)
-			);
+		const uint32_t rgba = _style.decorations[ii];
+		DecorationSpan& span = _spans[ii];
+		if (0 == rgba)
+		{
+			span.quad = UINT32_MAX;
+			continue;
+		}
 
-		setVertex(m_vertexCount + 0, x0, y0, m_underlineColor, STYLE_UNDERLINE);
-		setVertex(m_vertexCount + 1, x0, y1, m_underlineColor, STYLE_UNDERLINE);
-		setVertex(m_vertexCount + 2, x1, y1, m_underlineColor, STYLE_UNDERLINE);
-		setVertex(m_vertexCount + 3, x1, y0, m_underlineColor, STYLE_UNDERLINE);
+		// The glyphs first stretch the open span, then start spans of at
+		// most _spanGlyphLimit glyphs.
+		uint32_t numGlyphs = _numGlyphs;
+		if (UINT32_MAX != span.quad
+		&&  rgba == span.rgba)
+		{
+			uint32_t numStretched = _spanGlyphLimit - span.numGlyphs;
+			numStretched = numStretched < numGlyphs ? numStretched : numGlyphs;
+			span.numGlyphs += numStretched;
+			numGlyphs -= numStretched;
+		}
 
-		m_indexBuffer[m_indexCount + 0] = m_vertexCount + 0;
-		m_indexBuffer[m_indexCount + 1] = m_vertexCount + 1;
-		m_indexBuffer[m_indexCount + 2] = m_vertexCount + 2;
-		m_indexBuffer[m_indexCount + 3] = m_vertexCount + 0;
-		m_indexBuffer[m_indexCount + 4] = m_vertexCount + 2;
-		m_indexBuffer[m_indexCount + 5] = m_vertexCount + 3;
-		m_vertexCount += 4;
-		m_indexCount += 6;
+		if (0 != numGlyphs)
+		{
+			const uint32_t numSpans = (numGlyphs - 1) / _spanGlyphLimit + 1;
+			numQuads += numSpans;
+			span.quad = 0;
+			span.rgba = rgba;
+			span.numGlyphs = numGlyphs - (numSpans - 1) * _spanGlyphLimit;
+		}
 	}
 
-	if (m_styleFlags & STYLE_OVERLINE
-	&&  m_overlineColor & 0xFF000000)
+	return numQuads;
+}
+
+uint32_t TextBuffer::writeGlyphQuads(uint32_t _quad, const GlyphInfo& _glyph, const FontInfo& _font, float _penX, float _penY, float _kerning, float _lineAscender, float _lineDescender, float _lineGap, const GlyphStyle& _style, DecorationSpan* _spans, uint32_t _spanGlyphLimit)
+{
+	const GlyphInfo& blackGlyph = m_fontManager->getBlackGlyph();
+	uint32_t quad = _quad;
+
+	// Decorations span the advance, from the pen position before kerning.
+	float x0 = (_penX - _kerning);
+	float x1 = ( (float)x0 + (_glyph.advance_x) );
+
+	for (uint32_t ii = 0; ii < NUM_DECORATIONS; ++ii)
 	{
-		float x0 = (m_penX - kerning);
-		float y0 = (m_penY);
-		float x1 = ( (float)x0 + (glyph->advance_x) );
-		float y1 = y0 + font.underlineThickness;
+		const uint32_t style = s_decorationStyles[ii];
+		const uint32_t rgba = _style.decorations[ii];
+		DecorationSpan& span = _spans[ii];
+		if (0 == rgba)
+		{
+			span.quad = UINT32_MAX;
+			continue;
+		}
 
-		m_fontManager->getAtlas()->packUV(blackGlyph.regionIndex
-			, (uint8_t*)m_vertexBuffer
-			, sizeof(TextVertex) * m_vertexCount + offsetof(TextVertex, u)
-			, sizeof(TextVertex)
-			);
+		// The previous glyph ended at x0, stretch its decoration.
+		if (UINT32_MAX != span.quad
+		&&  rgba == span.rgba
+		&&  span.numGlyphs < _spanGlyphLimit)
+		{
+			stretchQuad(span.quad, x1);
+			++span.numGlyphs;
+			continue;
+		}
 
-		setVertex(m_vertexCount + 0, x0, y0, m_overlineColor, STYLE_OVERLINE);
-		setVertex(m_vertexCount + 1, x0, y1, m_overlineColor, STYLE_OVERLINE);
-		setVertex(m_vertexCount + 2, x1, y1, m_overlineColor, STYLE_OVERLINE);
-		setVertex(m_vertexCount + 3, x1, y0, m_overlineColor, STYLE_OVERLINE);
+		float y0;
+		float y1;
+		switch (style)
+		{
+		case STYLE_BACKGROUND:
+			y0 = (_penY);
+			y1 = (_penY + _lineAscender - _lineDescender + _lineGap);
+			break;
+
+		case STYLE_UNDERLINE:
+			y0 = (_penY + _lineAscender - _lineDescender * 0.5f);
+			y1 = y0 + _font.underlineThickness;
+			break;
+
+		case STYLE_OVERLINE:
+			y0 = (_penY);
+			y1 = y0 + _font.underlineThickness;
+			break;
+
+		default:
+			y0 = (_penY + 0.666667f * _font.ascender);
+			y1 = y0 + _font.underlineThickness;
+			break;
+		}
 
-		m_indexBuffer[m_indexCount + 0] = m_vertexCount + 0;
-		m_indexBuffer[m_indexCount + 1] = m_vertexCount + 1;
-		m_indexBuffer[m_indexCount + 2] = m_vertexCount + 2;
-		m_indexBuffer[m_indexCount + 3] = m_vertexCount + 0;
-		m_indexBuffer[m_indexCount + 4] = m_vertexCount + 2;
-		m_indexBuffer[m_indexCount + 5] = m_vertexCount + 3;
-		m_vertexCount += 4;
-		m_indexCount += 6;
+		span.quad = quad;
+		span.rgba = rgba;
+		span.numGlyphs = 1;
+		writeQuad(quad++, blackGlyph.regionIndex, x0, y0, x1, y1, rgba, (uint8_t)style);
 	}
 
-	if (m_styleFlags & STYLE_STRIKE_THROUGH
-	&&  m_strikeThroughColor & 0xFF000000)
-	{
-		float x0 = (m_penX - kerning);
-		float y0 = (m_penY + 0.666667f * font.ascender);
-		float x1 = ( (float)x0 + (glyph->advance_x) );
-		float y1 = y0 + font.underlineThickness;
+	float gx0 = _penX + (_glyph.offset_x);
+	float gy0 = (_penY + _lineAscender + (_glyph.offset_y) );
+	float gx1 = (gx0 + _glyph.width);
+	float gy1 = (gy0 + _glyph.height);
 
-		atlas->packUV(blackGlyph.regionIndex
-			, (uint8_t*)m_vertexBuffer
-			, sizeof(TextVertex) * m_vertexCount + offsetof(TextVertex, u)
-			, sizeof(TextVertex)
-			);
+	writeQuad(quad++, _glyph.regionIndex, gx0, gy0, gx1, gy1, _style.textColor, STYLE_NORMAL);
 
-		setVertex(m_vertexCount + 0, x0, y0, m_strikeThroughColor, STYLE_STRIKE_THROUGH);
-		setVertex(m_vertexCount + 1, x0, y1, m_strikeThroughColor, STYLE_STRIKE_THROUGH);
-		setVertex(m_vertexCount + 2, x1, y1, m_strikeThroughColor, STYLE_STRIKE_THROUGH);
-		setVertex(m_vertexCount + 3, x1, y0, m_strikeThroughColor, STYLE_STRIKE_THROUGH);
-
-		m_indexBuffer[m_indexCount + 0] = m_vertexCount + 0;
-		m_indexBuffer[m_indexCount + 1] = m_vertexCount + 1;
-		m_indexBuffer[m_indexCount + 2] = m_vertexCount + 2;
-		m_indexBuffer[m_indexCount + 3] = m_vertexCount + 0;
-		m_indexBuffer[m_indexCount + 4] = m_vertexCount + 2;
-		m_indexBuffer[m_indexCount + 5] = m_vertexCount + 3;
-		m_vertexCount += 4;
-		m_indexCount += 6;
-	}
-
-	float x0 = m_penX + (glyph->offset_x);
-	float y0 = (m_penY + m_lineAscender + (glyph->offset_y) );
-	float x1 = (x0 + glyph->width);
-	float y1 = (y0 + glyph->height);
-
-	atlas->packUV(glyph->regionIndex
-		, (uint8_t*)m_vertexBuffer
-		, sizeof(TextVertex) * m_vertexCount + offsetof(TextVertex, u)
-		, sizeof(TextVertex)
-		);
+	return quad - _quad;
+}
 
-	setVertex(m_vertexCount + 0, x0, y0, m_textColor);
-	setVertex(m_vertexCount + 1, x0, y1, m_textColor);
-	setVertex(m_vertexCount + 2, x1, y1, m_textColor);
-	setVertex(m_vertexCount + 3, x1, y0, m_textColor);
-
-	m_indexBuffer[m_indexCount + 0] = m_vertexCount + 0;
-	m_indexBuffer[m_indexCount + 1] = m_vertexCount + 1;
-	m_indexBuffer[m_indexCount + 2] = m_vertexCount + 2;
-	m_indexBuffer[m_indexCount + 3] = m_vertexCount + 0;
-	m_indexBuffer[m_indexCount + 4] = m_vertexCount + 2;
-	m_indexBuffer[m_indexCount + 5] = m_vertexCount + 3;
-	m_vertexCount += 4;
-	m_indexCount += 6;
+void TextBuffer::stretchQuad(uint32_t _quad, float _x1)
+{
+	if (m_instanced)
+	{
+		GlyphInstance& instance = m_instanceBuffer[_quad];
+		float height = (instance.size - floorf(instance.size / 4096.0f) * 4096.0f) * 0.25f;
+		instance.size = packInstanceSize(_x1 - instance.x, height);
+		return;
+	}
 
-	m_penX += glyph->advance_x;
-	if (m_penX > m_rectangle.width)
+	m_vertexBuffer[_quad * 4 + 2].x = _x1;
+	m_vertexBuffer[_quad * 4 + 3].x = _x1;
+}
+
+uint32_t TextBuffer::getPaletteIndex(uint32_t _rgba)
+{
+	for (uint32_t ii = 0; ii < m_paletteCount; ++ii)
 	{
-		m_rectangle.width = m_penX;
+		if (m_palette[ii] == _rgba)
+		{
+			return ii;
+		}
 	}
 
-	if ( (m_penY +m_lineAscender - m_lineDescender+m_lineGap) > m_rectangle.height)
+	if (m_paletteCount < MAX_PALETTE_COLORS)
 	{
-		m_rectangle.height = (m_penY +m_lineAscender - m_lineDescender+m_lineGap);
+		m_palette[m_paletteCount] = _rgba;
+		return m_paletteCount++;
+	}
+
+	// Palette full, use the closest color.
+	uint32_t best = 0;
+	uint32_t bestDistance = UINT32_MAX;
+	for (uint32_t ii = 0; ii < m_paletteCount; ++ii)
+	{
+		uint32_t distance = 0;
+		for (uint32_t shift = 0; shift < 32; shift += 8)
+		{
+			int32_t delta = (int32_t)( (m_palette[ii] >> shift) & 0xff) - (int32_t)( (_rgba >> shift) & 0xff);
+			distance += delta * delta;
+		}
+
+		if (distance < bestDistance)
+		{
+			best = ii;
+			bestDistance = distance;
+		}
 	}
+
+	BX_WARN(false, "Text buffer palette is full, color 0x%08x replaced by 0x%08x", _rgba, m_palette[best]);
+	return best;
 }
 
 void TextBuffer::verticalCenterLastLine(float _dy, float _top, float _bottom)
 {
+	// Decoration spans are a single quad each, carrying the style of their
+	// first vertex: backgrounds are refit to the line, others are moved.
+	invalidateVertices(m_lineStartIndex, m_vertexCount);
+
+	if (m_instanced)
+	{
+		for (uint32_t ii = m_lineStartIndex; ii < m_vertexCount; ii += 4)
+		{
+			GlyphInstance& instance = m_instanceBuffer[ii / 4];
+			if (m_styleBuffer[ii] == STYLE_BACKGROUND)
+			{
+				float width = floorf(instance.size / 4096.0f) * 0.25f;
+				instance.y = _top;
+				instance.size = packInstanceSize(width, _bottom - _top);
+			}
+			else
+			{
+				instance.y += _dy;
+			}
+		}
+
+		return;
+	}
+
 	for (uint32_t ii = m_lineStartIndex; ii < m_vertexCount; ii += 4)
 	{
 		if (m_styleBuffer[ii] == STYLE_BACKGROUND)
@@ -545,13 +1638,24 @@ TextBufferManager::TextBufferManager(FontManager* _fontManager)
 	m_textBuffers = new BufferCache[MAX_TEXT_BUFFER_COUNT];
 
 	const bgfx::Memory* vs_fontsdf = NULL;
+	const bgfx::Memory* vs_fontsdf_instanced = NULL;
 	const bgfx::Memory* fs_fontsdf = NULL;
+	const bool pages = AtlasFormat::Pages == m_fontManager->getAtlas()->getFormat();
 
 	switch (bgfx::getRendererType() )
 	{
 	case bgfx::RendererType::OpenGL:
-		vs_fontsdf = bgfx::makeRef(vs_fontsdf_glsl, sizeof(vs_fontsdf_glsl) );
-		fs_fontsdf = bgfx::makeRef(fs_fontsdf_glsl, sizeof(fs_fontsdf_glsl) );
+		vs_fontsdf_instanced = bgfx::makeRef(vs_fontsdf_instanced_glsl, sizeof(vs_fontsdf_instanced_glsl) );
+		if (pages)
+		{
+			vs_fontsdf = bgfx::makeRef(vs_fontsdf_pages_glsl, sizeof(vs_fontsdf_pages_glsl) );
+			fs_fontsdf = bgfx::makeRef(fs_fontsdf_pages_glsl, sizeof(fs_fontsdf_pages_glsl) );
+		}
+		else
+		{
+			vs_fontsdf = bgfx::makeRef(vs_fontsdf_glsl, sizeof(vs_fontsdf_glsl) );
+			fs_fontsdf = bgfx::makeRef(fs_fontsdf_glsl, sizeof(fs_fontsdf_glsl) );
+		}
 		break;
 
 	case bgfx::RendererType::Direct3D9:
@@ -574,6 +1678,11 @@ TextBufferManager::TextBufferManager(FontManager* _fontManager)
 	fsh = bgfx::createShader(fs_fontsdf);
 	m_distanceSubpixelProgram = bgfx::createProgram(vsh, fsh);
 	bgfx::destroyShader(vsh);
+
+	// Same fragment shader, quads expanded from glyph instances.
+	vsh = bgfx::createShader(vs_fontsdf_instanced);
+	m_distanceSubpixelInstancedProgram = bgfx::createProgram(vsh, fsh);
+	bgfx::destroyShader(vsh);
 	bgfx::destroyShader(fsh);
 
 	m_vertexDecl.begin();
@@ -583,6 +1692,40 @@ TextBufferManager::TextBufferManager(FontManager* _fontManager)
 	m_vertexDecl.end();
 
 	u_texColor = bgfx::createUniform("u_texColor", bgfx::UniformType::Uniform1iv);
+	u_atlasPages = bgfx::createUniform("u_atlasPages", bgfx::UniformType::Uniform4fv);
+	u_uvTable = bgfx::createUniform("u_uvTable", bgfx::UniformType::Uniform1iv);
+	u_uvTableSize = bgfx::createUniform("u_uvTableSize", bgfx::UniformType::Uniform4fv);
+	u_palette = bgfx::createUniform("u_palette", bgfx::UniformType::Uniform4fv, MAX_PALETTE_COLORS);
+
+	// Every quad uses the same two triangles, a single index buffer covering
+	// the largest chunk serves all the text buffers.
+	const bgfx::Memory* mem = bgfx::alloc(MAX_CHUNK_QUADS * 6 * sizeof(uint16_t) );
+	uint16_t* indices = (uint16_t*)mem->data;
+	for (uint32_t ii = 0; ii < MAX_CHUNK_QUADS; ++ii)
+	{
+		uint16_t vertex = (uint16_t)(ii * 4);
+		indices[ii * 6 + 0] = vertex + 0;
+		indices[ii * 6 + 1] = vertex + 1;
+		indices[ii * 6 + 2] = vertex + 2;
+		indices[ii * 6 + 3] = vertex + 0;
+		indices[ii * 6 + 4] = vertex + 2;
+		indices[ii * 6 + 5] = vertex + 3;
+	}
+	m_quadIndexBuffer = bgfx::createIndexBuffer(mem);
+
+	// Corners of the instanced quads, in the order of the glyph vertices.
+	m_quadVertexDecl.begin();
+	m_quadVertexDecl.add(bgfx::Attrib::Position, 2, bgfx::AttribType::Float);
+	m_quadVertexDecl.end();
+
+	static const float s_quadCorners[] =
+	{
+		0.0f, 0.0f,
+		0.0f, 1.0f,
+		1.0f, 1.0f,
+		1.0f, 0.0f,
+	};
+	m_quadVertexBuffer = bgfx::createVertexBuffer(bgfx::makeRef(s_quadCorners, sizeof(s_quadCorners) ), m_quadVertexDecl);
 }
 
 TextBufferManager::~TextBufferManager()
@@ -591,20 +1734,40 @@ TextBufferManager::~TextBufferManager()
 	delete [] m_textBuffers;
 
 	bgfx::destroyUniform(u_texColor);
+	bgfx::destroyUniform(u_atlasPages);
+	bgfx::destroyUniform(u_uvTable);
+	bgfx::destroyUniform(u_uvTableSize);
+	bgfx::destroyUniform(u_palette);
+	bgfx::destroyIndexBuffer(m_quadIndexBuffer);
+	bgfx::destroyVertexBuffer(m_quadVertexBuffer);
 
 	bgfx::destroyProgram(m_distanceSubpixelProgram);
+	bgfx::destroyProgram(m_distanceSubpixelInstancedProgram);
 }
 
 TextBufferHandle TextBufferManager::createTextBuffer(uint32_t _type, BufferType::Enum _bufferType)
 {
+	if (BufferType::Instanced == _bufferType
+	&&  0 == (bgfx::getCaps()->supported & BGFX_CAPS_INSTANCING) )
+	{
+		_bufferType = BufferType::Transient;
+	}
+
+	BX_CHECK(BufferType::Instanced != _bufferType || FONT_TYPE_DISTANCE_SUBPIXEL == _type
+		, "Instanced text buffers only support FONT_TYPE_DISTANCE_SUBPIXEL"
+		);
+
 	uint16_t textIdx = m_textBufferHandles.alloc();
 	BufferCache& bc = m_textBuffers[textIdx];
 
-	bc.textBuffer = new TextBuffer(m_fontManager);
+	bc.textBuffer = new TextBuffer(m_fontManager, BufferType::Instanced == _bufferType);
 	bc.fontType = _type;
 	bc.bufferType = _bufferType;
-	bc.indexBufferHandleIdx = bgfx::invalidHandle;
-	bc.vertexBufferHandleIdx = bgfx::invalidHandle;
+	bc.activeType = BufferType::Adaptive == _bufferType ? BufferType::Transient : _bufferType;
+	bc.stableFrames = 0;
+	bc.churnFrames = 0;
+	bc.chunks.clear();
+	bc.atlasGeneration = m_fontManager->getAtlas()->getGeneration();
 
 	TextBufferHandle ret = {textIdx};
 	return ret;
@@ -619,169 +1782,308 @@ void TextBufferManager::destroyTextBuffer(TextBufferHandle _handle)
 	delete bc.textBuffer;
 	bc.textBuffer = NULL;
 
-	if (bc.vertexBufferHandleIdx == bgfx::invalidHandle)
-	{
-		return;
-	}
+	destroyChunks(bc);
+}
 
-	switch (bc.bufferType)
+void TextBufferManager::destroyChunks(BufferCache& _bc)
+{
+	for (uint32_t ii = 0, num = (uint32_t)_bc.chunks.size(); ii < num; ++ii)
 	{
-	case BufferType::Static:
-		{
-			bgfx::IndexBufferHandle ibh;
-			bgfx::VertexBufferHandle vbh;
-			ibh.idx = bc.indexBufferHandleIdx;
-			vbh.idx = bc.vertexBufferHandleIdx;
-			bgfx::destroyIndexBuffer(ibh);
-			bgfx::destroyVertexBuffer(vbh);
-		}
-
-		break;
+		const BufferChunk& chunk = _bc.chunks[ii];
 
-	case BufferType::Dynamic:
-		bgfx::DynamicIndexBufferHandle ibh;
-		bgfx::DynamicVertexBufferHandle vbh;
-		ibh.idx = bc.indexBufferHandleIdx;
-		vbh.idx = bc.vertexBufferHandleIdx;
-		bgfx::destroyDynamicIndexBuffer(ibh);
-		bgfx::destroyDynamicVertexBuffer(vbh);
+		switch (_bc.activeType)
+		{
+		case BufferType::Static:
+			{
+				bgfx::VertexBufferHandle vbh;
+				vbh.idx = chunk.vertexBufferHandleIdx;
+				bgfx::destroyVertexBuffer(vbh);
+			}
+			break;
 
-		break;
+		case BufferType::Dynamic:
+			{
+				bgfx::DynamicVertexBufferHandle vbh;
+				vbh.idx = chunk.vertexBufferHandleIdx;
+				bgfx::destroyDynamicVertexBuffer(vbh);
+			}
+			break;
 
-	case BufferType::Transient: // destroyed every frame
-		break;
+		case BufferType::Transient: // destroyed every frame
+		case BufferType::Instanced:
+		case BufferType::Adaptive:
+			break;
+		}
 	}
+
+	_bc.chunks.clear();
 }
 
-void TextBufferManager::submitTextBuffer(TextBufferHandle _handle, uint8_t _id, int32_t _depth)
+void TextBufferManager::submitTextBuffer(TextBufferHandle _handle, uint8_t _id, int32_t _depth, const float* _mtx)
 {
 	BX_CHECK(bgfx::isValid(_handle), "Invalid handle used");
 
 	BufferCache& bc = m_textBuffers[_handle.idx];
 
-	uint32_t indexSize = bc.textBuffer->getIndexCount() * bc.textBuffer->getIndexSize();
-	uint32_t vertexSize = bc.textBuffer->getVertexCount() * bc.textBuffer->getVertexSize();
-
-	if (0 == indexSize || 0 == vertexSize)
+	uint32_t numChunks = bc.textBuffer->getChunkCount();
+	if (0 == numChunks)
 	{
 		return;
 	}
 
 	const bgfx::Memory* mem;
 
-	bgfx::setTexture(0, u_texColor, m_fontManager->getAtlas()->getTextureHandle() );
+	const Atlas* atlas = m_fontManager->getAtlas();
+	if (bc.atlasGeneration != atlas->getGeneration() )
+	{
+		// Regions moved or the atlas grew since the UVs were packed.
+		bc.atlasGeneration = atlas->getGeneration();
+		bc.textBuffer->repackUVs();
+
+		if (BufferType::Static == bc.activeType)
+		{
+			destroyChunks(bc);
+		}
+	}
 
-	switch (bc.fontType)
+	if (BufferType::Adaptive == bc.bufferType)
 	{
-	case FONT_TYPE_ALPHA:
-		bgfx::setProgram(m_basicProgram);
-		bgfx::setState(0
-			| BGFX_STATE_RGB_WRITE
-			| BGFX_STATE_BLEND_FUNC(BGFX_STATE_BLEND_SRC_ALPHA, BGFX_STATE_BLEND_INV_SRC_ALPHA)
-			);
-		break;
+		updateAdaptiveType(bc);
+	}
 
-	case FONT_TYPE_DISTANCE:
-		bgfx::setProgram(m_distanceProgram);
-		bgfx::setState(0
-			| BGFX_STATE_RGB_WRITE
-			| BGFX_STATE_BLEND_FUNC(BGFX_STATE_BLEND_SRC_ALPHA, BGFX_STATE_BLEND_INV_SRC_ALPHA)
-			);
-		break;
+	float atlasPages[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	if (AtlasFormat::Pages == atlas->getFormat() )
+	{
+		float pageCapacity = (float)atlas->getPageCapacity();
+		atlasPages[0] = 1.0f / pageCapacity;
+		atlasPages[1] = (float)atlas->getTextureSize();
+		atlasPages[2] = pageCapacity;
+	}
 
-	case FONT_TYPE_DISTANCE_SUBPIXEL:
-		bgfx::setProgram(m_distanceSubpixelProgram);
-		bgfx::setState(0
-			| BGFX_STATE_RGB_WRITE
-			| BGFX_STATE_BLEND_FUNC(BGFX_STATE_BLEND_FACTOR, BGFX_STATE_BLEND_INV_SRC_COLOR)
-			, bc.textBuffer->getTextColor()
-			);
-		break;
+	float uvTableSize[4] = { 1.0f / UV_TABLE_WIDTH, 1.0f / atlas->getUVTableHeight(), 0.0f, 0.0f };
+
+	float palette[MAX_PALETTE_COLORS * 4];
+	if (BufferType::Instanced == bc.activeType)
+	{
+		const uint32_t* colors = bc.textBuffer->getPalette();
+		for (uint32_t ii = 0, num = bc.textBuffer->getPaletteCount(); ii < num; ++ii)
+		{
+			palette[ii * 4 + 0] = ( (colors[ii] >>  0) & 0xff) / 255.0f;
+			palette[ii * 4 + 1] = ( (colors[ii] >>  8) & 0xff) / 255.0f;
+			palette[ii * 4 + 2] = ( (colors[ii] >> 16) & 0xff) / 255.0f;
+			palette[ii * 4 + 3] = ( (colors[ii] >> 24) & 0xff) / 255.0f;
+		}
 	}
 
-	switch (bc.bufferType)
+	// Static buffers are uploaded once, all their chunks at the same time.
+	if (BufferType::Static == bc.activeType
+	&&  bc.chunks.empty() )
 	{
-	case BufferType::Static:
+		for (uint32_t ii = 0; ii < numChunks; ++ii)
 		{
-			bgfx::IndexBufferHandle ibh;
-			bgfx::VertexBufferHandle vbh;
+			uint32_t vertexSize = bc.textBuffer->getChunkVertexCount(ii) * bc.textBuffer->getVertexSize();
 
-			if (bgfx::invalidHandle == bc.vertexBufferHandleIdx)
-			{
-				mem = bgfx::alloc(indexSize);
-				memcpy(mem->data, bc.textBuffer->getIndexBuffer(), indexSize);
-				ibh = bgfx::createIndexBuffer(mem);
+			mem = bgfx::alloc(vertexSize);
+			memcpy(mem->data, bc.textBuffer->getChunkVertexBuffer(ii), vertexSize);
+			bgfx::VertexBufferHandle vbh = bgfx::createVertexBuffer(mem, m_vertexDecl);
+
+			BufferChunk chunk = { vbh.idx, 0 };
+			bc.chunks.push_back(chunk);
+		}
+	}
+
+	// The transform is cached by the first draw and reused by the others.
+	uint32_t transformCache = 0;
 
-				mem = bgfx::alloc(vertexSize);
-				memcpy(mem->data, bc.textBuffer->getVertexBuffer(), vertexSize);
-				vbh = bgfx::createVertexBuffer(mem, m_vertexDecl);
+	for (uint32_t ii = 0; ii < numChunks; ++ii)
+	{
+		uint32_t indexCount = bc.textBuffer->getChunkIndexCount(ii);
+		uint32_t vertexCount = bc.textBuffer->getChunkVertexCount(ii);
+		uint32_t vertexSize = vertexCount * bc.textBuffer->getVertexSize();
 
-				bc.indexBufferHandleIdx = ibh.idx;
-				bc.vertexBufferHandleIdx = vbh.idx;
+		if (NULL != _mtx)
+		{
+			if (0 == ii)
+			{
+				transformCache = bgfx::setTransform(_mtx);
 			}
 			else
 			{
-				ibh.idx = bc.indexBufferHandleIdx;
-				vbh.idx = bc.vertexBufferHandleIdx;
+				bgfx::setTransform(transformCache);
 			}
+		}
 
-			bgfx::setVertexBuffer(vbh, bc.textBuffer->getVertexCount() );
-			bgfx::setIndexBuffer(ibh, bc.textBuffer->getIndexCount() );
+		bgfx::setTexture(0, u_texColor, atlas->getTextureHandle() );
+
+		if (AtlasFormat::Pages == atlas->getFormat()
+		||  BufferType::Instanced == bc.activeType)
+		{
+			bgfx::setUniform(u_atlasPages, atlasPages);
 		}
-		break;
 
-	case BufferType::Dynamic:
+		switch (bc.fontType)
 		{
-			bgfx::DynamicIndexBufferHandle ibh;
-			bgfx::DynamicVertexBufferHandle vbh;
+		case FONT_TYPE_ALPHA:
+			bgfx::setProgram(m_basicProgram);
+			bgfx::setState(0
+				| BGFX_STATE_RGB_WRITE
+				| BGFX_STATE_BLEND_FUNC(BGFX_STATE_BLEND_SRC_ALPHA, BGFX_STATE_BLEND_INV_SRC_ALPHA)
+				);
+			break;
+
+		case FONT_TYPE_DISTANCE:
+			bgfx::setProgram(m_distanceProgram);
+			bgfx::setState(0
+				| BGFX_STATE_RGB_WRITE
+				| BGFX_STATE_BLEND_FUNC(BGFX_STATE_BLEND_SRC_ALPHA, BGFX_STATE_BLEND_INV_SRC_ALPHA)
+				);
+			break;
+
+		case FONT_TYPE_DISTANCE_SUBPIXEL:
+			bgfx::setProgram(BufferType::Instanced == bc.activeType ? m_distanceSubpixelInstancedProgram : m_distanceSubpixelProgram);
+			bgfx::setState(0
+				| BGFX_STATE_RGB_WRITE
+				| BGFX_STATE_BLEND_FUNC(BGFX_STATE_BLEND_FACTOR, BGFX_STATE_BLEND_INV_SRC_COLOR)
+				, bc.textBuffer->getTextColor()
+				);
+			break;
+		}
 
-			if (bgfx::invalidHandle == bc.vertexBufferHandleIdx )
+		switch (bc.activeType)
+		{
+		case BufferType::Static:
 			{
-				mem = bgfx::alloc(indexSize);
-				memcpy(mem->data, bc.textBuffer->getIndexBuffer(), indexSize);
-				ibh = bgfx::createDynamicIndexBuffer(mem);
-
-				mem = bgfx::alloc(vertexSize);
-				memcpy(mem->data, bc.textBuffer->getVertexBuffer(), vertexSize);
-				vbh = bgfx::createDynamicVertexBuffer(mem, m_vertexDecl);
-
-				bc.indexBufferHandleIdx = ibh.idx;
-				bc.vertexBufferHandleIdx = vbh.idx;
+				bgfx::VertexBufferHandle vbh;
+				vbh.idx = bc.chunks[ii].vertexBufferHandleIdx;
+				bgfx::setVertexBuffer(vbh, vertexCount);
 			}
-			else
+			break;
+
+		case BufferType::Dynamic:
 			{
-				ibh.idx = bc.indexBufferHandleIdx;
-				vbh.idx = bc.vertexBufferHandleIdx;
+				bgfx::DynamicVertexBufferHandle vbh;
+
+				if (ii == bc.chunks.size()
+				||  bc.chunks[ii].vertexCapacity < vertexCount)
+				{
+					// Created with room to grow, so that appending to the
+					// buffer only uploads the new vertices.
+					uint32_t capacity = ii == bc.chunks.size() ? MIN_BUFFERED_QUADS * 4 : bc.chunks[ii].vertexCapacity;
+					while (capacity < vertexCount)
+					{
+						capacity *= 2;
+					}
+					capacity = capacity < MAX_CHUNK_VERTICES ? capacity : MAX_CHUNK_VERTICES;
+
+					mem = bgfx::alloc(capacity * bc.textBuffer->getVertexSize() );
+					memcpy(mem->data, bc.textBuffer->getChunkVertexBuffer(ii), vertexSize);
+					vbh = bgfx::createDynamicVertexBuffer(mem, m_vertexDecl);
+
+					BufferChunk chunk = { vbh.idx, capacity };
+					if (ii == bc.chunks.size() )
+					{
+						bc.chunks.push_back(chunk);
+					}
+					else
+					{
+						bgfx::DynamicVertexBufferHandle old;
+						old.idx = bc.chunks[ii].vertexBufferHandleIdx;
+						bgfx::destroyDynamicVertexBuffer(old);
+						bc.chunks[ii] = chunk;
+					}
+				}
+				else
+				{
+					vbh.idx = bc.chunks[ii].vertexBufferHandleIdx;
+
+					// Only the vertices modified since the last submit.
+					uint32_t firstVertex = ii * MAX_CHUNK_VERTICES;
+					uint32_t begin = bc.textBuffer->getDirtyBegin();
+					uint32_t end = bc.textBuffer->getDirtyEnd();
+					begin = begin > firstVertex ? begin - firstVertex : 0;
+					end = end > firstVertex ? end - firstVertex : 0;
+					end = end < vertexCount ? end : vertexCount;
+
+					if (begin < end)
+					{
+						uint32_t stride = bc.textBuffer->getVertexSize();
+						mem = bgfx::alloc( (end - begin) * stride);
+						memcpy(mem->data, bc.textBuffer->getChunkVertexBuffer(ii) + begin * stride, (end - begin) * stride);
+						bgfx::updateDynamicVertexBuffer(vbh, begin, mem);
+					}
+				}
+
+				bgfx::setVertexBuffer(vbh, vertexCount);
+			}
+			break;
 
-				mem = bgfx::alloc(indexSize);
-				memcpy(mem->data, bc.textBuffer->getIndexBuffer(), indexSize);
-				bgfx::updateDynamicIndexBuffer(ibh, mem);
+		case BufferType::Transient:
+			{
+				bgfx::TransientVertexBuffer tvb;
+				bgfx::allocTransientVertexBuffer(&tvb, vertexCount, m_vertexDecl);
+				memcpy(tvb.data, bc.textBuffer->getChunkVertexBuffer(ii), vertexSize);
+				bgfx::setVertexBuffer(&tvb, vertexCount);
+			}
+			break;
 
-				mem = bgfx::alloc(vertexSize);
-				memcpy(mem->data, bc.textBuffer->getVertexBuffer(), vertexSize);
-				bgfx::updateDynamicVertexBuffer(vbh, mem);
+		case BufferType::Instanced:
+			{
+				uint16_t instanceCount = (uint16_t)(vertexCount / 4);
+				uint16_t instanceSize = (uint16_t)bc.textBuffer->getInstanceSize();
+				const bgfx::InstanceDataBuffer* idb = bgfx::allocInstanceDataBuffer(instanceCount, instanceSize);
+				memcpy(idb->data, bc.textBuffer->getChunkInstanceBuffer(ii), instanceCount * instanceSize);
+
+				bgfx::setInstanceDataBuffer(idb, instanceCount);
+				bgfx::setVertexBuffer(m_quadVertexBuffer);
+				bgfx::setTexture(1, u_uvTable, atlas->getUVTableHandle() );
+				bgfx::setUniform(u_uvTableSize, uvTableSize);
+				bgfx::setUniform(u_palette, palette, (uint16_t)bc.textBuffer->getPaletteCount() );
+
+				// a single quad, drawn once per instance
+				indexCount = 6;
 			}
+			break;
 
-			bgfx::setVertexBuffer(vbh, bc.textBuffer->getVertexCount() );
-			bgfx::setIndexBuffer(ibh, bc.textBuffer->getIndexCount() );
+		case BufferType::Adaptive:
+			BX_CHECK(false, "Adaptive buffers are drawn as Transient or Dynamic ones");
+			break;
 		}
-		break;
 
-	case BufferType::Transient:
+		bgfx::setIndexBuffer(m_quadIndexBuffer, 0, indexCount);
+		bgfx::submit(_id, _depth);
+	}
+
+	bc.textBuffer->clearDirtyRange();
+}
+
+void TextBufferManager::updateAdaptiveType(BufferCache& _bc)
+{
+	if (_bc.textBuffer->getDirtyBegin() < _bc.textBuffer->getDirtyEnd() )
+	{
+		_bc.stableFrames = 0;
+
+		// Edited every few frames: streaming it is cheaper than updating
+		// GPU buffers.
+		if (BufferType::Dynamic == _bc.activeType
+		&&  ++_bc.churnFrames >= ADAPTIVE_DEMOTE_FRAMES)
 		{
-			bgfx::TransientIndexBuffer tib;
-			bgfx::TransientVertexBuffer tvb;
-			bgfx::allocTransientIndexBuffer(&tib, bc.textBuffer->getIndexCount() );
-			bgfx::allocTransientVertexBuffer(&tvb, bc.textBuffer->getVertexCount(), m_vertexDecl);
-			memcpy(tib.data, bc.textBuffer->getIndexBuffer(), indexSize);
-			memcpy(tvb.data, bc.textBuffer->getVertexBuffer(), vertexSize);
-			bgfx::setVertexBuffer(&tvb, bc.textBuffer->getVertexCount() );
-			bgfx::setIndexBuffer(&tib, bc.textBuffer->getIndexCount() );
+			destroyChunks(_bc);
+			_bc.activeType = BufferType::Transient;
 		}
-		break;
+
+		return;
+	}
+
+	if (_bc.stableFrames < ADAPTIVE_PROMOTE_FRAMES)
+	{
+		++_bc.stableFrames;
+		return;
 	}
 
-	bgfx::submit(_id, _depth);
+	// Stable, the dynamic path creates the GPU buffers on the next draw and
+	// then only uploads edited vertices.
+	_bc.churnFrames = 0;
+	_bc.activeType = BufferType::Dynamic;
 }
 
 void TextBufferManager::setStyle(TextBufferHandle _handle, uint32_t _flags)
@@ -847,6 +2149,20 @@ void TextBufferManager::appendText(TextBufferHandle _handle, FontHandle _fontHan
 	bc.textBuffer->appendText(_fontHandle, _string, _end);
 }
 
+void TextBufferManager::appendRuns(TextBufferHandle _handle, FontHandle _fontHandle, const char* _string, const StyleRun* _runs, uint32_t _numRuns)
+{
+	BX_CHECK(bgfx::isValid(_handle), "Invalid handle used");
+	BufferCache& bc = m_textBuffers[_handle.idx];
+	bc.textBuffer->appendRuns(_fontHandle, _string, _runs, _numRuns);
+}
+
+void TextBufferManager::appendLines(TextBufferHandle _handle, FontHandle _fontHandle, const TextLine* _lines, uint32_t _numLines, JobPool* _jobPool)
+{
+	BX_CHECK(bgfx::isValid(_handle), "Invalid handle used");
+	BufferCache& bc = m_textBuffers[_handle.idx];
+	bc.textBuffer->appendLines(_fontHandle, _lines, _numLines, _jobPool);
+}
+
 void TextBufferManager::appendAtlasFace(TextBufferHandle _handle, uint16_t _faceIndex)
 {
 	BX_CHECK(bgfx::isValid(_handle), "Invalid handle used");
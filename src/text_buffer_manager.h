@@ -6,6 +6,8 @@
 #ifndef TEXT_BUFFER_MANAGER_H_HEADER_GUARD
 #define TEXT_BUFFER_MANAGER_H_HEADER_GUARD
 
+#include <vector>
+
 #include "font_manager.h"
 
 BGFX_HANDLE(TextBufferHandle);
@@ -20,6 +22,17 @@ struct BufferType
 		Static,
 		Dynamic,
 		Transient,
+
+		/// One 16 bytes instance per glyph instead of four vertices, the
+		/// quads are expanded by the vertex shader. Uploaded every frame like
+		/// Transient buffers, which they fall back to without instancing
+		/// support. FONT_TYPE_DISTANCE_SUBPIXEL only.
+		Instanced,
+
+		/// Streamed like Transient while it changes. After a number of
+		/// submits without changes it is kept in GPU buffers like Dynamic,
+		/// until frequent edits make it stream again.
+		Adaptive,
 	};
 };
 
@@ -38,6 +51,26 @@ struct TextRectangle
 	float width, height;
 };
 
+/// attributes of consecutive bytes of the text given to appendRuns() or
+/// of a TextLine
+struct StyleRun
+{
+	uint32_t length;          //< utf-8 bytes, ending on a code point boundary
+	uint32_t textColor;       //< rgba
+	uint32_t backgroundColor; //< rgba, drawn with STYLE_BACKGROUND
+	uint32_t styleFlags;      //< TextStyleFlags, lines drawn with the colors of the buffer
+};
+
+/// a line of utf-8 text, without line feed
+struct TextLine
+{
+	const char* begin;
+	const char* end;
+	const StyleRun* runs; //< attributes of [begin, end), in order, or NULL
+	uint32_t numRuns;
+};
+
+class JobPool;
 class TextBuffer;
 class TextBufferManager
 {
@@ -47,7 +80,15 @@ public:
 
 	TextBufferHandle createTextBuffer(uint32_t _type, BufferType::Enum _bufferType);
 	void destroyTextBuffer(TextBufferHandle _handle);
-	void submitTextBuffer(TextBufferHandle _handle, uint8_t _id, int32_t _depth = 0);
+
+	/// Submit the buffer for rendering. The UVs are packed again first if the
+	/// atlas moved regions or grew since they were appended; buffers holding
+	/// removed regions must be rebuilt, see Atlas::getRemovalGeneration().
+	/// Dynamic buffers only upload the vertices modified since the previous
+	/// submit, and nothing when the buffer didn't change.
+	/// Buffers above 64K vertices are submitted as several draws, _mtx is the
+	/// model matrix to use for all of them.
+	void submitTextBuffer(TextBufferHandle _handle, uint8_t _id, int32_t _depth = 0, const float* _mtx = NULL);
 
 	void setStyle(TextBufferHandle _handle, uint32_t _flags = STYLE_NORMAL);
 	void setTextColor(TextBufferHandle _handle, uint32_t _rgba = 0x000000FF);
@@ -64,6 +105,24 @@ public:
 
 	/// Append a wide char unicode string to the buffer using current pen position and color.
 	void appendText(TextBufferHandle _handle, FontHandle _fontHandle, const wchar_t* _string, const wchar_t* _end = NULL);
+
+	/// Append utf-8 text split in runs of attributes, like calls to
+	/// setTextColor(), setBackgroundColor(), setStyle() and appendText()
+	/// for each run, and leave the colors and style of the last run.
+	/// _string holds the sum of the run lengths, it isn't NUL terminated.
+	void appendRuns(TextBufferHandle _handle, FontHandle _fontHandle, const char* _string, const StyleRun* _runs, uint32_t _numRuns);
+
+	/// Append lines of utf-8 text as if they were separated by line feeds:
+	/// the first line continues the current one, the pen is left at the end
+	/// of the last one. Lines with runs are drawn like appendRuns() would,
+	/// the others with the attributes of the last run before them, or of
+	/// the buffer, which keeps those of the last run. Each line is laid out
+	/// by a single thread of _jobPool and written straight to its slice of
+	/// the buffer; without a pool the lines are laid out on the calling
+	/// thread. Glyphs missing from the atlas are loaded on the calling
+	/// thread between the two passes, after which the lines are measured
+	/// again.
+	void appendLines(TextBufferHandle _handle, FontHandle _fontHandle, const TextLine* _lines, uint32_t _numLines, JobPool* _jobPool = NULL);
 		
 	/// Append a whole face of the atlas cube, mostly used for debugging and visualizing atlas.
 	void appendAtlasFace(TextBufferHandle _handle, uint16_t _faceIndex);
@@ -75,23 +134,44 @@ public:
 	TextRectangle getRectangle(TextBufferHandle _handle) const;	
 	
 private:
-	struct BufferCache
+	/// GPU buffers of up to 64K vertices, one draw each
+	struct BufferChunk
 	{
-		uint16_t indexBufferHandleIdx;
 		uint16_t vertexBufferHandleIdx;
+		uint32_t vertexCapacity; //< Dynamic buffers only
+	};
+
+	struct BufferCache
+	{
+		std::vector<BufferChunk> chunks;
 		TextBuffer* textBuffer;
 		BufferType::Enum bufferType;
+		BufferType::Enum activeType; //< storage in use, differs for Adaptive buffers
+		uint32_t stableFrames; //< submits without changes
+		uint32_t churnFrames;  //< submits with changes since promoted
 		uint32_t fontType;
+		uint32_t atlasGeneration; //< atlas generation the UVs were packed for
 	};
 
+	void destroyChunks(BufferCache& _bc);
+	void updateAdaptiveType(BufferCache& _bc);
+
 	BufferCache* m_textBuffers;
 	bx::HandleAllocT<MAX_TEXT_BUFFER_COUNT> m_textBufferHandles;
 	FontManager* m_fontManager;
 	bgfx::VertexDecl m_vertexDecl;
+	bgfx::IndexBufferHandle m_quadIndexBuffer; //< shared by all the chunks
+	bgfx::VertexDecl m_quadVertexDecl;
+	bgfx::VertexBufferHandle m_quadVertexBuffer; //< corners of the instanced quads
 	bgfx::UniformHandle u_texColor;
+	bgfx::UniformHandle u_atlasPages;
+	bgfx::UniformHandle u_uvTable;
+	bgfx::UniformHandle u_uvTableSize;
+	bgfx::UniformHandle u_palette;
 	bgfx::ProgramHandle m_basicProgram;
 	bgfx::ProgramHandle m_distanceProgram;
 	bgfx::ProgramHandle m_distanceSubpixelProgram;
+	bgfx::ProgramHandle m_distanceSubpixelInstancedProgram;
 };
 
 #endif // TEXT_BUFFER_MANAGER_H_HEADER_GUARD
@@ -0,0 +1,427 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Checks that text buffers draw the same vertices whether lines are appended
+// by appendText() of utf-8, in glyph runs, or of wide characters, glyph by
+// glyph, or by appendLines() with or without a job pool, the latter also when
+// the atlas is too small for the text and evicts glyphs. Styled lines are
+// compared between appendRuns() and appendLines() the same way, and the
+// instances of an instanced buffer against the vertices of a transient one.
+// Runs against fake_bgfx, from the repository root.
+
+#include <math.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cube_atlas.h"
+#include "fake_bgfx.h"
+#include "font_manager.h"
+#include "job_pool.h"
+#include "text_buffer_manager.h"
+#include "utf8.h"
+
+namespace {
+
+const char kFontPath[] = "art/VeraMono.ttf";
+const uint32_t kWorkerThreads = 3;
+const uint32_t kFrames = 8;
+const uint32_t kLinesPerFrame = 60;
+
+// Attributes of the buffer before the first run.
+const uint32_t kTextColor = 0x839496ff;
+const uint32_t kBackgroundColor = 0x002b36ff;
+
+enum AppendMode {
+  kAppendText,
+  kAppendWideText,
+  kAppendLines,
+  kAppendLinesParallel,
+};
+
+// The vertex and instance layouts of the text buffers.
+struct Vertex {
+  float x, y;
+  int16_t u, v, w, t;
+  uint32_t rgba;
+};
+
+struct Instance {
+  float x, y;
+  float size;  // Quarter pixels, width * 4096 + height.
+  float data;  // UV table entry * 64 + palette index.
+};
+
+uint32_t Random(uint32_t* seed) {
+  *seed = *seed * 1103515245 + 12345;
+  return *seed >> 16;
+}
+
+// Lines of up to 80 characters, some empty, drawn from a window of the
+// printable ASCII characters and a few others that moves with |frame|, so
+// that the glyphs of the first frames go cold.
+std::vector<std::string> MakeLines(uint32_t frame) {
+  const char* const kOthers[] = {"\xc3\xa9", "\xc3\xbc", "\xe2\x86\x92"};
+  std::vector<std::string> lines;
+  uint32_t seed = frame + 1;
+  for (uint32_t i = 0; i < kLinesPerFrame; ++i) {
+    const uint32_t length = Random(&seed) % 81;
+    std::string line;
+    for (uint32_t j = 0; j < length; ++j) {
+      const uint32_t value = Random(&seed) % 40;
+      if (value < 3)
+        line += kOthers[value];
+      else
+        line += (char)(' ' + (frame * 10 + value) % 95);
+    }
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+// Runs of a few characters over |line|, with colors and styles repeating
+// often enough for decorations to span runs. Half the lines have none.
+std::vector<StyleRun> MakeRuns(const std::string& line, uint32_t* seed) {
+  const uint32_t kColors[] = {0xdc322fff, 0x859900ff, 0x268bd2ff};
+  const uint32_t kBackgrounds[] = {0x073642ff, 0x00000000, 0xeee8d5ff};
+  const uint32_t kStyles[] = {
+      STYLE_NORMAL, STYLE_BACKGROUND, STYLE_UNDERLINE,
+      STYLE_BACKGROUND | STYLE_STRIKE_THROUGH | STYLE_OVERLINE};
+
+  std::vector<StyleRun> runs;
+  if (0 == Random(seed) % 2)
+    return runs;
+  for (size_t begin = 0; begin < line.size();) {
+    // A run ends on a character boundary.
+    size_t end = begin;
+    for (uint32_t count = Random(seed) % 8 + 1; count > 0 && end < line.size();
+         --count) {
+      do {
+        ++end;
+      } while (end < line.size() && 0x80 == (line[end] & 0xc0));
+    }
+    StyleRun run;
+    run.length = (uint32_t)(end - begin);
+    run.textColor = kColors[Random(seed) % 3];
+    run.backgroundColor = kBackgrounds[Random(seed) % 3];
+    run.styleFlags = kStyles[Random(seed) % 4];
+    runs.push_back(run);
+    begin = end;
+  }
+  return runs;
+}
+
+std::wstring Widen(const std::string& text) {
+  std::wstring wide;
+  CodePoint code_points[UTF8_CHUNK_SIZE];
+  for (const char* str = text.data(); str < text.data() + text.size();) {
+    const uint32_t num =
+        utf8_decode_chunk(&str, text.data() + text.size(), code_points);
+    wide.insert(wide.end(), code_points, code_points + num);
+  }
+  return wide;
+}
+
+bool LoadFont(FontManager* font_manager, TrueTypeHandle* ttf) {
+  FILE* file = fopen(kFontPath, "rb");
+  if (NULL == file)
+    return false;
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.insert(data.end(), buffer, buffer + size);
+  fclose(file);
+  *ttf = font_manager->createTtf(&data[0], (uint32_t)data.size());
+  return bgfx::isValid(*ttf);
+}
+
+// Appends the lines of |frame|, styled by runs when |styled| is set.
+void AppendFrame(TextBufferManager* text_buffer_manager,
+                 TextBufferHandle buffer,
+                 FontHandle font,
+                 uint32_t frame,
+                 AppendMode mode,
+                 bool styled,
+                 JobPool* job_pool) {
+  const std::vector<std::string> lines = MakeLines(frame);
+  std::vector<std::vector<StyleRun> > line_runs(lines.size());
+  if (styled) {
+    uint32_t seed = frame + 1;
+    for (size_t i = 0; i < lines.size(); ++i)
+      line_runs[i] = MakeRuns(lines[i], &seed);
+  }
+
+  if (kAppendLines == mode || kAppendLinesParallel == mode) {
+    std::vector<TextLine> text_lines(lines.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+      text_lines[i].begin = lines[i].data();
+      text_lines[i].end = lines[i].data() + lines[i].size();
+      text_lines[i].runs = line_runs[i].empty() ? NULL : &line_runs[i][0];
+      text_lines[i].numRuns = (uint32_t)line_runs[i].size();
+    }
+    text_buffer_manager->appendLines(buffer,
+                                     font,
+                                     &text_lines[0],
+                                     (uint32_t)text_lines.size(),
+                                     job_pool);
+    return;
+  }
+
+  // The same text in one string. Lines without runs, and line feeds, are
+  // added to the last run, which starts with the attributes of the buffer.
+  std::string text;
+  std::vector<StyleRun> runs(1);
+  runs[0].length = 0;
+  runs[0].textColor = kTextColor;
+  runs[0].backgroundColor = kBackgroundColor;
+  runs[0].styleFlags = STYLE_NORMAL;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    if (0 != i) {
+      text += "\n";
+      runs.back().length += 1;
+    }
+    text += lines[i];
+    if (line_runs[i].empty())
+      runs.back().length += (uint32_t)lines[i].size();
+    else
+      runs.insert(runs.end(), line_runs[i].begin(), line_runs[i].end());
+  }
+
+  if (styled) {
+    text_buffer_manager->appendRuns(
+        buffer, font, text.data(), &runs[0], (uint32_t)runs.size());
+  } else if (kAppendText == mode) {
+    text_buffer_manager->appendText(
+        buffer, font, text.data(), text.data() + text.size());
+  } else {
+    const std::wstring wide = Widen(text);
+    text_buffer_manager->appendText(
+        buffer, font, wide.data(), wide.data() + wide.size());
+  }
+}
+
+// Draws the frames in a new atlas, with |atlas_size| sides for a cube atlas
+// evicting glyphs or 0 for the growing paged atlas of the viewer, and
+// returns the vertices submitted.
+std::vector<uint8_t> Draw(uint32_t atlas_size,
+                          AppendMode mode,
+                          bool styled,
+                          JobPool* job_pool,
+                          uint32_t* eviction_passes) {
+  Atlas* atlas = 0 == atlas_size
+                     ? new Atlas(128, 4096, AtlasFormat::Pages, 1024)
+                     : new Atlas((uint16_t)atlas_size);
+  FontManager* font_manager = new FontManager(atlas);
+  TextBufferManager* text_buffer_manager =
+      new TextBufferManager(font_manager);
+
+  TrueTypeHandle ttf;
+  if (!LoadFont(font_manager, &ttf)) {
+    fprintf(stderr, "Can't load %s\n", kFontPath);
+    return std::vector<uint8_t>();
+  }
+  // Small alpha glyphs, much faster to bake than distance fields.
+  FontHandle base_font =
+      font_manager->createFontByPixelSize(ttf, 0, 24, FONT_TYPE_ALPHA);
+  FontHandle font = font_manager->createScaledFontToPixelSize(base_font, 12);
+  // appendText() looks the line feeds up as glyphs, appendLines() doesn't:
+  // the atlas must hold it from the start for the layouts to match.
+  font_manager->preloadGlyph(font, (CodePoint)'\n');
+  TextBufferHandle buffer = text_buffer_manager->createTextBuffer(
+      FONT_TYPE_ALPHA, BufferType::Transient);
+
+  fake_bgfx::Reset();
+  for (uint32_t frame = 0; frame < kFrames; ++frame) {
+    text_buffer_manager->clearTextBuffer(buffer);
+    text_buffer_manager->setTextColor(buffer, kTextColor);
+    text_buffer_manager->setBackgroundColor(buffer, kBackgroundColor);
+    text_buffer_manager->setUnderlineColor(buffer, 0xb58900ff);
+    text_buffer_manager->setOverlineColor(buffer, 0x6c71c4ff);
+    text_buffer_manager->setStrikeThroughColor(buffer, 0xcb4b16ff);
+    text_buffer_manager->setStyle(buffer, STYLE_NORMAL);
+    AppendFrame(text_buffer_manager,
+                buffer,
+                font,
+                frame,
+                mode,
+                styled,
+                job_pool);
+    // Drawn with the attributes left by the last run, on a line of its own
+    // as appendLines() doesn't stretch its decorations over later text.
+    text_buffer_manager->appendText(buffer, font, "\nend");
+    text_buffer_manager->submitTextBuffer(buffer, 0);
+    font_manager->update();
+  }
+  std::vector<uint8_t> vertices = fake_bgfx::GetDrawData();
+  *eviction_passes = font_manager->getGlyphCacheStats().evictionPasses;
+
+  text_buffer_manager->destroyTextBuffer(buffer);
+  font_manager->destroyFont(font);
+  font_manager->destroyFont(base_font);
+  font_manager->destroyTtf(ttf);
+  delete text_buffer_manager;
+  delete font_manager;
+  delete atlas;
+  return vertices;
+}
+
+// Draws a frame of lines, each of a color, in a buffer of |buffer_type| and
+// returns what was submitted.
+std::vector<uint8_t> DrawColoredLines(BufferType::Enum buffer_type,
+                                      fake_bgfx::Uploads* uploads) {
+  const uint32_t kColors[] = {0xdc322fff, 0x859900ff, 0x268bd2ff};
+  Atlas atlas(128, 4096, AtlasFormat::Pages, 1024);
+  FontManager font_manager(&atlas);
+  TextBufferManager text_buffer_manager(&font_manager);
+  TrueTypeHandle ttf;
+  if (!LoadFont(&font_manager, &ttf))
+    return std::vector<uint8_t>();
+  FontHandle base_font = font_manager.createFontByPixelSize(
+      ttf, 0, 24, FONT_TYPE_DISTANCE_SUBPIXEL);
+  FontHandle font = font_manager.createScaledFontToPixelSize(base_font, 12);
+
+  const std::vector<std::string> lines = MakeLines(0);
+  std::string text;
+  std::vector<StyleRun> runs(lines.size());
+  for (size_t i = 0; i < lines.size(); ++i) {
+    // Line feeds go with the line before them.
+    const std::string line = lines[i] + (i + 1 < lines.size() ? "\n" : "");
+    text += line;
+    runs[i].length = (uint32_t)line.size();
+    runs[i].textColor = kColors[i % 3];
+    runs[i].backgroundColor = kBackgroundColor;
+    runs[i].styleFlags = STYLE_NORMAL;
+  }
+
+  TextBufferHandle buffer = text_buffer_manager.createTextBuffer(
+      FONT_TYPE_DISTANCE_SUBPIXEL, buffer_type);
+  fake_bgfx::Reset();
+  text_buffer_manager.appendRuns(
+      buffer, font, text.data(), &runs[0], (uint32_t)runs.size());
+  text_buffer_manager.submitTextBuffer(buffer, 0);
+  *uploads = fake_bgfx::GetUploads();
+  std::vector<uint8_t> data = fake_bgfx::GetDrawData();
+
+  text_buffer_manager.destroyTextBuffer(buffer);
+  font_manager.destroyFont(font);
+  font_manager.destroyFont(base_font);
+  font_manager.destroyTtf(ttf);
+  return data;
+}
+
+// Checks that an instanced buffer draws the quads of a transient one: the
+// same corners, sizes to a quarter pixel, and a palette entry per color.
+int CheckInstanced() {
+  fake_bgfx::Uploads transient_uploads;
+  fake_bgfx::Uploads instanced_uploads;
+  const std::vector<uint8_t> vertex_data =
+      DrawColoredLines(BufferType::Transient, &transient_uploads);
+  const std::vector<uint8_t> instance_data =
+      DrawColoredLines(BufferType::Instanced, &instanced_uploads);
+
+  const size_t num_quads = vertex_data.size() / (4 * sizeof(Vertex));
+  if (0 == num_quads ||
+      instance_data.size() != num_quads * sizeof(Instance)) {
+    fprintf(stderr, "instanced: %d bytes of instances for %d quads\n",
+            (int)instance_data.size(), (int)num_quads);
+    return 1;
+  }
+  if (0 != instanced_uploads.vertex_bytes ||
+      0 != transient_uploads.instance_bytes) {
+    fprintf(stderr, "instanced: vertices uploaded\n");
+    return 1;
+  }
+
+  const Vertex* vertices = (const Vertex*)&vertex_data[0];
+  const Instance* instances = (const Instance*)&instance_data[0];
+  std::map<uint32_t, uint32_t> palette_indices;
+  std::map<uint32_t, uint32_t> colors;
+  for (size_t i = 0; i < num_quads; ++i) {
+    const Vertex* quad = &vertices[i * 4];
+    const Instance& instance = instances[i];
+    const float width = floorf(instance.size / 4096.0f) * 0.25f;
+    const float height = fmodf(instance.size, 4096.0f) * 0.25f;
+    const uint32_t palette_index = (uint32_t)fmodf(instance.data, 64.0f);
+    if (instance.x != quad[0].x || instance.y != quad[0].y ||
+        fabsf(width - (quad[2].x - quad[0].x)) > 0.125f ||
+        fabsf(height - (quad[2].y - quad[0].y)) > 0.125f) {
+      fprintf(stderr, "instanced: quad %d is at %.2f %.2f %.2fx%.2f, not "
+              "%.2f %.2f %.2fx%.2f\n", (int)i, instance.x, instance.y, width,
+              height, quad[0].x, quad[0].y, quad[2].x - quad[0].x,
+              quad[2].y - quad[0].y);
+      return 1;
+    }
+    if (palette_indices.insert(std::make_pair(quad[0].rgba, palette_index))
+                .first->second != palette_index ||
+        colors.insert(std::make_pair(palette_index, quad[0].rgba))
+                .first->second != quad[0].rgba) {
+      fprintf(stderr, "instanced: quad %d has palette entry %d for 0x%08x\n",
+              (int)i, (int)palette_index, quad[0].rgba);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main() {
+  JobPool job_pool(kWorkerThreads);
+
+  int failures = 0;
+  const uint32_t kAtlasSizes[] = {0, 64};
+  for (size_t i = 0; i < sizeof(kAtlasSizes) / sizeof(kAtlasSizes[0]); ++i) {
+    const uint32_t atlas_size = kAtlasSizes[i];
+    for (int styled = 0; styled < 2; ++styled) {
+      const char* name = styled ? "styled" : "plain";
+      uint32_t eviction_passes;
+      const std::vector<uint8_t> text =
+          Draw(atlas_size, kAppendText, styled, NULL, &eviction_passes);
+      const std::vector<uint8_t> lines =
+          Draw(atlas_size, kAppendLines, styled, NULL, &eviction_passes);
+      const std::vector<uint8_t> parallel_lines = Draw(
+          atlas_size, kAppendLinesParallel, styled, &job_pool,
+          &eviction_passes);
+
+      if (text.empty()) {
+        fprintf(stderr, "atlas %u, %s: nothing drawn\n", atlas_size, name);
+        ++failures;
+      }
+      if (!styled) {
+        const std::vector<uint8_t> wide_text =
+            Draw(atlas_size, kAppendWideText, false, NULL, &eviction_passes);
+        if (wide_text != text) {
+          fprintf(stderr,
+                  "atlas %u: appendText() differs with wide characters\n",
+                  atlas_size);
+          ++failures;
+        }
+      }
+      // Glyphs are evicted in a different order when appendText() loads them
+      // as it goes.
+      if (0 == atlas_size && lines != text) {
+        fprintf(stderr, "atlas %u, %s: appendLines() differs from %s\n",
+                atlas_size, name, styled ? "appendRuns()" : "appendText()");
+        ++failures;
+      }
+      if (parallel_lines != lines) {
+        fprintf(stderr, "atlas %u, %s: appendLines() differs with a job pool\n",
+                atlas_size, name);
+        ++failures;
+      }
+      if (0 != atlas_size && 0 == eviction_passes) {
+        fprintf(stderr, "atlas %u, %s: no glyph evicted\n", atlas_size, name);
+        ++failures;
+      }
+    }
+  }
+
+  failures += CheckInstanced();
+
+  printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
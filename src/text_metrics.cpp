@@ -3,11 +3,20 @@
 * License: http://www.opensource.org/licenses/BSD-2-Clause
 */
 
-#include <wchar.h> // wcslen
+#include <string.h> // strchr, strlen
+#include <wchar.h>  // wcslen
 
 #include "text_metrics.h"
 #include "utf8.h"
 
+/// Return the start of the line after the one at _string, or the end of
+/// the string. A line feed byte is never part of a multibyte sequence.
+static const char* nextLine(const char* _string)
+{
+	const char* lineFeed = strchr(_string, '\n');
+	return NULL != lineFeed ? lineFeed + 1 : _string + strlen(_string);
+}
+
 TextMetrics::TextMetrics(FontManager* _fontManager)
 	: m_fontManager(_fontManager)
 	, m_width(0)
@@ -34,13 +43,18 @@ void TextMetrics::appendText(FontHandle _fontHandle, const char* _string)
 		m_height += m_lineHeight;
 	}
 
-	CodePoint codepoint = 0;
-	uint32_t state = 0;
+	CodePoint codePoints[UTF8_CHUNK_SIZE];
+	CodePoint previous = 0;
 
-	for (; *_string; ++_string)
+	for (const char* str = _string, *end = _string + strlen(_string); str < end;)
 	{
-		if (!utf8_decode(&state, (uint32_t*)&codepoint, *_string) )
+		uint32_t numErrors;
+		uint32_t num = utf8_decode_chunk(&str, end, codePoints, NULL, 0, &numErrors);
+		BX_WARN(0 == numErrors, "The string is not well-formed");
+
+		for (uint32_t ii = 0; ii < num; ++ii)
 		{
+			CodePoint codepoint = codePoints[ii];
 			const GlyphInfo* glyph = m_fontManager->getGlyphInfo(_fontHandle, codepoint);
 			if (NULL != glyph)
 			{
@@ -50,10 +64,16 @@ void TextMetrics::appendText(FontHandle _fontHandle, const char* _string)
 					m_lineGap = font.lineGap;
 					m_lineHeight = font.ascender - font.descender;					
 					m_x = 0;
-					break;
+					return;
 				}
 
+				// No kerning before the first glyph.
+				if (0 != previous)
+				{
+					m_x += m_fontManager->getKerning(_fontHandle, previous, codepoint);
+				}
 				m_x += glyph->advance_x;
+				previous = codepoint;
 				if(m_x > m_width)
 				{
 					m_width = m_x;
@@ -65,8 +85,6 @@ void TextMetrics::appendText(FontHandle _fontHandle, const char* _string)
 			}
 		}
 	}
-
-	BX_CHECK(state == UTF8_ACCEPT, "The string is not well-formed");
 }
 
 void TextMetrics::appendText(FontHandle _fontHandle, const wchar_t* _string)
@@ -85,6 +103,7 @@ void TextMetrics::appendText(FontHandle _fontHandle, const wchar_t* _string)
 		m_height += m_lineHeight;
 	}
 
+	CodePoint previous = 0;
 	for (uint32_t ii = 0, end = (uint32_t)wcslen(_string); ii < end; ++ii)
 	{
 		uint32_t codepoint = _string[ii];
@@ -100,7 +119,12 @@ void TextMetrics::appendText(FontHandle _fontHandle, const wchar_t* _string)
 				break;
 			}
 
+			if (0 != previous)
+			{
+				m_x += m_fontManager->getKerning(_fontHandle, previous, codepoint);
+			}
 			m_x += glyph->advance_x;
+			previous = codepoint;
 			if(m_x > m_width)
 			{
 				m_width = m_x;
@@ -120,21 +144,12 @@ TextLineMetrics::TextLineMetrics(const FontInfo& _fontInfo)
 
 uint32_t TextLineMetrics::getLineCount(const char* _string) const
 {
-	CodePoint codepoint = 0;
-	uint32_t state = 0;
 	uint32_t lineCount = 1;
-	for (; *_string; ++_string)
+	for (const char* lineFeed = strchr(_string, '\n'); NULL != lineFeed; lineFeed = strchr(lineFeed + 1, '\n') )
 	{
-		if (utf8_decode(&state, (uint32_t*)&codepoint, *_string) == UTF8_ACCEPT)
-		{
-			if(codepoint == L'\n')
-			{				
-				++lineCount;
-			}
-		}
+		++lineCount;
 	}
 
-	BX_CHECK(state == UTF8_ACCEPT, "The string is not well-formed");
 	return lineCount;
 }
 
@@ -154,46 +169,21 @@ uint32_t TextLineMetrics::getLineCount(const wchar_t* _string) const
 
 void TextLineMetrics::getSubText(const char* _string, uint32_t _firstLine, uint32_t _lastLine, const char*& _begin, const char*& _end)
 {
-	CodePoint codepoint = 0;
-	uint32_t state = 0;
-	// y is bottom of a text line
 	uint32_t currentLine = 0;
 	while(*_string && (currentLine < _firstLine))
 	{
-		for (; *_string; ++_string)
-		{	
-			if(utf8_decode(&state, (uint32_t*)&codepoint, *_string) == UTF8_ACCEPT)
-			{
-				if(codepoint == L'\n')
-				{
-					++currentLine;
-					++_string;
-					break;
-				}
-			}
-		}
+		_string = nextLine(_string);
+		++currentLine;
 	}
 
-	BX_CHECK(state == UTF8_ACCEPT, "The string is not well-formed");
 	_begin = _string;
 
 	while ( (*_string) && (currentLine < _lastLine) )
 	{
-		for (; *_string; ++_string)
-		{	
-			if(utf8_decode(&state, (uint32_t*)&codepoint, *_string) == UTF8_ACCEPT)
-			{
-				if(codepoint == L'\n')
-				{
-					++currentLine;
-					++_string;
-					break;
-				}
-			}
-		}
+		_string = nextLine(_string);
+		++currentLine;
 	}
 
-	BX_CHECK(state == UTF8_ACCEPT, "The string is not well-formed");
 	_end = _string;
 }
 
@@ -231,48 +221,24 @@ void TextLineMetrics::getSubText(const wchar_t* _string, uint32_t _firstLine, ui
 
 void TextLineMetrics::getVisibleText(const char* _string, float _top, float _bottom, const char*& _begin, const char*& _end)
 {
-	CodePoint codepoint = 0;
-	uint32_t state = 0;
 	// y is bottom of a text line
 	float y = m_lineHeight;
 	while (*_string && (y < _top) )
 	{
-		for (; *_string; ++_string)
-		{	
-			if(utf8_decode(&state, (uint32_t*)&codepoint, *_string) == UTF8_ACCEPT)
-			{
-				if(codepoint == L'\n')
-				{
-					y += m_lineHeight;
-					++_string;
-					break;
-				}
-			}
-		}
+		_string = nextLine(_string);
+		y += m_lineHeight;
 	}
 
-	BX_CHECK(state == UTF8_ACCEPT, "The string is not well-formed");
 	_begin = _string;
 
 	// y is now top of a text line
 	y -= m_lineHeight;
 	while ( (*_string) && (y < _bottom) )
 	{
-		for (; *_string; ++_string)
-		{	
-			if(utf8_decode(&state, (uint32_t*)&codepoint, *_string) == UTF8_ACCEPT)
-			{
-				if(codepoint == L'\n')
-				{
-					y += m_lineHeight;
-					++_string;
-					break;
-				}
-			}
-		}
+		_string = nextLine(_string);
+		y += m_lineHeight;
 	}
 
-	BX_CHECK(state == UTF8_ACCEPT, "The string is not well-formed");
 	_end = _string;
 }
 
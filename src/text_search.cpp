@@ -0,0 +1,482 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "text_search.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define SEARCH_SSE2 1
+#else
+#	define SEARCH_SSE2 0
+#endif // SSE2
+
+const char* findLiteral(const char* _str, const char* _end, const char* _pattern, uint32_t _length)
+{
+#if SEARCH_SSE2
+	// Compare 16 candidates at once on their first and last bytes, most
+	// are rejected without reading the rest of the pattern.
+	const __m128i first = _mm_set1_epi8(_pattern[0]);
+	const __m128i last = _mm_set1_epi8(_pattern[_length - 1]);
+	for (; _end - _str >= 16; _str += 16)
+	{
+		const __m128i firstBytes = _mm_loadu_si128( (const __m128i*)_str);
+		const __m128i lastBytes = _mm_loadu_si128( (const __m128i*)(_str + _length - 1) );
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(
+			  _mm_cmpeq_epi8(firstBytes, first)
+			, _mm_cmpeq_epi8(lastBytes, last)
+			) );
+
+		for (uint32_t bit = 0; 0 != mask; ++bit, mask >>= 1)
+		{
+			const char* candidate = _str + bit;
+			if (0 != (mask & 1)
+			&&  0 == memcmp(candidate + 1, _pattern + 1, _length - 1) )
+			{
+				return candidate;
+			}
+		}
+	}
+#endif // SEARCH_SSE2
+
+	while (_str < _end)
+	{
+		_str = (const char*)memchr(_str, _pattern[0], _end - _str);
+		if (NULL == _str)
+		{
+			break;
+		}
+
+		if (0 == memcmp(_str + 1, _pattern + 1, _length - 1) )
+		{
+			return _str;
+		}
+		++_str;
+	}
+
+	return NULL;
+}
+
+TextSearch::TextSearch(uint32_t _numThreads)
+	: m_jobPool(_numThreads)
+	, m_text(NULL)
+	, m_size(0)
+	, m_isRegex(false)
+	, m_numMatches(0)
+	, m_maxMatchLength(0)
+	, m_running(false)
+	, m_cancel(false)
+	, m_done(true)
+	, m_truncated(false)
+{
+}
+
+TextSearch::~TextSearch()
+{
+	cancel();
+}
+
+void TextSearch::start(const char* _text, uint32_t _size, const char* _pattern, uint32_t _length, bool _regex)
+{
+	cancel();
+
+	m_text = _text;
+	m_size = _size;
+	m_pattern.assign(_pattern, _length);
+	m_regex = Regex();
+	m_isRegex = _regex;
+	m_chunks.clear();
+	m_numMatches = 0;
+	m_maxMatchLength = _regex ? 0 : _length;
+	m_cancel = false;
+	m_truncated = false;
+	m_done = true;
+
+	if (0 == _length)
+	{
+		return;
+	}
+
+	if (_regex)
+	{
+		if (!m_regex.compile(_pattern, _length) )
+		{
+			return;
+		}
+	}
+	else if (_length > _size)
+	{
+		return;
+	}
+
+	m_done = false;
+	m_running = true;
+	m_thread.init(threadFunc, this);
+}
+
+void TextSearch::cancel()
+{
+	if (!m_running)
+	{
+		return;
+	}
+
+	{
+		bx::MutexScope lock(m_mutex);
+		m_cancel = true;
+	}
+
+	m_thread.shutdown();
+	m_running = false;
+}
+
+bool TextSearch::isDone() const
+{
+	bx::MutexScope lock(m_mutex);
+	return m_done;
+}
+
+bool TextSearch::isTruncated() const
+{
+	bx::MutexScope lock(m_mutex);
+	return m_truncated;
+}
+
+uint32_t TextSearch::getMatchCount() const
+{
+	bx::MutexScope lock(m_mutex);
+	return m_numMatches;
+}
+
+bool TextSearch::isSearched(uint32_t _begin, uint32_t _end) const
+{
+	bx::MutexScope lock(m_mutex);
+	if (m_done)
+	{
+		return true;
+	}
+
+	if (m_chunks.empty() )
+	{
+		return false;
+	}
+
+	const uint32_t numChunks = (uint32_t)m_chunks.size();
+	for (uint32_t ii = findChunk(_begin); ii < numChunks && m_chunks[ii].begin < _end; ++ii)
+	{
+		if (!m_chunks[ii].done)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool TextSearch::findNextMatch(uint32_t _offset, TextMatch* _match) const
+{
+	bx::MutexScope lock(m_mutex);
+	_match->offset = UINT32_MAX;
+	_match->length = 0;
+
+	if (m_chunks.empty() )
+	{
+		return m_done;
+	}
+
+	const uint32_t numChunks = (uint32_t)m_chunks.size();
+	for (uint32_t ii = findChunk(_offset); ii < numChunks; ++ii)
+	{
+		const Chunk& chunk = m_chunks[ii];
+		if (!chunk.done)
+		{
+			// Chunks left behind by a cancelled search are never done.
+			return m_done;
+		}
+
+		for (uint32_t jj = 0; jj < chunk.matches.size(); ++jj)
+		{
+			if (chunk.matches[jj].offset >= _offset)
+			{
+				*_match = chunk.matches[jj];
+				return true;
+			}
+		}
+	}
+
+	return true;
+}
+
+void TextSearch::getMatches(uint32_t _begin, uint32_t _end, std::vector<TextMatch>* _matches) const
+{
+	bx::MutexScope lock(m_mutex);
+
+	const uint32_t numChunks = (uint32_t)m_chunks.size();
+	for (uint32_t ii = findChunk(_begin); ii < numChunks && m_chunks[ii].begin < _end; ++ii)
+	{
+		const Chunk& chunk = m_chunks[ii];
+		if (!chunk.done)
+		{
+			continue;
+		}
+
+		for (uint32_t jj = 0; jj < chunk.matches.size(); ++jj)
+		{
+			const TextMatch& match = chunk.matches[jj];
+			if (match.offset >= _begin
+			&&  match.offset < _end)
+			{
+				_matches->push_back(match);
+			}
+		}
+	}
+}
+
+void TextSearch::highlightMatches(uint32_t _offset, uint32_t _rgba, std::vector<StyleRun>* _runs) const
+{
+	uint32_t maxLength;
+	{
+		bx::MutexScope lock(m_mutex);
+		maxLength = m_maxMatchLength;
+	}
+
+	if (0 == maxLength)
+	{
+		return;
+	}
+
+	uint32_t size = 0;
+	for (uint32_t ii = 0; ii < _runs->size(); ++ii)
+	{
+		size += (*_runs)[ii].length;
+	}
+
+	// Include the matches starting before the text and ending in it.
+	std::vector<TextMatch> matches;
+	getMatches(_offset >= maxLength - 1 ? _offset - (maxLength - 1) : 0, _offset + size, &matches);
+	if (matches.empty() )
+	{
+		return;
+	}
+
+	std::vector<StyleRun> runs;
+	runs.reserve(_runs->size() + matches.size() * 2);
+
+	uint32_t pos = _offset;
+	uint32_t match = 0;
+	for (uint32_t ii = 0; ii < _runs->size(); ++ii)
+	{
+		const StyleRun& run = (*_runs)[ii];
+		const uint32_t runEnd = pos + run.length;
+		while (pos < runEnd)
+		{
+			while (match < matches.size()
+			&&     matches[match].offset + matches[match].length <= pos)
+			{
+				++match;
+			}
+
+			const bool inside = match < matches.size() && matches[match].offset <= pos;
+			uint32_t end = runEnd;
+			if (match < matches.size() )
+			{
+				uint32_t boundary = inside
+					? matches[match].offset + matches[match].length
+					: matches[match].offset
+					;
+				end = boundary < runEnd ? boundary : runEnd;
+			}
+
+			StyleRun piece = run;
+			piece.length = end - pos;
+			if (inside)
+			{
+				piece.backgroundColor = _rgba;
+				piece.styleFlags |= STYLE_BACKGROUND;
+			}
+			runs.push_back(piece);
+			pos = end;
+		}
+	}
+
+	_runs->swap(runs);
+}
+
+int32_t TextSearch::threadFunc(void* _userData)
+{
+	TextSearch* search = (TextSearch*)_userData;
+	search->splitChunks();
+
+	// One chunk per batch, claimed in order of offset by the threads.
+	search->m_jobPool.parallelFor( (uint32_t)search->m_chunks.size(), 1, searchChunksJob, search);
+
+	bx::MutexScope lock(search->m_mutex);
+	search->m_done = true;
+	return 0;
+}
+
+void TextSearch::searchChunksJob(void* _userData, uint32_t _begin, uint32_t _end)
+{
+	TextSearch* search = (TextSearch*)_userData;
+
+	std::vector<TextMatch> matches;
+	for (uint32_t ii = _begin; ii < _end; ++ii)
+	{
+		{
+			bx::MutexScope lock(search->m_mutex);
+			if (search->m_cancel)
+			{
+				return;
+			}
+		}
+
+		matches.clear();
+		if (search->m_isRegex)
+		{
+			search->searchRegexChunk(search->m_chunks[ii], &matches);
+		}
+		else
+		{
+			search->searchChunk(search->m_chunks[ii], &matches);
+		}
+
+		uint32_t maxLength = 0;
+		for (uint32_t jj = 0; jj < matches.size(); ++jj)
+		{
+			maxLength = matches[jj].length > maxLength ? matches[jj].length : maxLength;
+		}
+
+		bx::MutexScope lock(search->m_mutex);
+		if (search->m_numMatches + matches.size() > MAX_SEARCH_MATCHES)
+		{
+			search->m_truncated = true;
+			search->m_cancel = true;
+			return;
+		}
+
+		Chunk& chunk = search->m_chunks[ii];
+		chunk.matches.swap(matches);
+		chunk.done = true;
+		search->m_numMatches += (uint32_t)chunk.matches.size();
+		search->m_maxMatchLength = maxLength > search->m_maxMatchLength ? maxLength : search->m_maxMatchLength;
+	}
+}
+
+void TextSearch::splitChunks()
+{
+	std::vector<Chunk> chunks;
+	chunks.reserve(m_size / SEARCH_CHUNK_SIZE + 1);
+
+	Chunk chunk;
+	chunk.done = false;
+
+	// Substrings start anywhere they fit, lines are searched whole by the
+	// chunk they start in.
+	const uint32_t size = m_isRegex ? m_size : m_size - (uint32_t)m_pattern.size() + 1;
+	for (uint32_t begin = 0; begin < size;)
+	{
+		uint32_t end = size - begin > SEARCH_CHUNK_SIZE ? begin + SEARCH_CHUNK_SIZE : size;
+		if (m_isRegex
+		&&  end < size)
+		{
+			const char* lineEnd = (const char*)memchr(m_text + end - 1, '\n', size - end + 1);
+			end = NULL == lineEnd ? size : (uint32_t)(lineEnd - m_text) + 1;
+		}
+
+		chunk.begin = begin;
+		chunk.end = end;
+		chunks.push_back(chunk);
+		begin = end;
+	}
+
+	bx::MutexScope lock(m_mutex);
+	m_chunks.swap(chunks);
+}
+
+uint32_t TextSearch::findChunk(uint32_t _offset) const
+{
+	uint32_t first = 0;
+	uint32_t count = (uint32_t)m_chunks.size();
+	while (count > 0)
+	{
+		const uint32_t step = count / 2;
+		if (m_chunks[first + step].end <= _offset)
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+		else
+		{
+			count = step;
+		}
+	}
+
+	return first;
+}
+
+void TextSearch::searchChunk(const Chunk& _chunk, std::vector<TextMatch>* _matches) const
+{
+	const char* pattern = m_pattern.data();
+	const uint32_t length = (uint32_t)m_pattern.size();
+
+	// Matches start in [str, end), and may end in the next chunk. They don't
+	// overlap, the next one starts after this one.
+	const char* str = m_text + _chunk.begin;
+	const char* end = m_text + _chunk.end;
+	while (NULL != (str = findLiteral(str, end, pattern, length) ) )
+	{
+		TextMatch match = { (uint32_t)(str - m_text), length };
+		_matches->push_back(match);
+		str += length;
+	}
+}
+
+void TextSearch::searchRegexChunk(const Chunk& _chunk, std::vector<TextMatch>* _matches) const
+{
+	RegexMatcher matcher(m_regex);
+	const std::string& literal = m_regex.getRequiredLiteral();
+	const uint32_t length = (uint32_t)literal.size();
+
+	const char* str = m_text + _chunk.begin;
+	const char* end = m_text + _chunk.end;
+	while (str < end)
+	{
+		// Skip to the next line holding the literal.
+		const char* lineBegin = str;
+		if (0 != length)
+		{
+			if ( (uint32_t)(end - str) < length)
+			{
+				break;
+			}
+
+			const char* hit = findLiteral(str, end - length + 1, literal.data(), length);
+			if (NULL == hit)
+			{
+				break;
+			}
+
+			for (lineBegin = hit; lineBegin > str && '\n' != lineBegin[-1]; --lineBegin)
+			{
+			}
+		}
+
+		const char* lineEnd = (const char*)memchr(lineBegin, '\n', end - lineBegin);
+		lineEnd = NULL == lineEnd ? end : lineEnd;
+
+		if (matcher.isMatch(lineBegin, lineEnd) )
+		{
+			const char* matchBegin;
+			const char* matchEnd;
+			for (const char* pos = lineBegin; matcher.find(lineBegin, lineEnd, pos, &matchBegin, &matchEnd); pos = matchEnd)
+			{
+				TextMatch match = { (uint32_t)(matchBegin - m_text), (uint32_t)(matchEnd - matchBegin) };
+				_matches->push_back(match);
+			}
+		}
+
+		str = lineEnd + 1;
+	}
+}
@@ -0,0 +1,129 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef TEXT_SEARCH_H_HEADER_GUARD
+#define TEXT_SEARCH_H_HEADER_GUARD
+
+#include <bx/bx.h>
+#include <bx/mutex.h>
+#include <bx/thread.h>
+
+#include <string>
+#include <vector>
+
+#include "job_pool.h"
+#include "regex_matcher.h"
+#include "text_buffer_manager.h"
+
+/// Bytes of text searched by a job, the first chunks are searched first.
+/// Regex chunks are extended to the end of their last line.
+#define SEARCH_CHUNK_SIZE (1 << 20)
+
+/// Matches kept by a search, it stops once they are found.
+#define MAX_SEARCH_MATCHES (16 << 20)
+
+/// Find the first occurrence of a pattern starting in [_str, _end), with a
+/// SIMD filter on its first and last bytes. The bytes up to _end + _length
+/// - 1 must be readable.
+/// @return NULL if there is none
+const char* findLiteral(const char* _str, const char* _end, const char* _pattern, uint32_t _length);
+
+struct TextMatch
+{
+	uint32_t offset;
+	uint32_t length;
+};
+
+/// Substring or regex search over a whole document, on a background thread
+/// and the workers of its job pool. The text is split in chunks searched in
+/// order of offset, the matches of a chunk are visible as soon as it is
+/// done. Matches don't overlap within a chunk.
+///
+/// Regexes match within lines. Only the lines holding the literal every
+/// match requires, found as substrings are, are run through the matcher.
+///
+/// Offsets are 32 bit like those of LineIndex, texts are less than 4 GiB.
+class TextSearch
+{
+public:
+	/// @param _numThreads workers to start in addition to the search thread
+	TextSearch(uint32_t _numThreads);
+	~TextSearch();
+
+	/// Cancel the current search and search _pattern in [_text, _text +
+	/// _size). The text must not change until the search is done or
+	/// cancelled.
+	/// @param _regex true to search the lines matching _pattern as a Regex
+	void start(const char* _text, uint32_t _size, const char* _pattern, uint32_t _length, bool _regex);
+
+	/// Stop the current search and wait for its threads, the matches found
+	/// so far are kept.
+	void cancel();
+
+	/// Return true once every chunk was searched, or the search stopped.
+	bool isDone() const;
+
+	/// Return true if the search stopped at MAX_SEARCH_MATCHES.
+	bool isTruncated() const;
+
+	/// Matches found so far.
+	uint32_t getMatchCount() const;
+
+	/// Why the regex of the search didn't compile, empty if it did.
+	const char* getError() const
+	{
+		return m_regex.getError();
+	}
+
+	/// Return true if every match starting in [_begin, _end) is known.
+	bool isSearched(uint32_t _begin, uint32_t _end) const;
+
+	/// Find the first match at or after _offset.
+	/// @return false while the chunks in between are being searched,
+	///   otherwise _match is the match, at offset UINT32_MAX if none.
+	bool findNextMatch(uint32_t _offset, TextMatch* _match) const;
+
+	/// Append the known matches starting in [_begin, _end), in order.
+	void getMatches(uint32_t _begin, uint32_t _end, std::vector<TextMatch>* _matches) const;
+
+	/// Split _runs, style runs of the text starting at _offset, to draw
+	/// the known matches with a background of color _rgba.
+	void highlightMatches(uint32_t _offset, uint32_t _rgba, std::vector<StyleRun>* _runs) const;
+
+private:
+	/// Matches starting in [begin, end)
+	struct Chunk
+	{
+		uint32_t begin;
+		uint32_t end;
+		std::vector<TextMatch> matches;
+		bool done;
+	};
+
+	static int32_t threadFunc(void* _userData);
+	static void searchChunksJob(void* _userData, uint32_t _begin, uint32_t _end);
+	void splitChunks();
+	uint32_t findChunk(uint32_t _offset) const;
+	void searchChunk(const Chunk& _chunk, std::vector<TextMatch>* _matches) const;
+	void searchRegexChunk(const Chunk& _chunk, std::vector<TextMatch>* _matches) const;
+
+	JobPool m_jobPool;
+	bx::Thread m_thread;
+	mutable bx::Mutex m_mutex; //< guards the chunks and the flags below
+
+	const char* m_text;
+	uint32_t m_size;
+	std::string m_pattern;
+	Regex m_regex;
+	bool m_isRegex;
+	std::vector<Chunk> m_chunks; //< empty until split by the search thread
+	uint32_t m_numMatches;
+	uint32_t m_maxMatchLength;
+	bool m_running;
+	bool m_cancel;
+	bool m_done;
+	bool m_truncated;
+};
+
+#endif // TEXT_SEARCH_H_HEADER_GUARD
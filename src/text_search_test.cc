@@ -0,0 +1,152 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Checks findLiteral() and the substring search of TextSearch against a naive
+// scan, on patterns ending on the last readable byte and on matches
+// straddling the chunks of a search.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <bx/os.h>
+
+#include <string>
+#include <vector>
+
+#include "text_search.h"
+
+namespace {
+
+const uint32_t kWorkerThreads = 2;
+
+const char* const kPatterns[] = {
+    "a", "\n", "ab", "aa", "aba", "aaaa", "abcab", "aaaaaaaaaaaaaaaaaaab",
+};
+
+// Letters repeating often enough for overlapping and partial matches.
+std::string MakeText(uint32_t size, uint32_t seed) {
+  const char kBytes[] = "aab\nc";
+  std::string text;
+  for (uint32_t i = 0; i < size; ++i) {
+    seed = seed * 1103515245 + 12345;
+    text += kBytes[(seed >> 16) % (sizeof(kBytes) - 1)];
+  }
+  return text;
+}
+
+const char* NaiveFind(const char* str, const char* end, const char* pattern,
+                      uint32_t length) {
+  for (; str < end; ++str) {
+    if (memcmp(str, pattern, length) == 0)
+      return str;
+  }
+  return NULL;
+}
+
+// Matches of TextSearch: they don't overlap, except across the chunks, which
+// are searched independently.
+std::vector<uint32_t> NaiveSearch(const std::string& text,
+                                  const std::string& pattern) {
+  std::vector<uint32_t> offsets;
+  if (pattern.size() > text.size())
+    return offsets;
+  const size_t size = text.size() - pattern.size() + 1;
+  for (size_t begin = 0; begin < size; begin += SEARCH_CHUNK_SIZE) {
+    const size_t end =
+        size - begin > SEARCH_CHUNK_SIZE ? begin + SEARCH_CHUNK_SIZE : size;
+    for (size_t i = begin; i < end;) {
+      if (text.compare(i, pattern.size(), pattern) == 0) {
+        offsets.push_back((uint32_t)i);
+        i += pattern.size();
+      } else {
+        ++i;
+      }
+    }
+  }
+  return offsets;
+}
+
+// Searches each start range of |text| in a copy holding only the bytes
+// findLiteral() may read, so that reading past them is caught by address
+// sanitizers.
+int CheckFindLiteral(const std::string& text, const std::string& pattern) {
+  const uint32_t length = (uint32_t)pattern.size();
+  if (text.size() < length)
+    return 0;
+
+  int failures = 0;
+  for (size_t size = length; size <= text.size(); ++size) {
+    const std::vector<char> bytes(text.begin(), text.begin() + size);
+    const char* str = &bytes[0];
+    const char* end = str + size - length + 1;
+    for (const char* begin = str; begin < end; begin += 7) {
+      const char* found = findLiteral(begin, end, pattern.data(), length);
+      if (found != NaiveFind(begin, end, pattern.data(), length)) {
+        fprintf(stderr, "findLiteral \"%s\" in [%d, %d): wrong match\n",
+                pattern.c_str(), (int)(begin - str), (int)size);
+        ++failures;
+      }
+    }
+  }
+  return failures;
+}
+
+int CheckSearch(TextSearch* search, const std::string& text,
+                const std::string& pattern) {
+  search->start(text.data(), (uint32_t)text.size(), pattern.data(),
+                (uint32_t)pattern.size(), false);
+  while (!search->isDone())
+    bx::sleep(1);
+
+  std::vector<TextMatch> matches;
+  search->getMatches(0, UINT32_MAX, &matches);
+  std::vector<uint32_t> offsets;
+  for (size_t i = 0; i < matches.size(); ++i) {
+    if (matches[i].length != pattern.size()) {
+      fprintf(stderr, "search \"%s\": wrong match length\n", pattern.c_str());
+      return 1;
+    }
+    offsets.push_back(matches[i].offset);
+  }
+
+  if (offsets != NaiveSearch(text, pattern)) {
+    fprintf(stderr, "search \"%s\" in %d bytes: %d matches, %d expected\n",
+            pattern.c_str(), (int)text.size(), (int)offsets.size(),
+            (int)NaiveSearch(text, pattern).size());
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main() {
+  int failures = 0;
+
+  // Every end of a short text, in and past the SIMD blocks.
+  const std::string short_text = MakeText(100, 1) + "aaaaaaaaaaaaaaaaaaab";
+  for (size_t i = 0; i < sizeof(kPatterns) / sizeof(kPatterns[0]); ++i)
+    failures += CheckFindLiteral(short_text, kPatterns[i]);
+
+  TextSearch search(kWorkerThreads);
+
+  // Matches straddling each chunk boundary, and one ending on the last byte.
+  std::string text = MakeText(3 * SEARCH_CHUNK_SIZE + 100, 2);
+  for (uint32_t chunk = 1; chunk <= 3; ++chunk) {
+    for (uint32_t i = 0; i < 40; ++i)
+      text[chunk * SEARCH_CHUNK_SIZE - 20 + i] = "aaaaaaaaaaaaaaaaaaab"[i % 20];
+  }
+  text.replace(text.size() - 20, 20, "aaaaaaaaaaaaaaaaaaab");
+  for (size_t i = 0; i < sizeof(kPatterns) / sizeof(kPatterns[0]); ++i)
+    failures += CheckSearch(&search, text, kPatterns[i]);
+
+  // Patterns longer than the text, or than what is left of it after a match.
+  failures += CheckSearch(&search, "aab", "aaab");
+  failures += CheckSearch(&search, "aab", "aab");
+  failures += CheckSearch(&search, "xaab", "aab");
+  failures += CheckSearch(&search, "aaaaa", "aa");
+
+  printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
@@ -21,6 +21,13 @@
 
 #include "utf8.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	include <emmintrin.h>
+#	define UTF8_SSE2 1
+#else
+#	define UTF8_SSE2 0
+#endif // SSE2
+
 static const uint8_t s_utf8d[364] =
 {
 	// The first part of the table maps bytes to character classes that
@@ -55,3 +62,113 @@ uint32_t utf8_decode(uint32_t* _state, uint32_t* _codep, uint8_t _ch)
 	*_state = s_utf8d[256 + *_state + type];
 	return *_state;
 }
+
+uint32_t utf8_decode_block(const uint8_t* _in, uint32_t _size, CodePoint* _out, uint32_t* _errors, uint32_t _maxErrors, uint32_t* _numErrors)
+{
+	uint32_t numOut = 0;
+	uint32_t numErrors = 0;
+	uint32_t ii = 0;
+
+	while (ii < _size)
+	{
+#if UTF8_SSE2
+		// Zero extend 16 ASCII characters at once, they need no validation.
+		const __m128i zero = _mm_setzero_si128();
+		while (_size - ii >= 16)
+		{
+			const __m128i bytes = _mm_loadu_si128( (const __m128i*)&_in[ii]);
+			if (0 != _mm_movemask_epi8(bytes) )
+			{
+				break;
+			}
+
+			const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+			const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+			__m128i* out = (__m128i*)&_out[numOut];
+			_mm_storeu_si128(out + 0, _mm_unpacklo_epi16(lo, zero) );
+			_mm_storeu_si128(out + 1, _mm_unpackhi_epi16(lo, zero) );
+			_mm_storeu_si128(out + 2, _mm_unpacklo_epi16(hi, zero) );
+			_mm_storeu_si128(out + 3, _mm_unpackhi_epi16(hi, zero) );
+			ii += 16;
+			numOut += 16;
+		}
+
+		if (ii == _size)
+		{
+			break;
+		}
+#endif // UTF8_SSE2
+
+		if (_in[ii] < 0x80)
+		{
+			_out[numOut++] = _in[ii++];
+			continue;
+		}
+
+		// Run the automaton on a multibyte sequence. The byte rejecting it
+		// starts the next sequence, unless it's the first one.
+		const uint32_t start = ii;
+		uint32_t state = UTF8_ACCEPT;
+		uint32_t codePoint = 0;
+		for (; ii < _size; ++ii)
+		{
+			state = utf8_decode(&state, &codePoint, _in[ii]);
+			if (UTF8_ACCEPT == state
+			||  UTF8_REJECT == state)
+			{
+				break;
+			}
+		}
+
+		if (UTF8_ACCEPT == state)
+		{
+			_out[numOut++] = (CodePoint)codePoint;
+			++ii;
+			continue;
+		}
+
+		if (ii == start)
+		{
+			++ii;
+		}
+
+		_out[numOut++] = UTF8_REPLACEMENT_CHARACTER;
+		if (numErrors < _maxErrors)
+		{
+			_errors[numErrors] = start;
+		}
+		++numErrors;
+	}
+
+	if (NULL != _numErrors)
+	{
+		*_numErrors = numErrors;
+	}
+
+	return numOut;
+}
+
+uint32_t utf8_decode_chunk(const char** _str, const char* _end, CodePoint* _out, uint32_t* _errors, uint32_t _maxErrors, uint32_t* _numErrors)
+{
+	const uint8_t* str = (const uint8_t*)*_str;
+	uint32_t size = (uint32_t)(_end - *_str);
+
+	// Back off to the first byte of a sequence cut by the chunk end, if it
+	// starts within the last 3 bytes.
+	if (size > UTF8_CHUNK_SIZE)
+	{
+		size = UTF8_CHUNK_SIZE;
+		for (uint32_t ii = 0; ii < 3 && 0x80 == (str[size] & 0xc0); ++ii)
+		{
+			--size;
+		}
+
+		if (0x80 == (str[size] & 0xc0) )
+		{
+			size = UTF8_CHUNK_SIZE;
+		}
+	}
+
+	*_str += size;
+	return utf8_decode_block(str, size, _out, _errors, _maxErrors, _numErrors);
+}
@@ -4,11 +4,38 @@
 #ifndef UTF8_H_HEADER_GUARD
 #define UTF8_H_HEADER_GUARD
 
+#include <stddef.h> // NULL
 #include <stdint.h>
 
 #define UTF8_ACCEPT 0
-#define UTF8_REJECT 1
+#define UTF8_REJECT 12
+
+/// Decoded in place of invalid sequences.
+#define UTF8_REPLACEMENT_CHARACTER 0xfffd
+
+/// Bytes decoded at most by utf8_decode_chunk().
+#define UTF8_CHUNK_SIZE 256
+
+/// Unicode value of a character
+typedef int32_t CodePoint;
 
 uint32_t utf8_decode(uint32_t* _state, uint32_t* _codep, uint8_t _ch);
 
+/// Decode _size bytes of UTF-8 to _out, which must have room for _size
+/// code points. Each invalid or truncated sequence is decoded as one
+/// UTF8_REPLACEMENT_CHARACTER and the offset of its first byte is stored in
+/// _errors, up to _maxErrors. Runs of ASCII characters are converted 16 at
+/// a time with SSE2.
+///
+/// @return the number of code points decoded
+uint32_t utf8_decode_block(const uint8_t* _in, uint32_t _size, CodePoint* _out, uint32_t* _errors = NULL, uint32_t _maxErrors = 0, uint32_t* _numErrors = NULL);
+
+/// Decode the next UTF8_CHUNK_SIZE bytes at most of [*_str, _end), without
+/// splitting a sequence, then advance *_str past them. _out must have room
+/// for UTF8_CHUNK_SIZE code points. Errors are reported as with
+/// utf8_decode_block(), offsets are relative to the start of the chunk.
+///
+/// @return the number of code points decoded
+uint32_t utf8_decode_chunk(const char** _str, const char* _end, CodePoint* _out, uint32_t* _errors = NULL, uint32_t _maxErrors = 0, uint32_t* _numErrors = NULL);
+
 #endif // UTF8_H_HEADER_GUARD
@@ -6,3 +6,5 @@ vec4 v_color0      : COLOR0    = vec4(1.0, 0.0, 0.0, 1.0);
 vec4 v_texcoord0   : TEXCOORD0 = vec4(0.0, 0.0, 0.0, 0.0);
 vec4 v_sampleLeft  : TEXCOORD1 = vec4(0.0, 0.0, 0.0, 0.0);
 vec4 v_sampleRight : TEXCOORD2 = vec4(0.0, 0.0, 0.0, 0.0);
+
+vec4 i_data0 : TEXCOORD7;
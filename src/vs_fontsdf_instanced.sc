@@ -0,0 +1,53 @@
+$input a_position, i_data0
+$output v_color0, v_texcoord0
+
+#include "common.sh"
+
+// x: 1.0/page capacity, y: page size in texels, z: page capacity, 0 for a
+// cube atlas.
+uniform vec4 u_atlasPages;
+
+// x: 1.0/UV table width, y: 1.0/UV table height.
+uniform vec4 u_uvTableSize;
+
+// Colors of the text buffer, indexed by the glyph instances.
+uniform vec4 u_palette[64];
+
+SAMPLER2D(u_uvTable, 1);
+
+// i_data0 x,y: top left corner of the quad. z: width*4*4096 + height*4.
+// w: UV table entry*64 + palette index.
+void main()
+{
+	// Corners in the order of Atlas::packUV(): (0,0) (0,1) (1,1) (1,0).
+	vec2 corner = a_position;
+	float cornerIndex = corner.x*2.0 + abs(corner.x - corner.y);
+
+	float width = floor(i_data0.z / 4096.0);
+	float height = i_data0.z - width*4096.0;
+	vec2 position = i_data0.xy + corner * vec2(width, height) * 0.25;
+	gl_Position = mul(u_modelViewProj, vec4(position, 0.0, 1.0) );
+
+	float entry = floor(i_data0.w / 64.0);
+	float paletteIndex = i_data0.w - entry*64.0;
+	float row = floor(entry / 64.0);
+	float column = entry - row*64.0;
+	vec2 texel = vec2(column*4.0 + cornerIndex + 0.5, row + 0.5);
+
+	// The table stores the bits of signed normalized shorts.
+	vec4 bits = floor(texture2DLod(u_uvTable, texel * u_uvTableSize.xy, 0.0) * 65535.0 + 0.5);
+	vec4 uv = (bits - step(32768.0, bits) * 65536.0) / 32767.0;
+
+	if (u_atlasPages.z > 0.0)
+	{
+		// Pages are stacked vertically in the texture.
+		float page = floor(uv.w*16.0 + 0.5);
+		v_texcoord0 = vec4(uv.x, (uv.y + page) * u_atlasPages.x, 0.0, 0.0);
+	}
+	else
+	{
+		v_texcoord0 = uv;
+	}
+
+	v_color0 = u_palette[int(paletteIndex)];
+}
@@ -0,0 +1,17 @@
+$input a_position, a_color0, a_texcoord0
+$output v_color0, v_texcoord0
+
+#include "common.sh"
+
+// x: 1.0/page capacity, y: page size in texels, z: page capacity.
+uniform vec4 u_atlasPages;
+
+void main()
+{
+	gl_Position = mul(u_modelViewProj, vec4(a_position, 0.0, 1.0) );
+
+	// Pages are stacked vertically in the texture.
+	float page = floor(a_texcoord0.w*16.0 + 0.5);
+	v_texcoord0 = vec4(a_texcoord0.x, (a_texcoord0.y + page) * u_atlasPages.x, 0.0, 0.0);
+	v_color0 = a_color0;
+}